@@ -0,0 +1,115 @@
+#ifndef LUTCAMERA_H
+#define LUTCAMERA_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+namespace camodocal
+{
+
+/**
+ * \brief Lookup table wrapper of another camera model
+ *
+ * The bearing vectors of a regular grid of image points and the image points of a regular
+ * grid of bearing vectors are computed with the wrapped model at construction. liftSphere,
+ * liftProjective and spaceToPlane then bilinearly interpolate the grids instead of evaluating
+ * the model (e.g. the polynomial root finding of EquidistantCamera). The grid step is halved
+ * until the interpolation error, measured against the model, is below maxError pixels.
+ * Points outside the grids, or in cells the model is not defined, fall back to the model.
+ *
+ * liftProjective returns the unit bearing vector, like liftSphere.
+ * modelType() is the one of the wrapped model: cast camera() for model specific parameters.
+ */
+class LUTCamera: public Camera
+{
+public:
+    LUTCamera(const CameraPtr& camera, double maxError = 0.01);
+
+    const CameraPtr& camera(void) const;
+    // Max interpolation errors in pixels measured at construction
+    double liftError(void) const;
+    double projectError(void) const;
+    // Grid steps in pixels
+    double liftStep(void) const;
+    double projectStep(void) const;
+
+    Camera::ModelType modelType(void) const;
+    const std::string& cameraName(void) const;
+    int imageWidth(void) const;
+    int imageHeight(void) const;
+
+    void estimateIntrinsics(const cv::Size& boardSize,
+                            const std::vector< std::vector<cv::Point3f> >& objectPoints,
+                            const std::vector< std::vector<cv::Point2f> >& imagePoints);
+
+    // Lift points from the image plane to the sphere
+    void liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const;
+    //%output P
+
+    // Lift points from the image plane to the projective space
+    void liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const;
+    //%output P
+
+    // Projects 3D points to the image plane (Pi function)
+    void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const;
+    //%output p
+
+    void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
+    //%output p
+
+    cv::Mat initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
+                                    float fx = -1.0f, float fy = -1.0f,
+                                    cv::Size imageSize = cv::Size(0, 0),
+                                    float cx = -1.0f, float cy = -1.0f,
+                                    cv::Mat rmat = cv::Mat::eye(3, 3, CV_32F)) const;
+
+    int parameterCount(void) const;
+
+    void readParameters(const std::vector<double>& parameters);
+    void writeParameters(std::vector<double>& parameters) const;
+
+    void writeParametersToYamlFile(const std::string& filename) const;
+
+    std::string parametersToString(void) const;
+
+private:
+    // Regular grid of float vectors with origin (x0, y0)
+    class Grid
+    {
+    public:
+        void init(double x0, double y0, double step, int cols, int rows, int channels);
+        float* at(int col, int row);
+        // Bilinear interpolation, false outside the grid or on an undefined node
+        bool interpolate(double x, double y, float* out) const;
+
+        double x0, y0, step;
+        int cols = 0, rows = 0, channels = 0;
+    private:
+        double m_invStep;
+        std::vector<float> m_data;
+    };
+
+    void build(void);
+    double buildLiftGrid(double step);
+    double buildProjectGrid(double step);
+    // Azimuthal equidistant coordinates of the projection grid: theta * (x, y) / |(x, y)|
+    static void bearingToGrid(const Eigen::Vector3d& P, double& a, double& b);
+    static Eigen::Vector3d gridToBearing(double a, double b);
+
+    CameraPtr m_camera;
+    double m_maxError;
+    double m_pixelAngle; // Angle of a pixel around the image center
+    double m_thetaMax;   // Max angle to the optical axis on the image border
+    double m_liftError, m_projectError;
+    Grid m_liftGrid, m_projectGrid;
+};
+
+typedef boost::shared_ptr<LUTCamera> LUTCameraPtr;
+typedef boost::shared_ptr<const LUTCamera> LUTCameraConstPtr;
+
+}
+
+#endif
@@ -0,0 +1,429 @@
+#include "camodocal/camera_models/LUTCamera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace camodocal
+{
+
+namespace
+{
+// Coarsest and finest grid steps in pixels
+const double kInitialStep = 2.0;
+const double kMinStep = 0.5;
+// Cells checked against the model: one every kCheckStride in each direction
+const int kCheckStride = 3;
+}
+
+void
+LUTCamera::Grid::init(double _x0, double _y0, double _step, int _cols, int _rows, int _channels)
+{
+    x0 = _x0;
+    y0 = _y0;
+    step = _step;
+    cols = _cols;
+    rows = _rows;
+    channels = _channels;
+    m_invStep = 1.0 / step;
+    m_data.assign(static_cast<size_t>(cols) * rows * channels, std::numeric_limits<float>::quiet_NaN());
+}
+
+float*
+LUTCamera::Grid::at(int col, int row)
+{
+    return &m_data[(static_cast<size_t>(row) * cols + col) * channels];
+}
+
+bool
+LUTCamera::Grid::interpolate(double x, double y, float* out) const
+{
+    double fx = (x - x0) * m_invStep;
+    double fy = (y - y0) * m_invStep;
+    // Also rejects NaN
+    if (!(fx >= 0.0 && fy >= 0.0 && fx < cols - 1 && fy < rows - 1))
+    {
+        return false;
+    }
+    int ix = static_cast<int>(fx);
+    int iy = static_cast<int>(fy);
+    float ax = static_cast<float>(fx - ix);
+    float ay = static_cast<float>(fy - iy);
+    const float* c00 = &m_data[(static_cast<size_t>(iy) * cols + ix) * channels];
+    const float* c01 = c00 + channels;
+    const float* c10 = c00 + static_cast<size_t>(cols) * channels;
+    const float* c11 = c10 + channels;
+    for (int k = 0; k < channels; k++)
+    {
+        out[k] = (1.0f - ay) * ((1.0f - ax) * c00[k] + ax * c01[k])
+               + ay * ((1.0f - ax) * c10[k] + ax * c11[k]);
+        if (!std::isfinite(out[k]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+LUTCamera::LUTCamera(const CameraPtr& camera, double maxError)
+ : m_camera(camera)
+ , m_maxError(maxError)
+ , m_pixelAngle(0.0)
+ , m_thetaMax(0.0)
+ , m_liftError(0.0)
+ , m_projectError(0.0)
+{
+    build();
+}
+
+const CameraPtr&
+LUTCamera::camera(void) const
+{
+    return m_camera;
+}
+
+double
+LUTCamera::liftError(void) const
+{
+    return m_liftError;
+}
+
+double
+LUTCamera::projectError(void) const
+{
+    return m_projectError;
+}
+
+double
+LUTCamera::liftStep(void) const
+{
+    return m_liftGrid.step;
+}
+
+double
+LUTCamera::projectStep(void) const
+{
+    return m_projectGrid.step / m_pixelAngle;
+}
+
+void
+LUTCamera::bearingToGrid(const Eigen::Vector3d& P, double& a, double& b)
+{
+    double r = std::hypot(P(0), P(1));
+    if (r < 1e-12)
+    {
+        a = 0.0;
+        b = 0.0;
+        return;
+    }
+    double theta = atan2(r, P(2));
+    a = theta * P(0) / r;
+    b = theta * P(1) / r;
+}
+
+Eigen::Vector3d
+LUTCamera::gridToBearing(double a, double b)
+{
+    double theta = std::hypot(a, b);
+    if (theta < 1e-12)
+    {
+        return Eigen::Vector3d(0.0, 0.0, 1.0);
+    }
+    double s = sin(theta) / theta;
+    return Eigen::Vector3d(a * s, b * s, cos(theta));
+}
+
+void
+LUTCamera::build(void)
+{
+    int w = m_camera->imageWidth();
+    int h = m_camera->imageHeight();
+
+    // Angular size of a pixel at the image center, to express the errors and steps in pixels
+    Eigen::Vector3d P0, P1;
+    m_camera->liftSphere(Eigen::Vector2d(w / 2.0, h / 2.0), P0);
+    m_camera->liftSphere(Eigen::Vector2d(w / 2.0 + 1.0, h / 2.0), P1);
+    m_pixelAngle = atan2(P0.cross(P1).norm(), P0.dot(P1));
+    if (!std::isfinite(m_pixelAngle) || m_pixelAngle <= 0.0)
+    {
+        m_pixelAngle = M_PI / std::max(w, h);
+    }
+
+    // Field of view covered by the image
+    m_thetaMax = 0.0;
+    std::vector<Eigen::Vector2d> border;
+    for (int u = 0; u < w; u++)
+    {
+        border.emplace_back(u, 0);
+        border.emplace_back(u, h - 1);
+    }
+    for (int v = 0; v < h; v++)
+    {
+        border.emplace_back(0, v);
+        border.emplace_back(w - 1, v);
+    }
+    for (auto& p: border)
+    {
+        Eigen::Vector3d P;
+        m_camera->liftSphere(p, P);
+        double theta = atan2(std::hypot(P(0), P(1)), P(2));
+        if (std::isfinite(theta))
+        {
+            m_thetaMax = std::max(m_thetaMax, theta);
+        }
+    }
+    if (m_thetaMax <= 0.0)
+    {
+        m_thetaMax = M_PI / 2;
+    }
+
+    double step = kInitialStep;
+    m_liftError = buildLiftGrid(step);
+    while (m_liftError > m_maxError && step > kMinStep)
+    {
+        step /= 2;
+        m_liftError = buildLiftGrid(step);
+    }
+
+    step = kInitialStep;
+    m_projectError = buildProjectGrid(step);
+    while (m_projectError > m_maxError && step > kMinStep)
+    {
+        step /= 2;
+        m_projectError = buildProjectGrid(step);
+    }
+
+    printf("[LUTCamera] %s: lift step %.2fpx error %.4fpx, project step %.2fpx error %.4fpx, FOV %.1f deg\n",
+           cameraName().c_str(), liftStep(), m_liftError, projectStep(), m_projectError, m_thetaMax * 360 / M_PI);
+}
+
+double
+LUTCamera::buildLiftGrid(double step)
+{
+    int w = m_camera->imageWidth();
+    int h = m_camera->imageHeight();
+    // One cell of padding around the image for points tracked slightly outside
+    int cols = static_cast<int>(std::ceil((w - 1 + 2 * step) / step)) + 1;
+    int rows = static_cast<int>(std::ceil((h - 1 + 2 * step) / step)) + 1;
+    m_liftGrid.init(-step, -step, step, cols, rows, 3);
+    for (int j = 0; j < rows; j++)
+    {
+        for (int i = 0; i < cols; i++)
+        {
+            Eigen::Vector3d P;
+            m_camera->liftProjective(Eigen::Vector2d(m_liftGrid.x0 + i * step, m_liftGrid.y0 + j * step), P);
+            P.normalize();
+            if (P.allFinite())
+            {
+                float* node = m_liftGrid.at(i, j);
+                node[0] = P(0);
+                node[1] = P(1);
+                node[2] = P(2);
+            }
+        }
+    }
+
+    // The interpolation error is largest in the middle of the cells
+    double maxError = 0.0;
+    for (int j = 0; j < rows - 1; j += kCheckStride)
+    {
+        for (int i = 0; i < cols - 1; i += kCheckStride)
+        {
+            Eigen::Vector2d p(m_liftGrid.x0 + (i + 0.5) * step, m_liftGrid.y0 + (j + 0.5) * step);
+            float out[3];
+            Eigen::Vector3d P;
+            m_camera->liftProjective(p, P);
+            P.normalize();
+            if (!P.allFinite() || !m_liftGrid.interpolate(p(0), p(1), out))
+            {
+                continue;
+            }
+            Eigen::Vector3d P_lut = Eigen::Vector3f(out[0], out[1], out[2]).cast<double>().normalized();
+            double error = atan2(P.cross(P_lut).norm(), P.dot(P_lut)) / m_pixelAngle;
+            maxError = std::max(maxError, error);
+        }
+    }
+    return maxError;
+}
+
+double
+LUTCamera::buildProjectGrid(double step)
+{
+    int w = m_camera->imageWidth();
+    int h = m_camera->imageHeight();
+    double angleStep = step * m_pixelAngle;
+    double range = m_thetaMax + angleStep;
+    int cols = static_cast<int>(std::ceil(2 * range / angleStep)) + 1;
+    m_projectGrid.init(-range, -range, angleStep, cols, cols, 2);
+    for (int j = 0; j < cols; j++)
+    {
+        for (int i = 0; i < cols; i++)
+        {
+            double a = m_projectGrid.x0 + i * angleStep;
+            double b = m_projectGrid.y0 + j * angleStep;
+            double theta = std::hypot(a, b);
+            // Nodes out of the field of view are left undefined, the model may not be continuous there
+            if (theta > m_thetaMax + 2 * angleStep || theta >= M_PI)
+            {
+                continue;
+            }
+            Eigen::Vector2d p;
+            m_camera->spaceToPlane(gridToBearing(a, b), p);
+            if (p.allFinite())
+            {
+                float* node = m_projectGrid.at(i, j);
+                node[0] = p(0);
+                node[1] = p(1);
+            }
+        }
+    }
+
+    double maxError = 0.0;
+    for (int j = 0; j < cols - 1; j += kCheckStride)
+    {
+        for (int i = 0; i < cols - 1; i += kCheckStride)
+        {
+            double a = m_projectGrid.x0 + (i + 0.5) * angleStep;
+            double b = m_projectGrid.y0 + (j + 0.5) * angleStep;
+            float out[2];
+            Eigen::Vector2d p;
+            m_camera->spaceToPlane(gridToBearing(a, b), p);
+            // Only projections into the image matter
+            if (!p.allFinite() || p(0) < 0 || p(0) > w - 1 || p(1) < 0 || p(1) > h - 1 ||
+                !m_projectGrid.interpolate(a, b, out))
+            {
+                continue;
+            }
+            maxError = std::max(maxError, std::hypot(out[0] - p(0), out[1] - p(1)));
+        }
+    }
+    return maxError;
+}
+
+Camera::ModelType
+LUTCamera::modelType(void) const
+{
+    return m_camera->modelType();
+}
+
+const std::string&
+LUTCamera::cameraName(void) const
+{
+    return m_camera->cameraName();
+}
+
+int
+LUTCamera::imageWidth(void) const
+{
+    return m_camera->imageWidth();
+}
+
+int
+LUTCamera::imageHeight(void) const
+{
+    return m_camera->imageHeight();
+}
+
+void
+LUTCamera::estimateIntrinsics(const cv::Size& boardSize,
+                              const std::vector< std::vector<cv::Point3f> >& objectPoints,
+                              const std::vector< std::vector<cv::Point2f> >& imagePoints)
+{
+    m_camera->estimateIntrinsics(boardSize, objectPoints, imagePoints);
+    build();
+}
+
+void
+LUTCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
+{
+    float out[3];
+    if (m_liftGrid.interpolate(p(0), p(1), out))
+    {
+        P = Eigen::Vector3f(out[0], out[1], out[2]).cast<double>().normalized();
+    }
+    else
+    {
+        m_camera->liftSphere(p, P);
+    }
+}
+
+void
+LUTCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
+{
+    float out[3];
+    if (m_liftGrid.interpolate(p(0), p(1), out))
+    {
+        P = Eigen::Vector3f(out[0], out[1], out[2]).cast<double>().normalized();
+    }
+    else
+    {
+        m_camera->liftProjective(p, P);
+        P.normalize();
+    }
+}
+
+void
+LUTCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const
+{
+    double a, b;
+    bearingToGrid(P, a, b);
+    float out[2];
+    if (m_projectGrid.interpolate(a, b, out))
+    {
+        p << out[0], out[1];
+    }
+    else
+    {
+        m_camera->spaceToPlane(P, p);
+    }
+}
+
+void
+LUTCamera::undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const
+{
+    m_camera->undistToPlane(p_u, p);
+}
+
+cv::Mat
+LUTCamera::initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
+                                   float fx, float fy,
+                                   cv::Size imageSize,
+                                   float cx, float cy,
+                                   cv::Mat rmat) const
+{
+    return m_camera->initUndistortRectifyMap(map1, map2, fx, fy, imageSize, cx, cy, rmat);
+}
+
+int
+LUTCamera::parameterCount(void) const
+{
+    return m_camera->parameterCount();
+}
+
+void
+LUTCamera::readParameters(const std::vector<double>& parameters)
+{
+    m_camera->readParameters(parameters);
+    build();
+}
+
+void
+LUTCamera::writeParameters(std::vector<double>& parameters) const
+{
+    m_camera->writeParameters(parameters);
+}
+
+void
+LUTCamera::writeParametersToYamlFile(const std::string& filename) const
+{
+    m_camera->writeParametersToYamlFile(filename);
+}
+
+std::string
+LUTCamera::parametersToString(void) const
+{
+    return m_camera->parametersToString();
+}
+
+}
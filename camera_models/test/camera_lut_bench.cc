@@ -0,0 +1,118 @@
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+#include "camodocal/camera_models/CameraFactory.h"
+#include "camodocal/camera_models/LUTCamera.h"
+
+using namespace camodocal;
+
+namespace
+{
+double
+nowMs(void)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+// Accuracy and speed of LUTCamera against the analytic model of a camodocal calibration.
+// Usage: camera_lut_bench -c cam.yaml [-n 1000000] [-e 0.01]
+int
+main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("camera,c", po::value<std::string>()->default_value(""), "camodocal camera calibration yaml")
+        ("points,n", po::value<int>()->default_value(1000000), "random image points")
+        ("max-error,e", po::value<double>()->default_value(0.01), "LUT max interpolation error in pixels");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    CameraPtr camera = CameraFactory::instance()->generateCameraFromYamlFile(vm["camera"].as<std::string>());
+    if (!camera)
+    {
+        printf("[camera_lut_bench] Failed to read camera from %s\n", vm["camera"].as<std::string>().c_str());
+        return -1;
+    }
+    double tic = nowMs();
+    LUTCamera lut(camera, vm["max-error"].as<double>());
+    printf("[camera_lut_bench] LUT built in %.1fms\n", nowMs() - tic);
+
+    // Points of the image whose bearing the model defines
+    int num = vm["points"].as<int>();
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> u(0, camera->imageWidth() - 1), v(0, camera->imageHeight() - 1);
+    std::vector<Eigen::Vector2d> pts;
+    std::vector<Eigen::Vector3d> bearings;
+    while (static_cast<int>(pts.size()) < num)
+    {
+        Eigen::Vector2d p(u(rng), v(rng));
+        Eigen::Vector3d P;
+        camera->liftSphere(p, P);
+        if (P.allFinite())
+        {
+            pts.push_back(p);
+            bearings.push_back(P.normalized());
+        }
+    }
+
+    std::vector<Eigen::Vector3d> lifted(num), lifted_lut(num);
+    std::vector<Eigen::Vector2d> projected(num), projected_lut(num);
+    tic = nowMs();
+    for (int i = 0; i < num; i++)
+    {
+        camera->liftProjective(pts[i], lifted[i]);
+    }
+    double t_lift = nowMs() - tic;
+    tic = nowMs();
+    for (int i = 0; i < num; i++)
+    {
+        lut.liftProjective(pts[i], lifted_lut[i]);
+    }
+    double t_lift_lut = nowMs() - tic;
+    tic = nowMs();
+    for (int i = 0; i < num; i++)
+    {
+        camera->spaceToPlane(bearings[i], projected[i]);
+    }
+    double t_project = nowMs() - tic;
+    tic = nowMs();
+    for (int i = 0; i < num; i++)
+    {
+        lut.spaceToPlane(bearings[i], projected_lut[i]);
+    }
+    double t_project_lut = nowMs() - tic;
+
+    // Lift errors as the reprojection distance through the analytic model
+    double lift_max = 0, lift_sum = 0, project_max = 0, project_sum = 0;
+    for (int i = 0; i < num; i++)
+    {
+        Eigen::Vector2d p;
+        camera->spaceToPlane(lifted_lut[i], p);
+        double err = (p - projected[i]).norm();
+        lift_max = std::max(lift_max, err);
+        lift_sum += err;
+        err = (projected_lut[i] - projected[i]).norm();
+        project_max = std::max(project_max, err);
+        project_sum += err;
+    }
+    printf("[camera_lut_bench] %s %dx%d, %d points\n", camera->cameraName().c_str(),
+           camera->imageWidth(), camera->imageHeight(), num);
+    printf("%-16s %12s %12s %8s %14s %14s\n", "", "analytic ns", "LUT ns", "speedup", "mean err px", "max err px");
+    printf("%-16s %12.1f %12.1f %7.1fx %14.5f %14.5f\n", "liftProjective", t_lift * 1e6 / num, t_lift_lut * 1e6 / num,
+           t_lift / t_lift_lut, lift_sum / num, lift_max);
+    printf("%-16s %12.1f %12.1f %7.1fx %14.5f %14.5f\n", "spaceToPlane", t_project * 1e6 / num, t_project_lut * 1e6 / num,
+           t_project / t_project_lut, project_sum / num, project_max);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <boost/program_options.hpp>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace D2Common {
+// Command line options of the benchmark executables, on boost::program_options as the other test programs.
+// Each option is bound to a variable holding its default; lists are given comma separated.
+// --help prints the options and exits; unknown options, bad values and missing required options throw.
+class BenchOptions {
+    boost::program_options::options_description desc;
+    std::vector<std::unique_ptr<std::string>> list_values;
+    std::vector<std::function<void()>> list_parsers;
+    bool node_params = false;
+
+    template <typename T>
+    static std::string joinList(const std::vector<T> & values) {
+        std::ostringstream ss;
+        for (size_t i = 0; i < values.size(); i++) {
+            ss << (i > 0 ? "," : "") << values[i];
+        }
+        return ss.str();
+    }
+public:
+    BenchOptions(): desc("Allowed options") {
+        desc.add_options()("help", "produce help message");
+    }
+
+    template <typename T>
+    BenchOptions & add(const char * name, T & var, const char * help) {
+        desc.add_options()(name, boost::program_options::value<T>(&var)->default_value(var), help);
+        return *this;
+    }
+
+    BenchOptions & addRequired(const char * name, std::string & var, const char * help) {
+        desc.add_options()(name, boost::program_options::value<std::string>(&var)->required(), help);
+        return *this;
+    }
+
+    template <typename T>
+    BenchOptions & addList(const char * name, std::vector<T> & var, const char * help) {
+        list_values.emplace_back(new std::string(joinList(var)));
+        std::string * str = list_values.back().get();
+        desc.add_options()(name, boost::program_options::value<std::string>(str)->default_value(*str), help);
+        list_parsers.emplace_back([str, &var, name] {
+            var.clear();
+            std::istringstream ss(*str);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                std::istringstream item_ss(item);
+                T value;
+                if (!(item_ss >> value)) {
+                    throw boost::program_options::invalid_option_value(std::string(name) + " " + item);
+                }
+                var.emplace_back(value);
+            }
+        });
+        return *this;
+    }
+
+    // Also accept the node parameters _key:=value, read with ParamHandle::fromArgs
+    BenchOptions & allowNodeParams() {
+        node_params = true;
+        return *this;
+    }
+
+    void parse(int argc, char ** argv) {
+        namespace po = boost::program_options;
+        auto parser = po::command_line_parser(argc, argv).options(desc);
+        if (node_params) {
+            parser.allow_unregistered();
+        }
+        auto parsed = parser.run();
+        for (auto & arg : po::collect_unrecognized(parsed.options, po::include_positional)) {
+            if (!node_params || arg.find(":=") == std::string::npos) {
+                throw po::unknown_option(arg);
+            }
+        }
+        po::variables_map vm;
+        po::store(parsed, vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            exit(0);
+        }
+        po::notify(vm);
+        for (auto & parser_fn : list_parsers) {
+            parser_fn();
+        }
+    }
+};
+}
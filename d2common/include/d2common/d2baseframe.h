@@ -12,6 +12,9 @@ struct D2BaseFrame {
     bool is_keyframe = false;
     Swarm::Odometry odom;
     Swarm::Pose initial_ego_pose; //Only effective if this keyframe is from remote
+    //Marginal covariances from the VIO, zero if unknown. Pose is [position, rotation] in the world frame as nav_msgs/Odometry.
+    Matrix6d pose_cov = Matrix6d::Zero();
+    Matrix3d vel_cov = Matrix3d::Zero();
     D2BaseFrame() {}
     D2BaseFrame(double _stamp, FrameIdType _frame_id, int _drone_id, int _reference_frame_id, bool _is_keyframe, Swarm::Odometry _odom, Swarm::Pose _initial_ego_pose):
         stamp(_stamp),
@@ -45,7 +48,15 @@ struct D2BaseFrame {
         reference_frame_id(vio_frame.reference_frame_id),
         is_keyframe(vio_frame.is_keyframe),
         odom(vio_frame.odom),
-        initial_ego_pose(vio_frame.odom.pose.pose) {}
+        initial_ego_pose(vio_frame.odom.pose.pose) {
+        pose_cov = Map<const Matrix<double, 6, 6, RowMajor>>(vio_frame.odom.pose.covariance.data());
+        vel_cov = Map<const Matrix<double, 6, 6, RowMajor>>(vio_frame.odom.twist.covariance.data()).topLeftCorner<3, 3>();
+    }
+
+    void setCovariance(nav_msgs::Odometry & odom_ros) const {
+        Map<Matrix<double, 6, 6, RowMajor>>(odom_ros.pose.covariance.data()) = pose_cov;
+        Map<Matrix<double, 6, 6, RowMajor>>(odom_ros.twist.covariance.data()).topLeftCorner<3, 3>() = vel_cov;
+    }
     
     virtual void moveByPose(int new_ref_frame_id, const Swarm::Pose & delta_pose) {
         reference_frame_id = new_ref_frame_id;
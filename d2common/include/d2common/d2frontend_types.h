@@ -143,10 +143,29 @@ struct VisualImageDesc {
         return size;
     }
     
-    void releaseRawImage() {
+    void releaseRawImage(bool keep_encoded = false) {
         raw_image.release();
         raw_depth_image.release();
-        image.clear();
+        if (!keep_encoded) {
+            image.clear();
+        }
+    }
+
+    // Replace the raw images with a jpeg thumbnail of the raw image (scaled by scale), unless an
+    // encoded image already exists. image_width/height keep the size of the raw image.
+    void keepThumbnailOnly(double scale, int jpg_quality) {
+        if (image.empty() && !raw_image.empty()) {
+            cv::Mat thumbnail;
+            cv::resize(raw_image, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+            cv::imencode(".jpg", thumbnail, image, {cv::IMWRITE_JPEG_QUALITY, jpg_quality});
+            image_width = raw_image.cols;
+            image_height = raw_image.rows;
+        }
+        releaseRawImage(true);
+    }
+
+    size_t imageBytes() const {
+        return raw_image.total()*raw_image.elemSize() + raw_depth_image.total()*raw_depth_image.elemSize() + image.size();
     }
     
     VisualImageDesc() {}
@@ -387,10 +406,24 @@ struct VisualImageDescArray {
         return num;
     }
 
-    void releaseRawImages() {
+    void releaseRawImages(bool keep_encoded = false) {
+        for (auto & img : images) {
+            img.releaseRawImage(keep_encoded);
+        }
+    }
+
+    void keepThumbnailsOnly(double scale, int jpg_quality) {
+        for (auto & img : images) {
+            img.keepThumbnailOnly(scale, jpg_quality);
+        }
+    }
+
+    size_t imageBytes() const {
+        size_t bytes = 0;
         for (auto & img : images) {
-            img.releaseRawImage();
+            bytes += img.imageBytes();
         }
+        return bytes;
     }
 
     void setTd(double td) {
@@ -30,7 +30,10 @@ struct VINSFrame: public D2BaseFrame {
     void toVector(state_type * _pose, state_type * _spd_bias) const;
     void fromVector(state_type * _pose, state_type * _spd_bias);
     D2BaseFrame toBaseFrame() {
-        return D2BaseFrame(stamp, frame_id, drone_id, reference_frame_id, is_keyframe, odom, initial_ego_pose);
+        D2BaseFrame frame(stamp, frame_id, drone_id, reference_frame_id, is_keyframe, odom, initial_ego_pose);
+        frame.pose_cov = pose_cov;
+        frame.vel_cov = vel_cov;
+        return frame;
     }
 };
    
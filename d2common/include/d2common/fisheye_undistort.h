@@ -2,6 +2,7 @@
 
 #include <camodocal/camera_models/CameraFactory.h>
 #include <camodocal/camera_models/CylindricalCamera.h>
+#include <camodocal/camera_models/LUTCamera.h>
 #include <camodocal/camera_models/PinholeCamera.h>
 
 #include <d2common/utils.hpp>
@@ -16,6 +17,13 @@
 #include "sensor_msgs/Image.h"
 #include <opencv2/cudaarithm.hpp>
 #include <opencv2/cudaimgproc.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <memory>
 
 namespace D2Common {
 
@@ -76,8 +84,8 @@ class FisheyeUndist {
             camera_config_file);
         raw_width = cam->imageWidth();
         raw_height = cam->imageHeight();
-        fisheye2cam_pt = cv::Mat::zeros(raw_width, raw_height, CV_32FC2);
-        fisheye2cam_id = cv::Mat::ones(raw_width, raw_height, CV_8UC1);
+        fisheye2cam_pt = cv::Mat::zeros(raw_height, raw_width, CV_32FC2);
+        fisheye2cam_id = cv::Mat::ones(raw_height, raw_width, CV_8UC1);
         fisheye2cam_id = fisheye2cam_id * 255;
         undistMaps = generateAllUndistMap(cam, cameraRotation, imgWidth, fov);
         // ROS_INFO("undismap size %ld", undistMaps.size());
@@ -102,8 +110,8 @@ class FisheyeUndist {
           cam_id(_id) {
         raw_width = cam->imageWidth();
         raw_height = cam->imageHeight();
-        fisheye2cam_pt = cv::Mat::zeros(raw_width, raw_height, CV_32FC2);
-        fisheye2cam_id = cv::Mat::ones(raw_width, raw_height, CV_8UC1);
+        fisheye2cam_pt = cv::Mat::zeros(raw_height, raw_width, CV_32FC2);
+        fisheye2cam_id = cv::Mat::ones(raw_height, raw_width, CV_8UC1);
         fisheye2cam_id = fisheye2cam_id * 255;
         if (mode == UndistortPinhole5) {
             undistMaps =
@@ -126,17 +134,21 @@ class FisheyeUndist {
         }
         if (!photomertic.empty()) {
             auto _photometics = undist_all(photomertic, true);
-            auto _photometics_gpu = undist_all_cuda(photomertic, true);
             photometics = _photometics;
-            photometics_gpu = _photometics_gpu;
             for (int i = 0; i < _photometics.size(); i++) {
                 cv::Mat bgr;
                 cv::cvtColor(_photometics[i], bgr, cv::COLOR_GRAY2BGR);
                 photometics_bgr.push_back(bgr);
-                cv::cuda::GpuMat bgr_gpu;
-                cv::cuda::cvtColor(_photometics_gpu[i], bgr_gpu,
-                                   cv::COLOR_GRAY2BGR);
-                photometics_gpu_bgr.push_back(bgr_gpu);
+            }
+            if (enable_cuda) {
+                auto _photometics_gpu = undist_all_cuda(photomertic, true);
+                photometics_gpu = _photometics_gpu;
+                for (int i = 0; i < _photometics_gpu.size(); i++) {
+                    cv::cuda::GpuMat bgr_gpu;
+                    cv::cuda::cvtColor(_photometics_gpu[i], bgr_gpu,
+                                       cv::COLOR_GRAY2BGR);
+                    photometics_gpu_bgr.push_back(bgr_gpu);
+                }
             }
         } else {
             printf("no photometric calibration file found\n");
@@ -151,8 +163,14 @@ class FisheyeUndist {
     }
     
     cv::cuda::GpuMat undist_id_cuda(cv::cuda::GpuMat img_cuda, int _id, bool calib_photometric=false) {
-#ifndef WITHOUT_CUDA
         cv::cuda::GpuMat output;
+        undist_id_cuda(img_cuda, output, _id, calib_photometric);
+        return output;
+    }
+
+    // Undistort into output, which is reused when it already has the right size and type
+    void undist_id_cuda(const cv::cuda::GpuMat & img_cuda, cv::cuda::GpuMat & output, int _id, bool calib_photometric=false) {
+#ifndef WITHOUT_CUDA
         cv::cuda::remap(img_cuda, output, undistMapsGPUX[_id],
                         undistMapsGPUY[_id], REMAP_FUNC);
         if (photometics_gpu.size() > 0 && calib_photometric) {
@@ -167,10 +185,43 @@ class FisheyeUndist {
                 output.convertTo(output, CV_8U);
             }
         }
-        return output;
 #endif
     }
 
+    // CPU version of undist_id_cuda, for the maps built without CUDA
+    void undist_id(const cv::Mat & image, cv::Mat & output, int _id, bool calib_photometric=false) {
+        cv::remap(image, output, undistMaps[_id].first, undistMaps[_id].second, REMAP_FUNC);
+        if (photometics.size() > 0 && calib_photometric) {
+            auto & gain = output.channels() == 3 ? photometics_bgr[_id] : photometics[_id];
+            output.convertTo(output, gain.type());
+            cv::multiply(output, gain, output);
+            output.convertTo(output, image.depth());
+        }
+    }
+
+    // Compose the undistortion map of virtual camera _id with a map (map_x, map_y) defined on that
+    // virtual camera, e.g. a stereo rectification map. The result (CV_32FC2) maps each output pixel
+    // directly to the raw fisheye image, so a single remap replaces the two.
+    // Outside the virtual camera the map is a far negative sentinel: bilinear remap weights are
+    // multiples of 1/1024, so any output pixel interpolated with it still lands outside the raw image.
+    cv::Mat composeMap(int _id, const cv::Mat &map_x, const cv::Mat &map_y) const {
+        cv::Mat composed;
+        cv::remap(undistMaps[_id].first, composed, map_x, map_y, cv::INTER_LINEAR,
+                  cv::BORDER_CONSTANT, cv::Scalar(-1e7, -1e7));
+        return composed;
+    }
+
+    // Photometric gain of virtual camera _id resampled by (map_x, map_y).
+    // Empty if there is no photometric calibration.
+    cv::Mat composePhotometric(int _id, const cv::Mat &map_x, const cv::Mat &map_y) const {
+        cv::Mat gain;
+        if (photometics.size() > 0) {
+            cv::remap(photometics[_id], gain, map_x, map_y, cv::INTER_LINEAR,
+                      cv::BORDER_CONSTANT, cv::Scalar(1));
+        }
+        return gain;
+    }
+
     cv::cuda::GpuMat img_cuda;
     std::vector<cv::Mat> undist_all_cuda_cpu(
         const cv::Mat &image, bool use_rgb = false,
@@ -562,54 +613,15 @@ class FisheyeUndist {
                                                 Eigen::Quaterniond rotation,
                                                 const unsigned &imgWidth,
                                                 const unsigned &imgHeight) {
-        cv::Mat map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
-        ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
-        ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
-                  (rotation * Eigen::Vector3d(0, 0, 1))[0],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[1],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[2]);
-        for (unsigned int x = 0; x < imgWidth; x++)
-            for (unsigned int y = 0; y < imgHeight; y++) {
+        uint64_t key = mapCacheKey(p_cam, p_vcam, rotation, imgWidth, imgHeight, 0);
+        cv::Mat map = genMap(p_cam, imgWidth, imgHeight, key,
+            [&](unsigned x, unsigned y) {
                 Eigen::Vector3d objPoint;
                 p_vcam->liftProjective(Eigen::Vector2d(x, y), objPoint);
-                Eigen::Vector2d imgPoint;
-                p_cam->spaceToPlane(objPoint, imgPoint);
-
-                map.at<cv::Vec2f>(cv::Point(x, y)) =
-                    cv::Vec2f(imgPoint.x(), imgPoint.y());
-                if (!isnan(imgPoint.x()) && !isnan(imgPoint.y()) &&
-                    imgPoint.x() >= 0 && imgPoint.x() <= raw_width &&
-                    imgPoint.y() >= 0 && imgPoint.y() <= raw_height) {
-                    auto &pt = fisheye2cam_pt.at<cv::Vec2f>(
-                        cv::Point(imgPoint.x(), imgPoint.y()));
-                    fisheye2cam_id.at<uint8_t>(
-                        cv::Point(imgPoint.x(), imgPoint.y())) = _id;
-                    pt[0] = x;
-                    pt[1] = y;
-                }
-            }
-
-        ROS_DEBUG("Upper corners: (%.2f, %.2f), (%.2f, %.2f)",
-                  map.at<cv::Vec2f>(cv::Point(0, 0))[0],
-                  map.at<cv::Vec2f>(cv::Point(0, 0))[1],
-                  map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[0],
-                  map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[1]);
-
-        Eigen::Vector3d objPoint =
-            rotation * Eigen::Vector3d(((double)0 - (double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-
-        objPoint =
-            rotation * Eigen::Vector3d(((double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-        cv::Mat map1, map2;
-        cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
+                return objPoint;
+            });
+        fillFisheyeToCam(_id, map);
         return std::make_pair(map, cv::Mat());
-        // return std::make_pair(map1, map2);
     }
 
     std::pair<cv::Mat, cv::Mat> genOneUndistMap(int _id,
@@ -618,57 +630,201 @@ class FisheyeUndist {
                                                 const unsigned &imgWidth,
                                                 const unsigned &imgHeight,
                                                 const double &f_center) {
-        cv::Mat map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
-        ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
         ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
                   (rotation * Eigen::Vector3d(0, 0, 1))[0],
                   (rotation * Eigen::Vector3d(0, 0, 1))[1],
                   (rotation * Eigen::Vector3d(0, 0, 1))[2]);
-        for (unsigned int x = 0; x < imgWidth; x++)
-            for (unsigned int y = 0; y < imgHeight; y++) {
-                Eigen::Vector3d objPoint =
-                    rotation *
+        uint64_t key = mapCacheKey(p_cam, nullptr, rotation, imgWidth, imgHeight, f_center);
+        cv::Mat map = genMap(p_cam, imgWidth, imgHeight, key,
+            [&](unsigned x, unsigned y) {
+                return Eigen::Vector3d(rotation *
                     Eigen::Vector3d(((double)x - (double)imgWidth / 2),
                                     ((double)y - (double)imgHeight / 2),
-                                    f_center);
+                                    f_center));
+            });
+        fillFisheyeToCam(_id, map);
+        return std::make_pair(map, cv::Mat());
+    }
+
+    // Directory of the remap table cache. The tables are memory mapped from it, so the processes
+    // building the same virtual cameras (frontend, quadcam_depth_est, restarts) share one copy.
+    // Empty disables the cache.
+    static std::string &mapCacheDir() {
+        static std::string dir = defaultMapCacheDir();
+        return dir;
+    }
+
+   private:
+    struct MapCacheHeader {
+        char magic[8];
+        uint64_t key;
+        int32_t rows;
+        int32_t cols;
+    };
+    static const char *mapCacheMagic() { return "D2UMAP1"; }
+    // Keeps the memory mapped tables alive as long as the maps referencing them
+    std::vector<std::shared_ptr<void>> mapped_caches;
+
+    static std::string defaultMapCacheDir() {
+        const char *ros_home = getenv("ROS_HOME");
+        if (ros_home != nullptr) {
+            return std::string(ros_home) + "/fisheye_undist_cache";
+        }
+        const char *home = getenv("HOME");
+        if (home != nullptr) {
+            return std::string(home) + "/.ros/fisheye_undist_cache";
+        }
+        return "";
+    }
+
+    // A LUTCamera forwards its parameters and model type to the wrapped camera,
+    // so its grids are added to tell the interpolated maps from the exact ones.
+    static void appendCameraKey(const camodocal::CameraPtr &cam, std::vector<double> &values) {
+        std::vector<double> cam_values;
+        cam->writeParameters(cam_values);
+        values.insert(values.end(), cam_values.begin(), cam_values.end());
+        values.push_back(cam->modelType());
+        auto lut = dynamic_cast<const camodocal::LUTCamera *>(cam.get());
+        if (lut != nullptr) {
+            values.push_back(-1);
+            values.push_back(lut->liftStep());
+            values.push_back(lut->projectStep());
+            values.push_back(lut->liftError());
+            values.push_back(lut->projectError());
+        }
+    }
+
+    // FNV-1a hash of everything the map depends on: the raw camera model and its parameters,
+    // the virtual camera, its rotation, size and focal length (i.e. the FOV).
+    static uint64_t mapCacheKey(camodocal::CameraPtr p_cam, camodocal::CameraPtr p_vcam,
+                                const Eigen::Quaterniond &rotation, unsigned imgWidth,
+                                unsigned imgHeight, double focal) {
+        std::vector<double> values;
+        appendCameraKey(p_cam, values);
+        values.push_back(p_cam->imageWidth());
+        values.push_back(p_cam->imageHeight());
+        if (p_vcam) {
+            appendCameraKey(p_vcam, values);
+        }
+        values.insert(values.end(), rotation.coeffs().data(), rotation.coeffs().data() + 4);
+        values.push_back(imgWidth);
+        values.push_back(imgHeight);
+        values.push_back(focal);
+        uint64_t hash = 14695981039346656037ULL;
+        auto bytes = reinterpret_cast<const uint8_t *>(values.data());
+        for (size_t i = 0; i < values.size() * sizeof(double); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static std::string mapCachePath(uint64_t key) {
+        char name[32] = {0};
+        sprintf(name, "/%016lx.map", (unsigned long)key);
+        return mapCacheDir() + name;
+    }
+
+    // The fisheye image point of each pixel of a virtual camera, lifted by lift(x, y).
+    // Read from the cache if possible, otherwise computed in parallel over the rows and cached.
+    template <typename Lift>
+    cv::Mat genMap(camodocal::CameraPtr p_cam, unsigned imgWidth, unsigned imgHeight,
+                   uint64_t key, Lift lift) {
+        cv::Mat map = loadCachedMap(key, imgHeight, imgWidth);
+        if (!map.empty()) {
+            return map;
+        }
+        TicToc tic;
+        map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
+#pragma omp parallel for schedule(dynamic, 8)
+        for (int y = 0; y < (int)imgHeight; y++) {
+            auto row = map.ptr<cv::Vec2f>(y);
+            for (unsigned int x = 0; x < imgWidth; x++) {
                 Eigen::Vector2d imgPoint;
-                p_cam->spaceToPlane(objPoint, imgPoint);
-
-                map.at<cv::Vec2f>(cv::Point(x, y)) =
-                    cv::Vec2f(imgPoint.x(), imgPoint.y());
-                if (!isnan(imgPoint.x()) && !isnan(imgPoint.y()) &&
-                    imgPoint.x() >= 0 && imgPoint.x() <= raw_width &&
-                    imgPoint.y() >= 0 && imgPoint.y() <= raw_height) {
-                    auto &pt = fisheye2cam_pt.at<cv::Vec2f>(
-                        cv::Point(imgPoint.x(), imgPoint.y()));
-                    fisheye2cam_id.at<uint8_t>(
-                        cv::Point(imgPoint.x(), imgPoint.y())) = _id;
-                    pt[0] = x;
-                    pt[1] = y;
+                p_cam->spaceToPlane(lift(x, y), imgPoint);
+                row[x] = cv::Vec2f(imgPoint.x(), imgPoint.y());
+            }
+        }
+        printf("[FisheyeUndist] Generated map %dx%d in %.1fms\n", imgWidth, imgHeight, tic.toc());
+        saveCachedMap(key, map);
+        return map;
+    }
+
+    // Inverse of the map: the virtual camera pixel of the fisheye image points
+    void fillFisheyeToCam(int _id, const cv::Mat &map) {
+        for (int x = 0; x < map.cols; x++) {
+            for (int y = 0; y < map.rows; y++) {
+                const auto &imgPoint = map.at<cv::Vec2f>(y, x);
+                if (!isnan(imgPoint[0]) && !isnan(imgPoint[1]) &&
+                    imgPoint[0] >= 0 && imgPoint[0] < raw_width &&
+                    imgPoint[1] >= 0 && imgPoint[1] < raw_height) {
+                    cv::Point pt_fisheye(imgPoint[0], imgPoint[1]);
+                    fisheye2cam_id.at<uint8_t>(pt_fisheye) = _id;
+                    fisheye2cam_pt.at<cv::Vec2f>(pt_fisheye) = cv::Vec2f(x, y);
                 }
             }
+        }
+    }
 
-        ROS_DEBUG("Upper corners: (%.2f, %.2f), (%.2f, %.2f)",
-                  map.at<cv::Vec2f>(cv::Point(0, 0))[0],
-                  map.at<cv::Vec2f>(cv::Point(0, 0))[1],
-                  map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[0],
-                  map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[1]);
-
-        Eigen::Vector3d objPoint =
-            rotation * Eigen::Vector3d(((double)0 - (double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-
-        objPoint =
-            rotation * Eigen::Vector3d(((double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-        cv::Mat map1, map2;
-        cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
-        return std::make_pair(map, cv::Mat());
-        // return std::make_pair(map1, map2);
+    cv::Mat loadCachedMap(uint64_t key, int rows, int cols) {
+        if (mapCacheDir().empty()) {
+            return cv::Mat();
+        }
+        auto path = mapCachePath(key);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return cv::Mat();
+        }
+        size_t size = sizeof(MapCacheHeader) + (size_t)rows * cols * sizeof(cv::Vec2f);
+        struct stat st;
+        void *addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+            addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (addr == MAP_FAILED) {
+            printf("[FisheyeUndist] Ignore invalid map cache %s\n", path.c_str());
+            return cv::Mat();
+        }
+        std::shared_ptr<void> mapped(addr, [size](void *p) { munmap(p, size); });
+        auto header = static_cast<const MapCacheHeader *>(addr);
+        if (strncmp(header->magic, mapCacheMagic(), sizeof(header->magic)) != 0 ||
+            header->key != key || header->rows != rows || header->cols != cols) {
+            printf("[FisheyeUndist] Ignore invalid map cache %s\n", path.c_str());
+            return cv::Mat();
+        }
+        mapped_caches.push_back(mapped);
+        printf("[FisheyeUndist] Load map %dx%d from %s\n", cols, rows, path.c_str());
+        // Read only: the maps are never written after generation.
+        return cv::Mat(rows, cols, CV_32FC2, static_cast<uint8_t *>(addr) + sizeof(MapCacheHeader));
+    }
+
+    void saveCachedMap(uint64_t key, const cv::Mat &map) {
+        auto dir = mapCacheDir();
+        if (dir.empty()) {
+            return;
+        }
+        for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+            mkdir(dir.substr(0, pos).c_str(), 0755);
+            if (pos == std::string::npos) {
+                break;
+            }
+        }
+        // Written aside and renamed, so a concurrent process never maps a partial file
+        auto path = mapCachePath(key);
+        auto tmp_path = path + "." + std::to_string(getpid()) + ".tmp";
+        MapCacheHeader header;
+        strncpy(header.magic, mapCacheMagic(), sizeof(header.magic));
+        header.key = key;
+        header.rows = map.rows;
+        header.cols = map.cols;
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char *>(map.data), map.total() * map.elemSize());
+        ofs.close();
+        if (!ofs || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            printf("[FisheyeUndist] Failed to write map cache %s\n", path.c_str());
+            remove(tmp_path.c_str());
+        }
     }
 };
 }  // namespace D2Common
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace D2Common {
+// Pool of reusable image buffers. The images handed out are ordinary reference counted cv::Mat,
+// a buffer goes back to the pool once every cv::Mat referencing it (frames, trackers, queues)
+// has been released. The pool holds at most max_size buffers, so the resident memory is bounded
+// whatever the number of images retained downstream.
+class ImagePool {
+    std::vector<cv::Mat> buffers;
+    int max_size = 8;
+    int allocation_num = 0;
+public:
+    ImagePool(int _max_size = 8): max_size(_max_size) {}
+
+    cv::Mat acquire(int rows, int cols, int type) {
+        for (auto & buf : buffers) {
+            // Referenced by the pool only
+            if (buf.u->refcount == 1 && buf.rows == rows && buf.cols == cols && buf.type() == type) {
+                return buf;
+            }
+        }
+        allocation_num ++;
+        if ((int) buffers.size() >= max_size) {
+            // Too many images retained, do not grow the pool further
+            return cv::Mat(rows, cols, type);
+        }
+        buffers.emplace_back(rows, cols, type);
+        return buffers.back();
+    }
+
+    // Buffers allocated since the last call
+    int takeAllocationNum() {
+        int num = allocation_num;
+        allocation_num = 0;
+        return num;
+    }
+
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (auto & buf : buffers) {
+            bytes += buf.total() * buf.elemSize();
+        }
+        return bytes;
+    }
+};
+}
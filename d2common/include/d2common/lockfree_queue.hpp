@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace D2Common {
+// Bounded multi-producer multi-consumer queue without locks (D. Vyukov's algorithm).
+// Each slot carries a sequence number telling whether it is free for the producer of that
+// position or filled for its consumer, so push and pop are a single CAS on the position.
+// push fails instead of blocking when the queue is full.
+template <typename T>
+class LockFreeQueue {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    // Producers and consumers on separate cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+public:
+    // Capacity is rounded up to a power of two
+    explicit LockFreeQueue(size_t capacity = 1024) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    template <typename U>
+    bool push(U && value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot * slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->data = std::forward<U>(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T & value) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Slot * slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(slot->data);
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+}
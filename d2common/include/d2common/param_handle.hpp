@@ -0,0 +1,72 @@
+#pragma once
+#include <ros/ros.h>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace D2Common {
+// Source of the node parameters, with the interface of ros::NodeHandle::param.
+// Either the parameter server through a NodeHandle, or a plain map of values for running without a ROS master
+// (offline replays), where missing or unparsable values take the default.
+class ParamHandle {
+    ros::NodeHandle * nh = nullptr;
+    std::map<std::string, std::string> values;
+
+    static bool parse(const std::string & str, std::string & var) {
+        var = str;
+        return true;
+    }
+
+    static bool parse(const std::string & str, bool & var) {
+        if (str == "true" || str == "True" || str == "1") {
+            var = true;
+        } else if (str == "false" || str == "False" || str == "0") {
+            var = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    static bool parse(const std::string & str, T & var) {
+        std::istringstream ss(str);
+        T val;
+        ss >> val;
+        if (ss.fail()) {
+            return false;
+        }
+        var = val;
+        return true;
+    }
+public:
+    // Implicit, so that the constructors taking a ParamHandle still accept a NodeHandle
+    ParamHandle(ros::NodeHandle & _nh): nh(&_nh) {}
+    ParamHandle(const std::map<std::string, std::string> & _values): values(_values) {}
+
+    template <typename T>
+    void param(const std::string & key, T & var, const T & default_val) const {
+        if (nh != nullptr) {
+            nh->param<T>(key, var, default_val);
+            return;
+        }
+        auto it = values.find(key);
+        if (it == values.end() || !parse(it->second, var)) {
+            var = default_val;
+        }
+    }
+
+    // Collects the private parameter remappings _key:=value among the arguments, as ros::init would
+    static std::map<std::string, std::string> fromArgs(int argc, char ** argv) {
+        std::map<std::string, std::string> ret;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto pos = arg.find(":=");
+            if (arg.size() > 1 && arg[0] == '_' && pos != std::string::npos) {
+                ret[arg.substr(1, pos - 1)] = arg.substr(pos + 2);
+            }
+        }
+        return ret;
+    }
+};
+}
@@ -1,18 +1,26 @@
 #pragma once
 #include <mutex>
 #include <vector>
+#include <map>
+#include <set>
+#include <condition_variable>
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 
 namespace D2Common {
 template <class T>
 class BaseSyncDataReceiver {
 protected:
     std::recursive_mutex sync_data_recv_lock;
+    std::condition_variable_any sync_data_cond;
     std::vector<T> sync_datas;
 public:
     void add(const T & data) {
-        const Utility::Guard lock(sync_data_recv_lock);
-        sync_datas.emplace_back(data);
+        {
+            const Utility::Guard lock(sync_data_recv_lock);
+            sync_datas.emplace_back(data);
+        }
+        sync_data_cond.notify_all();
     }
     std::vector<T> retrive(int64_t token, int iteration_count) {
         const Utility::Guard lock(sync_data_recv_lock);
@@ -27,11 +35,123 @@ public:
         }
         return datas;
     }
+    //All the data of the token, data of older tokens is dropped
+    std::vector<T> retrive(int64_t token) {
+        const Utility::Guard lock(sync_data_recv_lock);
+        std::vector<T> datas;
+        for (auto it = sync_datas.begin(); it != sync_datas.end(); ) {
+            if (it->solver_token == token) {
+                datas.emplace_back(*it);
+                it = sync_datas.erase(it);
+            } else if (it->solver_token < token) {
+                it = sync_datas.erase(it);
+            } else {
+                it++;
+            }
+        }
+        return datas;
+    }
     std::vector<T> retrive_all() {
         const Utility::Guard lock(sync_data_recv_lock);
         std::vector<T> datas = sync_datas;
         sync_datas.clear();
         return datas;
     }
+    //Blocks until data of the token is pending or timeout (ms). Returns false on timeout.
+    bool waitForData(int64_t token, double timeout) {
+        std::unique_lock<std::recursive_mutex> lock(sync_data_recv_lock);
+        return sync_data_cond.wait_for(lock, std::chrono::microseconds((int64_t)(timeout * 1000)), [&]() {
+            for (auto & data : sync_datas) {
+                if (data.solver_token == token) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+};
+
+struct PeerSyncStats {
+    int fresh = 0; //Iterations synced with the data of the iteration
+    int stale = 0; //Iterations synced with older data within the staleness bound
+    int missed = 0; //Iterations without usable data at the timeout
+    double sum_wait = 0; //ms from the start of the wait to the arrival of fresh data, 0 if it was already there
+    double max_wait = 0;
+    double meanWait() const {
+        return fresh > 0 ? sum_wait / fresh : 0;
+    }
+};
+
+// Stale synchronous parallel sync of the consensus solvers. An iteration proceeds once every peer has sent
+// the data of an iteration no older than max_staleness, the latest data of each peer is reused until newer
+// arrives. max_staleness = 0 is the barrier on the data of the current iteration. Arrivals wake the wait.
+template <class T>
+class BoundedStalenessSync {
+protected:
+    int64_t token = -1;
+    std::map<int, T> latest; //Latest data of each peer in the solve of token
+    std::map<int, PeerSyncStats> stats;
+    void collect(BaseSyncDataReceiver<T> & receiver, int iteration_count, double t_wait) {
+        for (auto & data : receiver.retrive(token)) {
+            auto it = latest.find(data.drone_id);
+            if (it != latest.end() && it->second.iteration_count >= data.iteration_count) {
+                continue;
+            }
+            if (data.iteration_count >= iteration_count && (it == latest.end() || it->second.iteration_count < iteration_count)) {
+                auto & stat = stats[data.drone_id];
+                stat.sum_wait += t_wait;
+                stat.max_wait = std::max(stat.max_wait, t_wait);
+            }
+            latest[data.drone_id] = data;
+        }
+    }
+    bool ready(const std::set<int> & peers, int min_iteration) const {
+        for (auto peer : peers) {
+            auto it = latest.find(peer);
+            if (it == latest.end() || it->second.iteration_count < min_iteration) {
+                return false;
+            }
+        }
+        return true;
+    }
+public:
+    // Waits for the peers (without self) at iteration_count of the solve of _token and returns the data to
+    // average: the latest of each peer within the bound.
+    std::vector<T> wait(BaseSyncDataReceiver<T> & receiver, int64_t _token, int iteration_count,
+            const std::set<int> & peers, int max_staleness, double timeout) {
+        D2_TRACE_ZONE("BaseConsensusSync::wait");
+        Utility::TicToc tic;
+        if (_token != token || iteration_count == 0) {
+            token = _token;
+            latest.clear();
+        }
+        int min_iteration = iteration_count - max_staleness;
+        collect(receiver, iteration_count, 0);
+        while (!ready(peers, min_iteration)) {
+            double remain = timeout - tic.toc();
+            if (remain <= 0 || !receiver.waitForData(token, remain)) {
+                break;
+            }
+            collect(receiver, iteration_count, tic.toc());
+        }
+        std::vector<T> datas;
+        for (auto peer : peers) {
+            auto it = latest.find(peer);
+            auto & stat = stats[peer];
+            if (it == latest.end() || it->second.iteration_count < min_iteration) {
+                stat.missed ++;
+            } else if (it->second.iteration_count < iteration_count) {
+                stat.stale ++;
+                datas.emplace_back(it->second);
+            } else {
+                stat.fresh ++;
+                datas.emplace_back(it->second);
+            }
+        }
+        return datas;
+    }
+    const std::map<int, PeerSyncStats> & peerStats() const {
+        return stats;
+    }
 };
-}
\ No newline at end of file
+}
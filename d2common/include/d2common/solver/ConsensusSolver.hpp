@@ -13,6 +13,7 @@ struct ConsensusSolverConfig {
     int self_id = 0;
     int main_id = 1;
     double timout_wait_sync = 100;
+    int max_staleness = 0; //Iterations the data of a peer may lag behind, 0 waits for the data of every iteration
     double rho_landmark = 0.0;
     double rho_frame_T = 0.1;
     double rho_frame_theta = 0.1;
@@ -238,6 +238,135 @@ public:
     }
 };
 
+// Analytic-Jacobian version of RelPoseFactorPerturbAD. Parameters are [p, theta] with q = q0*Exp(theta).
+class RelPoseFactorPerturb : public ceres::SizedCostFunction<6, 6, 6> {
+    Matrix6d sqrt_info;
+    Vector3d t_rel;
+    Quaterniond q_rel;
+    Matrix3d R_rel;
+    Quaterniond qa0;
+    Quaterniond qb0;
+
+    static Matrix3d rightJacobianSO3(const Vector3d & theta) {
+        double angle = theta.norm();
+        Matrix3d S = Utility::skewSymmetric(theta);
+        if (angle < 1e-4) {
+            return Matrix3d::Identity() - 0.5*S;
+        }
+        return Matrix3d::Identity() - (1 - cos(angle))/(angle*angle)*S + (angle - sin(angle))/(angle*angle*angle)*S*S;
+    }
+public:
+    RelPoseFactorPerturb(const Swarm::Pose & relative_pose, const Matrix6d & _sqrt_info, 
+            const Quaterniond & q0, const Quaterniond & q1): 
+        sqrt_info(_sqrt_info), qa0(q0), qb0(q1) {
+        t_rel = relative_pose.pos();
+        q_rel = relative_pose.att();
+        R_rel = q_rel.toRotationMatrix();
+    }
+
+    bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        Map<const Vector3d> p_a(parameters[0]);
+        Map<const Vector3d> theta_a(parameters[0] + 3);
+        Map<const Vector3d> p_b(parameters[1]);
+        Map<const Vector3d> theta_b(parameters[1] + 3);
+        Quaterniond q_a = qa0*Utility::quatfromRotationVector(theta_a);
+        Quaterniond q_b = qb0*Utility::quatfromRotationVector(theta_b);
+        Matrix3d R_a_inv = q_a.conjugate().toRotationMatrix();
+        Vector3d p_ab_est = R_a_inv*(p_b - p_a);
+        // Same as RelPoseFactorPerturbAD: delta_q = q_rel * (q_a^-1 q_b)^-1 = q_rel * q_b^-1 * q_a
+        Quaterniond q_err = q_rel*q_b.conjugate()*q_a;
+        Map<Vector6d> res(residuals);
+        res.segment<3>(0) = p_ab_est - t_rel;
+        res.segment<3>(3) = 2.0*q_err.vec();
+        res.applyOnTheLeft(sqrt_info);
+        if (jacobians) {
+            double w = q_err.w();
+            Matrix3d skew_v = Utility::skewSymmetric(q_err.vec());
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_a(jacobians[0]);
+                Matrix3d Jr_a = rightJacobianSO3(theta_a);
+                Matrix6d J;
+                J.block<3, 3>(0, 0) = -R_a_inv;
+                J.block<3, 3>(0, 3) = Utility::skewSymmetric(p_ab_est)*Jr_a;
+                J.block<3, 3>(3, 0).setZero();
+                J.block<3, 3>(3, 3) = (w*Matrix3d::Identity() + skew_v)*Jr_a;
+                jacobian_a = sqrt_info*J;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_b(jacobians[1]);
+                Matrix3d Jr_b = rightJacobianSO3(theta_b);
+                Matrix6d J;
+                J.block<3, 3>(0, 0) = R_a_inv;
+                J.block<3, 3>(0, 3).setZero();
+                J.block<3, 3>(3, 0).setZero();
+                J.block<3, 3>(3, 3) = -(w*Matrix3d::Identity() - skew_v)*R_rel*Jr_b;
+                jacobian_b = sqrt_info*J;
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction* Create(const Swarm::LoopEdge & loop, const Eigen::Quaterniond & q0, const Eigen::Quaterniond & q1) {
+        return new RelPoseFactorPerturb(loop.relative_pose, loop.getSqrtInfoMat(), q0, q1);
+    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Analytic-Jacobian version of RelPoseFactor4D. Parameters are [x, y, z, yaw].
+class RelPoseFactor4DAnalytic : public ceres::SizedCostFunction<4, 4, 4> {
+    Eigen::Vector3d relative_pos;
+    double relative_yaw;
+    Eigen::Matrix4d sqrt_inf;
+public:
+    RelPoseFactor4DAnalytic(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf):
+        sqrt_inf(_sqrt_inf) {
+        relative_pos = _relative_pose.pos();
+        relative_yaw = _relative_pose.yaw();
+    }
+
+    bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        Map<const Vector3d> pos_a(parameters[0]);
+        Map<const Vector3d> pos_b(parameters[1]);
+        double yaw_a = parameters[0][3];
+        double yaw_b = parameters[1][3];
+        double c = cos(yaw_a), s = sin(yaw_a);
+        Matrix3d R_a_inv;
+        R_a_inv << c, s, 0,
+                -s, c, 0,
+                0, 0, 1;
+        Vector3d dp = pos_b - pos_a;
+        // Same as RelPoseFactor4D: err = [relative_pos - R_a^-1 (p_b - p_a), relative_yaw - (yaw_b - yaw_a)]
+        Map<Vector4d> res(residuals);
+        res.segment<3>(0) = relative_pos - R_a_inv*dp;
+        res(3) = Utility::NormalizeAngle(relative_yaw - Utility::NormalizeAngle(yaw_b - yaw_a));
+        res.applyOnTheLeft(sqrt_inf);
+        if (jacobians) {
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> jacobian_a(jacobians[0]);
+                Matrix4d J = Matrix4d::Zero();
+                J.block<3, 3>(0, 0) = R_a_inv;
+                J(0, 3) = s*dp.x() - c*dp.y();
+                J(1, 3) = c*dp.x() + s*dp.y();
+                J(3, 3) = 1;
+                jacobian_a = sqrt_inf*J;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> jacobian_b(jacobians[1]);
+                Matrix4d J = Matrix4d::Zero();
+                J.block<3, 3>(0, 0) = -R_a_inv;
+                J(3, 3) = -1;
+                jacobian_b = sqrt_inf*J;
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction* Create(const Swarm::LoopEdge & loop) {
+        return new RelPoseFactor4DAnalytic(loop.relative_pose, loop.getSqrtInfoMat4D());
+    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
 class RelRotFactor9D {
     Matrix3d R_sqrt_info;
     Matrix3d R_rel;
@@ -51,6 +51,9 @@ public:
     ceres::Problem & getProblem() {
         return *problem;
     }
+    const std::vector<ResidualInfo*> & getResiduals() const {
+        return residuals;
+    }
     virtual void reset() {
         delete problem;
         problem = new ceres::Problem();
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace D2Common {
+namespace Tracing {
+// Low overhead tracing of the hot paths. Scoped zones and counter samples are recorded into a ring buffer
+// per thread (the oldest events are overwritten), and aggregated into log-bucket histograms per name.
+// The events are exported as Chrome trace JSON (chrome://tracing, Perfetto), the histograms are printed
+// as a periodic summary. While tracing is disabled a zone costs one relaxed atomic load; building with
+// D2_DISABLE_TRACING removes the instrumentation altogether.
+// Names are kept by pointer: they must be string literals or otherwise outlive the tracing.
+struct TracingConfig {
+    bool enable = false;
+    std::string output; // Chrome trace JSON written on shutdown, none if empty
+    double summary_interval = 10.0; // Seconds between the printed summaries, none if <= 0
+    int buffer_size = 65536; // Events per thread
+};
+
+extern std::atomic<bool> enabled_flag;
+
+inline bool enabled() {
+    return enabled_flag.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds of the steady clock
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void init(const TracingConfig & config);
+// Stops the summary, prints the last one and writes the output if configured
+void shutdown();
+// Name of the calling thread in the trace
+void setThreadName(const char * name);
+void recordZone(const char * name, int64_t start, int64_t end);
+// Sample of a gauge (queue depth, landmark number), traced and aggregated
+void recordCounter(const char * name, double value);
+// Value aggregated in the summary only (solve time, iterations)
+void recordValue(const char * name, double value);
+bool writeChromeTrace(const std::string & path);
+// Histograms of the values recorded since the last call, formatted one name per line
+std::string summary();
+
+class Zone {
+    const char * name = nullptr;
+    int64_t start = 0;
+public:
+    explicit Zone(const char * _name) {
+        if (enabled()) {
+            name = _name;
+            start = now();
+        }
+    }
+
+    ~Zone() {
+        if (name != nullptr) {
+            recordZone(name, start, now());
+        }
+    }
+
+    Zone(const Zone &) = delete;
+    Zone & operator=(const Zone &) = delete;
+};
+}
+}
+
+#define D2_TRACE_CONCAT_INNER(a, b) a##b
+#define D2_TRACE_CONCAT(a, b) D2_TRACE_CONCAT_INNER(a, b)
+
+#ifndef D2_DISABLE_TRACING
+#define D2_TRACE_ZONE(name) D2Common::Tracing::Zone D2_TRACE_CONCAT(_d2_trace_zone_, __LINE__)(name)
+#define D2_TRACE_COUNTER(name, value) do { if (D2Common::Tracing::enabled()) { \
+    D2Common::Tracing::recordCounter(name, value); } } while (0)
+#define D2_TRACE_VALUE(name, value) do { if (D2Common::Tracing::enabled()) { \
+    D2Common::Tracing::recordValue(name, value); } } while (0)
+#define D2_TRACE_THREAD(name) D2Common::Tracing::setThreadName(name)
+#else
+#define D2_TRACE_ZONE(name) do {} while (0)
+#define D2_TRACE_COUNTER(name, value) do {} while (0)
+#define D2_TRACE_VALUE(name, value) do {} while (0)
+#define D2_TRACE_THREAD(name) do {} while (0)
+#endif
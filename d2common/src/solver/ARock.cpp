@@ -1,4 +1,5 @@
 #include <d2common/solver/ARock.hpp>
+#include <d2common/tracing.hpp>
 #include <d2common/solver/consenus_factor.h>
 #include <d2common/solver/consenus_factor_4d.h>
 #include <ceres/normal_prior.h>
@@ -119,6 +120,7 @@ void ARockBase::createDualState(const ParamInfo & param_info, int drone_id, bool
 SolverReport ARockBase::solve_arock() {
     // ROS_INFO("ARockBase::solve");
     SolverReport report;
+    D2_TRACE_ZONE("ARockBase::solve_arock");
     Utility::TicToc tic;
     int iter_cnt = 0;
     int total_cnt = 0;
@@ -1,4 +1,5 @@
 #include <d2common/solver/ConsensusSolver.hpp>
+#include <d2common/tracing.hpp>
 #include <ceres/normal_prior.h>
 #include <d2common/solver/consenus_factor.h>
 #include <d2common/solver/BaseParamResInfo.hpp>
@@ -35,6 +36,7 @@ void ConsensusSolver::addParam(const ParamInfo & param_info) {
 
 SolverReport ConsensusSolver::solve() {
     SolverReport report;
+    D2_TRACE_ZONE("ConsensusSolver::solve");
     Utility::TicToc tic;
     iteration_count = 0;
     for (int i = 0; i < config.max_steps; i++) {
@@ -71,6 +73,7 @@ SolverReport ConsensusSolver::solve() {
 void ConsensusSolver::syncData() {
     broadcastData();
     if (config.sync_for_averaging) {
+        D2_TRACE_ZONE("ConsensusSolver::waitForSync");
         Utility::TicToc tic_sync;
         waitForSync(); 
         // printf("ConsensusSolver wait for sync time: %.1fms step %d/%d\n", tic_sync.toc(), i, config.max_steps);
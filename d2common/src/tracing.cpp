@@ -0,0 +1,374 @@
+#include <d2common/tracing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+namespace D2Common {
+namespace Tracing {
+std::atomic<bool> enabled_flag{false};
+
+namespace {
+enum EventType {
+    ZONE_EVENT,
+    COUNTER_EVENT
+};
+
+enum StatKind {
+    ZONE_STAT,
+    COUNTER_STAT,
+    VALUE_STAT
+};
+
+struct Event {
+    const char * name;
+    int64_t start;
+    int64_t duration;
+    double value;
+    EventType type;
+};
+
+// Four buckets per octave from 1e-3, so that a percentile is within 19% of the recorded values
+struct Histogram {
+    static constexpr int BUCKETS = 128;
+    static constexpr double MIN_VALUE = 1e-3;
+    uint64_t count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    uint32_t buckets[BUCKETS] = {0};
+
+    static int bucket(double value) {
+        if (!(value >= MIN_VALUE)) {
+            return 0;
+        }
+        return std::min(BUCKETS - 1, 1 + (int) (4 * std::log2(value / MIN_VALUE)));
+    }
+
+    void add(double value) {
+        count ++;
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        buckets[bucket(value)] ++;
+    }
+
+    void merge(const Histogram & other) {
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        for (int i = 0; i < BUCKETS; i++) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    // Upper bound of the bucket holding the percentile, clamped to the recorded range
+    double percentile(double p) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t target = std::max((uint64_t) 1, (uint64_t) std::ceil(p * count));
+        uint64_t cumulative = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            cumulative += buckets[i];
+            if (cumulative >= target) {
+                double upper = i == 0 ? MIN_VALUE : MIN_VALUE * std::pow(2.0, i / 4.0);
+                return std::max(min, std::min(max, upper));
+            }
+        }
+        return max;
+    }
+};
+
+struct Stat {
+    StatKind kind;
+    Histogram histogram;
+};
+
+// Written by its thread only, the lock is contended only by the summary and the export
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<Event> events;
+    uint64_t head = 0; // Events written since the start, the ring position is head % size
+    uint64_t overwritten = 0; // Since the last summary
+    int tid = 0;
+    std::string name;
+    std::unordered_map<const char *, Stat> stats;
+
+    void push(const Event & event) {
+        if (events.empty()) {
+            return;
+        }
+        if (head >= events.size()) {
+            overwritten ++;
+        }
+        events[head % events.size()] = event;
+        head ++;
+    }
+
+    void addStat(const char * _name, StatKind kind, double value) {
+        auto it = stats.find(_name);
+        if (it == stats.end()) {
+            it = stats.emplace(_name, Stat{kind, Histogram()}).first;
+        }
+        it->second.histogram.add(value);
+    }
+};
+
+struct Registry {
+    std::mutex mutex;
+    TracingConfig config;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    int64_t epoch = 0;
+    int64_t last_summary = 0;
+    std::thread summary_thread;
+    std::condition_variable summary_cond;
+    bool stop_summary = false;
+
+    ~Registry() {
+        stopSummary();
+    }
+
+    void stopSummary() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop_summary = true;
+        }
+        summary_cond.notify_all();
+        if (summary_thread.joinable()) {
+            summary_thread.join();
+        }
+    }
+};
+
+Registry & registry() {
+    static Registry reg;
+    return reg;
+}
+
+thread_local std::shared_ptr<ThreadBuffer> local_buffer;
+thread_local std::string local_thread_name;
+
+ThreadBuffer & localBuffer() {
+    if (local_buffer == nullptr) {
+        auto & reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        local_buffer = std::make_shared<ThreadBuffer>();
+        local_buffer->events.resize(std::max(reg.config.buffer_size, 0));
+        local_buffer->tid = reg.buffers.size() + 1;
+        local_buffer->name = local_thread_name.empty() ? "thread " + std::to_string(local_buffer->tid) : local_thread_name;
+        reg.buffers.emplace_back(local_buffer);
+    }
+    return *local_buffer;
+}
+
+std::string escapeJson(const std::string & str) {
+    std::string ret;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if ((unsigned char) c < 0x20) {
+            ret += ' ';
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+void printSummary() {
+    auto str = summary();
+    if (!str.empty()) {
+        printf("%s", str.c_str());
+    }
+}
+
+void summaryThread(double interval) {
+    auto & reg = registry();
+    std::unique_lock<std::mutex> lock(reg.mutex);
+    while (!reg.stop_summary) {
+        reg.summary_cond.wait_for(lock, std::chrono::duration<double>(interval));
+        if (reg.stop_summary) {
+            break;
+        }
+        lock.unlock();
+        printSummary();
+        lock.lock();
+    }
+}
+}
+
+void init(const TracingConfig & config) {
+    auto & reg = registry();
+    if (!config.enable) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (enabled()) {
+            printf("[Tracing] Already enabled, ignore the new configuration\n");
+            return;
+        }
+        reg.config = config;
+        reg.epoch = now();
+        reg.last_summary = reg.epoch;
+        reg.stop_summary = false;
+        for (auto & buffer : reg.buffers) {
+            std::lock_guard<std::mutex> buf_lock(buffer->mutex);
+            buffer->events.resize(std::max(config.buffer_size, 0));
+            buffer->head = 0;
+            buffer->overwritten = 0;
+        }
+    }
+    enabled_flag.store(true, std::memory_order_release);
+    if (config.summary_interval > 0) {
+        reg.summary_thread = std::thread(summaryThread, config.summary_interval);
+    }
+    printf("[Tracing] Enabled, %d events per thread, output %s\n", config.buffer_size,
+        config.output.empty() ? "none" : config.output.c_str());
+}
+
+void shutdown() {
+    if (!enabled()) {
+        return;
+    }
+    auto & reg = registry();
+    reg.stopSummary();
+    enabled_flag.store(false, std::memory_order_release);
+    printSummary();
+    if (!reg.config.output.empty()) {
+        writeChromeTrace(reg.config.output);
+    }
+}
+
+void setThreadName(const char * name) {
+    local_thread_name = name;
+    if (local_buffer != nullptr) {
+        std::lock_guard<std::mutex> lock(local_buffer->mutex);
+        local_buffer->name = name;
+    }
+}
+
+void recordZone(const char * name, int64_t start, int64_t end) {
+    auto & buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.push(Event{name, start, end - start, 0.0, ZONE_EVENT});
+    buffer.addStat(name, ZONE_STAT, (end - start) / 1e6);
+}
+
+void recordCounter(const char * name, double value) {
+    auto & buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.push(Event{name, now(), 0, value, COUNTER_EVENT});
+    buffer.addStat(name, COUNTER_STAT, value);
+}
+
+void recordValue(const char * name, double value) {
+    auto & buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.addStat(name, VALUE_STAT, value);
+}
+
+bool writeChromeTrace(const std::string & path) {
+    auto & reg = registry();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    int64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffers = reg.buffers;
+        epoch = reg.epoch;
+    }
+    FILE * f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        printf("[Tracing] Failed to open %s\n", path.c_str());
+        return false;
+    }
+    int pid = getpid();
+    size_t event_num = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"d2slam\"}}", pid);
+    for (auto & buffer : buffers) {
+        std::vector<Event> events;
+        std::string name;
+        int tid;
+        {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            uint64_t num = std::min((uint64_t) buffer->events.size(), buffer->head);
+            for (uint64_t i = buffer->head - num; i < buffer->head; i++) {
+                events.emplace_back(buffer->events[i % buffer->events.size()]);
+            }
+            name = buffer->name;
+            tid = buffer->tid;
+        }
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            pid, tid, escapeJson(name).c_str());
+        for (auto & event : events) {
+            double ts = (event.start - epoch) / 1e3;
+            if (event.type == ZONE_EVENT) {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    escapeJson(event.name).c_str(), ts, event.duration / 1e3, pid, tid);
+            } else {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%g}}",
+                    escapeJson(event.name).c_str(), ts, pid, tid, event.value);
+            }
+        }
+        event_num += events.size();
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("[Tracing] Wrote %ld events of %ld threads to %s\n", event_num, buffers.size(), path.c_str());
+    return true;
+}
+
+std::string summary() {
+    auto & reg = registry();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    double duration;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffers = reg.buffers;
+        int64_t t = now();
+        duration = (t - reg.last_summary) / 1e9;
+        reg.last_summary = t;
+    }
+    // Merged over the threads by name, sorted for a stable layout
+    std::map<std::pair<int, std::string>, Histogram> merged;
+    uint64_t overwritten = 0;
+    for (auto & buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        for (auto & it : buffer->stats) {
+            merged[std::make_pair((int) it.second.kind, std::string(it.first))].merge(it.second.histogram);
+        }
+        buffer->stats.clear();
+        overwritten += buffer->overwritten;
+        buffer->overwritten = 0;
+    }
+    if (merged.empty()) {
+        return "";
+    }
+    static const char * kind_names[] = {"zone", "counter", "value"};
+    char buf[256];
+    snprintf(buf, sizeof(buf), "[Tracing] Summary of the last %.1fs, %ld events overwritten\n", duration, overwritten);
+    std::string ret = buf;
+    for (auto & it : merged) {
+        auto & hist = it.second;
+        const char * unit = it.first.first == ZONE_STAT ? "ms" : "";
+        snprintf(buf, sizeof(buf), "[Tracing] %-7s %-36s n %6ld mean %9.3f%s p50 %9.3f p90 %9.3f p99 %9.3f max %9.3f\n",
+            kind_names[it.first.first], it.first.second.c_str(), hist.count, hist.sum / hist.count, unit,
+            hist.percentile(0.5), hist.percentile(0.9), hist.percentile(0.99), hist.max);
+        ret += buf;
+    }
+    return ret;
+}
+}
+}
@@ -46,18 +46,10 @@ public:
     }
 
     std::vector<float> inference(const cv::Mat & input) {
+        D2_TRACE_ZONE("MobileNetVLADONNX::inference");
         TicToc tic;
-        cv::Mat _input;
-        if (input.channels() == 3) {
-            cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
-        } else {
-            _input = input;
-        }
-        if (_input.rows != height || _input.cols != width) {
-            cv::resize(_input, _input, cv::Size(width, height));
-        } 
-        _input.convertTo(_input, CV_32F); // DO NOT SCALING HERE
-        doInference(_input.data, 1);
+        setInput(input, 1.0); // DO NOT SCALING HERE
+        run();
         if (params->enable_perf_output) {
             printf("MobileNetVLADONNX::inference() took %f ms\n", tic.toc());
         }
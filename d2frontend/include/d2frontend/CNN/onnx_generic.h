@@ -1,7 +1,14 @@
 #pragma once
 #include "CNN_generic.h"
 #include <onnxruntime_cxx_api.h>
+#include <algorithm>
 namespace D2FrontEnd {
+// False with a CPU only build of onnxruntime, where appending the CUDA provider throws
+inline bool onnxCUDAAvailable() {
+    auto providers = Ort::GetAvailableProviders();
+    return std::find(providers.begin(), providers.end(), "CUDAExecutionProvider") != providers.end();
+}
+
 class ONNXInferenceGeneric: public CNNInferenceGeneric {
 protected:
     Ort::Value input_tensor_{nullptr};
@@ -10,6 +17,7 @@ protected:
     Ort::Session * session_ = nullptr;
     std::string output_name;
     float * input_image = nullptr;
+    cv::Mat resized_input;
     char engine_folder [256] = {0};
     char int8_calib_table_name_c [256] = {0};
 public:
@@ -20,9 +28,29 @@ public:
     }
 
     virtual void doInference(const unsigned char* input, const uint32_t batchSize) override {
+        memcpy(input_image, input, width*height*sizeof(float));
+        run();
+    }
+
+    // Convert a 8-bit image straight into the input tensor (scaled by scale), without an
+    // intermediate float image. Only a BGR input or a size mismatch needs an extra buffer.
+    void setInput(const cv::Mat & input, double scale) {
+        cv::Mat gray = input;
+        if (input.channels() == 3) {
+            cv::cvtColor(input, gray, cv::COLOR_BGR2GRAY);
+        }
+        if (gray.rows != height || gray.cols != width) {
+            cv::resize(gray, resized_input, cv::Size(width, height));
+            gray = resized_input;
+        }
+        cv::Mat tensor(height, width, CV_32F, input_image);
+        gray.convertTo(tensor, CV_32F, scale);
+    }
+
+    // Run the network on the current content of the input tensor
+    virtual void run() {
         const char* input_names[] = {m_InputBlobName.c_str()};
         const char* output_names[] = {output_name.c_str()};
-        memcpy(input_image, input, width*height*sizeof(float));
         session_->Run(Ort::RunOptions{nullptr}, input_names, &input_tensor_, 1, output_names, &output_tensor_, 1);
     }
 
@@ -31,6 +59,11 @@ public:
         session_options.SetIntraOpNumThreads(1);
         session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
 
+        if (!onnxCUDAAvailable()) {
+            printf("ONNX runtime has no CUDA provider, inference of %s runs on the CPU\n", engine_path.c_str());
+            session_ = new Ort::Session(env, engine_path.c_str(), session_options);
+            return;
+        }
         if (onnx_with_tensorrt) {
             int pn = engine_path.find_last_of('/');
             std::string configPath = engine_path.substr(0, pn);
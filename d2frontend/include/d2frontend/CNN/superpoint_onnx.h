@@ -24,6 +24,6 @@ public:
 
     
     void inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors, std::vector<float> & scores);
-    void doInference(const unsigned char* input, const uint32_t batchSize) override;
+    void run() override;
 };
 }
\ No newline at end of file
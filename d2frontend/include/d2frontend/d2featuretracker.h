@@ -99,8 +99,10 @@ protected:
     LandmarkManager * lmanager = nullptr;
     int keyframe_count = 0;
     int frame_count = 0;
+    double keyframe_thres_scale = 1.0; //Set by the estimator to take fewer keyframes under its compute budget
     bool inited = false;
     std::map<int, LKImageInfo> prev_lk_info; //frame.camera_index->image
+    std::set<LandmarkIdType> rejected_landmarks; //Outliers of the estimator, not tracked further
     std::pair<bool, LandmarkPerFrame> createLKLandmark(const VisualImageDesc & frame, cv::Point2f pt, LandmarkIdType landmark_id = -1);
     std::recursive_mutex track_lock;
     std::recursive_mutex keyframe_lock;
@@ -141,6 +143,7 @@ public:
     bool trackRemoteFrames(VisualImageDescArray & frames);
     void updatebySldWin(const std::vector<VINSFrame*> sld_win);
     void updatebyLandmarkDB(const std::map<LandmarkIdType, LandmarkPerId> & vins_landmark_db);
+    void setKeyframeThresScale(double scale);
     std::vector<camodocal::CameraPtr> cams;
 };
 
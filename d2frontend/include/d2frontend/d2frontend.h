@@ -89,6 +89,8 @@ public:
     
 protected:
     virtual void Init(ros::NodeHandle & nh);
+    // Camera, feature tracker and loop detector from params, without ROS nor network
+    void initLocalModules();
 };
 
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <ros/ros.h>
 #include <swarm_msgs/Pose.h>
 #include <d2common/d2basetypes.h>
+#include <d2common/param_handle.hpp>
+#include <d2common/tracing.hpp>
 
 #define ACCEPT_LOOP_YAW (30) //ACCEPT MAX Yaw 
 
@@ -91,6 +93,7 @@ struct D2FrontendParams {
     bool verbose = false;
     bool print_network_status = false;
     bool lazy_broadcast_keyframe = true;
+    D2Common::Tracing::TracingConfig tracing;
 
     bool is_comp_images;
     std::vector<std::string> image_topics, depth_topics;
@@ -100,6 +103,9 @@ struct D2FrontendParams {
     int width_undistort = 800;
     int height_undistort = 400;
     bool enable_undistort_image; //Undistort image before feature detection
+    bool enable_cuda = true; //Undistortion, LK optical flow and CNNs on the GPU, cleared if OpenCV finds no CUDA device
+    bool enable_camera_lut = false; //Lift and project with lookup tables of the camera models
+    double camera_lut_max_error = 0.01; //Max interpolation error of the lookup tables in pixels
     double focal_length = 460.0;
     std::vector<Swarm::Pose> extrinsics;
     std::vector<cv::Mat> cam_Ks;
@@ -112,12 +118,16 @@ struct D2FrontendParams {
     std::vector<int> camera_seq;
 
     bool show_raw_image = false;
+    //Image retention, only relevant with show: otherwise raw images are dropped once tracked
+    bool keyframe_thumbnail = true; //Keyframes in the loop database keep a jpeg thumbnail instead of the raw images
+    double keyframe_thumbnail_scale = 0.5;
+    int max_loop_viz_frames = 100; //Latest frames whose images are cached for drawing the loops
     //Configs of submodules
     LoopCamConfig * loopcamconfig;
     LoopDetectorConfig * loopdetectorconfig;
     D2FTConfig * ftconfig;
 
-    D2FrontendParams(ros::NodeHandle &);
+    D2FrontendParams(const D2Common::ParamHandle & nh);
     D2FrontendParams() {}
     void readCameraCalibrationfromFile(const std::string & path);
     void generateCameraModels(cv::FileStorage & fsSettings, std::string config_path);
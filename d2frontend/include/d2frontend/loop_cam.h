@@ -2,6 +2,7 @@
 
 #include <ros/ros.h>
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/cuda.hpp>
 #include <functional>
 #include "d2frontend_params.h"
 #include "CNN/onnx_generic.h"
@@ -11,6 +12,7 @@
 #include <message_filters/time_synchronizer.h>
 #include <d2frontend/utils.h>
 #include "d2common/d2frontend_types.h"
+#include "d2common/image_pool.hpp"
 #include <fstream>
 
 //#include <swarm_loop/HFNetSrv.h>
@@ -71,9 +73,19 @@ class LoopCam {
     std::vector<FisheyeUndist*> undistortors;
     MobileNetVLADONNX * netvlad_onnx = nullptr;
     SuperPointONNX * superpoint_onnx = nullptr;
+    // Per virtual camera: GPU buffers of the undistortion and the pool of host images it is
+    // downloaded to. A host image is reused once no frame references it any more.
+    std::vector<cv::cuda::GpuMat> undist_gpu_input, undist_gpu_output;
+    std::vector<ImagePool> undist_pools;
 public:
+    // Image copies and allocations made for the current frame, reported with the perf output
+    struct ImageBufferStats {
+        int copies = 0;
+        int allocations = 0;
+    } image_stats;
     // LoopDetector * loop_detector = nullptr;
     LoopCam(LoopCamConfig config, ros::NodeHandle & nh);
+    LoopCam(LoopCamConfig config);
     
     VisualImageDesc extractorImgDescDeepnet(ros::Time stamp, cv::Mat img, int index, int camera_id, bool superpoint_mode=false);
     std::vector<VisualImageDesc> generateStereoImageDescriptor(const StereoFrame & msg, int i, cv::Mat &_show);
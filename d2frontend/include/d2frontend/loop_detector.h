@@ -9,6 +9,7 @@
 #include <faiss/IndexFlat.h>
 #include <swarm_msgs/drone_trajectory.hpp>
 #include <mutex>
+#include <deque>
 
 using namespace swarm_msgs;
 #define REMOTE_MAGIN_NUMBER 1000000
@@ -77,7 +78,10 @@ protected:
     std::map<int64_t, VisualImageDescArray> keyframe_database;
     std::mutex keyframe_database_mutex;
 
+    size_t database_image_bytes = 0;
+
     std::map<int64_t, std::vector<cv::Mat>> msgid2cvimgs;
+    std::deque<int64_t> cvimgs_order; //Insertion order of msgid2cvimgs, bounded by max_loop_viz_frames
     
     double t0 = -1;
     int loop_count = 0;
@@ -89,12 +93,14 @@ protected:
 
     bool computeCorrespondFeatures(const VisualImageDesc & new_img_desc, const VisualImageDesc & old_img_desc, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &idx_b, 
-            std::vector<int> &cam_indices);
+            std::vector<int> &cam_indices, std::vector<double> &scores);
 
+    //scores: confidence of the matches for the guided PnP RANSAC, higher is better
     bool computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
             const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
             std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> & cam_indices,
-            std::vector<std::pair<int, int>> &index2dirindex_a, std::vector<std::pair<int, int>> &index2dirindex_b);
+            std::vector<std::pair<int, int>> &index2dirindex_a, std::vector<std::pair<int, int>> &index2dirindex_b,
+            std::vector<double> &scores);
 
     int addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss = true);
     int addImageDescToDatabase(VisualImageDesc & new_img_desc);
@@ -115,6 +121,8 @@ public:
     void onLoopConnection(LoopEdge & loop_conn);
     LoopCam * loop_cam = nullptr;
     cv::Mat decode_image(const VisualImageDesc & _img_desc);
+    std::vector<cv::Mat> visualizationImages(const VisualImageDescArray & image_array);
+    void cacheVisualizationImages(const VisualImageDescArray & image_array);
     void updatebyLandmarkDB(const std::map<LandmarkIdType, LandmarkPerId> & vins_landmark_db);
     void updatebySldWin(const std::vector<VINSFrame*> sld_win);
     bool hasFrame(FrameIdType frame_id);
@@ -52,13 +52,23 @@ std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b,
         const std::vector<cv::Point2f> pts_b=std::vector<cv::Point2f>(),
         double search_local_dist = -1);
     
+struct PnPRansacReport {
+    bool succ = false;
+    int iterations = 0; //Minimal samples drawn
+    int models = 0; //Solutions of the minimal solver
+    int verified = 0; //Solutions passing the preemptive test, verified on all the points
+    double time = 0; //ms
+};
+
+//scores: confidence of each match, higher first. Empty samples uniformly.
 int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std::vector<Vector3d> lm_3d_norm_b,
         Swarm::Pose extrinsic_b, Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
-        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true, const std::vector<double> & scores=std::vector<double>());
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers);
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<double> & scores=std::vector<double>(), int max_iterations=50, PnPRansacReport * report=nullptr);
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
-        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true, const std::vector<double> & scores=std::vector<double>());
 }
\ No newline at end of file
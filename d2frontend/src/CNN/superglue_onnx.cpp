@@ -1,5 +1,6 @@
 #include <d2frontend/CNN/superglue_onnx.h>
 #include <d2frontend/CNN/superpoint_common.h>
+#include <d2frontend/CNN/onnx_generic.h>
 
 namespace D2FrontEnd {
 std::vector<float> flatten(const std::vector<cv::Point2f> & vec) {
@@ -19,13 +20,15 @@ void SuperGlueOnnx::init(const std::string & engine_path) {
     Ort::SessionOptions session_options;
     session_options.SetIntraOpNumThreads(1);
     session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
-    OrtCUDAProviderOptions options;
-    options.device_id = 0;
-    options.arena_extend_strategy = 0;
-    options.gpu_mem_limit = 1 * 1024 * 1024 * 1024;
-    options.cudnn_conv_algo_search = OrtCudnnConvAlgoSearch::OrtCudnnConvAlgoSearchExhaustive;
-    options.do_copy_in_default_stream = 1;
-    session_options.AppendExecutionProvider_CUDA(options);
+    if (onnxCUDAAvailable()) {
+        OrtCUDAProviderOptions options;
+        options.device_id = 0;
+        options.arena_extend_strategy = 0;
+        options.gpu_mem_limit = 1 * 1024 * 1024 * 1024;
+        options.cudnn_conv_algo_search = OrtCudnnConvAlgoSearch::OrtCudnnConvAlgoSearchExhaustive;
+        options.do_copy_in_default_stream = 1;
+        session_options.AppendExecutionProvider_CUDA(options);
+    }
     printf("[SuperGlueOnnx] Loading superglue from %s...\n", engine_path.c_str());
     session_ = new Ort::Session(env, engine_path.c_str(), session_options);
     memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
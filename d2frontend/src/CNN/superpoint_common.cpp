@@ -9,6 +9,7 @@ void NMS2(std::vector<cv::Point2f> det, cv::Mat conf, std::vector<cv::Point2f>&
         int border, int dist_thresh, int img_width, int img_height, int max_num);
 void getKeyPoints(const cv::Mat & prob, float threshold, int nms_dist, std::vector<cv::Point2f> &keypoints, std::vector<float>& scores, int width, int height, int max_num)
 {
+    D2_TRACE_ZONE("getKeyPoints");
     TicToc getkps;
     auto mask = (prob > threshold);
     std::vector<cv::Point> kps;
@@ -38,6 +39,7 @@ void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & mDesc
         const std::vector<cv::Point2f> &keypoints, 
         std::vector<float> & local_descriptors, int width, int height, 
         const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean) {
+    D2_TRACE_ZONE("computeDescriptors");
     TicToc tic;
     cv::Mat kpt_mat(keypoints.size(), 2, CV_32F);  // [n_keypoints, 2]  (y, x)
     for (size_t i = 0; i < keypoints.size(); i++) {
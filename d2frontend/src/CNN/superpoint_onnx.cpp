@@ -45,29 +45,20 @@ SuperPointONNX::SuperPointONNX(std::string engine_path,
     }
 }
 
-void SuperPointONNX::doInference(const unsigned char* input, const uint32_t batchSize) {
+void SuperPointONNX::run() {
     const char* input_names[] = {m_InputBlobName.c_str()};
     const char* output_names_[] = {"semi", "desc"};
-    memcpy(input_image, input, width*height*sizeof(float));
     session_->Run(Ort::RunOptions{nullptr}, input_names, &input_tensor_, 1, output_names_, output_tensors_.data(), 2);
 }
 
 void SuperPointONNX::inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors, std::vector<float> & scores) {
+    D2_TRACE_ZONE("SuperPointONNX::inference");
     TicToc tic;
-    cv::Mat _input;
     keypoints.clear();
     local_descriptors.clear();
     assert(input.rows == height && input.cols == width && "Input image must have same size with network");
-    if (input.channels() == 3) {
-        cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
-    } else {
-        _input = input;
-    }
-    if (_input.rows != height || _input.cols != width) {
-        cv::resize(_input, _input, cv::Size(width, height));
-    } 
-    _input.convertTo(_input, CV_32F, 1/255.0);
-    ((CNNInferenceGeneric*) this)->doInference(_input);
+    setInput(input, 1/255.0);
+    run();
     double inference_time = tic.toc();
 
     TicToc tic1;
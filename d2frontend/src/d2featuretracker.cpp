@@ -62,8 +62,8 @@ void D2FeatureTracker::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
 void D2FeatureTracker::updatebyLandmarkDB(const std::map<LandmarkIdType, LandmarkPerId> & vins_landmark_db) {
     //update by sliding window
     const Guard guard2(lmanager_lock);
+    auto & db = lmanager->getLandmarkDB();
     if (_config.enable_motion_prediction_local || _config.enable_search_local_aera_remote) {
-        auto & db = lmanager->getLandmarkDB();
         for (auto & kv : vins_landmark_db) {
             if (db.find(kv.first) != db.end()) {
                 auto & lm = lmanager->at(kv.first);
@@ -72,6 +72,19 @@ void D2FeatureTracker::updatebyLandmarkDB(const std::map<LandmarkIdType, Landmar
             }
         }
     }
+    //Tracks rejected by the estimator are not propagated, the features are detected again as new landmarks
+    for (auto it = rejected_landmarks.begin(); it != rejected_landmarks.end();) {
+        if (db.find(*it) == db.end()) {
+            it = rejected_landmarks.erase(it);
+        } else {
+            it++;
+        }
+    }
+    for (auto & kv : vins_landmark_db) {
+        if (kv.second.flag == LandmarkFlag::OUTLIER && db.find(kv.first) != db.end()) {
+            rejected_landmarks.insert(kv.first);
+        }
+    }
 }
 
 bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
@@ -83,6 +96,7 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
     TrackReport report;
     landmark_predictions_viz.clear();
     frames.send_to_backend = (frame_count % _config.frame_step) == 0;
+    D2_TRACE_ZONE("D2FeatureTracker::trackLocalFrames");
     TicToc tic;
     if (!inited) {
         inited = true;
@@ -196,6 +210,7 @@ bool D2FeatureTracker::trackRemoteFrames(VisualImageDescArray & frames) {
     landmark_predictions_viz.clear();
     frame_count ++;
     TrackReport report;
+    D2_TRACE_ZONE("D2FeatureTracker::trackRemoteFrames");
     TicToc tic;
     int dir_cur = 0, dir_prev = 0;
     VisualImageDescArray prev;
@@ -341,6 +356,9 @@ TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose &
                 assert(ids_b_to_a[i] < previous.spLandmarkNum() && "too large");
                 auto prev_index = ids_b_to_a[i];
                 auto landmark_id = previous.landmarks[prev_index].landmark_id;
+                if (rejected_landmarks.find(landmark_id) != rejected_landmarks.end()) {
+                    continue;
+                }
                 auto &cur_lm = frame.landmarks[i];
                 auto &prev_lm = previous.landmarks[prev_index];
                 cur_lm.landmark_id = landmark_id;
@@ -375,15 +393,34 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
     TrackReport report;
     if (prev_lk_info.find(frame.camera_index) == prev_lk_info.end()) {
         prev_lk_info[frame.camera_index] = LKImageInfo();
-        cv::cuda::GpuMat image_cuda(frame.raw_image);
-        prev_lk_info[frame.camera_index].pyr = buildImagePyramid(image_cuda);
+        if (params->enable_cuda) {
+            cv::cuda::GpuMat image_cuda(frame.raw_image);
+            prev_lk_info[frame.camera_index].pyr = buildImagePyramid(image_cuda);
+        }
     }
     auto cur_lk_pts = prev_lk_info[frame.camera_index].lk_pts;
     auto cur_lk_ids = prev_lk_info[frame.camera_index].lk_ids;
+    if (!rejected_landmarks.empty()) {
+        int j = 0;
+        for (int i = 0; i < cur_lk_ids.size(); i++) {
+            if (rejected_landmarks.find(cur_lk_ids[i]) == rejected_landmarks.end()) {
+                cur_lk_pts[j] = cur_lk_pts[i];
+                cur_lk_ids[j] = cur_lk_ids[i];
+                j++;
+            }
+        }
+        cur_lk_pts.resize(j);
+        cur_lk_ids.resize(j);
+    }
     if (!cur_lk_ids.empty()) {
         int prev_lk_num = cur_lk_ids.size();
-        cur_lk_pts = opticalflowTrackPyr(frame.raw_image, prev_lk_info[frame.camera_index].pyr, cur_lk_pts, cur_lk_ids, 
-            TrackLRType::WHOLE_IMG_MATCH, true);
+        if (params->enable_cuda) {
+            cur_lk_pts = opticalflowTrackPyr(frame.raw_image, prev_lk_info[frame.camera_index].pyr, cur_lk_pts, cur_lk_ids, 
+                TrackLRType::WHOLE_IMG_MATCH, true);
+        } else {
+            cur_lk_pts = opticalflowTrack(frame.raw_image, prev_lk_info[frame.camera_index].image, cur_lk_pts, cur_lk_ids, 
+                TrackLRType::WHOLE_IMG_MATCH, false);
+        }
         if (params->verbose) {
             printf("[D2FeatureTracker::trackLK] track %d LK points, %d lost, track rate %.1f%%\n", 
                 prev_lk_num, prev_lk_num - cur_lk_pts.size(), cur_lk_pts.size() * 100.0 / prev_lk_num);
@@ -417,8 +454,9 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
     //Discover new points.
     std::vector<cv::Point2f> n_pts;
     if (!frame.raw_image.empty()) {
+        D2_TRACE_ZONE("D2FeatureTracker::detectPoints");
         TicToc t_det;
-        detectPoints(frame.raw_image, n_pts, cur_all_pts, params->total_feature_num, true, _config.lk_use_fast);
+        detectPoints(frame.raw_image, n_pts, cur_all_pts, params->total_feature_num, params->enable_cuda, _config.lk_use_fast);
         if (params->enable_perf_output) {
             printf("[D2FeatureTracker::trackLK] detect %ld points in %.2fms\n", n_pts.size(), t_det.toc());
         }
@@ -440,7 +478,8 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
     }
     prev_lk_info[frame.camera_index].lk_pts = cur_lk_pts;
     prev_lk_info[frame.camera_index].lk_ids = cur_lk_ids;
-    prev_lk_info[frame.camera_index].image  = frame.raw_image.clone();
+    // Frames never write to their raw image, so keeping a reference is enough
+    prev_lk_info[frame.camera_index].image  = frame.raw_image;
     prev_lk_info[frame.camera_index].frame_id = frame.frame_id;
     return report;
 }
@@ -518,8 +557,11 @@ TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, Visual
     auto cur_lk_ids = prev_lk_info[left_frame.camera_index].lk_ids;
     auto cur_lk_pyr = prev_lk_info[left_frame.camera_index].pyr;
     assert(left_frame.frame_id == prev_lk_info[left_frame.camera_index].frame_id);
-    if (!cur_lk_ids.empty()) {
+    if (!cur_lk_ids.empty() && params->enable_cuda) {
         cur_lk_pts = opticalflowTrackPyr(right_frame.raw_image, cur_lk_pyr, cur_lk_pts, cur_lk_ids, type, false);
+    } else if (!cur_lk_ids.empty()) {
+        cur_lk_pts = opticalflowTrack(right_frame.raw_image, prev_lk_info[left_frame.camera_index].image, cur_lk_pts, 
+            cur_lk_ids, type, false);
     }
     // printf("[trackLK] indices %d<->%d track type %d LK points: %lu\n", left_frame.camera_index, right_frame.camera_index, type, cur_lk_pts.size());
     for (int i = 0; i < cur_lk_pts.size(); i++) {
@@ -537,6 +579,11 @@ TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, Visual
     return report;
 }
 
+void D2FeatureTracker::setKeyframeThresScale(double scale) {
+    const Guard lock(keyframe_lock);
+    keyframe_thres_scale = scale;
+}
+
 bool D2FeatureTracker::isKeyframe(const TrackReport & report) {
     int prev_num = current_keyframes.size() > 0 ? current_keyframes.back().landmarkNum(): 0;
     if (report.meanParallex() > 0.5) {
@@ -545,8 +592,8 @@ bool D2FeatureTracker::isKeyframe(const TrackReport & report) {
     if (keyframe_count < _config.min_keyframe_num || 
         report.long_track_num < _config.long_track_thres ||
         prev_num < _config.last_track_thres ||
-        report.unmatched_num > _config.new_feature_thres*prev_num || //Unmatched is assumed to be new
-        report.meanParallex() > _config.parallex_thres) { //Attenion, if mismatch this will be big
+        report.unmatched_num > _config.new_feature_thres*keyframe_thres_scale*prev_num || //Unmatched is assumed to be new
+        report.meanParallex() > _config.parallex_thres*keyframe_thres_scale) { //Attenion, if mismatch this will be big
         if (params->verbose) {
             printf("[D2FeatureTracker] keyframe_count: %d, long_track_num: %d, prev_num:%d, unmatched_num: %d, parallex: %f\n", 
                 keyframe_count, report.long_track_num, prev_num, report.unmatched_num, report.meanParallex());
@@ -800,6 +847,7 @@ std::pair<std::vector<float>, std::vector<cv::Point2f>> getFeatureHalfImg(const
 
 bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, std::vector<int> & ids_b_to_a, 
         const D2FeatureTracker::MatchLocalFeatureParams & param) {
+    D2_TRACE_ZONE("D2FeatureTracker::matchLocalFeatures");
     TicToc tic;
     auto & raw_desc_a = img_desc_a.landmark_descriptor;
     auto & raw_desc_b = img_desc_b.landmark_descriptor;
@@ -12,6 +12,7 @@
 #include <mutex>
 #include <swarm_msgs/node_frame.h>
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 #include <image_transport/image_transport.h>
 
 // #define BACKWARD_HAS_DW 1
@@ -72,16 +73,36 @@ void D2Frontend::depthImagesCallback(const sensor_msgs::ImageConstPtr left, cons
 }
 
 void D2Frontend::monoImageCallback(const sensor_msgs::ImageConstPtr & image) {
-    auto _l = getImageFromMsg(image);
-    auto img = _l->image;
-    //Horizon split image to four images:
+    cv::Mat img;
+    auto & stats = loop_cam->image_stats;
+    if (image->encoding == "8UC1" || image->encoding == "mono8") {
+        // Shares the message buffer. With undistortion the raw image is only read by the upload,
+        // otherwise frames keep it as their raw image and it has to outlive the message.
+        img = cv_bridge::toCvShare(image)->image;
+        if (!params->enable_undistort_image) {
+            img = img.clone();
+            stats.copies ++;
+            stats.allocations ++;
+        }
+    } else if (image->encoding == sensor_msgs::image_encodings::BGR8) {
+        cv::cvtColor(cv_bridge::toCvShare(image)->image, img, cv::COLOR_BGR2GRAY);
+        stats.copies ++;
+        stats.allocations ++;
+    } else {
+        img = getImageFromMsg(image)->image;
+        stats.copies ++;
+        stats.allocations ++;
+        if (img.channels() == 3) {
+            cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
+            stats.copies ++;
+            stats.allocations ++;
+        }
+    }
+    //Horizon split image to four images, as views of the gray image:
     std::vector<cv::Mat> imgs;
     const int num_imgs = 4;
     for (int i = 0; i < 4; i++) {
         imgs.emplace_back(img(cv::Rect(i * img.cols /num_imgs, 0, img.cols /num_imgs, img.rows)));
-        if (imgs.back().channels() == 3) {
-            cv::cvtColor(imgs.back(), imgs.back(), cv::COLOR_BGR2GRAY);
-        }
     }
     if (params->show_raw_image) {
         cv::namedWindow("raw_image", cv::WINDOW_NORMAL | cv::WINDOW_GUI_EXPANDED);
@@ -93,6 +114,7 @@ void D2Frontend::monoImageCallback(const sensor_msgs::ImageConstPtr & image) {
 
 void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
     static int count = 0;
+    D2_TRACE_ZONE("D2Frontend::processStereoframe");
     // ROS_INFO("[D2Frontend::processStereoframe] %d", count ++);
     auto vframearry = loop_cam->processStereoframe(stereoframe);
     vframearry.motion_prediction = getMotionPredict(vframearry.stamp);
@@ -102,6 +124,9 @@ void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
     received_image = true;
     if (!params->show) {
         vframearry.releaseRawImages();
+    } else if (!is_keyframe || !params->enable_loop) {
+        // Once tracked, only the loop detector reads the raw images, for the keyframes
+        vframearry.releaseRawImages(true);
     }
     if (vframearry.send_to_backend) {
         backendFrameCallback(vframearry);
@@ -111,8 +136,8 @@ void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
 void D2Frontend::addToLoopQueue(const VisualImageDescArray & viokf) {
     if (params->enable_loop) {
         lock_guard guard(loop_lock);
-        Utility::TicToc tic;
         loop_queue.push(viokf);
+        D2_TRACE_COUNTER("loop_queue", loop_queue.size());
     }
 }
 
@@ -166,6 +191,7 @@ void D2Frontend::processRemoteImage(VisualImageDescArray & frame_desc, bool succ
 
 
 void D2Frontend::loopDetectionThread() {
+    D2_TRACE_THREAD("loop_detection");
     while (ros::ok()) {
         if (loop_queue.size() > 0) {
             VisualImageDescArray vframearry;
@@ -197,18 +223,23 @@ void D2Frontend::onRemoteFrameROS(const swarm_msgs::ImageArrayDescriptor & remot
 
 D2Frontend::D2Frontend () {}
 
+void D2Frontend::initLocalModules() {
+    loop_cam = new LoopCam(*(params->loopcamconfig));
+    feature_tracker = new D2FeatureTracker(*(params->ftconfig));
+    feature_tracker->cams = loop_cam->cams;
+    loop_detector = new LoopDetector(params->self_id, *(params->loopdetectorconfig));
+    loop_detector->loop_cam = loop_cam;
+}
+
 void D2Frontend::Init(ros::NodeHandle & nh) {
     //Init Loop Net
     params = new D2FrontendParams(nh);
+    D2Common::Tracing::init(params->tracing);
     it_ = new image_transport::ImageTransport(nh);
     cv::setNumThreads(1);
 
     loop_net = new LoopNet(params->_lcm_uri, params->send_img, params->send_whole_img_desc, params->recv_msg_duration);
-    loop_cam = new LoopCam(*(params->loopcamconfig), nh);
-    feature_tracker = new D2FeatureTracker(*(params->ftconfig));
-    feature_tracker->cams = loop_cam->cams;
-    loop_detector = new LoopDetector(params->self_id, *(params->loopdetectorconfig));
-    loop_detector->loop_cam = loop_cam;
+    initLocalModules();
 
     loop_detector->on_loop_cb = [&] (LoopEdge & loop_con) {
         this->onLoopConnection(loop_con, true);
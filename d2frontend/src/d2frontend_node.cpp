@@ -1,4 +1,5 @@
 #include "d2frontend/d2frontend.h"
+#include <d2common/tracing.hpp>
 
 class D2FrontendNode :  public D2FrontEnd::D2Frontend
 {
@@ -19,6 +20,7 @@ int main(int argc, char **argv)
     D2FrontendNode frontend(n);
     ros::MultiThreadedSpinner spinner(3);
     spinner.spin();
+    D2Common::Tracing::shutdown();
     return 0;
 }
 
@@ -4,15 +4,17 @@
 #include "d2frontend/d2featuretracker.h"
 #include "swarm_msgs/swarm_lcm_converter.hpp"
 #include <opencv2/core/eigen.hpp>
+#include <opencv2/core/cuda.hpp>
 #include <yaml-cpp/yaml.h>
 #include <camodocal/camera_models/CataCamera.h>
 #include <camodocal/camera_models/PinholeCamera.h>
+#include <camodocal/camera_models/LUTCamera.h>
 #include <d2common/fisheye_undistort.h>
 
 namespace D2FrontEnd {
     D2FrontendParams * params;
     std::pair<camodocal::CameraPtr, Swarm::Pose> readCameraConfig(const std::string & camera_name, const YAML::Node & config);
-    D2FrontendParams::D2FrontendParams(ros::NodeHandle & nh)
+    D2FrontendParams::D2FrontendParams(const D2Common::ParamHandle & nh)
     {
         //Read VINS params.
         nh.param<std::string>("vins_config_path",vins_config_path, "");
@@ -43,8 +45,36 @@ namespace D2FrontEnd {
         nh.param<bool>("enable_sub_remote_frame", enable_sub_remote_frame, false);
         nh.param<std::string>("output_path", OUTPUT_PATH, "");
         enable_perf_output = (int) fsSettings["enable_perf_output"];
+        if (!fsSettings["keyframe_thumbnail"].empty()) {
+            keyframe_thumbnail = (int) fsSettings["keyframe_thumbnail"];
+        }
+        if (!fsSettings["keyframe_thumbnail_scale"].empty()) {
+            keyframe_thumbnail_scale = fsSettings["keyframe_thumbnail_scale"];
+        }
+        if (!fsSettings["max_loop_viz_frames"].empty()) {
+            max_loop_viz_frames = (int) fsSettings["max_loop_viz_frames"];
+        }
+        if (!fsSettings["enable_tracing"].empty()) {
+            tracing.enable = (int) fsSettings["enable_tracing"];
+        }
+        if (!fsSettings["tracing_output"].empty()) {
+            tracing.output = (std::string) fsSettings["tracing_output"];
+        }
+        if (!fsSettings["tracing_summary_interval"].empty()) {
+            tracing.summary_interval = fsSettings["tracing_summary_interval"];
+        }
+        if (!fsSettings["tracing_buffer_size"].empty()) {
+            tracing.buffer_size = (int) fsSettings["tracing_buffer_size"];
+        }
         print_network_status = (int) fsSettings["print_network_status"];
         verbose = (int) fsSettings["verbose"];
+        if (!fsSettings["enable_cuda"].empty()) {
+            enable_cuda = (int) fsSettings["enable_cuda"];
+        }
+        if (enable_cuda && cv::cuda::getCudaEnabledDeviceCount() == 0) {
+            printf("[D2FrontendParams] No CUDA device available, the frontend runs on the CPU\n");
+            enable_cuda = false;
+        }
 
         //Loopcam configs
         loopcamconfig->superpoint_max_num = (int) fsSettings["max_superpoint_cnt"];
@@ -181,6 +211,14 @@ namespace D2FrontEnd {
                 ROS_ERROR("[D2Frontend]Failed to read camera from %s", cam_calib_path.c_str());
             }
         }
+        if (!fsSettings["undist_map_cache_dir"].empty()) {
+            FisheyeUndist::mapCacheDir() = (std::string) fsSettings["undist_map_cache_dir"];
+        }
+        if (enable_camera_lut) {
+            for (auto & cam: camera_ptrs) {
+                cam = camodocal::CameraPtr(new camodocal::LUTCamera(cam, camera_lut_max_error));
+            }
+        }
         std::string photometric_calib_file = fsSettings["photometric_calib"];
         cv::Mat photometric;
         if ( photometric_calib_file != "") {
@@ -196,7 +234,7 @@ namespace D2FrontEnd {
             raw_camera_ptrs = camera_ptrs;
             camera_ptrs.clear();
             for (auto cam: raw_camera_ptrs) { 
-                auto ptr = new FisheyeUndist(cam, 0, undistort_fov, true, FisheyeUndist::UndistortCylindrical, 
+                auto ptr = new FisheyeUndist(cam, 0, undistort_fov, enable_cuda, FisheyeUndist::UndistortCylindrical, 
                     width_undistort, height_undistort, photometric);
                 auto cylind_cam = ptr->cam_top;
                 camera_ptrs.push_back(cylind_cam);
@@ -222,6 +260,12 @@ namespace D2FrontEnd {
         undistort_fov = fsSettings["undistort_fov"];
         width = (int) fsSettings["image_width"];
         height = (int) fsSettings["image_height"];
+        if (!fsSettings["enable_camera_lut"].empty()) {
+            enable_camera_lut = (int) fsSettings["enable_camera_lut"];
+            if (!fsSettings["camera_lut_max_error"].empty()) {
+                camera_lut_max_error = fsSettings["camera_lut_max_error"];
+            }
+        }
         std::string camera_seq_str = fsSettings["camera_seq"]; // Back-right Back-left Front-left Front-right
         if (camera_seq_str == "") {
             this->camera_seq = std::vector<int>{0, 1, 2, 3};
@@ -14,7 +14,10 @@ using namespace std::chrono;
 double TRIANGLE_THRES;
 
 namespace D2FrontEnd {
-LoopCam::LoopCam(LoopCamConfig config, ros::NodeHandle &nh) : 
+LoopCam::LoopCam(LoopCamConfig config, ros::NodeHandle &nh) : LoopCam(config) {
+}
+
+LoopCam::LoopCam(LoopCamConfig config) : 
     camera_configuration(config.camera_configuration),
     self_id(config.self_id),
     _config(config)
@@ -33,6 +36,9 @@ LoopCam::LoopCam(LoopCamConfig config, ros::NodeHandle &nh) :
     }
     undistortors = params->undistortors;
     cams = params->camera_ptrs;
+    undist_gpu_input.resize(undistortors.size());
+    undist_gpu_output.resize(undistortors.size());
+    undist_pools.resize(undistortors.size());
     printf("[D2FrontEnd::LoopCam] Deepnet ready\n");
     if (_config.OUTPUT_RAW_SUPERPOINT_DESC) {
         fsp.open(params->OUTPUT_PATH+"superpoint.csv", std::fstream::app);
@@ -47,7 +53,7 @@ void LoopCam::encodeImage(const cv::Mat &_img, VisualImageDesc &_img_desc)
 
     cv::imencode(".jpg", _img, _img_desc.image, jpg_params);
     _img_desc.image_width = _img.cols;
-    _img_desc.image_width = _img.rows;
+    _img_desc.image_height = _img.rows;
     // std::cout << "IMENCODE Cost " << duration_cast<microseconds>(high_resolution_clock::now() - start).count()/1000.0 << "ms" << std::endl;
     // std::cout << "JPG SIZE" << _img_desc.image.size() << std::endl;
 }
@@ -159,6 +165,7 @@ VisualImageDescArray LoopCam::processStereoframe(const StereoFrame & msg) {
     visual_array.stamp = msg.stamp.toSec();
     
     cv::Mat _show, tmp;
+    D2_TRACE_ZONE("LoopCam::processStereoframe");
     TicToc tt;
     static int t_count = 0;
     static double tt_sum = 0;
@@ -197,6 +204,10 @@ VisualImageDescArray LoopCam::processStereoframe(const StereoFrame & msg) {
     tt_sum+= tt.toc();
     t_count+= 1;
     printf("[D2Frontend::LoopCam] KF Count %d loop_cam cost avg %.1fms cur %.1fms\n", kf_count, tt_sum/t_count, tt.toc());
+    if (params->enable_perf_output) {
+        printf("[D2Frontend::LoopCam] image copies %d allocations %d\n", image_stats.copies, image_stats.allocations);
+    }
+    image_stats = ImageBufferStats();
 
     visual_array.frame_id = msg.keyframe_id;
     visual_array.pose_drone = msg.pose_drone;
@@ -224,9 +235,25 @@ VisualImageDesc LoopCam::generateImageDescriptor(const StereoFrame & msg, int vc
         return ides;
     }
     cv::Mat undist = msg.left_images[vcam_id];
+    D2_TRACE_ZONE("LoopCam::generateImageDescriptor");
     TicToc tt;
-    if (_config.enable_undistort_image) {
-        undist = cv::Mat(undistortors[vcam_id]->undist_id_cuda(undist, 0, true));
+    if (_config.enable_undistort_image && !params->enable_cuda) {
+        cv::Mat output;
+        undistortors[vcam_id]->undist_id(undist, output, 0, true);
+        undist = output;
+        image_stats.copies ++;
+        image_stats.allocations ++;
+    } else if (_config.enable_undistort_image) {
+        // The raw image may be a view of the incoming message: it is only read by the upload,
+        // and the undistorted image is downloaded into a pooled buffer.
+        auto & gpu_input = undist_gpu_input[vcam_id];
+        auto & gpu_output = undist_gpu_output[vcam_id];
+        gpu_input.upload(undist);
+        undistortors[vcam_id]->undist_id_cuda(gpu_input, gpu_output, 0, true);
+        undist = undist_pools[vcam_id].acquire(gpu_output.rows, gpu_output.cols, gpu_output.type());
+        gpu_output.download(undist);
+        image_stats.copies ++;
+        image_stats.allocations += undist_pools[vcam_id].takeAllocationNum();
     }
     if (params->enable_perf_output) {
         printf("[D2Frontend::LoopCam] undist image cost %.1fms\n", tt.toc());
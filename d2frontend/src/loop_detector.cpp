@@ -24,6 +24,7 @@ namespace D2FrontEnd {
 void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     //Lock frame_mutex with Guard
     std::lock_guard<std::recursive_mutex> guard(frame_mutex);
+    D2_TRACE_ZONE("LoopDetector::processImageArray");
     TicToc tt;
     static double t_sum = 0;
     static int t_count = 0;
@@ -82,22 +83,7 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     if (image_array.spLandmarkNum() >= _config.loop_inlier_feature_num || is_lazy_frame) {
         //Initialize images for visualization
         if (params->show) {
-            std::vector<cv::Mat> imgs;
-            for (unsigned int i = 0; i < images_num; i++) {
-                auto & img_des = image_array.images[i];
-                if (!img_des.raw_image.empty()) {
-                    imgs.emplace_back(img_des.raw_image);
-                } else if (img_des.image.size() != 0) {
-                    imgs.emplace_back(decode_image(img_des));
-                } else {
-                    // imgs[i] = cv::Mat(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
-                    imgs.emplace_back(cv::Mat(params->height, params->width, CV_8U, cv::Scalar(255)));
-                }
-                if (params->camera_configuration == STEREO_PINHOLE) {
-                    break;
-                }
-            }
-            msgid2cvimgs[image_array.frame_id] = imgs;
+            cacheVisualizationImages(image_array);
         }
 
         bool success = false;
@@ -185,10 +171,45 @@ cv::Mat LoopDetector::decode_image(const VisualImageDesc & _img_desc) {
     // auto ret = cv::imdecode(_img_desc.image, cv::IMREAD_GRAYSCALE);
     auto ret = cv::imdecode(_img_desc.image, cv::IMREAD_UNCHANGED);
     // std::cout << "IMDECODE Cost " << duration_cast<microseconds>(high_resolution_clock::now() - start).count()/1000.0 << "ms" << std::endl;
-
+    if (!ret.empty() && _img_desc.image_width > 0 && _img_desc.image_height > 0 && 
+            (ret.cols != _img_desc.image_width || ret.rows != _img_desc.image_height)) {
+        //Thumbnail, back to the size of the landmark coordinates
+        cv::resize(ret, ret, cv::Size(_img_desc.image_width, _img_desc.image_height));
+    }
     return ret;
 }
 
+std::vector<cv::Mat> LoopDetector::visualizationImages(const VisualImageDescArray & image_array) {
+    std::vector<cv::Mat> imgs;
+    for (unsigned int i = 0; i < image_array.images.size(); i++) {
+        auto & img_des = image_array.images[i];
+        if (!img_des.raw_image.empty()) {
+            imgs.emplace_back(img_des.raw_image);
+        } else if (img_des.image.size() != 0) {
+            imgs.emplace_back(decode_image(img_des));
+        } else {
+            // imgs[i] = cv::Mat(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
+            imgs.emplace_back(cv::Mat(params->height, params->width, CV_8U, cv::Scalar(255)));
+        }
+        if (params->camera_configuration == STEREO_PINHOLE) {
+            break;
+        }
+    }
+    return imgs;
+}
+
+void LoopDetector::cacheVisualizationImages(const VisualImageDescArray & image_array) {
+    if (msgid2cvimgs.find(image_array.frame_id) == msgid2cvimgs.end()) {
+        cvimgs_order.push_back(image_array.frame_id);
+    }
+    msgid2cvimgs[image_array.frame_id] = visualizationImages(image_array);
+    //Older frames are decoded again from the database if a loop needs them
+    while (cvimgs_order.size() > params->max_loop_viz_frames) {
+        msgid2cvimgs.erase(cvimgs_order.front());
+        cvimgs_order.pop_front();
+    }
+}
+
 int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss) {
     if (add_to_faiss) {
         for (size_t i = 0; i < new_fisheye_desc.images.size(); i++) {
@@ -205,9 +226,16 @@ int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_des
             const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
         }
     }
-    keyframe_database[new_fisheye_desc.frame_id] = new_fisheye_desc;
-    printf("[LoopDetector] Add KF %ld with %d images from %d to local keyframe database. Total frames: %ld\n", 
-            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, keyframe_database.size());
+    auto & stored = keyframe_database[new_fisheye_desc.frame_id];
+    database_image_bytes -= stored.imageBytes();
+    stored = new_fisheye_desc;
+    if (params->keyframe_thumbnail) {
+        stored.keepThumbnailsOnly(params->keyframe_thumbnail_scale, params->JPG_QUALITY);
+    }
+    database_image_bytes += stored.imageBytes();
+    printf("[LoopDetector] Add KF %ld with %d images from %d to local keyframe database. Total frames: %ld images %.1fMB\n", 
+            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, keyframe_database.size(),
+            database_image_bytes/1024.0/1024.0);
     // new_fisheye_desc.printSize();
     return new_fisheye_desc.frame_id;
 }
@@ -370,7 +398,7 @@ bool LoopDetector::checkLoopOdometryConsistency(LoopEdge & loop_conn) const {
 bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
     const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
     std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &cam_indices, std::vector<std::pair<int, int>> &index2dirindex_a,
-    std::vector<std::pair<int, int>> &index2dirindex_b) {
+    std::vector<std::pair<int, int>> &index2dirindex_b, std::vector<double> &scores) {
     std::vector<int> dirs_a;
     std::vector<int> dirs_b;
     
@@ -407,10 +435,11 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
         std::vector<int> _idx_a;
         std::vector<int> _idx_b;
         std::vector<int> _camera_indices;
+        std::vector<double> _scores;
 
         if (dir_a < frame_array_a.images.size() && dir_b < frame_array_b.images.size() && dir_a >= 0 && dir_b >= 0) {
             bool succ = computeCorrespondFeatures(frame_array_a.images[dir_a],frame_array_b.images[dir_b],
-                _lm_pos_a, _idx_a, _lm_norm_3d_b, _idx_b, _camera_indices);
+                _lm_pos_a, _idx_a, _lm_norm_3d_b, _idx_b, _camera_indices, _scores);
             // ROS_INFO("[LoopDetector] computeCorrespondFeatures on camera_index %d:%d gives %d common features", dir_b, dir_a, _lm_pos_a.size());
             if (!succ) {
                 continue;
@@ -431,6 +460,7 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
         lm_pos_a.insert(lm_pos_a.end(), _lm_pos_a.begin(), _lm_pos_a.end());
         lm_norm_3d_b.insert(lm_norm_3d_b.end(), _lm_norm_3d_b.begin(), _lm_norm_3d_b.end());
         cam_indices.insert(cam_indices.end(), _camera_indices.begin(), _camera_indices.end());
+        scores.insert(scores.end(), _scores.begin(), _scores.end());
     }
 
     if(lm_norm_3d_b.size() > _config.loop_inlier_feature_num && matched_dir_count >= _config.MIN_DIRECTION_LOOP) {
@@ -445,7 +475,7 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
 
 bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, 
-            std::vector<int> &idx_b, std::vector<int> &cam_indices) {
+            std::vector<int> &idx_b, std::vector<int> &cam_indices, std::vector<double> &scores) {
     std::vector<cv::DMatch> _matches;
     auto & _a_lms = img_desc_a.landmarks;
     auto & _b_lms = img_desc_b.landmarks;
@@ -496,6 +526,8 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
             lm_pos_a.push_back(landmark_db.at(landmark_id).position);
             lm_norm_3d_b.push_back(pt3d_norm_b);
             cam_indices.push_back(img_desc_b.camera_index);
+            //Both the descriptor distance and superglue's 1 - score are lower for the better matches
+            scores.push_back(-match.distance);
     }
 
     if (lm_b_2d.size() < 4) {
@@ -508,6 +540,8 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
         reduceVector(idx_b, mask);
         reduceVector(lm_pos_a, mask);
         reduceVector(lm_norm_3d_b, mask);
+        reduceVector(cam_indices, mask);
+        reduceVector(scores, mask);
     }
     return true;
 }
@@ -538,9 +572,10 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
     std::vector<int> inliers;
     std::vector<int> camera_indices;
     std::vector<std::pair<int, int>> index2dirindex_a, index2dirindex_b;
+    std::vector<double> scores;
     
     success = computeCorrespondFeaturesOnImageArray(frame_array_a, frame_array_b, 
-        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, index2dirindex_a, index2dirindex_b);
+        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, index2dirindex_a, index2dirindex_b, scores);
     
     if(success) {
         std::vector<Swarm::Pose> extrinsics;
@@ -548,7 +583,8 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
             extrinsics.push_back(img.extrinsic);
         }
         success = computeRelativePosePnPnonCentral(lm_pos_a, lm_norm_3d_b,
-                extrinsics, camera_indices, frame_array_a.pose_drone, frame_array_b.pose_drone, DP_old_to_new, inliers, _config.is_4dof);
+                extrinsics, camera_indices, frame_array_a.pose_drone, frame_array_b.pose_drone, DP_old_to_new, inliers, _config.is_4dof,
+                true, scores);
         if (!success) {
             printf("[LoopDetector::computeLoop@%d] Compute relative pose failed!\n", self_id);
             return false;
@@ -610,8 +646,10 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
     cv::Mat show;
     char title[100] = {0};
     std::vector<cv::Mat> _matched_imgs;
-    auto & imgs_a = msgid2cvimgs[frame_array_a.frame_id];
-    auto & imgs_b = msgid2cvimgs[frame_array_b.frame_id];
+    auto it_a = msgid2cvimgs.find(frame_array_a.frame_id);
+    auto it_b = msgid2cvimgs.find(frame_array_b.frame_id);
+    auto imgs_a = it_a != msgid2cvimgs.end() ? it_a->second : visualizationImages(frame_array_a);
+    auto imgs_b = it_b != msgid2cvimgs.end() ? it_b->second : visualizationImages(frame_array_b);
     _matched_imgs.resize(imgs_b.size());
     for (size_t i = 0; i < imgs_b.size(); i ++) {
         int dir_a = ((-main_dir_b + main_dir_a + _config.MAX_DIRS) % _config.MAX_DIRS + i)% _config.MAX_DIRS;
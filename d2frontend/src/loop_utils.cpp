@@ -2,6 +2,8 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/eigen.hpp>
 #include <fstream>
+#include <random>
+#include <limits>
 #include <d2common/d2basetypes.h>
 #include <d2common/utils.hpp>
 #include <d2frontend/d2frontend_params.h>
@@ -248,6 +250,7 @@ std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat
     if (prev_pts.size() == 0) {
         return std::vector<cv::Point2f>();
     }
+    D2_TRACE_ZONE("opticalflowTrack");
     TicToc tic;
     std::vector<uchar> status;
     std::vector<cv::Point2f> cur_pts;
@@ -360,6 +363,7 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
     if (prev_pts.size() == 0) {
         return std::vector<cv::Point2f>();
     }
+    D2_TRACE_ZONE("opticalflowTrackPyr");
     TicToc tic;
     std::vector<uchar> status;
     std::vector<cv::Point2f> cur_pts;
@@ -517,14 +521,26 @@ std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray
     int small_width = _img.cols() / cols;
     int small_height = _img.rows() / rows;
     int num_features = ceil((double)features*1.5/ ((double) cols * rows));
-    auto fast = cv::cuda::FastFeatureDetector::create(10, true, cv::FastFeatureDetector::TYPE_9_16, features);
-    cv::cuda::GpuMat gpu_img(_img);
+    cv::Ptr<cv::cuda::FastFeatureDetector> fast;
+    cv::Ptr<cv::FastFeatureDetector> fast_cpu;
+    cv::cuda::GpuMat gpu_img;
+    cv::Mat img = _img.getMat();
+    if (params->enable_cuda) {
+        fast = cv::cuda::FastFeatureDetector::create(10, true, cv::FastFeatureDetector::TYPE_9_16, features);
+        gpu_img.upload(img);
+    } else {
+        fast_cpu = cv::FastFeatureDetector::create(10, true, cv::FastFeatureDetector::TYPE_9_16);
+    }
     std::vector<cv::KeyPoint> total_kpts;
     for (int i = 0; i < cols; i ++) {
         for (int j = 0; j < rows; j ++) {
             std::vector<cv::KeyPoint> kpts;
             cv::Rect roi(small_width*i, small_height*j, small_width, small_height);
-            fast->detect(gpu_img(roi), kpts);
+            if (params->enable_cuda) {
+                fast->detect(gpu_img(roi), kpts);
+            } else {
+                fast_cpu->detect(img(roi), kpts);
+            }
             // printf("Detect %d features in region %d %d\n", kpts.size(), i, j);
             for (auto kp : kpts) {
                 kp.pt.x = kp.pt.x + small_width*i;
@@ -576,29 +592,16 @@ double gravityCheck(const Swarm::Pose & pnp_pose, const Swarm::Pose & ego_motion
 
 int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std::vector<Vector3d> lm_3d_norm_b,
             Swarm::Pose extrinsic_b, Swarm::Pose ego_motion_a, Swarm::Pose ego_motion_b, Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, 
-            bool is_4dof, bool verify_gravity) {
-        //Compute PNP
-    // ROS_INFO("Matched features %ld", matched_2d_norm_old.size());
-    cv::Mat K = (cv::Mat_<double>(3, 3) << 1.0, 0, 0, 0, 1.0, 0, 0, 0, 1.0);
-    cv::Mat r, rvec, rvec2, t, t2, D, tmp_r;
-
-    int iteratives = 100;
-    Point3fVector pts3d;
-    Point2fVector pts2d;
-    for (int i = 0; i < lm_positions_a.size(); i++) {
-        auto z = lm_3d_norm_b[i].z();
-        if (z > 1e-1) {
-            pts3d.push_back(cv::Point3f(lm_positions_a[i].x(), lm_positions_a[i].y(), lm_positions_a[i].z()));
-            pts2d.push_back(cv::Point2f(lm_3d_norm_b[i].x()/z, lm_3d_norm_b[i].y()/z));
-        }
-    }
-    if (pts3d.size() < params->loopdetectorconfig->loop_inlier_feature_num) {
+            bool is_4dof, bool verify_gravity, const std::vector<double> & scores) {
+    if (lm_positions_a.size() < params->loopdetectorconfig->loop_inlier_feature_num) {
         return false;
     }
-    bool success = solvePnPRansac(pts3d, pts2d, K, D, rvec, t, false,   
-        iteratives,  5.0/params->focal_length, 0.99,  inliers);
-    auto p_cam_old_in_new = PnPRestoCamPose(rvec, t);
-    auto pnp_predict_pose_b = p_cam_old_in_new*(extrinsic_b.toIsometry().inverse());
+    //A single camera is the central case of the non-central PnP, which gives the pose of the drone directly.
+    std::vector<int> camera_indices(lm_positions_a.size(), 0);
+    PnPRansacReport report;
+    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, {extrinsic_b}, camera_indices, inliers,
+        scores, 100, &report);
+    bool success = report.succ;
     if (!success) {
         return 0;
     }
@@ -607,13 +610,118 @@ int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std
         auto RPerr = gravityCheck(pnp_predict_pose_b, ego_motion_b);
         success = pnp_result_verify(success, inliers.size(), RPerr, DP_b_to_a);
         printf("[SWARM_LOOP@%d] DPose %s PnPRansac %d inlines %d/%d, dyaw %f dpos %f g_err %f \n",
-                params->self_id, DP_b_to_a.toStr().c_str(), success, inliers.size(), pts2d.size(), fabs(DP_b_to_a.yaw())*57.3, DP_b_to_a.pos().norm(), RPerr);
+                params->self_id, DP_b_to_a.toStr().c_str(), success, inliers.size(), lm_positions_a.size(), fabs(DP_b_to_a.yaw())*57.3, DP_b_to_a.pos().norm(), RPerr);
     }
     return success;
 }
 
+//Error (1 - cos of the angle) of the bearing of correspondence i to the body pose (R, t), as opengv's AbsolutePoseSacProblem
+inline double bearingError(const opengv::absolute_pose::NoncentralAbsoluteAdapter & adapter, const Matrix3d & R, const Vector3d & t, int i) {
+    Vector3d p_body = R.transpose() * (adapter.getPoint(i) - t);
+    Vector3d p_cam = adapter.getCamRotation(i).transpose() * (p_body - adapter.getCamOffset(i));
+    return 1.0 - p_cam.normalized().dot(adapter.getBearingVector(i));
+}
+
+//PROSAC (Chum and Matas 2005): the samples are drawn from the top n matches by score, n grows with the iterations
+//so that the sampling is uniform over all matches after max_iterations.
+class ProsacSampler {
+    std::vector<int> order;
+    int N;
+    int m;
+    int n;
+    int t = 0;
+    double T_n;
+    int T_n_prime;
+    std::mt19937 rng;
+public:
+    //Not progressive: uniform samples over all the matches from the start
+    ProsacSampler(const std::vector<int> & _order, int _m, int max_iterations, bool progressive):
+        order(_order), N(_order.size()), m(_m), n(progressive ? _m : _order.size()), T_n_prime(progressive ? 1 : 0), rng(0) {
+        T_n = max_iterations;
+        for (int i = 0; i < m; i++) {
+            T_n *= (double) (n - i) / (N - i);
+        }
+    }
+    std::vector<int> sample() {
+        t ++;
+        if (t > T_n_prime && n < N) {
+            double T_n1 = T_n * (n + 1) / (n + 1 - m);
+            T_n_prime += std::ceil(T_n1 - T_n);
+            T_n = T_n1;
+            n ++;
+        }
+        //The newest match of the subset and m - 1 of the others, or m of the subset once its samples are drawn
+        std::vector<int> ret;
+        int pool = n;
+        if (T_n_prime >= t) {
+            ret.push_back(order[n - 1]);
+            pool = n - 1;
+        }
+        while ((int) ret.size() < m) {
+            int index = order[std::uniform_int_distribution<int>(0, pool - 1)(rng)];
+            if (std::find(ret.begin(), ret.end(), index) == ret.end()) {
+                ret.push_back(index);
+            }
+        }
+        return ret;
+    }
+    //A match of the subset not in the sample, for the preemptive test
+    int randomInSubset(const std::vector<int> & sample) {
+        int pool = std::max(n, m + 1);
+        while (true) {
+            int index = order[std::uniform_int_distribution<int>(0, pool - 1)(rng)];
+            if (std::find(sample.begin(), sample.end(), index) == sample.end()) {
+                return index;
+            }
+        }
+    }
+    int subsetSize() const {
+        return n;
+    }
+};
+
+//PROSAC stopping: over the top n* matches where the inliers of the best model are not random (above the binomial
+//tail of a wrong model agreeing with random_inlier_ratio of the matches, at 5%), the fewest iterations with samples of
+//size m to draw an all-inlier sample with the confidence.
+inline int prosacStopIterations(const std::vector<int> & inlier_prefix, int m, int min_subset, double confidence) {
+    const double random_inlier_ratio = 0.1;
+    int N = inlier_prefix.size() - 1;
+    double ret = std::numeric_limits<double>::max();
+    for (int n_star = std::min(min_subset, N); n_star <= N; n_star++) {
+        double expected = random_inlier_ratio * (n_star - m);
+        if (inlier_prefix[n_star] - m < expected + 1.64 * sqrt(expected * (1 - random_inlier_ratio))) {
+            continue;
+        }
+        double p_good = std::pow((double) inlier_prefix[n_star] / n_star, m);
+        if (p_good >= 1.0) {
+            return 0;
+        }
+        ret = std::min(ret, std::ceil(std::log(1 - confidence) / std::log(1 - p_good)));
+    }
+    return std::min(ret, (double) std::numeric_limits<int>::max());
+}
+
+//Non-central PnP RANSAC for the multi-camera drone. GP3P hypotheses from PROSAC samples, each solution has to pass the
+//T(d,d) preemptive test on d matches of the sampled subset before the verification on all the matches, which bails out
+//once it can not beat the best. The iterations stop when the inlier ratio of the best model within the sampled subset
+//gives the confidence that no better sample was missed, then the pose is refined on the inliers by non-linear optimization.
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers) {
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<double> & scores, int max_iterations, PnPRansacReport * _report) {
+    const int sample_size = 3;
+    const double confidence = 0.99;
+    const double threshold = 0.5/params->focal_length;
+    D2_TRACE_ZONE("computePosePnPnonCentral");
+    TicToc tic;
+    PnPRansacReport report;
+    inliers.clear();
+    int N = lm_positions_a.size();
+    if (N <= sample_size) {
+        if (_report != nullptr) {
+            *_report = report;
+        }
+        return Swarm::Pose();
+    }
     opengv::bearingVectors_t bearings;
     std::vector<int> camCorrespondences;
     opengv::points_t points;
@@ -628,57 +736,111 @@ Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_
         camRotations.push_back(cam_extrinsics[i].R());
         camOffsets.push_back(cam_extrinsics[i].pos());
     }
-
-    //Solve with GP3P + RANSAC
     opengv::absolute_pose::NoncentralAbsoluteAdapter adapter(
         bearings, camCorrespondences, points, camOffsets, camRotations);
-    opengv::sac::Ransac<
-        opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> ransac;
-    std::shared_ptr<opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> absposeproblem_ptr(new opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem(
-        adapter, opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem::GP3P));
-    ransac.sac_model_ = absposeproblem_ptr;
-    // ransac.threshold_ = 1.0 - cos(atan(sqrt(10.0)*0.5/460.0));
-    ransac.threshold_ = 0.5/params->focal_length;
-    ransac.max_iterations_ = 50;
-    ransac.computeModel();
-    //Obtain relative pose results
-    inliers = ransac.inliers_;
-    auto best_transformation = ransac.model_coefficients_;
-    Matrix3d R = best_transformation.block<3, 3>(0, 0);
-    Vector3d t = best_transformation.block<3, 1>(0, 3);
-    Swarm::Pose p_drone_old_in_new_init(R, t);
-    
-    //Filter by inliers and perform non-linear optimization to refine.
-    std::set <int>inlier_set(inliers.begin(), inliers.end());
-    bearings.clear();
-    camCorrespondences.clear();
-    points.clear();
-    for (int i = 0; i < lm_positions_a.size(); i++) {
-        if (inlier_set.find(i) == inlier_set.end()) {
-            continue;
+
+    std::vector<int> order(N);
+    for (int i = 0; i < N; i++) {
+        order[i] = i;
+    }
+    if (scores.size() == N) {
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return scores[a] > scores[b];
+        });
+    }
+    bool guided = scores.size() == N;
+    ProsacSampler sampler(order, sample_size, max_iterations, guided);
+    //Without scores the test matches are outliers as often as the samples are, rejecting as many good models as bad ones
+    const int preemptive_points = guided ? 1 : 0;
+    //Without scores the order is arbitrary, only the inlier ratio over all the matches is meaningful
+    const int min_subset = guided ? 2 * (sample_size + preemptive_points) : N;
+
+    int best_inliers = 0;
+    Matrix3d best_R = Matrix3d::Identity();
+    Vector3d best_t = Vector3d::Zero();
+    //Inliers of the best model among the top k matches by score, and of the model under verification
+    std::vector<int> best_prefix(N + 1, 0), prefix(N + 1, 0);
+    int required_iterations = max_iterations;
+    while (report.iterations < required_iterations) {
+        report.iterations ++;
+        auto indices = sampler.sample();
+        opengv::transformations_t solutions = opengv::absolute_pose::gp3p(adapter, indices);
+        for (auto & solution : solutions) {
+            Matrix3d R = solution.block<3, 3>(0, 0);
+            Vector3d t = solution.block<3, 1>(0, 3);
+            if (!R.allFinite() || !t.allFinite()) {
+                continue;
+            }
+            report.models ++;
+            bool pass = true;
+            for (int k = 0; k < preemptive_points && pass; k++) {
+                pass = bearingError(adapter, R, t, sampler.randomInSubset(indices)) < threshold;
+            }
+            if (!pass) {
+                continue;
+            }
+            report.verified ++;
+            int count = 0;
+            int k = 0;
+            for (; k < N && count + N - k > best_inliers; k++) {
+                count += bearingError(adapter, R, t, order[k]) < threshold;
+                prefix[k + 1] = count;
+            }
+            if (k == N && count > best_inliers) {
+                best_inliers = count;
+                best_R = R;
+                best_t = t;
+                best_prefix.swap(prefix);
+                required_iterations = std::min(max_iterations, prosacStopIterations(best_prefix, sample_size + preemptive_points,
+                    min_subset, confidence));
+            }
         }
-        bearings.push_back(lm_3d_norm_b[i]);
-        camCorrespondences.push_back(camera_indices[i]);
-        points.push_back(lm_positions_a[i]);
     }
-    adapter.sett(t);
-    adapter.setR(R);
-    opengv::transformation_t nonlinear_transformation =
-        opengv::absolute_pose::optimize_nonlinear(adapter);
-    R = nonlinear_transformation.block<3, 3>(0, 0);
-    t = nonlinear_transformation.block<3, 1>(0, 3);
-    Swarm::Pose p_drone_old_in_new(R, t);
-    // printf("[InitPnP] pose_init %s pose_refine %s\n", p_drone_old_in_new_init.toStr().c_str(), 
-    //         p_drone_old_in_new.toStr().c_str());
-    return p_drone_old_in_new;
+    if (best_inliers <= sample_size) {
+        report.time = tic.toc();
+        if (_report != nullptr) {
+            *_report = report;
+        }
+        return Swarm::Pose();
+    }
+    for (int i = 0; i < N; i++) {
+        if (bearingError(adapter, best_R, best_t, i) < threshold) {
+            inliers.push_back(i);
+        }
+    }
+
+    //Non-linear refinement on the inliers, kept if it does not lose inliers
+    adapter.sett(best_t);
+    adapter.setR(best_R);
+    opengv::transformation_t nonlinear_transformation = opengv::absolute_pose::optimize_nonlinear(adapter, inliers);
+    Matrix3d R = nonlinear_transformation.block<3, 3>(0, 0);
+    Vector3d t = nonlinear_transformation.block<3, 1>(0, 3);
+    std::vector<int> refined_inliers;
+    for (int i = 0; i < N; i++) {
+        if (bearingError(adapter, R, t, i) < threshold) {
+            refined_inliers.push_back(i);
+        }
+    }
+    if (R.allFinite() && t.allFinite() && refined_inliers.size() >= inliers.size()) {
+        best_R = R;
+        best_t = t;
+        inliers = refined_inliers;
+    }
+    report.succ = true;
+    report.time = tic.toc();
+    if (_report != nullptr) {
+        *_report = report;
+    }
+    return Swarm::Pose(best_R, best_t);
 }
 
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose ego_motion_b, 
-        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity) {
+        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity, const std::vector<double> & scores) {
+    D2_TRACE_ZONE("computeRelativePosePnPnonCentral");
     D2Common::Utility::TicToc tic;
-    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers);
+    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers, scores);
     DP_b_to_a =  Swarm::Pose::DeltaPose(pnp_predict_pose_b, drone_pose_a, is_4dof);
 
     bool success = true;
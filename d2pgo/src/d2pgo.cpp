@@ -1,4 +1,5 @@
 #include "d2pgo.h"
+#include <d2common/tracing.hpp>
 #include "ARockPGO.hpp"
 #include <d2common/solver/RelPoseFactor.hpp>
 #include <d2common/solver/pose_local_parameterization.h>
@@ -22,11 +23,10 @@ void D2PGO::addFrame(D2BaseFrame frame) {
     state.addFrame(frame);
     // printf("[D2PGO@%d]add frame %ld ref %d ego_pose %s pose %s from drone %d\n", self_id, frame.frame_id, frame.reference_frame_id,
     //     frame.initial_ego_pose.toStr().c_str(), frame.odom.pose().toStr().c_str(), frame.drone_id);
-    if (ego_motion_trajs.find(frame.drone_id) == ego_motion_trajs.end()) {
-        Swarm::DroneTrajectory traj(frame.drone_id, true);
-        ego_motion_trajs[frame.drone_id] = traj;
+    if (ego_motion_index.find(frame.drone_id) == ego_motion_index.end()) {
+        ego_motion_index[frame.drone_id] = EgoMotionIndex(egoMotionCovarianceParams());
     }
-    ego_motion_trajs[frame.drone_id].push(frame.stamp, frame.initial_ego_pose, frame.frame_id);
+    ego_motion_index[frame.drone_id].push(frame.stamp, frame.initial_ego_pose, frame.frame_id);
     updated = true;
     is_rot_init_convergence = false;
 }
@@ -107,6 +107,7 @@ void D2PGO::waitForRotInitFinish() {
     }
     sendSignal("ROT_INIT_FINISH");
     rot_init_finished_robots.insert(self_id);
+    D2_TRACE_ZONE("D2PGO::waitForRotInitFinish");
     D2Common::Utility::TicToc timer;
     int count = 0;
     while (rot_init_finished_robots.size() != available_robots.size() && timer.toc()/1000 < config.rot_init_timeout) {
@@ -124,6 +125,7 @@ void D2PGO::waitForRotInitFinish() {
 
 bool D2PGO::solve_multi(bool force_solve) {
     const Guard lock(state_lock);
+    D2_TRACE_ZONE("D2PGO::solve_multi");
     if ((state.size(self_id) < config.min_solve_size) && !force_solve) {
         // printf("[D2PGO] Not enough frames to solve %d.\n", state.size(self_id));
         return false;
@@ -144,6 +146,7 @@ bool D2PGO::solve_multi(bool force_solve) {
         }
     }
     if (config.enable_pcm) {
+        D2_TRACE_ZONE("D2PGO::outlierRejection");
         D2Common::Utility::TicToc tic;
         auto good_loops = rejection.OutlierRejectionLoopEdges(ros::Time::now(), available_loops);
         printf("[D2PGO] Pcm takes %3.1fms, good %ld/%ld loops\n", tic.toc(), good_loops.size(), available_loops.size());
@@ -212,6 +215,9 @@ bool D2PGO::solve_multi(bool force_solve) {
     printf("[D2PGO::solve@%d] solve_count %d mode [multi,%d] total frames %ld loops %d opti_time %.1fms iters %d initial cost %.2e final cost %.2e\n", 
             self_id, solve_count, config.mode, used_frames.size(), used_loops_count, report.total_time*1000, 
             report.total_iterations, report.initial_cost, report.final_cost);
+    D2_TRACE_VALUE("D2PGO::solve_time", report.total_time*1000);
+    D2_TRACE_VALUE("D2PGO::solve_iterations", report.total_iterations);
+    D2_TRACE_COUNTER("D2PGO::frames", used_frames.size());
     solve_count ++;
     updated = false;
     return true;
@@ -219,6 +225,7 @@ bool D2PGO::solve_multi(bool force_solve) {
 
 bool D2PGO::solve_single() {
     const Guard lock(state_lock);
+    D2_TRACE_ZONE("D2PGO::solve_single");
     if (state.size(self_id) < config.min_solve_size || !updated) {
         // printf("[D2PGO] Not enough frames to solve %d.\n", state.size(self_id));
         return false;
@@ -280,6 +287,9 @@ bool D2PGO::solve_single() {
     printf("[D2PGO::solve@%d] solve_count %d mode single,%d total frames %ld loops %d opti_time %.1fms iters %d initial cost %.2e final cost %.2e\n", 
             self_id, solve_count, config.mode, used_frames.size(), used_loops_count, report.total_time*1000, 
             report.total_iterations, report.initial_cost, report.final_cost);
+    D2_TRACE_VALUE("D2PGO::solve_time", report.total_time*1000);
+    D2_TRACE_VALUE("D2PGO::solve_iterations", report.total_iterations);
+    D2_TRACE_COUNTER("D2PGO::frames", used_frames.size());
     solve_count ++;
     updated = false;
     return true;
@@ -289,6 +299,14 @@ bool D2PGO::isRotInitConvergence() const {
     return is_rot_init_convergence || !config.enable_rotation_initialization;
 }
 
+EgoMotionCovarianceParams D2PGO::egoMotionCovarianceParams() const {
+    EgoMotionCovarianceParams params;
+    params.pos_covariance_per_meter = config.pos_covariance_per_meter;
+    params.yaw_covariance_per_meter = config.yaw_covariance_per_meter;
+    params.min_cov_len = config.min_cov_len;
+    return params;
+}
+
 bool D2PGO::isMain() const {
     return main_id == self_id;
 }
@@ -360,29 +378,36 @@ void D2PGO::evalLoop(const Swarm::LoopEdge & loop) {
     std::cout << residuals.transpose() << "\n" << std::endl;
 }
 
+ceres::CostFunction * D2PGO::createRelPoseFactor(const Swarm::LoopEdge & loop) {
+    // The analytic factors are used when pgo_use_autodiff is off.
+    // Ceres evaluates the residual blocks in parallel with ceres_options.num_threads.
+    if (config.pgo_pose_dof == PGO_POSE_4D) {
+        if (config.pgo_use_autodiff) {
+            return RelPoseFactor4D::Create(loop);
+        }
+        return RelPoseFactor4DAnalytic::Create(loop);
+    }
+    if (config.perturb_mode && isRotInitConvergence()) {
+        auto qa = state.getAttitudeInit(loop.keyframe_id_a);
+        auto qb = state.getAttitudeInit(loop.keyframe_id_b);
+        if (config.pgo_use_autodiff) {
+            return RelPoseFactorPerturbAD::Create(loop, qa, qb);
+        }
+        return RelPoseFactorPerturb::Create(loop, qa, qb);
+    }
+    if (config.pgo_use_autodiff) {
+        return RelPoseFactorAD::Create(loop);
+    }
+    return RelPoseFactor::Create(loop);
+}
+
 void D2PGO::setupLoopFactors(SolverWrapper * solver, const std::vector<Swarm::LoopEdge> & good_loops) {
     used_loops_count = 0;
     // auto loss_function = new ceres::HuberLoss(1.0);    
     auto loss_function = nullptr;
     for (auto loop : good_loops) {
         if (state.hasFrame(loop.keyframe_id_a) && state.hasFrame(loop.keyframe_id_b)) {
-            ceres::CostFunction * loop_factor = nullptr;
-            if (config.pgo_pose_dof == PGO_POSE_4D) {
-                loop_factor = RelPoseFactor4D::Create(loop);
-                // this->evalLoop(loop);
-            } else {
-                if (config.pgo_use_autodiff) {
-                    if (config.perturb_mode && isRotInitConvergence()) {
-                        auto qa = state.getAttitudeInit(loop.keyframe_id_a);
-                        auto qb = state.getAttitudeInit(loop.keyframe_id_b);
-                        loop_factor = RelPoseFactorPerturbAD::Create(loop, qa, qb);
-                    } else {
-                        loop_factor = RelPoseFactorAD::Create(loop);
-                    }
-                } else {
-                    loop_factor = RelPoseFactor::Create(loop);
-                }
-            }
+            ceres::CostFunction * loop_factor = createRelPoseFactor(loop);
             auto res_info = RelPoseResInfo::create(loop_factor, 
                 loss_function, loop.keyframe_id_a, loop.keyframe_id_b, config.pgo_pose_dof == PGO_POSE_4D, config.perturb_mode);
             solver->addResidual(res_info);
@@ -421,33 +446,14 @@ void D2PGO::setupEgoMotionFactors(SolverWrapper * solver, int drone_id) {
         } else {
             rel_pose = Swarm::Pose::DeltaPose(frame_a->initial_ego_pose, frame_b->initial_ego_pose);
         }
-        double len = rel_pose.pos().norm();
-        if (len < config.min_cov_len) {
-            len = config.min_cov_len;
-        }
-        Eigen::Matrix6d cov = Eigen::Matrix6d::Zero();
-        cov.block<3, 3>(0, 0) = Matrix3d::Identity()*config.pos_covariance_per_meter*len 
-            + 0.5*Matrix3d::Identity()*config.yaw_covariance_per_meter*len*len;
-        cov.block<3, 3>(3, 3) = Matrix3d::Identity()*config.yaw_covariance_per_meter*len;
+        Eigen::Matrix6d cov = EgoMotionIndex::segmentCovariance(egoMotionCovarianceParams(), rel_pose.pos().norm());
         Matrix6d sqrt_info = cov.inverse().cwiseAbs().cwiseSqrt();
         Swarm::LoopEdge loop(frame_a->frame_id, frame_b->frame_id, rel_pose, sqrt_info);
+        auto factor = createRelPoseFactor(loop);
         if (config.pgo_pose_dof == PGO_POSE_4D) {
-            auto factor = RelPoseFactor4D::Create(loop);
             auto res_info = RelPoseResInfo::create(factor, nullptr, frame_a->frame_id, frame_b->frame_id, true);
             solver->addResidual(res_info);
         } else if (config.pgo_pose_dof == PGO_POSE_6D) {
-            ceres::CostFunction * factor;
-            if (config.pgo_use_autodiff) {
-                if (config.perturb_mode && isRotInitConvergence()) {
-                    auto qa = state.getAttitudeInit(frame_a->frame_id);
-                    auto qb = state.getAttitudeInit(frame_b->frame_id);
-                    factor = RelPoseFactorPerturbAD::Create(loop, qa, qb);
-                } else {
-                    factor = RelPoseFactorAD::Create(loop);
-                }
-            } else {
-                factor = RelPoseFactor::Create(loop);
-            }
             auto res_info = RelPoseResInfo::create(factor, nullptr, frame_a->frame_id, frame_b->frame_id, false, config.perturb_mode);
             solver->addResidual(res_info);
         }
@@ -562,26 +568,31 @@ std::map<int, Swarm::DroneTrajectory> D2PGO::getOptimizedTrajs() {
             if (used_frames.find(frame->frame_id) == used_frames.end()) {
                 continue;
             }
-            auto pose = frame->odom.pose();
-            if (config.pgo_pose_dof == PGO_POSE_4D) {
-                //Then we need to combine the roll pitch from ego motion
-                Swarm::Pose ego_pose = frame->initial_ego_pose;
-                auto delta_att = ego_pose.att_yaw_only().inverse() * ego_pose.att();
-                pose.att() = pose.att()*delta_att;
-            }
-            if (config.perturb_mode) {
-                auto pointer = state.getPerturbState(frame->frame_id);
-                Map<Vector3d> pos(pointer);
-                Map<Vector3d> perturb_theta(pointer+3);
-                Quaterniond q_perturb = Utility::quatfromRotationVector(perturb_theta);
-                pose = Swarm::Pose(pos, state.getAttitudeInit(frame->frame_id)*q_perturb);
-            }
-            trajs[drone_id].push(frame->stamp, pose, frame->frame_id);
+            trajs[drone_id].push(frame->stamp, getOptimizedPose(frame), frame->frame_id);
         }
     }
     return trajs;
 }
 
+Swarm::Pose D2PGO::getOptimizedPose(const D2BaseFrame * frame) const {
+    const Guard lock(state_lock);
+    auto pose = frame->odom.pose();
+    if (config.pgo_pose_dof == PGO_POSE_4D) {
+        //Then we need to combine the roll pitch from ego motion
+        Swarm::Pose ego_pose = frame->initial_ego_pose;
+        auto delta_att = ego_pose.att_yaw_only().inverse() * ego_pose.att();
+        pose.att() = pose.att()*delta_att;
+    }
+    if (config.perturb_mode) {
+        auto pointer = state.getPerturbState(frame->frame_id);
+        Map<Vector3d> pos(pointer);
+        Map<Vector3d> perturb_theta(pointer+3);
+        Quaterniond q_perturb = Utility::quatfromRotationVector(perturb_theta);
+        pose = Swarm::Pose(pos, state.getAttitudeInit(frame->frame_id)*q_perturb);
+    }
+    return pose;
+}
+
 std::map<int, Swarm::Odometry> D2PGO::getPredictedOdoms() const {
     const Guard lock(state_lock);
     std::map<int, Swarm::Odometry> ret;
@@ -29,7 +29,7 @@ protected:
     bool is_rot_init_convergence = false;
     SolverWrapper * solver = nullptr;
     std::vector<Swarm::LoopEdge> used_loops;
-    std::map<int, Swarm::DroneTrajectory> ego_motion_trajs;
+    std::map<int, EgoMotionIndex> ego_motion_index;
     SwarmLocalOutlierRejection rejection;
     RotInit * rot_init = nullptr;
     RotInit * pose6d_init = nullptr;
@@ -39,6 +39,7 @@ protected:
     int save_count = 0;
 
     void saveG2O(bool only_self=false);
+    ceres::CostFunction * createRelPoseFactor(const Swarm::LoopEdge & loop);
     void setupLoopFactors(SolverWrapper * solver, const std::vector<Swarm::LoopEdge> & good_loops);
     void setupEgoMotionFactors(SolverWrapper * solver);
     void setupEgoMotionFactors(SolverWrapper * solver, int drone_id);
@@ -46,6 +47,7 @@ protected:
     bool isMain() const;
     bool isRotInitConvergence() const;
     void waitForRotInitFinish();
+    EgoMotionCovarianceParams egoMotionCovarianceParams() const;
 public:
     void postPerturbSolve();
     std::function<void(void)> postsolve_callback;
@@ -54,7 +56,7 @@ public:
     D2PGO(D2PGOConfig _config):
         config(_config), self_id(_config.self_id), main_id(_config.main_id),
         state(_config.self_id, _config.pgo_pose_dof == PGO_POSE_4D),
-        rejection(_config.self_id, _config.pcm_rej, ego_motion_trajs),
+        rejection(_config.self_id, _config.pcm_rej, ego_motion_index),
         available_robots{_config.self_id} {
     }
     void evalLoop(const Swarm::LoopEdge & loop);
@@ -69,6 +71,7 @@ public:
     void sendSignal(const std::string & signal);
     void rotInitial(const std::vector<Swarm::LoopEdge> & good_loops);
     std::map<int, Swarm::DroneTrajectory> getOptimizedTrajs();
+    Swarm::Pose getOptimizedPose(const D2BaseFrame * frame) const;
     std::vector<D2BaseFrame*> getAllLocalFrames();
     void setAvailableRobots(const std::set<int> & _available_robots) {
         available_robots = _available_robots;
@@ -1,5 +1,6 @@
 #include <ros/ros.h>
 #include "d2pgo.h"
+#include <d2common/tracing.hpp>
 #include "swarm_msgs/ImageArrayDescriptor.h"
 #include "swarm_msgs/swarm_fused.h"
 #include "geometry_msgs/PoseStamped.h"
@@ -172,6 +173,12 @@ protected:
         //Config ceres
         config.ceres_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;// ceres::DENSE_SCHUR;
         config.ceres_options.num_threads = 1;
+        if (!fsSettings["pgo_num_threads"].empty()) {
+            config.ceres_options.num_threads = fsSettings["pgo_num_threads"];
+        }
+        if (!fsSettings["pgo_use_autodiff"].empty()) {
+            config.pgo_use_autodiff = (int) fsSettings["pgo_use_autodiff"];
+        }
         config.ceres_options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;// ceres::DOGLEG;
         config.ceres_options.max_solver_time_in_seconds =  fsSettings["pgo_solver_time"];
         config.main_id = 1;
@@ -188,11 +195,25 @@ protected:
         config.is_realtime = true;
         config.enable_pcm = (int)fsSettings["enable_pcm"];
         config.pcm_rej.pcm_thres = fsSettings["pcm_thres"];
+        if (!fsSettings["pcm_thread_num"].empty()) {
+            config.pcm_rej.pcm_thread_num = fsSettings["pcm_thread_num"];
+        }
         config.enable_rotation_initialization = false;
         config.enable_gravity_prior = (int)fsSettings["enable_gravity_prior"];
         config.rot_init_config.gravity_sqrt_info = fsSettings["gravity_sqrt_info"];
         solver_timer_freq = (double) fsSettings["solver_timer_freq"];
         config.perturb_mode = true;
+        D2Common::Tracing::TracingConfig tracing;
+        if (!fsSettings["enable_tracing"].empty()) {
+            tracing.enable = (int) fsSettings["enable_tracing"];
+        }
+        if (!fsSettings["pgo_tracing_output"].empty()) {
+            tracing.output = (std::string) fsSettings["pgo_tracing_output"];
+        }
+        if (!fsSettings["tracing_summary_interval"].empty()) {
+            tracing.summary_interval = fsSettings["tracing_summary_interval"];
+        }
+        D2Common::Tracing::init(tracing);
         //Debugging 
         config.debug_save_g2o_only = (int) fsSettings["debug_save_g2o_only"];
         if (config.mode == PGO_MODE::PGO_MODE_NON_DIST) {
@@ -220,5 +241,6 @@ int main(int argc, char **argv)
     D2PGO::D2PGONode d2pgonode(n);
     ros::MultiThreadedSpinner spinner(4);
     spinner.spin();
+    D2Common::Tracing::shutdown();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "ego_motion_index.hpp"
+#include <algorithm>
+
+namespace D2PGO {
+Matrix6d EgoMotionIndex::segmentCovariance(const EgoMotionCovarianceParams & params, double len) {
+    if (len < params.min_cov_len) {
+        len = params.min_cov_len;
+    }
+    Matrix6d cov = Matrix6d::Zero();
+    cov.block<3, 3>(0, 0) = Matrix3d::Identity()*params.pos_covariance_per_meter*len
+        + 0.5*Matrix3d::Identity()*params.yaw_covariance_per_meter*len*len;
+    cov.block<3, 3>(3, 3) = Matrix3d::Identity()*params.yaw_covariance_per_meter*len;
+    return cov;
+}
+
+void EgoMotionIndex::push(double stamp, const Swarm::Pose & ego_pose, FrameIdType frame_id) {
+    if (hasFrame(frame_id)) {
+        return;
+    }
+    int pos = std::upper_bound(stamps.begin(), stamps.end(), stamp) - stamps.begin();
+    stamps.insert(stamps.begin() + pos, stamp);
+    frame_ids.insert(frame_ids.begin() + pos, frame_id);
+    poses.insert(poses.begin() + pos, ego_pose);
+    cum_length.resize(poses.size());
+    // Usually pos is the last one and only the new entry is computed.
+    updatePrefix(pos);
+}
+
+void EgoMotionIndex::updatePrefix(int from) {
+    for (int i = from; i < (int)poses.size(); i++) {
+        frame_index[frame_ids[i]] = i;
+        if (i == 0) {
+            cum_length[i] = 0;
+        } else {
+            cum_length[i] = cum_length[i - 1] + (poses[i].pos() - poses[i - 1].pos()).norm();
+        }
+    }
+}
+
+std::pair<Swarm::Pose, Matrix6d> EgoMotionIndex::relativePose(FrameIdType frame_a, FrameIdType frame_b, bool is_4dof) const {
+    int index_a = frame_index.at(frame_a);
+    int index_b = frame_index.at(frame_b);
+    Swarm::Pose rel_pose = Swarm::Pose::DeltaPose(poses[index_a], poses[index_b], is_4dof);
+    return std::make_pair(rel_pose, segmentCovariance(params, fabs(cum_length[index_b] - cum_length[index_a])));
+}
+
+double EgoMotionIndex::trajectoryLength(FrameIdType frame_a, FrameIdType frame_b) const {
+    return fabs(cum_length[frame_index.at(frame_b)] - cum_length[frame_index.at(frame_a)]);
+}
+
+double EgoMotionIndex::trajectoryLengthByTs(double ts_a, double ts_b) const {
+    if (stamps.empty()) {
+        return 0;
+    }
+    int index_a = std::min<int>(std::lower_bound(stamps.begin(), stamps.end(), ts_a) - stamps.begin(), stamps.size() - 1);
+    int index_b = std::min<int>(std::lower_bound(stamps.begin(), stamps.end(), ts_b) - stamps.begin(), stamps.size() - 1);
+    return fabs(cum_length[index_b] - cum_length[index_a]);
+}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <swarm_msgs/Pose.h>
+#include <d2common/d2basetypes.h>
+
+using namespace D2Common;
+
+namespace D2PGO {
+struct EgoMotionCovarianceParams {
+    double pos_covariance_per_meter = 4e-3;
+    double yaw_covariance_per_meter = 4e-5;
+    double min_cov_len = 0.1;
+};
+
+// Prefix-composed index of the ego-motion trajectory of one drone.
+// Ego poses are stored per keyframe (the "cumulative pose" from the first frame) together with
+// the prefix sums of trajectory length, so the relative pose and covariance between any two keyframes
+// is two lookups and one composition. The covariance is the one of DroneTrajectory: the odometry model
+// over the trajectory length between the two keyframes.
+// Frames appended in time order only extend the prefix; an out-of-order frame invalidates the suffix after it.
+class EgoMotionIndex {
+    EgoMotionCovarianceParams params;
+    std::vector<double> stamps;
+    std::vector<FrameIdType> frame_ids;
+    std::vector<Swarm::Pose> poses;
+    std::vector<double> cum_length;
+    std::unordered_map<FrameIdType, int> frame_index;
+    void updatePrefix(int from);
+public:
+    EgoMotionIndex() {}
+    EgoMotionIndex(const EgoMotionCovarianceParams & _params): params(_params) {}
+    // Covariance of a single odometry segment, same model as the ego-motion factors.
+    static Matrix6d segmentCovariance(const EgoMotionCovarianceParams & params, double len);
+    void push(double stamp, const Swarm::Pose & ego_pose, FrameIdType frame_id);
+    bool hasFrame(FrameIdType frame_id) const {
+        return frame_index.find(frame_id) != frame_index.end();
+    }
+    int size() const {
+        return poses.size();
+    }
+    // Relative pose (a->b) and its covariance.
+    std::pair<Swarm::Pose, Matrix6d> relativePose(FrameIdType frame_a, FrameIdType frame_b, bool is_4dof) const;
+    double trajectoryLength(FrameIdType frame_a, FrameIdType frame_b) const;
+    double trajectoryLengthByTs(double ts_a, double ts_b) const;
+};
+}
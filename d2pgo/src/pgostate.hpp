@@ -106,7 +106,7 @@ public:
         initial_attitude[frame_id] = _attitude;
     }
 
-    Eigen::Quaterniond getAttitudeInit(FrameIdType frame_id) {
+    Eigen::Quaterniond getAttitudeInit(FrameIdType frame_id) const {
         return initial_attitude.at(frame_id);
     }
 };
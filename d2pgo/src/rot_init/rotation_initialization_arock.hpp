@@ -15,6 +15,7 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
 
     virtual SolverReport solveLocalStep() override {
         SolverReport report;
+        D2_TRACE_ZONE("RotationInitARock::solveLocalStep");
         D2Common::Utility::TicToc tic;
         if (solve_6d) {
             report.state_changes = RotationInitialization<T>::solveLinearPose6d();
@@ -113,7 +114,7 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
     void broadcastData() {
         const std::lock_guard<std::recursive_mutex> lock(pgo_data_mutex);
         // broadcast the data.
-        for (auto it : dual_states_local) {
+        for (auto & it : dual_states_local) {
             DPGOData data;
             data.stamp = ros::Time::now().toSec();
             data.drone_id = self_id;
@@ -124,7 +125,7 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
             } else {
                 data.type = DPGO_ROT_MAT_DUAL;
             }
-            for (auto it2 : it.second) {
+            for (auto & it2 : it.second) {
                 auto ptr = it2.first;
                 auto &dual_state = it2.second;
                 // printf("[broadcastData%d] local dual drone %d: frame_id %d delta:", self_id, 
@@ -1,5 +1,6 @@
 #pragma once
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 #include "../pgostate.hpp"
 #include <swarm_msgs/relative_measurments.hpp>
 #include "../d2pgo_config.h"
@@ -37,6 +38,11 @@ protected:
     int self_id;
     int eff_frame_num = 0;
     bool is_multi = false;
+    //The symbolic factorization (AMD fill-reducing ordering) is kept while the sparsity of H is unchanged.
+    Eigen::SimplicialLLT<SparseMatrix<T>, Eigen::Lower, Eigen::AMDOrdering<int>> llt_solver;
+    std::vector<int> H_outer_index;
+    std::vector<int> H_inner_index;
+    int symbolic_count = 0;
 
     virtual void addFrameId(FrameIdType _frame_id) {
         all_frames.insert(_frame_id);
@@ -143,19 +149,67 @@ protected:
         return row_id + 3;
     }
 
+    // Assemble the normal equation H = A^T A, g = A^T b directly from the row-wise triplets of A,
+    // only the lower triangle of H is filled since the LLT only reads it.
+    void buildNormalEquation(int rows, int cols, const std::vector<Tpl> & triplet_list, const VecX & b, 
+            SparseMatrix<T> & H, VecX & g) {
+        std::vector<int> row_ptr(rows + 1, 0);
+        for (auto & triplet : triplet_list) {
+            row_ptr[triplet.row() + 1]++;
+        }
+        for (int i = 0; i < rows; i++) {
+            row_ptr[i + 1] += row_ptr[i];
+        }
+        std::vector<int> row_cols(triplet_list.size());
+        std::vector<T> row_vals(triplet_list.size());
+        std::vector<int> cursor(row_ptr.begin(), row_ptr.end() - 1);
+        for (auto & triplet : triplet_list) {
+            int k = cursor[triplet.row()]++;
+            row_cols[k] = triplet.col();
+            row_vals[k] = triplet.value();
+        }
+        std::vector<Tpl> H_triplets;
+        g = VecX::Zero(cols);
+        for (int r = 0; r < rows; r++) {
+            for (int i = row_ptr[r]; i < row_ptr[r + 1]; i++) {
+                g(row_cols[i]) += row_vals[i]*b(r);
+                for (int j = row_ptr[r]; j < row_ptr[r + 1]; j++) {
+                    if (row_cols[i] >= row_cols[j]) {
+                        H_triplets.emplace_back(Tpl(row_cols[i], row_cols[j], row_vals[i]*row_vals[j]));
+                    }
+                }
+            }
+        }
+        H.resize(cols, cols);
+        H.setFromTriplets(H_triplets.begin(), H_triplets.end());
+    }
+
+    bool isSamePattern(const SparseMatrix<T> & H) const {
+        if (H.cols() != (int)H_outer_index.size() - 1 || H.nonZeros() != (int)H_inner_index.size()) {
+            return false;
+        }
+        return std::equal(H_outer_index.begin(), H_outer_index.end(), H.outerIndexPtr()) &&
+            std::equal(H_inner_index.begin(), H_inner_index.end(), H.innerIndexPtr());
+    }
+
     VecX solveLinear(int row_id, int cols, const std::vector<Tpl> & triplet_list, VecX & b) {
-        SparseMatrix<T> A(row_id, cols);
-        A.setFromTriplets(triplet_list.begin(), triplet_list.end());
-        auto At = A.transpose();
-        SparseMatrix<T> H = At*A;
         if (b.rows() > row_id) {
             b.conservativeResize(row_id);
         }
-        b = At*b;
-        Eigen::SimplicialLLT<Eigen::SparseMatrix<T>> solver;
-        solver.compute(H);
-        if (solver.info() != Eigen::Success) {
-            std::cout << solver.info() << std::endl;
+        SparseMatrix<T> H;
+        VecX g;
+        buildNormalEquation(row_id, cols, triplet_list, b, H, g);
+        H.makeCompressed();
+        if (!isSamePattern(H)) {
+            //Topology of the graph changed, redo the symbolic factorization.
+            llt_solver.analyzePattern(H);
+            H_outer_index.assign(H.outerIndexPtr(), H.outerIndexPtr() + H.cols() + 1);
+            H_inner_index.assign(H.innerIndexPtr(), H.innerIndexPtr() + H.nonZeros());
+            symbolic_count++;
+        }
+        llt_solver.factorize(H);
+        if (llt_solver.info() != Eigen::Success) {
+            std::cout << llt_solver.info() << std::endl;
             std::ofstream ofsh("/tmp/H" + std::to_string(self_id) + ".txt");
             for(int i = 0; i < H.outerSize(); i++)
                 for(typename Eigen::SparseMatrix<T>::InnerIterator it(H,i); it; ++it)
@@ -169,13 +223,17 @@ protected:
             std::ofstream ofs1("/tmp/b" + std::to_string(self_id) + ".txt");
             ofs1 << b << std::endl;
             ofs1.close();
+            //Force the symbolic factorization on next solve.
+            H_outer_index.clear();
+            H_inner_index.clear();
         }
-        assert(solver.info() == Eigen::Success && "LLT failed");
-        auto X = solver.solve(b);
+        assert(llt_solver.info() == Eigen::Success && "LLT failed");
+        VecX X = llt_solver.solve(g);
         return X;
     }
 
     double solveLinearRot() {
+        D2_TRACE_ZONE("RotationInitialization::solveLinearRot");
         TicToc tic;
         VecX b(loops.size()*ROTMAT_SIZE + pose_priors.size()*ROTMAT_SIZE);
         if (config.enable_gravity_prior) {
@@ -205,10 +263,10 @@ protected:
         double dt_solve = tic_solve.toc();
         TicToc tic2;
         auto state_changes = recoverRotationLLT(X);
-        printf("[RotInit%d] RotInit %.2fms setup %.2fms LLT %.2fms Recover %.2fms state_changes %.1f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d g_prior: %d\n", 
+        printf("[RotInit%d] RotInit %.2fms setup %.2fms LLT %.2fms Recover %.2fms state_changes %.1f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d g_prior: %d symbolic %d\n", 
             self_id, tic.toc(), dt_setup, dt_solve, tic2.toc(), state_changes*100,
             frame_id_to_idx.size(), eff_frame_num, loops.size(), pose_priors.size(),
-            typeid(T) == typeid(float), config.enable_gravity_prior);
+            typeid(T) == typeid(float), config.enable_gravity_prior, symbolic_count);
         return state_changes;
     }
 
@@ -328,6 +386,7 @@ protected:
     }
 
     double solveLinearPose6d(bool finetune_rot = false) {
+        D2_TRACE_ZONE("RotationInitialization::solveLinearPose6d");
         TicToc tic;
         int pose_size = POSE_EFF_SIZE;
         if (!finetune_rot) {
@@ -350,9 +409,9 @@ protected:
         double dt_solve = tic_solve.toc();
         //Recover poses from X
         double changes = recoverPose6dfromLinear(X, finetune_rot);
-        printf("[RotInit%d] solveLinearPose6d %.2fms setup %.2fms LLT %.2fms changes %.2f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d\n", self_id,
+        printf("[RotInit%d] solveLinearPose6d %.2fms setup %.2fms LLT %.2fms changes %.2f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d symbolic %d\n", self_id,
             tic.toc(), dt_setup, dt_solve, changes*100, frame_id_to_idx.size(), eff_frame_num, loops.size(), pose_priors.size(),
-            typeid(T) == typeid(float));
+            typeid(T) == typeid(float), symbolic_count);
         return changes;
     }
 
@@ -439,6 +498,7 @@ public:
     SolverReport solve() {
         //Chordal relaxation algorithm.
         SolverReport report;
+        D2_TRACE_ZONE("RotationInitialization::solve");
         TicToc tic;
         for (auto loop : loops) {
             auto frame_id_a = loop.keyframe_id_a;
@@ -0,0 +1,51 @@
+#include "pcm_consistency_graph.hpp"
+#include <algorithm>
+
+namespace D2PGO {
+PCMConsistencyGraph::PCMConsistencyGraph() {
+    gio.m_vi_Vertices.push_back(0);
+    gio.m_i_MaximumVertexDegree = 0;
+    gio.m_i_MinimumVertexDegree = 0;
+    gio.m_d_AverageVertexDegree = 0;
+}
+
+void PCMConsistencyGraph::appendVertices(int new_vertex_num, const std::vector<std::pair<int, int>> & consistent_pairs) {
+    auto & vertices = gio.m_vi_Vertices;
+    auto & edges = gio.m_vi_Edges;
+    int old_num = vertexCount();
+    int total_num = old_num + new_vertex_num;
+    add_count.assign(total_num, 0);
+    for (auto & pair : consistent_pairs) {
+        add_count[pair.first]++;
+        add_count[pair.second]++;
+    }
+    // New row offsets. Rows only grow, so new offset of each row >= its old offset.
+    vertices.resize(total_num + 1, vertices.back());
+    int old_edge_num = edges.size();
+    edges.resize(old_edge_num + 2*consistent_pairs.size());
+    std::vector<int> old_offsets(vertices.begin(), vertices.begin() + old_num + 1);
+    int shift = 0;
+    for (int i = 0; i < total_num; i++) {
+        vertices[i] += shift;
+        shift += add_count[i];
+    }
+    vertices[total_num] = edges.size();
+    // Move existing rows backward to their new offsets, last row first so nothing is clobbered.
+    cursor.resize(total_num);
+    for (int i = old_num - 1; i >= 0; i--) {
+        if (vertices[i] != old_offsets[i]) {
+            std::move_backward(edges.begin() + old_offsets[i], edges.begin() + old_offsets[i + 1],
+                edges.begin() + vertices[i] + old_offsets[i + 1] - old_offsets[i]);
+        }
+        cursor[i] = vertices[i] + old_offsets[i + 1] - old_offsets[i];
+    }
+    for (int i = old_num; i < total_num; i++) {
+        cursor[i] = vertices[i];
+    }
+    for (auto & pair : consistent_pairs) {
+        edges[cursor[pair.first]++] = pair.second;
+        edges[cursor[pair.second]++] = pair.first;
+    }
+    gio.CalculateVertexDegrees();
+}
+}
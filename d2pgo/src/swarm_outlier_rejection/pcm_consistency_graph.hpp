@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include "fast_max-clique_finder/src/graphIO.h"
+
+namespace D2PGO {
+// Pairwise consistency graph of PCM stored persistently in CSR form.
+// New loops are appended as new vertices; the adjacency of existing vertices is
+// grown in place so we never rebuild the graph from scratch before max-clique.
+class PCMConsistencyGraph {
+    FMC::CGraphIO gio;
+    std::vector<int> add_count;
+    std::vector<int> cursor;
+public:
+    PCMConsistencyGraph();
+    int vertexCount() const {
+        return gio.m_vi_Vertices.size() - 1;
+    }
+    int edgeCount() const {
+        return gio.m_vi_Edges.size()/2;
+    }
+    // Append new_vertex_num vertices. consistent_pairs holds undirected edges (new_vertex, other)
+    // where new_vertex >= vertexCount() before the call and other < new_vertex.
+    void appendVertices(int new_vertex_num, const std::vector<std::pair<int, int>> & consistent_pairs);
+    FMC::CGraphIO & graph() {
+        return gio;
+    }
+};
+}
@@ -4,6 +4,7 @@
 #include "fast_max-clique_finder/src/graphIO.h"
 #include "fast_max-clique_finder/src/findClique.h"
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 #include <d2common/d2basetypes.h>
 
 using D2Common::Utility::TicToc;
@@ -15,8 +16,8 @@ using D2Common::FrameIdType;
 namespace D2PGO {
 std::fstream pcm_errors;
 FILE * f_logs;
-SwarmLocalOutlierRejection::SwarmLocalOutlierRejection(int _self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, Swarm::DroneTrajectory> &_ego_motion_trajs):
-        self_id(_self_id), param(_param), ego_motion_trajs(_ego_motion_trajs) {
+SwarmLocalOutlierRejection::SwarmLocalOutlierRejection(int _self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, EgoMotionIndex> &_ego_motion_index):
+        self_id(_self_id), param(_param), ego_motion_index(_ego_motion_index) {
     if (param.debug_write_pcm_errors) {
         f_logs = fopen("/root/output/pcm_logs.txt", "w");
         pcm_errors.open("/root/output/pcm_errors.txt", std::ios::out);
@@ -111,113 +112,140 @@ std::vector<Swarm::LoopEdge> SwarmLocalOutlierRejection::OutlierRejectionLoopEdg
     return good_loops;
 }
 
-void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & new_loops, int id_a, int id_b) {
-    std::map<FrameIdType, int> bad_pair_count;
+bool SwarmLocalOutlierRejection::hasEgoMotion(const Swarm::LoopEdge & edge1, const Swarm::LoopEdge & edge2,
+        int same_robot_pair) const {
+    auto it_a = ego_motion_index.find(edge1.id_a);
+    auto it_b = ego_motion_index.find(edge1.id_b);
+    if (it_a == ego_motion_index.end() || it_b == ego_motion_index.end()) {
+        return false;
+    }
+    if (same_robot_pair == 1) {
+        return it_a->second.hasFrame(edge1.keyframe_id_a) && it_a->second.hasFrame(edge2.keyframe_id_a) &&
+            it_b->second.hasFrame(edge1.keyframe_id_b) && it_b->second.hasFrame(edge2.keyframe_id_b);
+    }
+    return it_a->second.hasFrame(edge1.keyframe_id_a) && it_a->second.hasFrame(edge2.keyframe_id_b) &&
+        it_b->second.hasFrame(edge1.keyframe_id_b) && it_b->second.hasFrame(edge2.keyframe_id_a);
+}
 
+double SwarmLocalOutlierRejection::computePCMError(const PCMCandidate & candidate, const Swarm::LoopEdge & edge1,
+        const Swarm::LoopEdge & edge2, Swarm::Pose & err_pose, Matrix6d & _covariance,
+        std::pair<Swarm::Pose, Matrix6d> & odom_a, std::pair<Swarm::Pose, Matrix6d> & odom_b) const {
+    Swarm::Pose p_edge2;
+    //ODOM is tsa->tsb
+    if (candidate.same_robot_pair == 1) {
+        p_edge2 = edge2.relative_pose;
+        odom_a = ego_motion_index.at(edge1.id_a).relativePose(edge1.keyframe_id_a, edge2.keyframe_id_a, param.is_4dof);
+        odom_b = ego_motion_index.at(edge1.id_b).relativePose(edge1.keyframe_id_b, edge2.keyframe_id_b, param.is_4dof);
+    } else {
+        p_edge2 = edge2.relative_pose.inverse();
+        odom_a = ego_motion_index.at(edge1.id_a).relativePose(edge1.keyframe_id_a, edge2.keyframe_id_b, param.is_4dof);
+        odom_b = ego_motion_index.at(edge1.id_b).relativePose(edge1.keyframe_id_b, edge2.keyframe_id_a, param.is_4dof);
+    }
+    _covariance = edge1.getCovariance() + edge2.getCovariance() + odom_a.second + odom_b.second;
+    err_pose = odom_a.first*p_edge2*odom_b.first.inverse()*edge1.relative_pose.inverse();
+    return Swarm::computeSquaredMahalanobisDistance(err_pose.log_map(), _covariance);
+}
+
+void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & new_loops, int id_a, int id_b) {
     auto & pcm_graph = loop_pcm_graph[id_a][id_b];
     auto & _all_loops = all_loops[id_a][id_b];
+    int old_size = _all_loops.size();
+    auto loop_by_index = [&](int index) -> const Swarm::LoopEdge & {
+        return index < old_size ? _all_loops[index] : new_loops[index - old_size];
+    };
 
-    TicToc tic1;
-
+    //Stage 1: collect the pairs to check (new loop vs all previous loops).
+    D2_TRACE_ZONE("SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM");
+    //Pairs without the ego-motion of their frames are left inconsistent here: a lookup throwing in the parallel stage would terminate.
+    TicToc tic;
+    std::vector<PCMCandidate> candidates;
     for (size_t i = 0; i < new_loops.size(); i++) {
         auto & edge1 = new_loops[i];
-        //Now only process inter-edges
-        while (pcm_graph.size() < _all_loops.size() + 1) {
-            pcm_graph.emplace_back(std::vector<int>(0));
+        int index1 = old_size + i;
+        for (int j = 0; j < index1; j++) {
+            int same_robot_pair = loop_by_index(j).same_robot_pair(edge1);
+            if (same_robot_pair > 0 && hasEgoMotion(edge1, loop_by_index(j), same_robot_pair)) {
+                candidates.emplace_back(PCMCandidate{index1, j, same_robot_pair});
+            }
         }
+    }
+    double collect_time = tic.toc();
 
-        auto p_edge1 = edge1.relative_pose;
-        Matrix6d _cov_mat_1 = edge1.getCovariance();
-
-        for (size_t j = 0; j < _all_loops.size(); j++) {
-            auto & edge2 = _all_loops[j];
-            auto _cov_mat_2 = edge2.getCovariance();;
-            Matrix6d _covariance = _cov_mat_1 + _cov_mat_2;
-
-            int same_robot_pair = edge2.same_robot_pair(edge1);
-            if (same_robot_pair > 0) {
-                //Now we can compute the consistency error.
-                std::pair<Swarm::Pose, Matrix6d> odom_a, odom_b;
-                Swarm::Pose p_edge2;
-                double traj_a = 0, traj_b = 0;
-
-                if (same_robot_pair == 1) {
-                    p_edge2 = edge2.relative_pose;
-                    //ODOM is tsa->tsb
-                    odom_a = ego_motion_trajs.at(edge1.id_a).get_relative_pose_by_frame_id(edge1.keyframe_id_a, edge2.keyframe_id_a, param.is_4dof);
-                    odom_b = ego_motion_trajs.at(edge1.id_b).get_relative_pose_by_frame_id(edge1.keyframe_id_b, edge2.keyframe_id_b, param.is_4dof);
-                    if (param.debug_write_debug) {
-                        traj_a = ego_motion_trajs.at(edge1.id_a).trajectory_length_by_ts(edge1.ts_a, edge2.ts_a);
-                        traj_b = ego_motion_trajs.at(edge1.id_b).trajectory_length_by_ts(edge1.ts_b, edge2.ts_b);
-                    }
-
-                    _covariance += odom_a.second + odom_b.second;
-
-                }  else if (same_robot_pair == 2) {
-                    p_edge2 = edge2.relative_pose.inverse();
-                    odom_a = ego_motion_trajs.at(edge1.id_a).get_relative_pose_by_frame_id(edge1.keyframe_id_a, edge2.keyframe_id_b, param.is_4dof);
-                    odom_b = ego_motion_trajs.at(edge1.id_b).get_relative_pose_by_frame_id(edge1.keyframe_id_b, edge2.keyframe_id_a, param.is_4dof);
-                    
-                    if (param.debug_write_debug) {
-                        traj_a = ego_motion_trajs.at(edge1.id_a).trajectory_length_by_ts(edge1.ts_a, edge2.ts_b);
-                        traj_b = ego_motion_trajs.at(edge1.id_b).trajectory_length_by_ts(edge1.ts_b, edge2.ts_a);
-                    }
-
-                    _covariance += odom_a.second + odom_b.second;
-                }
-
-                Swarm::Pose err_pose = odom_a.first*p_edge2*odom_b.first.inverse()*p_edge1.inverse();
-                auto logmap = err_pose.log_map();
-                double smd = Swarm::computeSquaredMahalanobisDistance(logmap, _covariance);
-
-                if (smd < param.pcm_thres) {
-                    //Add edge i to j
-                    pcm_graph[_all_loops.size()].push_back(j);
-                    pcm_graph[j].push_back(_all_loops.size());
-                }
-
-                if (param.debug_write_debug) {
-                    fprintf(f_logs, "\n");
-                    fprintf(f_logs, "EdgePair %ld->%ld\n", edge1.id, edge2.id);
-                    fprintf(f_logs, "Edge1 %ld->%ld DOF %d Pose %s cov_1 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
-                        edge1.keyframe_id_a, edge1.keyframe_id_b, edge1.res_count, edge1.relative_pose.toStr().c_str(),
-                        _cov_mat_1(0, 0), _cov_mat_1(1, 1), _cov_mat_1(2, 2), _cov_mat_1(3, 3), _cov_mat_1(4, 4), _cov_mat_1(5, 5));
-                    fprintf(f_logs, "Edge2 %ld->%ld DOF %d Pose %s cov_2 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
-                        edge2.keyframe_id_a, edge2.keyframe_id_b, edge2.res_count, edge2.relative_pose.toStr().c_str(),
-                        _cov_mat_2(0, 0), _cov_mat_2(1, 1), _cov_mat_2(2, 2), _cov_mat_2(3, 3), _cov_mat_2(4, 4), _cov_mat_2(5, 5));
-                        
-                    auto cov = odom_a.second;
-                    fprintf(f_logs, "odom_a %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_a.first.toStr().c_str(), 
-                        traj_a, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
-                    cov = odom_b.second;
-                    fprintf(f_logs, "odom_b %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_b.first.toStr().c_str(), 
-                        traj_b, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
-                    fprintf(f_logs, "err_pose %s logmap [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", err_pose.toStr().c_str(), 
-                        logmap(0), logmap(1), logmap(2), logmap(3), logmap(4), logmap(5));
-                    fprintf(f_logs, "squaredMahalanobisDistance %f Same Direction %d _cov(T, Q)  [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", smd, same_robot_pair == 1,
-                        _covariance(0, 0), _covariance(1, 1), _covariance(2, 2), _covariance(3, 3), _covariance(4, 4), _covariance(5, 5));
-                }
-                
-                if (param.debug_write_pcm_errors) {
-                    pcm_errors << edge1.id << " " << edge2.id << " "  << smd << " " << std::endl;
-                }
+    //Stage 2: pairwise Mahalanobis checks, the relative odometry comes from the prefix index in O(1).
+    tic.tic();
+    std::vector<double> smds(candidates.size());
+#pragma omp parallel for num_threads(param.pcm_thread_num)
+    for (size_t k = 0; k < candidates.size(); k++) {
+        auto & candidate = candidates[k];
+        Swarm::Pose err_pose;
+        Matrix6d _covariance;
+        std::pair<Swarm::Pose, Matrix6d> odom_a, odom_b;
+        smds[k] = computePCMError(candidate, loop_by_index(candidate.index1), loop_by_index(candidate.index2), 
+            err_pose, _covariance, odom_a, odom_b);
+    }
+    double mahalanobis_time = tic.toc();
 
+    //Stage 3: append the consistent pairs to the persistent graph.
+    tic.tic();
+    std::vector<std::pair<int, int>> consistent_pairs;
+    for (size_t k = 0; k < candidates.size(); k++) {
+        auto & candidate = candidates[k];
+        double smd = smds[k];
+        if (smd < param.pcm_thres) {
+            //Add edge i to j
+            consistent_pairs.emplace_back(candidate.index1, candidate.index2);
+        }
+        auto & edge1 = loop_by_index(candidate.index1);
+        auto & edge2 = loop_by_index(candidate.index2);
+        if (param.debug_write_debug) {
+            Swarm::Pose err_pose;
+            Matrix6d _covariance;
+            std::pair<Swarm::Pose, Matrix6d> odom_a, odom_b;
+            computePCMError(candidate, edge1, edge2, err_pose, _covariance, odom_a, odom_b);
+            auto logmap = err_pose.log_map();
+            Matrix6d _cov_mat_1 = edge1.getCovariance();
+            Matrix6d _cov_mat_2 = edge2.getCovariance();
+            double traj_a = 0, traj_b = 0;
+            if (candidate.same_robot_pair == 1) {
+                traj_a = ego_motion_index.at(edge1.id_a).trajectoryLengthByTs(edge1.ts_a, edge2.ts_a);
+                traj_b = ego_motion_index.at(edge1.id_b).trajectoryLengthByTs(edge1.ts_b, edge2.ts_b);
+            } else {
+                traj_a = ego_motion_index.at(edge1.id_a).trajectoryLengthByTs(edge1.ts_a, edge2.ts_b);
+                traj_b = ego_motion_index.at(edge1.id_b).trajectoryLengthByTs(edge1.ts_b, edge2.ts_a);
             }
+            fprintf(f_logs, "\n");
+            fprintf(f_logs, "EdgePair %ld->%ld\n", edge1.id, edge2.id);
+            fprintf(f_logs, "Edge1 %ld->%ld DOF %d Pose %s cov_1 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
+                edge1.keyframe_id_a, edge1.keyframe_id_b, edge1.res_count, edge1.relative_pose.toStr().c_str(),
+                _cov_mat_1(0, 0), _cov_mat_1(1, 1), _cov_mat_1(2, 2), _cov_mat_1(3, 3), _cov_mat_1(4, 4), _cov_mat_1(5, 5));
+            fprintf(f_logs, "Edge2 %ld->%ld DOF %d Pose %s cov_2 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
+                edge2.keyframe_id_a, edge2.keyframe_id_b, edge2.res_count, edge2.relative_pose.toStr().c_str(),
+                _cov_mat_2(0, 0), _cov_mat_2(1, 1), _cov_mat_2(2, 2), _cov_mat_2(3, 3), _cov_mat_2(4, 4), _cov_mat_2(5, 5));
+                
+            auto cov = odom_a.second;
+            fprintf(f_logs, "odom_a %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_a.first.toStr().c_str(), 
+                traj_a, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
+            cov = odom_b.second;
+            fprintf(f_logs, "odom_b %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_b.first.toStr().c_str(), 
+                traj_b, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
+            fprintf(f_logs, "err_pose %s logmap [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", err_pose.toStr().c_str(), 
+                logmap(0), logmap(1), logmap(2), logmap(3), logmap(4), logmap(5));
+            fprintf(f_logs, "squaredMahalanobisDistance %f Same Direction %d _cov(T, Q)  [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", smd, candidate.same_robot_pair == 1,
+                _covariance(0, 0), _covariance(1, 1), _covariance(2, 2), _covariance(3, 3), _covariance(4, 4), _covariance(5, 5));
+        }
+        
+        if (param.debug_write_pcm_errors) {
+            pcm_errors << edge1.id << " " << edge2.id << " "  << smd << " " << std::endl;
         }
-        _all_loops.push_back(edge1);
     }
+    _all_loops.insert(_all_loops.end(), new_loops.begin(), new_loops.end());
+    pcm_graph.appendVertices(new_loops.size(), consistent_pairs);
+    double graph_time = tic.toc();
 
-    double compute_pcm_erros = tic1.toc();
     std::vector<int> max_clique_data;
-    FMC::CGraphIO pcm_graph_fmc;
-    pcm_graph_fmc.m_vi_Vertices.push_back(0);
-    for(size_t i=0;i < pcm_graph.size(); i++) {
-        pcm_graph_fmc.m_vi_Edges.insert(pcm_graph_fmc.m_vi_Edges.end(),pcm_graph[i].begin(),pcm_graph[i].end());
-        pcm_graph_fmc.m_vi_Vertices.push_back(pcm_graph_fmc.m_vi_Edges.size());
-    }
-    pcm_graph_fmc.CalculateVertexDegrees();
+    auto & pcm_graph_fmc = pcm_graph.graph();
+    tic.tic();
     if (param.incremental_pcm) {
-        TicToc tic;
         int prev_max_clique_size = good_loops_set[id_a][id_b].size();
         int ret = FMC::maxCliqueHeuIncremental(pcm_graph_fmc, new_loops.size(), prev_max_clique_size, max_clique_data);
         if (ret > 0 && max_clique_data.size() > 0) {
@@ -228,13 +256,14 @@ void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<
                 good_loops_set[id_b][id_a].insert(_all_loops[i].id);
             }
         }
-        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms maxCliqueHeuInc takes %.1fms ret %d(%d) loops %ld good %ld\n", 
-            id_a, id_b, compute_pcm_erros, tic.toc(), ret, max_clique_data.size(), _all_loops.size(), good_loops_set[id_a][id_b].size());
+        printf("[D2PGO](OutlierRejection) %d<->%d pairs %ld collect %.1fms mahalanobis %.1fms graph %.1fms maxCliqueHeuInc %.1fms ret %d(%d) loops %ld good %ld\n", 
+            id_a, id_b, candidates.size(), collect_time, mahalanobis_time, graph_time, tic.toc(),
+            ret, max_clique_data.size(), _all_loops.size(), good_loops_set[id_a][id_b].size());
     } else {
-        TicToc tic;
         FMC::maxCliqueHeu(pcm_graph_fmc, max_clique_data);
-        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms maxCliqueHeu takes %.1fms loops %ld good %ld\n", 
-            id_a, id_b, compute_pcm_erros, tic.toc(), _all_loops.size(), max_clique_data.size());
+        printf("[D2PGO](OutlierRejection) %d<->%d pairs %ld collect %.1fms mahalanobis %.1fms graph %.1fms maxCliqueHeu %.1fms loops %ld good %ld\n", 
+            id_a, id_b, candidates.size(), collect_time, mahalanobis_time, graph_time, tic.toc(),
+            _all_loops.size(), max_clique_data.size());
         //In non-incremental mode, we need to clear the good_loops_set
         good_loops_set[id_a][id_b].clear();
         good_loops_set[id_b][id_a].clear();
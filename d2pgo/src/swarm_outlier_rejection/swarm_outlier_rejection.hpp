@@ -5,18 +5,30 @@
 #include <swarm_msgs/drone_trajectory.hpp>
 #include <swarm_msgs/relative_measurments.hpp>
 #include "../d2pgo_config.h"
+#include "pcm_consistency_graph.hpp"
+#include "../ego_motion_index.hpp"
 
 namespace D2PGO {
 
-typedef std::vector<std::vector<int>> DisjointGraph;
+struct PCMCandidate {
+    int index1; // Index of the new loop in all_loops
+    int index2; // Index of the loop to compare with
+    int same_robot_pair;
+};
+
 class SwarmLocalOutlierRejection {
     SwarmLocalOutlierRejectionParams param;
-    std::map<int, Swarm::DroneTrajectory>  & ego_motion_trajs;
-    //Drone  ida           idb            index_det       linked dets
-    std::map<int, std::map<int, DisjointGraph>> loop_pcm_graph;
+    std::map<int, EgoMotionIndex> & ego_motion_index;
+    //Drone  ida           idb            consistency graph
+    std::map<int, std::map<int, PCMConsistencyGraph>> loop_pcm_graph;
     std::map<int, std::map<int, std::vector<Swarm::LoopEdge>>> all_loops;
     std::set<int64_t> all_loops_set;
 
+    // Whether the ego-motion of both drones covers the frames of the two loops, required by computePCMError
+    bool hasEgoMotion(const Swarm::LoopEdge & edge1, const Swarm::LoopEdge & edge2, int same_robot_pair) const;
+    double computePCMError(const PCMCandidate & candidate, const Swarm::LoopEdge & edge1,
+        const Swarm::LoopEdge & edge2, Swarm::Pose & err_pose, Matrix6d & _covariance,
+        std::pair<Swarm::Pose, Matrix6d> & odom_a, std::pair<Swarm::Pose, Matrix6d> & odom_b) const;
     void OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & inter_loops, int id_a, int id_b);
     std::vector<int64_t> good_loops();
 public:
@@ -27,7 +39,7 @@ public:
 
     std::mutex lcm_mutex;
     
-    SwarmLocalOutlierRejection(int self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, Swarm::DroneTrajectory> &_ego_motion_trajs);
+    SwarmLocalOutlierRejection(int self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, EgoMotionIndex> &_ego_motion_index);
     std::vector<Swarm::LoopEdge> OutlierRejectionLoopEdges(ros::Time stamp, const std::vector<Swarm::LoopEdge> & available_loops);
 };
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "../src/ego_motion_index.hpp"
+#include <swarm_msgs/drone_trajectory.hpp>
+#include <d2common/utils.hpp>
+#include <random>
+
+using namespace D2PGO;
+using D2Common::Utility::TicToc;
+
+// Microbenchmark of relative odometry queries used in PCM:
+// Swarm::DroneTrajectory (recompose the path) vs EgoMotionIndex (prefix lookups).
+int main(int argc, char ** argv) {
+    int frame_num = 5000;
+    int query_num = 100000;
+    if (argc > 1) {
+        frame_num = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        query_num = atoi(argv[2]);
+    }
+    std::mt19937 rng(0);
+    std::normal_distribution<double> noise(0, 0.1);
+    Swarm::DroneTrajectory traj(0, true);
+    EgoMotionIndex index;
+    Swarm::Pose pose = Swarm::Pose::Identity();
+    for (int i = 0; i < frame_num; i++) {
+        Swarm::Pose delta(Vector3d(0.5 + noise(rng), noise(rng), noise(rng)),
+            Quaterniond(AngleAxisd(noise(rng), Vector3d::UnitZ())));
+        pose = pose * delta;
+        traj.push(i*0.1, pose, i);
+        index.push(i*0.1, pose, i);
+    }
+    std::uniform_int_distribution<int> frame_dist(0, frame_num - 1);
+    std::vector<std::pair<FrameIdType, FrameIdType>> queries(query_num);
+    for (auto & query : queries) {
+        query = std::make_pair(frame_dist(rng), frame_dist(rng));
+    }
+
+    TicToc tic;
+    double sum_traj = 0;
+    for (auto & query : queries) {
+        auto ret = traj.get_relative_pose_by_frame_id(query.first, query.second, true);
+        sum_traj += ret.first.pos().norm();
+    }
+    double traj_time = tic.toc();
+
+    tic.tic();
+    double sum_index = 0;
+    for (auto & query : queries) {
+        auto ret = index.relativePose(query.first, query.second, true);
+        sum_index += ret.first.pos().norm();
+    }
+    double index_time = tic.toc();
+
+    tic.tic();
+    EgoMotionIndex index_build;
+    pose = Swarm::Pose::Identity();
+    for (int i = 0; i < frame_num; i++) {
+        index_build.push(i*0.1, pose, i);
+    }
+    double build_time = tic.toc();
+
+    printf("[bench_ego_motion_index] frames %d queries %d\n", frame_num, query_num);
+    printf("DroneTrajectory: %.1fms %.3fus/query\n", traj_time, traj_time*1000/query_num);
+    printf("EgoMotionIndex:  %.1fms %.3fus/query build %.1fms\n", index_time, index_time*1000/query_num, build_time);
+    printf("Mean relative distance %.3f vs %.3f\n", sum_traj/query_num, sum_index/query_num);
+    return 0;
+}
@@ -0,0 +1,331 @@
+#include "posegraph_g2o.hpp"
+#include "../src/d2pgo.h"
+#include <thread>
+#include <atomic>
+#include <random>
+#include <ros/serialization.h>
+#include <swarm_msgs/DPGOSignal.h>
+#include <d2common/bench_options.hpp>
+
+// Single-process multi-agent benchmark of D2PGO.
+// N D2PGO instances are wired through an in-memory bus with configurable latency, loss and bandwidth,
+// so no roscore or ROS transport is needed. Agent i only knows its own partition <g2o>/i.g2o, as in
+// d2pgo_test_multi.launch. Each round every agent runs one solve_multi in parallel, then the global cost
+// (6-DoF residual of the union of all edges), bytes exchanged and ATE are written to CSV.
+
+using namespace D2PGO;
+using D2Common::Utility::TicToc;
+
+struct BusMessage {
+    int sender = -1;
+    int target = -1;
+    bool is_signal = false;
+    DPGOData data;
+    std::string signal;
+};
+
+class InMemoryBus {
+    std::mutex bus_mutex;
+    std::multimap<double, BusMessage> in_flight; // Deliver time (ms since start) -> message
+    std::map<int, double> link_free_time;
+    std::map<int, D2PGO::D2PGO*> agents;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    TicToc clock;
+    std::thread th;
+    std::atomic<bool> running{false};
+
+    // Serialization on the sender link, shared by all receivers of a multicast.
+    double transmitTime(int sender, size_t bytes) {
+        double now = clock.toc();
+        double start = std::max(now, link_free_time[sender]);
+        double tx_time = bandwidth_kbps > 0 ? bytes*8.0/bandwidth_kbps : 0;
+        link_free_time[sender] = start + tx_time;
+        return start + tx_time + latency_ms;
+    }
+
+    void multicast(int sender, BusMessage msg, size_t bytes, bool lossy) {
+        const std::lock_guard<std::mutex> lock(bus_mutex);
+        double deliver_time = transmitTime(sender, bytes);
+        bytes_sent += bytes;
+        msgs_sent++;
+        for (auto & it : agents) {
+            if (it.first == sender) {
+                continue;
+            }
+            if (lossy && uniform(rng) < loss_rate) {
+                msgs_lost++;
+                continue;
+            }
+            msg.target = it.first;
+            in_flight.emplace(deliver_time, msg);
+        }
+    }
+
+    void deliverDue() {
+        std::vector<BusMessage> due;
+        {
+            const std::lock_guard<std::mutex> lock(bus_mutex);
+            double now = clock.toc();
+            auto end = in_flight.upper_bound(now);
+            for (auto it = in_flight.begin(); it != end; it++) {
+                due.emplace_back(it->second);
+            }
+            in_flight.erase(in_flight.begin(), end);
+        }
+        for (auto & msg : due) {
+            if (msg.is_signal) {
+                agents.at(msg.target)->inputDPGOsignal(msg.sender, msg.signal);
+            } else {
+                agents.at(msg.target)->inputDPGOData(msg.data);
+            }
+        }
+    }
+public:
+    double latency_ms = 0;
+    double loss_rate = 0;
+    double bandwidth_kbps = 0; //0 for unlimited
+    std::atomic<size_t> bytes_sent{0};
+    std::atomic<size_t> msgs_sent{0};
+    std::atomic<size_t> msgs_lost{0};
+
+    InMemoryBus(): rng(0) {}
+
+    void addAgent(int agent_id, D2PGO::D2PGO * pgo) {
+        agents[agent_id] = pgo;
+        pgo->bd_data_callback = [this, agent_id] (const DPGOData & data) {
+            BusMessage msg;
+            msg.sender = agent_id;
+            msg.data = data;
+            auto ros_msg = data.toROS();
+            multicast(agent_id, msg, ros::serialization::serializationLength(ros_msg), true);
+        };
+        pgo->bd_signal_callback = [this, agent_id] (const std::string & signal) {
+            BusMessage msg;
+            msg.sender = agent_id;
+            msg.is_signal = true;
+            msg.signal = signal;
+            swarm_msgs::DPGOSignal ros_msg;
+            ros_msg.signal = signal;
+            ros_msg.drone_id = agent_id;
+            ros_msg.target_id = -1;
+            // Signals are resent by the agents until acknowledged, so they are not dropped here.
+            multicast(agent_id, msg, ros::serialization::serializationLength(ros_msg), false);
+        };
+    }
+
+    void start() {
+        running = true;
+        th = std::thread([&] {
+            while (running) {
+                deliverDue();
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+
+    void stop() {
+        running = false;
+        if (th.joinable()) {
+            th.join();
+        }
+    }
+};
+
+struct BenchParams {
+    std::string g2o_path = "";
+    std::string gt_path = "";
+    std::string csv_path = "d2pgo_bench.csv";
+    std::string solver_type = "arock";
+    int agents = 1;
+    int max_steps = 100;
+    bool is_4dof = true;
+    double conv_tol = 1e-4;
+    double latency_ms = 0;
+    double loss_rate = 0;
+    double bandwidth_kbps = 0;
+    int threads = 1;
+    bool use_autodiff = true;
+};
+
+D2PGOConfig makeConfig(const BenchParams & params, int self_id) {
+    D2PGOConfig config;
+    config.self_id = self_id;
+    config.main_id = 0;
+    config.pgo_pose_dof = params.is_4dof ? PGO_POSE_4D : PGO_POSE_6D;
+    config.loop_distance_threshold = 1000;
+    config.enable_ego_motion = false;
+    config.ceres_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    config.ceres_options.num_threads = params.threads;
+    config.pgo_use_autodiff = params.use_autodiff;
+    config.ceres_options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+    config.ceres_options.max_solver_time_in_seconds = 0.1;
+    config.ceres_options.max_num_iterations = 50;
+    config.arock_config.self_id = self_id;
+    config.arock_config.ceres_options = config.ceres_options;
+    config.arock_config.max_steps = 1;
+    config.rot_init_config.self_id = self_id;
+    config.rot_init_config.enable_float32 = false;
+    config.debug_rot_init_only = false;
+    config.write_g2o = false;
+    config.mode = params.solver_type == "ceres" ? PGO_MODE_NON_DIST : PGO_MODE_DISTRIBUTED_AROCK;
+    return config;
+}
+
+double evaluateCost(const std::vector<Swarm::LoopEdge> & edges, const std::map<FrameIdType, Swarm::Pose> & poses) {
+    double cost = 0;
+    for (auto & edge : edges) {
+        auto it_a = poses.find(edge.keyframe_id_a);
+        auto it_b = poses.find(edge.keyframe_id_b);
+        if (it_a == poses.end() || it_b == poses.end()) {
+            continue;
+        }
+        Swarm::Pose err = edge.relative_pose.inverse()*Swarm::Pose::DeltaPose(it_a->second, it_b->second);
+        Vector6d res = edge.getSqrtInfoMat()*err.log_map();
+        cost += 0.5*res.squaredNorm();
+    }
+    return cost;
+}
+
+double evaluateATE(const std::map<FrameIdType, D2BaseFrame> & gt, const std::map<FrameIdType, Swarm::Pose> & poses, FrameIdType align_frame) {
+    if (gt.empty() || gt.find(align_frame) == gt.end() || poses.find(align_frame) == poses.end()) {
+        return NAN;
+    }
+    Swarm::Pose align = gt.at(align_frame).odom.pose()*poses.at(align_frame).inverse();
+    double sum = 0;
+    int count = 0;
+    for (auto & it : poses) {
+        auto it_gt = gt.find(it.first);
+        if (it_gt == gt.end()) {
+            continue;
+        }
+        sum += ((align*it.second).pos() - it_gt->second.odom.pose().pos()).squaredNorm();
+        count++;
+    }
+    return count > 0 ? sqrt(sum/count) : NAN;
+}
+
+int main(int argc, char ** argv) {
+    BenchParams params;
+    D2Common::BenchOptions options;
+    options.addRequired("g2o", params.g2o_path, "directory of the per-agent partitions 0.g2o, 1.g2o, ...")
+        .add("gt", params.gt_path, "ground truth g2o of the full graph")
+        .add("csv", params.csv_path, "output csv")
+        .add("solver", params.solver_type, "arock or ceres")
+        .add("agents", params.agents, "number of agents")
+        .add("max_steps", params.max_steps, "maximum rounds")
+        .add("is_4dof", params.is_4dof, "4-DoF pose graph")
+        .add("conv_tol", params.conv_tol, "relative cost change regarded as converged")
+        .add("latency_ms", params.latency_ms, "bus latency")
+        .add("loss", params.loss_rate, "bus message loss rate")
+        .add("bandwidth_kbps", params.bandwidth_kbps, "bus bandwidth, 0 for unlimited")
+        .add("threads", params.threads, "solver threads per agent")
+        .add("autodiff", params.use_autodiff, "autodiff relative pose residuals");
+    options.parse(argc, argv);
+    if (params.agents < 1) {
+        printf("[d2pgo_bench] Need at least one agent\n");
+        return -1;
+    }
+    // Only the clock is needed, no roscore.
+    ros::Time::init();
+    std::vector<std::map<FrameIdType, D2BaseFrame>> keyframes(params.agents);
+    std::vector<std::vector<Swarm::LoopEdge>> agent_edges(params.agents);
+    // Union of the partitions for the global cost, inter-agent edges are known by both sides.
+    std::vector<Swarm::LoopEdge> edges;
+    std::set<std::pair<FrameIdType, FrameIdType>> edge_set;
+    size_t keyframe_num = 0;
+    for (int i = 0; i < params.agents; i++) {
+        auto path = params.g2o_path + "/" + std::to_string(i) + ".g2o";
+        read_g2o_agent(path, keyframes[i], agent_edges[i], params.is_4dof, params.agents - 1);
+        printf("[d2pgo_bench] agent %d %s keyframes %ld edges %ld\n", i, path.c_str(), keyframes[i].size(), agent_edges[i].size());
+        keyframe_num += keyframes[i].size();
+        for (auto & edge : agent_edges[i]) {
+            if (edge_set.insert(std::make_pair(edge.keyframe_id_a, edge.keyframe_id_b)).second) {
+                edges.emplace_back(edge);
+            }
+        }
+    }
+    std::map<FrameIdType, D2BaseFrame> gt_keyframes;
+    if (params.gt_path != "") {
+        std::vector<Swarm::LoopEdge> gt_edges;
+        read_g2o_agent(params.gt_path, gt_keyframes, gt_edges, params.is_4dof, params.agents - 1);
+    }
+    printf("[d2pgo_bench] %d agents keyframes %ld edges %ld latency %.1fms loss %.2f bandwidth %.0fkbps\n",
+        params.agents, keyframe_num, edges.size(), params.latency_ms, params.loss_rate, params.bandwidth_kbps);
+
+    InMemoryBus bus;
+    bus.latency_ms = params.latency_ms;
+    bus.loss_rate = params.loss_rate;
+    bus.bandwidth_kbps = params.bandwidth_kbps;
+    std::set<int> agent_ids;
+    for (int i = 0; i < params.agents; i++) {
+        agent_ids.insert(i);
+    }
+    std::vector<D2PGO::D2PGO*> pgos;
+    for (int i = 0; i < params.agents; i++) {
+        auto pgo = new D2PGO::D2PGO(makeConfig(params, i));
+        pgo->setAvailableRobots(agent_ids);
+        for (auto & kv : keyframes[i]) {
+            pgo->addFrame(kv.second);
+        }
+        for (auto & edge : agent_edges[i]) {
+            pgo->addLoop(edge, true);
+        }
+        bus.addAgent(i, pgo);
+        pgos.emplace_back(pgo);
+    }
+    FrameIdType align_frame = keyframes[0].empty() ? -1 : keyframes[0].begin()->first;
+
+    std::ofstream csv(params.csv_path);
+    csv << "iter,wall_time_ms,cost,bytes,msgs,msgs_lost,ate" << std::endl;
+    bus.start();
+    TicToc tic;
+    double last_cost = -1;
+    int converged_rounds = 0;
+    for (int iter = 0; iter < params.max_steps; iter++) {
+        std::vector<std::thread> threads;
+        for (auto pgo : pgos) {
+            threads.emplace_back([pgo, &params] {
+                if (params.solver_type == "ceres") {
+                    pgo->solve_single();
+                } else {
+                    pgo->solve_multi(true);
+                }
+            });
+        }
+        for (auto & th : threads) {
+            th.join();
+        }
+        double wall_time = tic.toc();
+        // Each agent is the authority of its own frames.
+        std::map<FrameIdType, Swarm::Pose> poses;
+        for (auto pgo : pgos) {
+            for (auto frame : pgo->getAllLocalFrames()) {
+                poses[frame->frame_id] = pgo->getOptimizedPose(frame);
+            }
+        }
+        double cost = evaluateCost(edges, poses);
+        double ate = evaluateATE(gt_keyframes, poses, align_frame);
+        csv << iter << "," << wall_time << "," << cost << "," << bus.bytes_sent << ","
+            << bus.msgs_sent << "," << bus.msgs_lost << "," << ate << std::endl;
+        printf("[d2pgo_bench] iter %d time %.1fms cost %.4e bytes %ld ate %.4f\n", iter, wall_time, cost,
+            (size_t)bus.bytes_sent, ate);
+        if (last_cost > 0 && fabs(last_cost - cost)/last_cost < params.conv_tol) {
+            converged_rounds++;
+            if (converged_rounds >= 3) {
+                printf("[d2pgo_bench] Converged at iter %d\n", iter);
+                break;
+            }
+        } else {
+            converged_rounds = 0;
+        }
+        last_cost = cost;
+    }
+    bus.stop();
+    csv.close();
+    printf("[d2pgo_bench] Total time %.1fms bytes %ld written to %s\n", tic.toc(), (size_t)bus.bytes_sent, params.csv_path.c_str());
+    for (auto pgo : pgos) {
+        delete pgo;
+    }
+    return 0;
+}
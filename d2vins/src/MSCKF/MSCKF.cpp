@@ -1,130 +1,485 @@
 #include "MSCKF.hpp"
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
+#include <d2common/d2vinsframe.h>
+#include <Eigen/QR>
+#include <unistd.h>
 
 namespace D2VINS {
+using D2Common::Utility::skewSymmetric;
+
+// 95% quantile of the chi-square distribution, Wilson-Hilferty approximation
+static double chi2Threshold(int dof) {
+    double h = 2.0 / (9.0 * dof);
+    return dof * pow(1 - h + 1.645 * sqrt(h), 3);
+}
+
+// Orthonormal basis of the tangent plane of the unit sphere at z
+static Eigen::Matrix<double, 3, 2> tangentBasis(const Vector3d & z) {
+    Vector3d a = fabs(z.x()) < 0.9 ? Vector3d::UnitX() : Vector3d::UnitY();
+    Vector3d b1 = z.cross(a).normalized();
+    Vector3d b2 = z.cross(b1);
+    Eigen::Matrix<double, 3, 2> B;
+    B << b1, b2;
+    return B;
+}
+
 MSCKF::MSCKF() {
     Q_imu.setZero();
-    Q_imu.block<3, 3>(0, 0) = _config.gyr_n*Matrix3d::Identity();
-    Q_imu.block<3, 3>(3, 3) = _config.gyr_w*Matrix3d::Identity();
-    Q_imu.block<3, 3>(6, 6) = _config.acc_n*Matrix3d::Identity();
-    Q_imu.block<3, 3>(9, 9) = _config.acc_w*Matrix3d::Identity();
+    Q_imu.block<3, 3>(0, 0) = params->gyr_n*params->gyr_n*Matrix3d::Identity();
+    Q_imu.block<3, 3>(3, 3) = params->gyr_w*params->gyr_w*Matrix3d::Identity();
+    Q_imu.block<3, 3>(6, 6) = params->acc_n*params->acc_n*Matrix3d::Identity();
+    Q_imu.block<3, 3>(9, 9) = params->acc_w*params->acc_w*Matrix3d::Identity();
+    obs_sigma = params->msckf_obs_noise_px / params->focal_length;
+    nominal_state.camera_extrisincs = params->camera_extrinsics;
+    td = params->td_initial;
+}
+
+void MSCKF::inputImu(const IMUData & data) {
+    const Guard lock(state_lock);
+    if (!initFirstPoseFlag) {
+        imubuf.add(data);
+    }
+    imu_queue.push_back(data);
+    if (initFirstPoseFlag && data.t > prop_odom.stamp) {
+        IMUData imu = data;
+        imu.dt = data.t - prop_odom.stamp;
+        imu.propagation(prop_odom, nominal_state.bias_acc, nominal_state.bias_gyro, imu_last_prop);
+        imu_last_prop = data;
+    }
 }
 
-void MSCKF::initFirstPose() {
+void MSCKF::initFirstPose(const VisualImageDescArray & frame) {
+    double t_img = frame.stamp + td;
     auto q0 = Utility::g2R(imubuf.mean_acc());
     nominal_state.q_imu = q0;
+    nominal_state.q_imu.normalize();
+    nominal_state.bias_gyro = imubuf.mean_gyro();
+    nominal_state.bias_acc = imubuf.mean_acc() - nominal_state.q_imu.inverse() * IMUData::Gravity;
+    nominal_state.v_imu.setZero();
+    nominal_state.p_imu.setZero();
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> P0;
+    P0.setZero();
+    P0.block<3, 3>(0, 0) = 1e-4 * Matrix3d::Identity();
+    P0.block<3, 3>(3, 3) = 1e-4 * Matrix3d::Identity();
+    P0.block<3, 3>(6, 6) = 1e-2 * Matrix3d::Identity();
+    P0.block<3, 3>(9, 9) = 1e-2 * Matrix3d::Identity();
+    P0.block<3, 3>(12, 12) = 1e-6 * Matrix3d::Identity();
+    error_state.setImuP(P0);
+    //The IMU before the frame is used by the initialization
+    while (!imu_queue.empty() && imu_queue.front().t <= t_img) {
+        imu_last = imu_queue.front();
+        imu_queue.pop_front();
+    }
+    imu_last.t = t_img;
+    t_last = t_img;
+    initFirstPoseFlag = true;
+    printf("[D2VINS::MSCKF] Init pose with IMU %ld samples, q0 %s Ba %.3f %.3f %.3f Bg %.3f %.3f %.3f\n", imubuf.size(),
+        nominal_state.imuPose().toStr().c_str(), nominal_state.bias_acc.x(), nominal_state.bias_acc.y(), nominal_state.bias_acc.z(),
+        nominal_state.bias_gyro.x(), nominal_state.bias_gyro.y(), nominal_state.bias_gyro.z());
 }
 
-void MSCKF::predict(const double t, const IMUData & imudata) {
-    //Follows  Mourikis, Anastasios I., and Stergios I. Roumeliotis. 
-    // "A multi-state constraint Kalman filter for vision-aided inertial navigation." 
+void MSCKF::predict(const IMUData & imudata) {
+    //Follows  Mourikis, Anastasios I., and Stergios I. Roumeliotis.
+    // "A multi-state constraint Kalman filter for vision-aided inertial navigation."
     // Proceedings 2007 IEEE International Conference on Robotics and Automation. IEEE, 2007.
-    // Sect III-B
-    if (t_last < 0 ) {
-        t_last = t;
-    }
-
-    imubuf.add(imudata);
-    if (!initFirstPoseFlag) {
-        //First pose is inited in keyframe. So first pose must is a keyframe.
+    // Sect III-B, with local angle errors (R = R_hat Exp(ang)) as in Sola J. Quaternion kinematics
+    // for the error-state Kalman filter.
+    double dt = imudata.t - t_last;
+    if (dt <= 0) {
         return;
     }
+    Matrix3d R0 = nominal_state.get_imu_R();
+    Vector3d angvel_hat = 0.5 * (imu_last.gyro + imudata.gyro) - nominal_state.bias_gyro; //Planet angular velocity is ignored
+    Vector3d acc_hat = 0.5 * (imu_last.acc + imudata.acc) - nominal_state.bias_acc;
 
-    double dt = t - t_last;
-
-    static IMUData imudatalast;
-
-    //trapezoidal integration
-    Vector3d gyro = (imudata.gyro + imudatalast.gyro)/2;
-    Vector3d acc = (imudata.acc + imudatalast.acc)/2;
-    imudatalast = imudata;
-    
-    Vector3d angvel_hat = imudata.gyro - error_state.bias_gyro; //Planet angular velocity is ignored
-    Matrix3d Rq_hat = nominal_state.get_imu_R();
-    Vector3d acc_hat = imudata.acc - error_state.bias_acc;
-
-    //Nominal State
-    Quaterniond omg_l(0, angvel_hat.x(), angvel_hat.y(), angvel_hat.z());
-
-    //Naive intergation
-    auto qdot = nominal_state.q_imu * omg_l;
-    auto vdot = Rq_hat*acc_hat + IMUData::Gravity;
-    auto pdot = nominal_state.v_imu;
-
-    //Internal the quaternion is save as [qw, qx, qy, qz] in Eigen
-    nominal_state.q_imu.coeffs().block<3, 1>(0, 0) += qdot.coeffs().block<3, 1>(0, 0)*dt;
+    //Nominal state, midpoint integration as IMUData::propagation
+    Vector3d un_acc_0 = nominal_state.q_imu * (imu_last.acc - nominal_state.bias_acc) - IMUData::Gravity;
+    nominal_state.q_imu = nominal_state.q_imu * Utility::deltaQ(angvel_hat * dt);
     nominal_state.q_imu.normalize();
-    nominal_state.v_imu += vdot*dt;
-    nominal_state.p_imu += pdot*dt;
-
+    Vector3d un_acc_1 = nominal_state.q_imu * (imudata.acc - nominal_state.bias_acc) - IMUData::Gravity;
+    Vector3d un_acc = 0.5 * (un_acc_0 + un_acc_1);
+    nominal_state.p_imu += dt * nominal_state.v_imu + 0.5 * dt * dt * un_acc;
+    nominal_state.v_imu += dt * un_acc;
 
     //Error state
     // Model:
     // d (x_err)/dt = F_mat * x_err + G * n_imu
-    // x_err: error state vector
-
+    // x_err: [ang, bias_gyro, v, bias_acc, pos], n_imu: [n_g, n_wg, n_a, n_wa]
     Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> F_mat;
     F_mat.setZero();
-
-    //Rows 1-3, dynamics on quat
-    F_mat.block<3, 3>(0, 0) = skewSymmetric(angvel_hat);
+    F_mat.block<3, 3>(0, 0) = - skewSymmetric(angvel_hat);
     F_mat.block<3, 3>(0, 3) = - Matrix3d::Identity();
-
-    //Rows 4-6, dynamics on bias is empty
-    //Rows 7-9, dynamics on velocity
-    F_mat.block<3, 3>(6, 0) = - Rq_hat * skewSymmetric(acc_hat);
-    F_mat.block<3, 3>(6, 6) = - 2 * skewSymmetric(acc_hat);
-    F_mat.block<3, 3>(6, 9) = - Rq_hat;
-    F_mat.block<3, 3>(6, 12) = - skewSymmetric(acc_hat);
-    //Rows 10-12, dynamics on bias is empty
-    
-    //Rows 13-15, dynamics on position
+    F_mat.block<3, 3>(6, 0) = - R0 * skewSymmetric(acc_hat);
+    F_mat.block<3, 3>(6, 9) = - R0;
     F_mat.block<3, 3>(12, 6) = Matrix3d::Identity();
 
     Eigen::Matrix<double, IMU_STATE_DIM, IMU_NOISE_DIM> G_mat;
     G_mat.setZero();
     G_mat.block<3, 3>(0, 0) = - Matrix3d::Identity();
     G_mat.block<3, 3>(3, 3) = Matrix3d::Identity();
-    G_mat.block<3, 3>(6, 6) = - Rq_hat;
+    G_mat.block<3, 3>(6, 6) = - R0;
     G_mat.block<3, 3>(9, 9) = Matrix3d::Identity();
 
-    //Now we need to intergate this, naive approach is trapezoidal rule
-    //x_err_new = F_mat*x_err_last*dt + x_err_last
-    //Or \dot Phi = F_mat Phi, Phi(0) = I
-    // Phi = I + F_mat Phi * dt
-    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Phi;
-    Phi.setIdentity();
-    Phi = Phi + F_mat*dt;
-    auto G = G_mat*dt;
-    
+    // Phi = exp(F dt), truncated at the second order
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Fdt = F_mat * dt;
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Phi =
+        Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM>::Identity() + Fdt + 0.5 * Fdt * Fdt;
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Qd = Phi * G_mat * Q_imu * G_mat.transpose() * Phi.transpose() * dt;
+
     // Suggest by (268)-(269) in Sola J. Quaternion kinematics for the error-state Kalman filter
     // We don't predict the error state space
     // Instead, we only predict the P of error state, and predict the nominal state
-    auto P_new = Phi*error_state.getImuP()*Phi.transpose() + G*Q_imu*G.transpose();
-    auto P_imu_other_new = Phi*error_state.getImuOtherP();
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> P_new = Phi*error_state.getImuP()*Phi.transpose() + Qd;
+    error_state.setImuP(0.5 * (P_new + P_new.transpose()));
+    if (error_state.stateDimFull() > IMU_STATE_DIM) {
+        error_state.setImuOtherP(Phi*error_state.getImuOtherP());
+    }
+    imu_last = imudata;
+    t_last = imudata.t;
+}
+
+void MSCKF::propagateTo(double t) {
+    while (!imu_queue.empty() && imu_queue.front().t <= t) {
+        predict(imu_queue.front());
+        imu_queue.pop_front();
+    }
+    if (t_last < t && !imu_queue.empty()) {
+        //Interpolate the IMU at t, the next sample is applied by the next propagation
+        auto & next = imu_queue.front();
+        double alpha = (t - imu_last.t) / (next.t - imu_last.t);
+        IMUData imu;
+        imu.t = t;
+        imu.acc = (1 - alpha) * imu_last.acc + alpha * next.acc;
+        imu.gyro = (1 - alpha) * imu_last.gyro + alpha * next.gyro;
+        predict(imu);
+    }
+}
+
+void MSCKF::addObservations(const VisualImageDescArray & frame) {
+    for (auto & img : frame.images) {
+        for (auto lm : img.landmarks) {
+            if (lm.landmark_id < 0 || lm.camera_index >= nominal_state.camera_extrisincs.size()) {
+                continue;
+            }
+            lm.frame_id = frame.frame_id;
+            feature_tracks[lm.landmark_id].emplace_back(lm);
+        }
+    }
+}
 
-    //Set states to error_state
-    error_state.setImuP(P_new);
-    error_state.setImuOtherP(P_imu_other_new);
+Swarm::Pose MSCKF::cameraPose(int clone_index, int camera_index) const {
+    return nominal_state.sld_win_poses[clone_index] * nominal_state.camera_extrisincs[camera_index];
 }
 
-void MSCKF::addKeyframe(const double t) {
-    //For convience, we require t here is exact same to last imu t
-     if (!initFirstPoseFlag) {
-        if (imubuf.size() >= _config.init_imu_num) {
-            initFirstPose();
+bool MSCKF::triangulate(const std::vector<LandmarkPerFrame> & track, Vector3d & pos) const {
+    //Linear triangulation on the bearings: sum (I - d d^T)(P - c) = 0
+    Matrix3d A = Matrix3d::Zero();
+    Vector3d b = Vector3d::Zero();
+    std::vector<Swarm::Pose> cam_poses;
+    std::vector<Vector3d> bearings;
+    for (auto & lm : track) {
+        int clone_index = nominal_state.cloneIndex(lm.frame_id);
+        if (clone_index < 0) {
+            continue;
         }
+        auto pose = cameraPose(clone_index, lm.camera_index);
+        Vector3d z = lm.pt3d_norm.normalized();
+        Vector3d d = pose.att() * z;
+        Matrix3d M = Matrix3d::Identity() - d * d.transpose();
+        A += M;
+        b += M * pose.pos();
+        cam_poses.emplace_back(pose);
+        bearings.emplace_back(z);
+    }
+    if (cam_poses.size() < 2) {
+        return false;
+    }
+    Eigen::SelfAdjointEigenSolver<Matrix3d> eig(A);
+    //Smallest eigen value is ~ sin^2(parallax) / 2 for two rays
+    if (eig.eigenvalues()(0) < 1e-4 * cam_poses.size()) {
+        return false;
+    }
+    pos = A.ldlt().solve(b);
+    //Refine on the unit sphere residuals
+    for (int iter = 0; iter < 3; iter ++) {
+        Matrix3d JtJ = Matrix3d::Zero();
+        Vector3d Jtr = Vector3d::Zero();
+        for (int i = 0; i < cam_poses.size(); i++) {
+            Vector3d f = cam_poses[i].att().inverse() * (pos - cam_poses[i].pos());
+            double norm = f.norm();
+            Vector3d n = f / norm;
+            auto B = tangentBasis(bearings[i]);
+            Eigen::Matrix<double, 2, 3> J = B.transpose() * (Matrix3d::Identity() - n * n.transpose()) / norm
+                * cam_poses[i].att().inverse().toRotationMatrix();
+            Vector2d r = B.transpose() * (bearings[i] - n);
+            JtJ += J.transpose() * J;
+            Jtr += J.transpose() * r;
+        }
+        pos += JtJ.ldlt().solve(Jtr);
+    }
+    for (int i = 0; i < cam_poses.size(); i++) {
+        Vector3d f = cam_poses[i].att().inverse() * (pos - cam_poses[i].pos());
+        //In front of the camera along the observed bearing, which also holds for fisheye beyond 180 degrees
+        if (f.dot(bearings[i]) < 0.5 * f.norm() || f.norm() < params->min_depth_to_fuse) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MSCKF::featureJacobian(const std::vector<LandmarkPerFrame> & track, MatrixXd & H_x, VectorXd & r) const {
+    Vector3d pos;
+    if (!triangulate(track, pos)) {
+        return false;
+    }
+    int obs_num = track.size();
+    int dim = error_state.stateDimFull();
+    MatrixXd H_xf = MatrixXd::Zero(2 * obs_num, dim);
+    MatrixXd H_f = MatrixXd::Zero(2 * obs_num, 3);
+    VectorXd r_f = VectorXd::Zero(2 * obs_num);
+    int row = 0;
+    for (auto & lm : track) {
+        int clone_index = nominal_state.cloneIndex(lm.frame_id);
+        if (clone_index < 0) {
+            continue;
+        }
+        auto & pose_i = nominal_state.sld_win_poses[clone_index];
+        auto & ext = nominal_state.camera_extrisincs[lm.camera_index];
+        Matrix3d R_i = pose_i.R();
+        Matrix3d R_bc = ext.R();
+        // f = R_bc^T (R_i^T (P - p_i) - t_bc)
+        Vector3d q = R_i.transpose() * (pos - pose_i.pos());
+        Vector3d f = R_bc.transpose() * (q - ext.pos());
+        double norm = f.norm();
+        Vector3d n = f / norm;
+        Vector3d z = lm.pt3d_norm.normalized();
+        auto B = tangentBasis(z);
+        Eigen::Matrix<double, 2, 3> J = B.transpose() * (Matrix3d::Identity() - n * n.transpose()) / norm;
+        int offset = MSCKFErrorStateVector::cloneOffset(clone_index);
+        H_xf.block<2, 3>(row, offset) = J * R_bc.transpose() * skewSymmetric(q);
+        H_xf.block<2, 3>(row, offset + 3) = - J * R_bc.transpose() * R_i.transpose();
+        H_f.block<2, 3>(row, 0) = J * R_bc.transpose() * R_i.transpose();
+        r_f.segment<2>(row) = B.transpose() * (z - n);
+        row += 2;
+    }
+    if (row <= 3) {
+        return false;
+    }
+    //Project on the left null space of H_f to remove the feature from the measurement
+    Eigen::HouseholderQR<MatrixXd> qr(H_f.topRows(row));
+    MatrixXd Qt = qr.householderQ().transpose();
+    H_x = (Qt * H_xf.topRows(row)).bottomRows(row - 3);
+    r = (Qt * r_f.head(row)).bottomRows(row - 3);
+    //Chi-square test
+    MatrixXd S = H_x * error_state.P * H_x.transpose();
+    S.diagonal().array() += obs_sigma * obs_sigma;
+    double gamma = r.dot(S.ldlt().solve(r));
+    return gamma < chi2Threshold(row - 3);
+}
+
+void MSCKF::update(const std::vector<LandmarkIdType> & landmark_ids) {
+    std::vector<MatrixXd> Hs;
+    std::vector<VectorXd> rs;
+    int rows = 0;
+    for (auto landmark_id : landmark_ids) {
+        MatrixXd H_x;
+        VectorXd r;
+        if (featureJacobian(feature_tracks.at(landmark_id), H_x, r)) {
+            rows += r.rows();
+            Hs.emplace_back(H_x);
+            rs.emplace_back(r);
+            used_features ++;
+        } else {
+            rejected_features ++;
+        }
+    }
+    if (rows == 0) {
         return;
     }
-    if (t_last >= 0) {
-        assert(fabs(t - t_last) < 1.0/_config.IMU_FREQ && "MSCKF new image must be added EXACTLY after the corresponding imu is applied!");
+    MatrixXd H(rows, error_state.stateDimFull());
+    VectorXd r(rows);
+    int row = 0;
+    for (int i = 0; i < Hs.size(); i++) {
+        H.middleRows(row, Hs[i].rows()) = Hs[i];
+        r.segment(row, rs[i].rows()) = rs[i];
+        row += Hs[i].rows();
+    }
+    measurementUpdate(H, r);
+}
+
+void MSCKF::measurementUpdate(MatrixXd & H, VectorXd & r) {
+    int dim = error_state.stateDimFull();
+    if (H.rows() > dim) {
+        //Measurement compression, (28)-(29) in [Mourikis et al. 2007]
+        Eigen::HouseholderQR<MatrixXd> qr(H);
+        MatrixXd Qt = qr.householderQ().transpose();
+        VectorXd r_c = (Qt * r).head(dim);
+        MatrixXd H_c = qr.matrixQR().topRows(dim).triangularView<Eigen::Upper>();
+        H = H_c;
+        r = r_c;
+    }
+    measurement_dim += H.rows();
+    auto & P = error_state.P;
+    MatrixXd S = H * P * H.transpose();
+    S.diagonal().array() += obs_sigma * obs_sigma;
+    MatrixXd K = S.ldlt().solve(H * P).transpose();
+    VectorXd dx = K * r;
+    P = P - K * S * K.transpose();
+    P = 0.5 * (P + P.transpose());
+    nominal_state.inject(dx);
+}
+
+void MSCKF::pruneClones() {
+    while (nominal_state.sld_win_ids.size() > params->msckf_max_clones) {
+        FrameIdType frame_id = nominal_state.sld_win_ids.front();
+        //Use the features observed in the oldest clone before removing it
+        std::vector<LandmarkIdType> landmark_ids;
+        for (auto & it : feature_tracks) {
+            if (it.second.size() >= params->msckf_min_track && it.second.front().frame_id == frame_id) {
+                landmark_ids.emplace_back(it.first);
+            }
+        }
+        update(landmark_ids);
+        for (auto landmark_id : landmark_ids) {
+            feature_tracks.erase(landmark_id);
+        }
+        for (auto it = feature_tracks.begin(); it != feature_tracks.end();) {
+            auto & track = it->second;
+            while (!track.empty() && track.front().frame_id == frame_id) {
+                track.erase(track.begin());
+            }
+            if (track.empty()) {
+                it = feature_tracks.erase(it);
+            } else {
+                it++;
+            }
+        }
+        nominal_state.removeClone(0);
+        error_state.removeClone(0);
+    }
+}
+
+bool MSCKF::inputImage(VisualImageDescArray & frame) {
+    D2_TRACE_ZONE("MSCKF::inputImage");
+    TicToc tic;
+    double t_img = frame.stamp + td;
+    while (true) {
+        {
+            const Guard lock(state_lock);
+            if (!imu_queue.empty() && imu_queue.back().t >= t_img) {
+                break;
+            }
+        }
+        usleep(1000);
+    }
+    const Guard lock(state_lock);
+    used_features = 0;
+    rejected_features = 0;
+    measurement_dim = 0;
+    if (!initFirstPoseFlag) {
+        if (imubuf.size() < params->init_imu_num) {
+            return false;
+        }
+        initFirstPose(frame);
+    } else {
+        propagateTo(t_img);
+    }
+    error_state.stateAugmentation();
+    nominal_state.addKeyframe(frame.frame_id);
+    addObservations(frame);
+
+    //Features lost in this frame
+    std::set<LandmarkIdType> observed;
+    for (auto & img : frame.images) {
+        for (auto & lm : img.landmarks) {
+            observed.insert(lm.landmark_id);
+        }
+    }
+    std::vector<LandmarkIdType> lost_ids;
+    for (auto it = feature_tracks.begin(); it != feature_tracks.end();) {
+        if (observed.find(it->first) != observed.end()) {
+            it++;
+            continue;
+        }
+        if (it->second.size() >= params->msckf_min_track) {
+            lost_ids.emplace_back(it->first);
+            it++;
+        } else {
+            it = feature_tracks.erase(it);
+        }
+    }
+    update(lost_ids);
+    for (auto landmark_id : lost_ids) {
+        feature_tracks.erase(landmark_id);
+    }
+    pruneClones();
+
+    frame.pose_drone = nominal_state.imuPose();
+    frame.Ba = nominal_state.bias_acc;
+    frame.Bg = nominal_state.bias_gyro;
+    frame.setTd(td);
+
+    //Restart the IMU rate propagation from the updated state
+    prop_odom = filterOdometry();
+    imu_last_prop = imu_last;
+    for (auto & imu : imu_queue) {
+        IMUData _imu = imu;
+        _imu.dt = imu.t - prop_odom.stamp;
+        _imu.propagation(prop_odom, nominal_state.bias_acc, nominal_state.bias_gyro, imu_last_prop);
+        imu_last_prop = imu;
+    }
+    if (params->enable_perf_output) {
+        printf("[D2VINS::MSCKF] frame %ld clones %ld features %ld used %d rejected %d measurement dim %d state dim %d time %.2fms\n",
+            frame.frame_id, nominal_state.sld_win_ids.size(), feature_tracks.size(), used_features, rejected_features,
+            measurement_dim, error_state.stateDimFull(), tic.toc());
     }
-    error_state.stateAugmentation(t);
-    nominal_state.addKeyframe(t);
+    return true;
 }
 
-void MSCKF::update(const LandmarkPerId & feature_by_id) {  
-   
+Swarm::Odometry MSCKF::filterOdometry() const {
+    Swarm::Odometry odom(t_last, nominal_state.imuPose());
+    odom.vel() = nominal_state.v_imu;
+    return odom;
 }
 
-}
\ No newline at end of file
+Swarm::Odometry MSCKF::getOdometry() const {
+    const Guard lock(state_lock);
+    return filterOdometry();
+}
+
+Swarm::Odometry MSCKF::getImuPropagation() const {
+    const Guard lock(state_lock);
+    return prop_odom;
+}
+
+Swarm::Odometry MSCKF::getMotionPredict(double stamp) const {
+    const Guard lock(state_lock);
+    if (!initFirstPoseFlag) {
+        return Swarm::Odometry();
+    }
+    double t = stamp + td;
+    Swarm::Odometry odom = filterOdometry();
+    IMUData imu_prev = imu_last;
+    for (auto & imu : imu_queue) {
+        if (imu.t > t) {
+            break;
+        }
+        IMUData _imu = imu;
+        _imu.dt = imu.t - odom.stamp;
+        _imu.propagation(odom, nominal_state.bias_acc, nominal_state.bias_gyro, imu_prev);
+        imu_prev = imu;
+    }
+    return odom;
+}
+
+std::vector<Swarm::Pose> MSCKF::getClonePoses() const {
+    const Guard lock(state_lock);
+    return nominal_state.sld_win_poses;
+}
+
+int MSCKF::cloneNum() const {
+    const Guard lock(state_lock);
+    return nominal_state.sld_win_ids.size();
+}
+}
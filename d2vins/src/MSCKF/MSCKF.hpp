@@ -1,24 +1,64 @@
-#include <d2common/d2vinsframe.h>
+#pragma once
+#include <d2common/d2frontend_types.h>
+#include <d2common/d2imu.h>
+#include <swarm_msgs/Odometry.h>
 #include "../d2vins_params.hpp"
 #include "MSCKF_state.hpp"
+#include <deque>
+#include <mutex>
+
 using namespace D2Common;
 namespace D2VINS {
+// Multi-state constraint Kalman filter [Mourikis et al. 2007], a low latency alternative to the sliding
+// window optimization of D2Estimator on a single drone. The filter state is the IMU state and the IMU
+// poses cloned at the last frames. Features are not estimated: when a track ends, or when the oldest
+// clone it is observed in is pruned, the feature is triangulated and its observations constrain the
+// clones after projection on the left null space of the feature Jacobian.
+// Observations are unit bearings of LandmarkPerFrame, so fisheye and multiple cameras are handled alike.
 class MSCKF {
     MSCKFStateVector nominal_state;
     MSCKFErrorStateVector error_state;
-    D2VINSConfig _config;
     double t_last = -1;
     bool initFirstPoseFlag = false;
+    double td = 0;
 
-    IMUBuffer imubuf;
+    IMUBuffer imubuf; //IMU before the first pose, for initialization
+    std::deque<IMUData> imu_queue; //IMU not yet applied to the filter
+    IMUData imu_last;
+    Swarm::Odometry prop_odom; //IMU rate propagation of the latest filter state
+    IMUData imu_last_prop;
 
+    std::map<LandmarkIdType, std::vector<LandmarkPerFrame>> feature_tracks;
     Eigen::Matrix<double, IMU_NOISE_DIM, IMU_NOISE_DIM> Q_imu;
+    double obs_sigma;
+    mutable std::recursive_mutex state_lock;
+
+    //Statistics of the last frame
+    int used_features = 0;
+    int rejected_features = 0;
+    int measurement_dim = 0;
 
+    void initFirstPose(const VisualImageDescArray & frame);
+    void predict(const IMUData & imudata);
+    void propagateTo(double t);
+    void addObservations(const VisualImageDescArray & frame);
+    bool triangulate(const std::vector<LandmarkPerFrame> & track, Vector3d & pos) const;
+    bool featureJacobian(const std::vector<LandmarkPerFrame> & track, MatrixXd & H_x, VectorXd & r) const;
+    void update(const std::vector<LandmarkIdType> & landmark_ids);
+    void measurementUpdate(MatrixXd & H, VectorXd & r);
+    void pruneClones();
+    Swarm::Pose cameraPose(int clone_index, int camera_index) const;
+    Swarm::Odometry filterOdometry() const;
 public:
     MSCKF();
-    void initFirstPose();
-    void predict(const double t, const IMUData & imudata);
-    void addKeyframe(const double t); //For convience, we require t here is exact same to last imu t
-    void update(const LandmarkPerId & feature_by_id);
+    void inputImu(const IMUData & data);
+    //Propagate to the frame, clone the pose and update with the features whose track ended.
+    //Returns false while the filter is not initialized.
+    bool inputImage(VisualImageDescArray & frame);
+    Swarm::Odometry getOdometry() const;
+    Swarm::Odometry getImuPropagation() const;
+    Swarm::Odometry getMotionPredict(double stamp) const;
+    std::vector<Swarm::Pose> getClonePoses() const;
+    int cloneNum() const;
 };
-}
\ No newline at end of file
+}
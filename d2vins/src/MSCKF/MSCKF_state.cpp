@@ -1,5 +1,7 @@
 #include "MSCKF_state.hpp"
+#include <d2common/utils.hpp>
 
+namespace D2VINS {
 MSCKFStateVector::MSCKFStateVector():
     q_imu(1.0, 0.0, 0.0, 0.0),
     bias_gyro(0.0, 0.0, 0.0),
@@ -9,61 +11,54 @@ MSCKFStateVector::MSCKFStateVector():
 {
 }
 
-Matrix3d MSCKFStateVector::get_imu_R() const { 
+Matrix3d MSCKFStateVector::get_imu_R() const {
     return q_imu.toRotationMatrix();
 }
 
-MSCKFErrorStateVector::MSCKFErrorStateVector(const MSCKFStateVector & state0) {
-    ang.setZero();
-    pos.setZero();
-    v_imu.setZero();
-    bias_gyro.setZero();
-    bias_acc.setZero();
-    camera_extrisincs.resize(state0.camera_extrisincs.size());
-    for (auto & extrinsic : camera_extrisincs) {
-        extrinsic.first.setZero();
-        extrinsic.second.setZero();
-    }
-
-    sld_win_poses.resize(state0.sld_win_poses.size());
-    
-    for (auto & pose : camera_extrisincs) {
-        pose.first.setZero();
-        pose.second.setZero();
-    }
+Swarm::Pose MSCKFStateVector::imuPose() const {
+    return Swarm::Pose(p_imu, q_imu);
 }
 
-void MSCKFErrorStateVector::reset(MSCKFStateVector & nominal) {
-    assert(camera_extrisincs.size() == nominal.camera_extrisincs.size());
-    assert(sld_win_poses.size() == nominal.sld_win_poses.size());
+void MSCKFStateVector::addKeyframe(FrameIdType frame_id) {
+    sld_win_poses.push_back(imuPose());
+    sld_win_ids.push_back(frame_id);
+}
 
-    //TODO:
+void MSCKFStateVector::removeClone(int index) {
+    sld_win_poses.erase(sld_win_poses.begin() + index);
+    sld_win_ids.erase(sld_win_ids.begin() + index);
 }
 
-void MSCKFErrorStateVector::setImuVector(Eigen::Matrix<double, IMU_STATE_DIM, 1> v) {
-    ang = v.block<3, 1>(0, 0);
-    bias_gyro = v.block<3, 1>(3, 0);
-    v_imu = v.block<3, 1>(6, 0);
-    bias_acc = v.block<3, 1>(9, 0);
-    pos = v.block<3, 1>(12, 0);
+int MSCKFStateVector::cloneIndex(FrameIdType frame_id) const {
+    for (int i = 0; i < sld_win_ids.size(); i++) {
+        if (sld_win_ids[i] == frame_id) {
+            return i;
+        }
+    }
+    return -1;
 }
 
-void MSCKFErrorStateVector::setImuP(Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> _P) {
-    P.block<IMU_STATE_DIM, IMU_STATE_DIM>(0, 0) = _P;
+void MSCKFStateVector::inject(const VectorXd & dx) {
+    q_imu = q_imu * D2Common::Utility::quatfromRotationVector(dx.segment<3>(0));
+    q_imu.normalize();
+    bias_gyro += dx.segment<3>(3);
+    v_imu += dx.segment<3>(6);
+    bias_acc += dx.segment<3>(9);
+    p_imu += dx.segment<3>(12);
+    for (int i = 0; i < sld_win_poses.size(); i++) {
+        int offset = MSCKFErrorStateVector::cloneOffset(i);
+        auto & pose = sld_win_poses[i];
+        Quaterniond q = pose.att() * D2Common::Utility::quatfromRotationVector(dx.segment<3>(offset));
+        pose = Swarm::Pose(pose.pos() + dx.segment<3>(offset + 3), q.normalized());
+    }
 }
 
-void MSCKFStateVector::addKeyframe(double t) {
-    sld_win_poses.push_back(Swarm::Pose(q_imu, p_imu));
+MSCKFErrorStateVector::MSCKFErrorStateVector() {
+    P = MatrixXd::Zero(IMU_STATE_DIM, IMU_STATE_DIM);
 }
 
-Eigen::Matrix<double, IMU_STATE_DIM, 1> MSCKFErrorStateVector::getImuVector() const {
-    Eigen::Matrix<double, IMU_STATE_DIM, 1> v;
-    v.block<3, 1>(0, 0) = ang;
-    v.block<3, 1>(3, 0) = bias_gyro;
-    v.block<3, 1>(6, 0) = v_imu;
-    v.block<3, 1>(9, 0) = bias_acc;
-    v.block<3, 1>(12, 0) = pos;
-    return v;
+void MSCKFErrorStateVector::setImuP(const Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> & _P) {
+    P.block<IMU_STATE_DIM, IMU_STATE_DIM>(0, 0) = _P;
 }
 
 Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> MSCKFErrorStateVector::getImuP() const {
@@ -74,27 +69,39 @@ Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> MSCKFErrorStateVector::getI
     return P.block(0, IMU_STATE_DIM, IMU_STATE_DIM, P.cols() - IMU_STATE_DIM);
 }
 
-void MSCKFErrorStateVector::setImuOtherP(Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> _P) {
+void MSCKFErrorStateVector::setImuOtherP(const Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> & _P) {
     P.block(0, IMU_STATE_DIM, IMU_STATE_DIM, P.cols() - IMU_STATE_DIM) = _P;
     P.block(IMU_STATE_DIM, 0, P.cols() - IMU_STATE_DIM, IMU_STATE_DIM) = _P.transpose();
 }
 
-void MSCKFErrorStateVector::stateAugmentation(double t) {
+void MSCKFErrorStateVector::stateAugmentation() {
     // This function  modified from (14) - (16) in [Mourikis et al. 2007].
     // The original state records image poses in  [Mourikis et al. 2007].
     // [Li M. et al. 2013] suggest to directly use IMU poses.
-    // Our implementations also record IMU poses because we will make this appliable to arbitrary number of cameras. 
-
+    // Our implementations also record IMU poses because we will make this appliable to arbitrary number of cameras.
+    // The clone is a copy of the IMU pose, so J only selects the angle and the position.
     int prev_dim = stateDimFull();
-    sld_win_poses.push_back(std::make_pair(ang, pos));
-    auto G = MatrixXd(prev_dim + 6, prev_dim);
-    G.setZero();
-
-    auto J = MatrixXd(6, prev_dim);
-    J.block(0, 0, 3, 3) = Matrix3d::Identity();
-    J.block(3, 12, 3, 3)  = Matrix3d::Identity();
+    MatrixXd J = MatrixXd::Zero(CLONE_STATE_DIM, prev_dim);
+    J.block<3, 3>(0, 0).setIdentity();
+    J.block<3, 3>(3, 12).setIdentity();
+
+    MatrixXd P_new(prev_dim + CLONE_STATE_DIM, prev_dim + CLONE_STATE_DIM);
+    P_new.topLeftCorner(prev_dim, prev_dim) = P;
+    P_new.block(prev_dim, 0, CLONE_STATE_DIM, prev_dim) = J * P;
+    P_new.block(0, prev_dim, prev_dim, CLONE_STATE_DIM) = P * J.transpose();
+    P_new.bottomRightCorner<CLONE_STATE_DIM, CLONE_STATE_DIM>() = J * P * J.transpose();
+    P = P_new;
+}
 
-    G.block(0, 0, prev_dim, prev_dim).setIdentity();
-    G.block(prev_dim, 0, 6, prev_dim) = J;
-    P = G * P * G.transpose();
+void MSCKFErrorStateVector::removeClone(int index) {
+    int offset = cloneOffset(index);
+    int dim = stateDimFull();
+    int tail = dim - offset - CLONE_STATE_DIM;
+    MatrixXd P_new(dim - CLONE_STATE_DIM, dim - CLONE_STATE_DIM);
+    P_new.topLeftCorner(offset, offset) = P.topLeftCorner(offset, offset);
+    P_new.topRightCorner(offset, tail) = P.topRightCorner(offset, tail);
+    P_new.bottomLeftCorner(tail, offset) = P.bottomLeftCorner(tail, offset);
+    P_new.bottomRightCorner(tail, tail) = P.bottomRightCorner(tail, tail);
+    P = P_new;
+}
 }
@@ -1,61 +1,62 @@
-#include "swarm_msgs/Pose.h"
+#pragma once
+#include <swarm_msgs/Pose.h>
+#include <d2common/d2basetypes.h>
 
 #define IMU_STATE_DIM 15
 #define IMU_NOISE_DIM 12
+#define CLONE_STATE_DIM 6
+
+namespace D2VINS {
+using D2Common::FrameIdType;
 
 class MSCKFStateVector {
 public:
     // Follow param should be
-    //q, bias_gyro, v, bias_acc, p, [q_cam, p_cam], [q_t-1,p_t-1] ... [q_t-n, p_t-n]
+    //q, bias_gyro, v, bias_acc, p, [q_t-n,p_t-n] ... [q_t-1, p_t-1]
     Quaterniond q_imu; //quaternion in global frame
     Vector3d bias_gyro; //bias in body frame
     Vector3d v_imu; //Velocity of Imu in global frame
     Vector3d bias_acc; //bias of acceleration
     Vector3d p_imu; //position
-    std::vector<Swarm::Pose> camera_extrisincs; //[q, p]^T
-    std::vector<Swarm::Pose> sld_win_poses;  //[q_{t-1},p_{t-1}], [q_{t-2},p_{t-2}] .., [q_{t-n},p_{t-n}]
+    std::vector<Swarm::Pose> camera_extrisincs; //[q, p]^T, fixed (not in the error state)
+    std::vector<Swarm::Pose> sld_win_poses;  //IMU poses cloned at the frames, oldest first
+    std::vector<FrameIdType> sld_win_ids; //Frame ids of the clones
 
+    void addKeyframe(FrameIdType frame_id);
+    void removeClone(int index);
+    int cloneIndex(FrameIdType frame_id) const;
+    //Apply an error state correction, ordered as MSCKFErrorStateVector
+    void inject(const VectorXd & dx);
 
-    void addKeyframe(double t);
-    
     MSCKFStateVector();
-    Eigen::VectorXd getFullVector();
     Matrix3d get_imu_R() const;
+    Swarm::Pose imuPose() const;
 };
 
 class MSCKFErrorStateVector {
 public:
-    // Follow param is ordered exactly as them in vector [ang, bias_gyro, v_imu, bias_acc, pos]
-    Vector3d ang, bias_gyro;
-    Vector3d v_imu;
-    Vector3d bias_acc, pos; //IMU vector should be these 15
-
-    std::vector<std::pair<Vector3d, Vector3d>>  camera_extrisincs; //In q, P order
-    //IMU poses to here...
-
-    std::vector<std::pair<Vector3d, Vector3d>>  sld_win_poses; //In q, P order
-    
+    // The error state is ordered as [ang, bias_gyro, v_imu, bias_acc, pos, [ang_i, pos_i] of each clone].
+    // Angle errors are local: R = R_hat * Exp(ang).
     MatrixXd P;
 
-    MSCKFErrorStateVector() {}
+    MSCKFErrorStateVector();
+
+    //Clone the current IMU pose, following (14) - (16) in [Mourikis et al. 2007]
+    void stateAugmentation();
+    void removeClone(int index);
 
-    MSCKFErrorStateVector(const MSCKFStateVector & state0);
-    
-    void stateAugmentation(double t);
-    
-    VectorXd getFullVector() const;
-    Eigen::Matrix<double, IMU_STATE_DIM, 1> getImuVector() const;
     Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> getImuP() const;
     Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> getImuOtherP() const;
 
-    void setImuVector(Eigen::Matrix<double, IMU_STATE_DIM, 1> v);
-    void setImuP(Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> _P);
-    void setImuOtherP(Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> _P);
-    
-    void reset(MSCKFStateVector & state); //Reset with MSCKF state
+    void setImuP(const Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> & _P);
+    void setImuOtherP(const Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> & _P);
 
-    unsigned int stateDimFull() {
-        return IMU_STATE_DIM + camera_extrisincs.size() * 6 + sld_win_poses.size() * 6;
+    unsigned int stateDimFull() const {
+        return P.rows();
     }
 
-};
\ No newline at end of file
+    static int cloneOffset(int index) {
+        return IMU_STATE_DIM + index * CLONE_STATE_DIM;
+    }
+};
+}
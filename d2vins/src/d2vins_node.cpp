@@ -5,10 +5,13 @@
 #include "sensor_msgs/Imu.h"
 #include "estimator/d2estimator.hpp"
 #include "network/d2vins_net.hpp"
+#include "MSCKF/MSCKF.hpp"
+#include "visualization/output_writer.hpp"
 #include <mutex>
 #include <queue>
 #include <chrono>
 #include <d2frontend/d2featuretracker.h>
+#include <d2common/tracing.hpp>
 #include <swarm_msgs/swarm_fused.h>
 
 using namespace std::chrono;
@@ -28,8 +31,10 @@ class D2VINSNode :  public D2FrontEnd::D2Frontend
     typedef std::lock_guard<std::mutex> Guard;
     D2Estimator * estimator = nullptr;
     D2VINSNet * d2vins_net = nullptr;
+    MSCKF * msckf = nullptr; //Filter backend, replaces the estimator if estimator_backend is BACKEND_MSCKF
+    D2OutputWriter msckf_writer;
     ros::Subscriber imu_sub, pgo_fused_sub;
-    ros::Publisher visual_array_pub;
+    ros::Publisher visual_array_pub, msckf_odom_pub, msckf_imu_prop_pub;
     int frame_count = 0;
     std::queue<D2Common::VisualImageDescArray> viokf_queue;
     std::mutex queue_lock;
@@ -43,6 +48,9 @@ class D2VINSNode :  public D2FrontEnd::D2Frontend
     std::map<int, std::pair<int, Swarm::Pose>> vins_poses;
 protected:
     Swarm::Pose getMotionPredict(double stamp) const override {
+        if (msckf != nullptr) {
+            return msckf->getMotionPredict(stamp).pose();
+        }
         return estimator->getMotionPredict(stamp).first.pose();
     }
 
@@ -58,7 +66,9 @@ protected:
         {
             ready_drones.insert(frame_desc.drone_id);
             vins_poses[frame_desc.drone_id] = std::make_pair(frame_desc.reference_frame_id, frame_desc.pose_drone);
-            if (params->estimation_mode != D2VINSConfig::SINGLE_DRONE_MODE && succ_track &&
+            if (msckf != nullptr) {
+                //Single drone only
+            } else if (params->estimation_mode != D2VINSConfig::SINGLE_DRONE_MODE && succ_track &&
                     !frame_desc.is_lazy_frame && frame_desc.matched_frame < 0) {
                 estimator->inputRemoteImage(frame_desc);
             } else {
@@ -89,12 +99,38 @@ protected:
         }
         feature_tracker->updatebySldWin(sld_win);
         feature_tracker->updatebyLandmarkDB(estimator->getLandmarkDB());
+        feature_tracker->setKeyframeThresScale(estimator->keyframeThresScale());
+    }
+
+    void processMSCKF(D2Common::VisualImageDescArray & viokf) {
+        D2_TRACE_ZONE("D2VINSNode::processMSCKF");
+        Utility::TicToc input;
+        if (!msckf->inputImage(viokf)) {
+            return;
+        }
+        double input_time = input.toc();
+        if (viokf.is_keyframe) {
+            addToLoopQueue(viokf);
+        }
+        auto odom = msckf->getOdometry();
+        msckf_odom_pub.publish(odom.toRos());
+        msckf_writer.pushOdometry(params->self_id, odom.stamp, odom.pose());
+        msckf_writer.pushExtrinsics(params->self_id, params->camera_extrinsics, params->td_initial);
+        if (params->pub_visual_frame) {
+            visual_array_pub.publish(viokf.toROS());
+        }
+        if (params->verbose || params->enable_perf_output) {
+            printf("[D2VINS] MSCKF input_time %.1fms\n", input_time);
+        }
     }
 
     void processVIOKFThread() {
+        D2_TRACE_THREAD("viokf");
         while(ros::ok()) {
             if (!viokf_queue.empty()) {
+                D2_TRACE_ZONE("D2VINSNode::processVIOKF");
                 Utility::TicToc estimator_timer;
+                D2_TRACE_COUNTER("viokf_queue", viokf_queue.size());
                 if (viokf_queue.size() > params->warn_pending_frames) {
                     ROS_WARN("[D2VINS] Low efficient on D2VINS::estimator pending frames: %d", viokf_queue.size());
                 }
@@ -104,8 +140,13 @@ protected:
                     viokf = viokf_queue.front();
                     viokf_queue.pop();
                 }
+                if (msckf != nullptr) {
+                    processMSCKF(viokf);
+                    continue;
+                }
                 bool ret;
                 {
+                    D2_TRACE_ZONE("D2VINSNode::inputImage");
                     Utility::TicToc input;
                     ret = estimator->inputImage(viokf);
                     double input_time = input.toc();
@@ -148,6 +189,7 @@ protected:
                         }
                     }
                     printf("[D2VINS] force landmarks %d to broadcast\n", force_landmarks);
+                    D2_TRACE_ZONE("D2VINSNode::broadcastVisualImageDescArray");
                     Utility::TicToc broadcast_timer;
                     loop_net->broadcastVisualImageDescArray(viokf, force_landmarks);
                     if (params->verbose || params->enable_perf_output) {
@@ -168,11 +210,16 @@ protected:
         }
         data.dt = imu.header.stamp.toSec() - last_imu_ts;
         last_imu_ts = imu.header.stamp.toSec();
+        if (msckf != nullptr) {
+            msckf->inputImu(data);
+            msckf_imu_prop_pub.publish(msckf->getImuPropagation().toRos());
+            return;
+        }
         estimator->inputImu(data);
     }
 
     void pgoSwarmFusedCallback(const swarm_msgs::swarm_fused & fused) {
-        if (params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE) {
+        if (params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE || msckf != nullptr) {
             return;
         }
         for (size_t i = 0; i < fused.ids.size(); i++) {
@@ -190,6 +237,7 @@ protected:
     }
 
     void solverThread() {
+        D2_TRACE_THREAD("solver");
         while (ros::ok()) {
             if (need_solve) {
                 estimator->solveinDistributedMode();
@@ -209,10 +257,14 @@ protected:
     void Init(ros::NodeHandle & nh) {
         D2Frontend::Init(nh);
         initParams(nh);
+        visual_array_pub = nh.advertise<swarm_msgs::ImageArrayDescriptor>("image_array_desc", 1);
+        if (params->estimator_backend == D2VINSConfig::BACKEND_MSCKF) {
+            InitMSCKF(nh);
+            return;
+        }
         estimator = new D2Estimator(params->self_id);
         d2vins_net = new D2VINSNet(estimator, params->lcm_uri);
         estimator->init(nh, d2vins_net);
-        visual_array_pub = nh.advertise<swarm_msgs::ImageArrayDescriptor>("image_array_desc", 1);
         imu_sub = nh.subscribe(params->imu_topic, 1000, &D2VINSNode::imuCallback, this, ros::TransportHints().tcpNoDelay()); //We need a big queue for IMU.
         pgo_fused_sub = nh.subscribe("/d2pgo/swarm_fused", 1, &D2VINSNode::pgoSwarmFusedCallback, this, ros::TransportHints().tcpNoDelay());
         thread_viokf = std::thread([&] {
@@ -227,6 +279,7 @@ protected:
             });
         }
         thread_comm = std::thread([&] {
+            D2_TRACE_THREAD("d2vins_net");
             ROS_INFO("Starting d2vins_net lcm.");
             while(0 == d2vins_net->lcmHandle()) {
             }
@@ -234,6 +287,25 @@ protected:
         ROS_INFO("D2VINS node %d initialized. Ready to start.", params->self_id);
     }
 
+    void InitMSCKF(ros::NodeHandle & nh) {
+        msckf = new MSCKF;
+        msckf_odom_pub = nh.advertise<nav_msgs::Odometry>("odometry", 1000);
+        msckf_imu_prop_pub = nh.advertise<nav_msgs::Odometry>("imu_propagation", 1000);
+        OutputWriterConfig writer_config;
+        writer_config.output_folder = params->output_folder;
+        writer_config.self_id = params->self_id;
+        writer_config.path_pub_rate = params->path_pub_rate;
+        writer_config.max_path_length = params->max_path_length;
+        writer_config.write_binary_traj = params->write_binary_traj;
+        msckf_writer.init(nh, writer_config);
+        imu_sub = nh.subscribe(params->imu_topic, 1000, &D2VINSNode::imuCallback, this, ros::TransportHints().tcpNoDelay()); //We need a big queue for IMU.
+        thread_viokf = std::thread([&] {
+            processVIOKFThread();
+            printf("[D2VINS] processVIOKFThread exit.\n");
+        });
+        ROS_INFO("D2VINS node %d initialized with the MSCKF backend. Ready to start.", params->self_id);
+    }
+
 public:
     D2VINSNode(ros::NodeHandle & nh) {
         Init(nh);
@@ -251,6 +323,7 @@ int main(int argc, char **argv)
     ros::AsyncSpinner spinner(4);
     spinner.start();
     ros::waitForShutdown();
+    D2Common::Tracing::shutdown();
     return 0;
 }
 
@@ -14,7 +14,7 @@ using namespace D2Common;
 namespace D2VINS {
 D2VINSConfig * params = nullptr;
 
-void initParams(ros::NodeHandle & nh) {
+void initParams(const D2Common::ParamHandle & nh) {
     params = new D2VINSConfig;
     std::string vins_config_path;
     nh.param<std::string>("vins_config_path", vins_config_path, "");
@@ -69,6 +69,15 @@ void D2VINSConfig::init(const std::string & config_file) {
     enable_perf_output = (int)fsSettings["enable_perf_output"];
     debug_print_sldwin = (int)fsSettings["debug_print_sldwin"];
     debug_write_margin_matrix = (int)fsSettings["debug_write_margin_matrix"];
+    if (!fsSettings["path_pub_rate"].empty()) {
+        path_pub_rate = fsSettings["path_pub_rate"];
+    }
+    if (!fsSettings["max_path_length"].empty()) {
+        max_path_length = (int) fsSettings["max_path_length"];
+    }
+    if (!fsSettings["write_binary_traj"].empty()) {
+        write_binary_traj = (int) fsSettings["write_binary_traj"];
+    }
     verbose = (int) fsSettings["verbose"];
     print_network_status = (int) fsSettings["print_network_status"];
     
@@ -89,25 +98,67 @@ void D2VINSConfig::init(const std::string & config_file) {
     estimation_mode = (ESTIMATION_MODE) (int) fsSettings["estimation_mode"];
     lazy_broadcast_keyframe = (int) fsSettings["lazy_broadcast_keyframe"];
 
+    //Backend
+    if (!fsSettings["estimator_backend"].empty()) {
+        estimator_backend = (ESTIMATOR_BACKEND) (int) fsSettings["estimator_backend"];
+        if (estimator_backend == BACKEND_MSCKF && estimation_mode != SINGLE_DRONE_MODE) {
+            printf("[D2VINS::D2VINSConfig] MSCKF backend only supports single drone mode\n");
+            estimation_mode = SINGLE_DRONE_MODE;
+        }
+    }
+    if (!fsSettings["msckf_max_clones"].empty()) {
+        msckf_max_clones = (int) fsSettings["msckf_max_clones"];
+    }
+    if (!fsSettings["msckf_min_track"].empty()) {
+        msckf_min_track = (int) fsSettings["msckf_min_track"];
+    }
+    if (!fsSettings["msckf_obs_noise_px"].empty()) {
+        msckf_obs_noise_px = fsSettings["msckf_obs_noise_px"];
+    }
+
     //Initialiazation
     init_method = (InitialMethod) (int)fsSettings["init_method"];
     depth_estimate_baseline = fsSettings["depth_estimate_baseline"];
     tri_max_err = fsSettings["tri_max_err"];
+    if (!fsSettings["tri_ransac"].empty()) {
+        tri_ransac = (int) fsSettings["tri_ransac"];
+    }
+    if (!fsSettings["tri_ransac_iterations"].empty()) {
+        tri_ransac_iterations = fsSettings["tri_ransac_iterations"];
+    }
     
     //Sliding window
     max_sld_win_size = fsSettings["max_sld_win_size"];
     landmark_estimate_tracks = fsSettings["landmark_estimate_tracks"];
     min_solve_frames = fsSettings["min_solve_frames"];
+    if (!fsSettings["enable_adaptive_budget"].empty()) {
+        enable_adaptive_budget = (int) fsSettings["enable_adaptive_budget"];
+    }
+    if (!fsSettings["latency_budget_ms"].empty()) {
+        latency_budget = fsSettings["latency_budget_ms"];
+    }
+    if (!fsSettings["adaptive_budget_max_level"].empty()) {
+        adaptive_budget_max_level = (int) fsSettings["adaptive_budget_max_level"];
+    }
 
     //Outlier rejection
     perform_outlier_rejection_num = fsSettings["perform_outlier_rejection_num"];
     landmark_outlier_threshold = fsSettings["thres_outlier"];
+    if (!fsSettings["enable_observation_rejection"].empty()) {
+        enable_observation_rejection = (int) fsSettings["enable_observation_rejection"];
+    }
+    if (!fsSettings["thres_outlier_chi2"].empty()) {
+        landmark_outlier_chi2 = fsSettings["thres_outlier_chi2"];
+    }
 
     //Marginalization
     margin_sparse_solver = (int)fsSettings["margin_sparse_solver"];
     enable_marginalization = (int)fsSettings["enable_marginalization"];
     remove_base_when_margin_remote = (int)fsSettings["remove_base_when_margin_remote"];
     margin_enable_fej = (int)fsSettings["margin_enable_fej"];
+    if (!fsSettings["estimate_covariance"].empty()) {
+        estimate_covariance = (int) fsSettings["estimate_covariance"];
+    }
     
     camera_extrinsics = D2FrontEnd::params->extrinsics;
 
@@ -137,12 +188,18 @@ void D2VINSConfig::init(const std::string & config_file) {
     consensus_config->ceres_options.max_solver_time_in_seconds = solver_time/consensus_config->max_steps;
     consensus_config->self_id = self_id;
     consensus_config->timout_wait_sync = fsSettings["timout_wait_sync"];
+    if (!fsSettings["consensus_max_staleness"].empty()) {
+        consensus_config->max_staleness = (int) fsSettings["consensus_max_staleness"];
+    }
     consensus_config->rho_landmark = fsSettings["rho_landmark"];
     consensus_config->rho_frame_T = fsSettings["rho_frame_T"];
     consensus_config->rho_frame_theta = fsSettings["rho_frame_theta"];
     consensus_config->relaxation_alpha = fsSettings["relaxation_alpha"];
     consensus_config->sync_for_averaging = (int) fsSettings["consensus_sync_for_averaging"];
     consensus_sync_to_start = (int) fsSettings["consensus_sync_to_start"];
+    if (!fsSettings["consensus_partial_exchange"].empty()) {
+        consensus_partial_exchange = (int) fsSettings["consensus_partial_exchange"];
+    }
 
     //Sqrt root information matrix
     ProjectionTwoFrameOneCamFactor::sqrt_info = focal_length / 1.5 * Matrix2d::Identity();
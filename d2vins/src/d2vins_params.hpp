@@ -4,6 +4,7 @@
 #include <swarm_msgs/Pose.h>
 #include <ceres/ceres.h>
 #include <d2common/d2basetypes.h>
+#include <d2common/param_handle.hpp>
 
 #define UNIT_SPHERE_ERROR
 using namespace Eigen;
@@ -40,6 +41,9 @@ struct D2VINSConfig {
     int min_solve_frames = 9;
     int max_sld_win_size = 10;
     int landmark_estimate_tracks = 4; //thres for landmark to tracking
+    bool enable_adaptive_budget = false; //Adapt window (down to min_solve_frames), keyframe thresholds and max_solve_cnt to latency_budget
+    double latency_budget = 50.0; //ms of the solve of a frame
+    int adaptive_budget_max_level = 4;
 
     //Initialization
     enum InitialMethod {
@@ -52,6 +56,8 @@ struct D2VINSConfig {
     InitialMethod init_method = INIT_POSE_PNP;
     double depth_estimate_baseline = 0.05;
     double tri_max_err = 0.1;
+    bool tri_ransac = false; //Two-view RANSAC before the triangulation of tracks of 3 observations or more
+    int tri_ransac_iterations = 8;
     
     //Estimation
     bool estimate_td = false;
@@ -75,6 +81,15 @@ struct D2VINSConfig {
     int max_solve_cnt = 10000;
     int max_solve_measurements = -1;
 
+    //Backend
+    enum ESTIMATOR_BACKEND {
+        BACKEND_OPTIMIZATION, //Sliding window optimization (D2Estimator)
+        BACKEND_MSCKF //Multi-state constraint Kalman filter, single drone only
+    } estimator_backend = BACKEND_OPTIMIZATION;
+    int msckf_max_clones = 20; //Clones kept in the filter
+    int msckf_min_track = 3; //Observations of a feature used in an update
+    double msckf_obs_noise_px = 1.5; //Noise of the observations in pixels on focal_length
+    
     //Fuse depth
     bool fuse_dep = true;
     double min_inv_dep = 1e-1; //10 meter away
@@ -86,12 +101,15 @@ struct D2VINSConfig {
     ceres::Solver::Options ceres_options;
     D2Common::ConsensusSolverConfig * consensus_config = nullptr;
     bool consensus_sync_to_start = true;
+    bool consensus_partial_exchange = true; //Send only the frames the peers hold, in the compact encoding
     int consensus_trigger_time_err_us = 50;
     double wait_for_start_timout = 300.0;
 
     //Outlier rejection
     int perform_outlier_rejection_num = 50;
     double landmark_outlier_threshold = 10.0;
+    bool enable_observation_rejection = true; //Remove the single observations failing the chi-square test
+    double landmark_outlier_chi2 = 5.991; //95% of the chi-square distribution with 2 DoF
 
     //Margin config
     bool margin_sparse_solver = true;
@@ -99,6 +117,9 @@ struct D2VINSConfig {
     int remove_base_when_margin_remote = 2;
     bool margin_enable_fej = true;
 
+    //Covariance of the latest pose, velocity and extrinsics after each solve, published with the odometry
+    bool estimate_covariance = true;
+
     //Safety
     int min_measurements_per_keyframe = 10;
     double max_imu_time_err = 0.0025;
@@ -117,6 +138,9 @@ struct D2VINSConfig {
     bool enable_perf_output = false;
     bool debug_write_margin_matrix = false;
     bool pub_visual_frame = false;
+    double path_pub_rate = 10.0; //Hz
+    int max_path_length = 10000; //Latest poses in the published paths, 0 for unlimited
+    bool write_binary_traj = false;
 
     bool verbose = true;
     bool print_network_status = false;
@@ -132,5 +156,5 @@ struct D2VINSConfig {
 };
 
 extern D2VINSConfig * params;
-void initParams(ros::NodeHandle & nh);
+void initParams(const D2Common::ParamHandle & nh);
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "adaptive_budget.hpp"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+namespace D2VINS {
+AdaptiveBudget::AdaptiveBudget(const AdaptiveBudgetConfig & _config):
+    config(_config) {
+    config.min_sld_win_size = std::min(config.min_sld_win_size, config.max_sld_win_size);
+}
+
+int AdaptiveBudget::sldWinSize(int _level) const {
+    return std::max(config.min_sld_win_size, config.max_sld_win_size - _level);
+}
+
+int AdaptiveBudget::maxLandmarks(int _level) const {
+    return std::max(1, (int) (config.max_landmarks * std::pow(config.landmark_decay, _level)));
+}
+
+double AdaptiveBudget::keyframeThresScale(int _level) const {
+    return 1.0 + _level * config.keyframe_thres_step;
+}
+
+double AdaptiveBudget::cost(int _level, int landmark_num) const {
+    //The cap only matters if the solve was bounded by it
+    double landmarks = landmark_num < maxLandmarks(level) ? landmark_num : maxLandmarks(_level);
+    return sldWinSize(_level) * std::max(landmarks, 1.0);
+}
+
+double AdaptiveBudget::latencyPercentile() const {
+    if (latencies.empty()) {
+        return 0;
+    }
+    std::vector<double> sorted(latencies.begin(), latencies.end());
+    int index = std::min((int) sorted.size() - 1, (int) (config.percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+void AdaptiveBudget::setLevel(int _level) {
+    level = _level;
+    dwell = 0;
+    level_changes ++;
+    //The latencies of the previous level say little about the new one
+    latencies.clear();
+}
+
+bool AdaptiveBudget::update(double latency, int landmark_num) {
+    latencies.emplace_back(latency);
+    while (latencies.size() > config.history) {
+        latencies.pop_front();
+    }
+    dwell ++;
+    if (latencies.size() < config.history / 2) {
+        return false;
+    }
+    double latency_pct = latencyPercentile();
+    if (latency_pct > config.latency_budget && level < config.max_level) {
+        //Shed load fast
+        setLevel(level + 1);
+        return true;
+    }
+    if (level > 0 && dwell >= config.min_dwell && latencies.size() >= config.history &&
+            latency_pct < config.low_ratio * config.latency_budget) {
+        double predicted = latency_pct * cost(level - 1, landmark_num) / cost(level, landmark_num);
+        if (predicted < config.latency_budget) {
+            setLevel(level - 1);
+            return true;
+        }
+    }
+    return false;
+}
+}
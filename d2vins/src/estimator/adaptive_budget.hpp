@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+
+namespace D2VINS {
+// Compute-adaptive sizing of the sliding window solve. The latency of the solves of the last frames is compared with
+// a per frame budget: above it the policy steps one level down (shorter window, higher keyframe thresholds, fewer
+// landmarks), well below it the policy steps back up if the latency predicted for the richer level still fits.
+// Hysteresis: the band [low_ratio, 1] * budget where nothing changes, and min_dwell solves at a level before stepping up.
+
+struct AdaptiveBudgetConfig {
+    double latency_budget = 50.0; //ms per frame
+    double percentile = 0.9; //Of the latencies in the history, compared with the budget
+    size_t history = 10; //Solves
+    double low_ratio = 0.6; //Step up below low_ratio * budget
+    int min_dwell = 20; //Solves at a level before stepping up
+    int max_level = 4;
+    //Level 0 is the configured window and landmarks. The window shrinks by one frame per level down to
+    //min_sld_win_size (min_solve_frames in D2Estimator, no solve below it), so at most max - min frames are shed
+    int max_sld_win_size = 10;
+    int min_sld_win_size = 9;
+    int max_landmarks = 1000;
+    double landmark_decay = 0.75; //Landmarks per level
+    double keyframe_thres_step = 0.25; //Keyframe thresholds are scaled by 1 + level * step
+};
+
+class AdaptiveBudget {
+    AdaptiveBudgetConfig config;
+    int level = 0;
+    int dwell = 0;
+    int level_changes = 0;
+    std::deque<double> latencies;
+    //Relative cost of a solve at a level, with landmark_num landmarks used at the current level
+    double cost(int _level, int landmark_num) const;
+    void setLevel(int _level);
+public:
+    AdaptiveBudget() {}
+    AdaptiveBudget(const AdaptiveBudgetConfig & _config);
+    // Feeds the latency (ms) of the solve of a frame and the number of landmarks it used.
+    // Returns true if the level changed.
+    bool update(double latency, int landmark_num);
+    int getLevel() const {
+        return level;
+    }
+    int levelChanges() const {
+        return level_changes;
+    }
+    int sldWinSize(int _level) const;
+    int maxLandmarks(int _level) const;
+    double keyframeThresScale(int _level) const;
+    int sldWinSize() const {
+        return sldWinSize(level);
+    }
+    int maxLandmarks() const {
+        return maxLandmarks(level);
+    }
+    double keyframeThresScale() const {
+        return keyframeThresScale(level);
+    }
+    double latencyPercentile() const;
+};
+}
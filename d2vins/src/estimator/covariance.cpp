@@ -0,0 +1,98 @@
+#include "covariance.hpp"
+#include <Eigen/SparseCholesky>
+
+namespace D2VINS {
+SparseMat evaluateHessian(D2EstimatorState * state, const std::vector<ResidualInfo*> & residuals,
+        const std::set<state_type*> & fixed, std::map<state_type*, ParamInfo> & params, int & residual_dim) {
+    params.clear();
+    residual_dim = 0;
+    int state_dim = 0;
+    std::vector<Eigen::Triplet<state_type>> triplet_list;
+    std::vector<int> indices;
+    for (auto info : residuals) {
+        info->Evaluate(state);
+        if (std::isnan(info->residuals.maxCoeff()) || std::isnan(info->residuals.minCoeff())) {
+            printf("\033[0;31m[D2VINS::evaluateHessian] Residual type %d residuals is nan\033[0m\n", info->residual_type);
+            continue;
+        }
+        auto param_list = info->paramsList(state);
+        indices.resize(param_list.size());
+        for (auto i = 0; i < param_list.size(); i ++) {
+            indices[i] = -1;
+            if (fixed.find(param_list[i].pointer) != fixed.end()) {
+                continue;
+            }
+            auto it = params.find(param_list[i].pointer);
+            if (it == params.end()) {
+                it = params.emplace(param_list[i].pointer, param_list[i]).first;
+                it->second.index = state_dim;
+                state_dim += it->second.eff_size;
+            }
+            indices[i] = it->second.index;
+        }
+        //J_i^T J_j of every pair of blocks. Only the eff param part, that is: on tangent space.
+        for (auto i = 0; i < param_list.size(); i ++) {
+            if (indices[i] < 0) {
+                continue;
+            }
+            auto size_i = param_list[i].eff_size;
+            auto J_i = info->jacobians[i].leftCols(size_i);
+            for (auto j = 0; j < param_list.size(); j ++) {
+                if (indices[j] < 0) {
+                    continue;
+                }
+                auto size_j = param_list[j].eff_size;
+                MatrixXd H_ij = J_i.transpose() * info->jacobians[j].leftCols(size_j);
+                for (auto u = 0; u < size_i; u ++) {
+                    for (auto v = 0; v < size_j; v ++) {
+                        triplet_list.emplace_back(indices[i] + u, indices[j] + v, H_ij(u, v));
+                    }
+                }
+            }
+        }
+        residual_dim += info->residualSize();
+    }
+    SparseMat H(state_dim, state_dim);
+    H.setFromTriplets(triplet_list.begin(), triplet_list.end());
+    return H;
+}
+
+bool marginalCovariance(const SparseMat & H, const std::vector<std::pair<int, int>> & wanted, MatrixXd & cov) {
+    int wanted_dim = 0;
+    for (auto & range : wanted) {
+        wanted_dim += range.second;
+    }
+    Eigen::SimplicialLDLT<SparseMat> solver;
+    solver.compute(H);
+    if (solver.info() != Eigen::Success || solver.vectorD().minCoeff() <= 0) {
+        return false;
+    }
+    //Columns of H^-1 of the wanted ranges
+    MatrixXd E = MatrixXd::Zero(H.rows(), wanted_dim);
+    int col = 0;
+    for (auto & range : wanted) {
+        for (int i = 0; i < range.second; i ++) {
+            E(range.first + i, col ++) = 1;
+        }
+    }
+    MatrixXd X = solver.solve(E);
+    if (solver.info() != Eigen::Success) {
+        return false;
+    }
+    cov.resize(wanted_dim, wanted_dim);
+    int row = 0;
+    for (auto & range : wanted) {
+        cov.middleRows(row, range.second) = X.middleRows(range.first, range.second);
+        row += range.second;
+    }
+    //Symmetrize the round-off
+    cov = (cov + cov.transpose()) * 0.5;
+    return true;
+}
+
+Matrix6d poseCovarianceToWorld(const Matrix6d & cov, const Swarm::Pose & pose) {
+    Matrix6d J = Matrix6d::Identity();
+    J.block<3, 3>(3, 3) = pose.R();
+    return J * cov * J.transpose();
+}
+}
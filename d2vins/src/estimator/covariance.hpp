@@ -0,0 +1,32 @@
+#pragma once
+#include "ParamResidualInfo.hpp"
+
+namespace D2VINS {
+// Marginal covariance of a few parameter blocks of the sliding window, recovered from the tangent space
+// Gauss-Newton Hessian H = J^T J of the last solve.
+// Only the wanted columns of H^-1 are computed: one sparse LDLT factorization of H and a pair of
+// triangular solves per wanted column, the full inverse is never formed.
+
+struct CovarianceReport {
+    bool succ = false;
+    int state_dim = 0;
+    int residual_dim = 0;
+    int wanted_dim = 0;
+    double time_hessian = 0; //ms
+    double time_recovery = 0; //ms
+};
+
+// Hessian of the residuals at the current state, columns of the blocks ordered as they appear in the residuals.
+// Blocks in fixed are held constant by the solver: they are conditioned on and get no column.
+// params receives the layout (index, eff_size) of each block.
+SparseMat evaluateHessian(D2EstimatorState * state, const std::vector<ResidualInfo*> & residuals,
+    const std::set<state_type*> & fixed, std::map<state_type*, ParamInfo> & params, int & residual_dim);
+
+// Covariance of the wanted (index, size) ranges of H, jointly: the result is the sum of sizes square,
+// blocks in the order of wanted. Returns false if H is not positive definite.
+bool marginalCovariance(const SparseMat & H, const std::vector<std::pair<int, int>> & wanted, MatrixXd & cov);
+
+// Pose covariance on the [position, local rotation] tangent of PoseLocalParameterization to the world frame
+// (rotation perturbation on the left), which is the convention of nav_msgs/Odometry.
+Matrix6d poseCovarianceToWorld(const Matrix6d & cov, const Swarm::Pose & pose);
+}
@@ -1,4 +1,5 @@
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 #include "d2estimator.hpp" 
 #include "unistd.h"
 #include "../factors/imu_factor.h"
@@ -23,22 +24,37 @@ D2Estimator::D2Estimator(int drone_id):
 }
 
 void D2Estimator::init(ros::NodeHandle & nh, D2VINSNet * net) {
-    state.init(params->camera_extrinsics, params->td_initial);
+    init(net);
     visual.init(nh, this);
+}
+
+void D2Estimator::init(D2VINSNet * net) {
+    state.init(params->camera_extrinsics, params->td_initial);
     printf("[D2Estimator::init] init done estimator on drone %d\n", self_id);
     for (auto cam_id : state.getAvailableCameraIds()) {
         Swarm::Pose ext = state.getExtrinsic(cam_id);
         printf("[D2VINS::D2Estimator] extrinsic %d: %s\n", cam_id, ext.toStr().c_str());
     }
     vinsnet = net;
-    vinsnet->DistributedVinsData_callback = [&](DistributedVinsData msg) {
-        onDistributedVinsData(msg);
-    };
-    vinsnet->DistributedSync_callback = [&](int drone_id, int signal, int64_t token) {
-        onSyncSignal(drone_id, signal, token);
-    };
+    if (vinsnet != nullptr) {
+        vinsnet->DistributedVinsData_callback = [&](DistributedVinsData msg) {
+            onDistributedVinsData(msg);
+        };
+        vinsnet->DistributedSync_callback = [&](int drone_id, int signal, int64_t token) {
+            onSyncSignal(drone_id, signal, token);
+        };
+    }
 
     imu_bufs[self_id] = IMUBuffer();
+    if (params->enable_adaptive_budget) {
+        AdaptiveBudgetConfig budget_config;
+        budget_config.latency_budget = params->latency_budget;
+        budget_config.max_level = params->adaptive_budget_max_level;
+        budget_config.max_sld_win_size = params->max_sld_win_size;
+        budget_config.min_sld_win_size = params->min_solve_frames;
+        budget_config.max_landmarks = params->max_solve_cnt;
+        budget = AdaptiveBudget(budget_config);
+    }
     if (params->estimation_mode == D2VINSConfig::DISTRIBUTED_CAMERA_CONSENUS) {
         solver = new D2VINSConsensusSolver(this, &state, sync_data_receiver, *params->consensus_config, solve_token);
     } else {
@@ -102,6 +118,7 @@ std::pair<bool, Swarm::Pose> D2Estimator::initialFramePnP(const VisualImageDescA
     std::vector<Vector3d> lm_positions_a, lm_3d_norm_b;
     std::vector<Swarm::Pose> cam_extrinsics;
     std::vector<int> camera_indices, inliers;
+    std::vector<double> scores; //Longer tracks first in the RANSAC sampling
     //Compute pose with computePosePnPnonCentral
     int i = 0;
     for (auto image: frame.images) {
@@ -114,17 +131,25 @@ std::pair<bool, Swarm::Pose> D2Estimator::initialFramePnP(const VisualImageDescA
                     lm_positions_a.push_back(est_lm.position);
                     lm_3d_norm_b.push_back(lm.pt3d_norm);
                     camera_indices.push_back(lm.camera_index);
+                    scores.push_back(est_lm.track.size());
                 }
             }
         }
     }
+    D2_TRACE_ZONE("D2Estimator::initialFramePnP");
     D2Common::Utility::TicToc tic;
-    auto pose_imu = D2FrontEnd::computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers);
+    D2FrontEnd::PnPRansacReport report;
+    auto pose_imu = D2FrontEnd::computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers,
+        scores, params->pnp_iteratives, &report);
     bool success = inliers.size() > params->pnp_min_inliers;
     if (frame.drone_id != self_id) {
         printf("[D2VINS::D2Estimator@%d] PnP succ %d frame %ld@%d final %s inliers %d points %d time: %.2fms\n", self_id, success, 
                 frame.frame_id, frame.drone_id, pose_imu.toStr().c_str(), inliers.size(), lm_positions_a.size(), tic.toc());
     }
+    if (params->enable_perf_output) {
+        printf("[D2VINS::D2Estimator@%d] PnP RANSAC iterations %d models %d verified %d time %.2fms\n", self_id,
+            report.iterations, report.models, report.verified, report.time);
+    }
     return std::make_pair(success, pose_imu);
 }
 
@@ -335,7 +360,7 @@ void D2Estimator::setStateProperties() {
             continue;
         }
         int drone_id = state.getCameraBelonging(cam_id);
-        if (!params->estimate_extrinsic || state.size(drone_id) < params->max_sld_win_size || 
+        if (!params->estimate_extrinsic || state.size(drone_id) < state.maxSldWinSize() || 
                 state.lastFrame().odom.vel().norm() < params->estimate_extrinsic_vel_thres) {
             problem.SetParameterBlockConstant(state.getExtrinsicState(cam_id));
         }
@@ -351,7 +376,7 @@ void D2Estimator::setStateProperties() {
         problem.SetParameterLowerBound(pointer, 0, params->min_inv_dep);
     }
 
-    if (!params->estimate_td || state.size() < params->max_sld_win_size || 
+    if (!params->estimate_td || state.size() < state.maxSldWinSize() || 
                 state.lastFrame().odom.vel().norm() < params->estimate_extrinsic_vel_thres) {
         // printf("[D2Estimator::setStateProperties@%d] set td to fixed sld_size %d/%d \n", self_id, state.size(), params->max_sld_win_size);
         problem.SetParameterBlockConstant(state.getTdState(self_id));
@@ -416,6 +441,7 @@ bool D2Estimator::readyForStart() {
 }
 
 void D2Estimator::waitForStart() {
+    D2_TRACE_ZONE("D2Estimator::waitForStart");
     D2Common::Utility::TicToc timer;
     while(!readyForStart()) {
         sendSyncSignal(SyncSignal::DSolverReady, -1);
@@ -446,6 +472,7 @@ void D2Estimator::solveinDistributedMode() {
         return;
     }
     updated = false;
+    D2_TRACE_ZONE("D2Estimator::solveinDistributedMode");
     D2Common::Utility::TicToc tic;
     if (params->consensus_sync_to_start) {
         if (true) {
@@ -481,6 +508,9 @@ void D2Estimator::solveinDistributedMode() {
     }
 
     margined_landmarks = state.clearUselessFrames(); // clear in dist mode.
+    if (params->consensus_partial_exchange) {
+        vinsnet->pubSlidingWindow();
+    }
     resetMarginalizer();
     state.preSolve(imu_bufs);
     solver->reset();
@@ -493,6 +523,7 @@ void D2Estimator::solveinDistributedMode() {
     }
     auto report = solver->solve();
     state.syncFromState(used_landmarks);
+    reportOutliers(report);
 
     //Now do some statistics
     static double sum_time = 0;
@@ -501,10 +532,19 @@ void D2Estimator::solveinDistributedMode() {
     sum_time += report.total_time;
     sum_iteration += report.total_iterations;
     sum_cost += report.final_cost;
+    D2_TRACE_VALUE("D2Estimator::solve_time", report.total_time*1000);
+    D2_TRACE_VALUE("D2Estimator::solve_iterations", report.total_iterations);
+    D2_TRACE_VALUE("D2Estimator::final_cost", report.final_cost);
+    D2_TRACE_COUNTER("D2Estimator::landmarks", current_landmark_num);
 
     if (params->enable_perf_output) {
         printf("[D2VINS::solveDist@%d] average time %.1fms, average time of iter: %.1fms, average iteration %.3f, average cost %.3f\n", 
             self_id, sum_time*1000/solve_count, sum_time*1000/sum_iteration, sum_iteration/solve_count, sum_cost/solve_count);
+        for (auto & it : static_cast<D2VINSConsensusSolver*>(solver)->peerStats()) {
+            auto & stat = it.second;
+            printf("[D2VINS::solveDist@%d] peer %d: fresh %d stale %d missed %d wait mean %.1fms max %.1fms\n",
+                self_id, it.first, stat.fresh, stat.stale, stat.missed, stat.meanWait(), stat.max_wait);
+        }
     }
 
     auto last_odom = state.lastFrame().odom;
@@ -540,6 +580,8 @@ void D2Estimator::solveinDistributedMode() {
 }
 
 void D2Estimator::solveNonDistrib() {
+    D2_TRACE_ZONE("D2Estimator::solveNonDistrib");
+    D2Common::Utility::TicToc tic;
     resetMarginalizer();
     state.preSolve(imu_bufs);
     solver->reset();
@@ -548,7 +590,12 @@ void D2Estimator::solveNonDistrib() {
     setupPriorFactor();
     setStateProperties();
     SolverReport report = solver->solve();
+    if (params->estimate_covariance) {
+        //Before syncFromState, which may drop the states of outlier landmarks used by the residuals
+        estimateCovariance();
+    }
     state.syncFromState(used_landmarks);
+    reportOutliers(report);
 
     //Now do some statistics
     static double sum_time = 0;
@@ -557,6 +604,10 @@ void D2Estimator::solveNonDistrib() {
     sum_time += report.total_time;
     sum_iteration += report.total_iterations;
     sum_cost += report.final_cost;
+    D2_TRACE_VALUE("D2Estimator::solve_time", report.total_time*1000);
+    D2_TRACE_VALUE("D2Estimator::solve_iterations", report.total_iterations);
+    D2_TRACE_VALUE("D2Estimator::final_cost", report.final_cost);
+    D2_TRACE_COUNTER("D2Estimator::landmarks", current_landmark_num);
 
     if (params->enable_perf_output) {
         printf("[D2VINS] average time %.1fms, average time of iter: %.1fms, average iteration %.3f, average cost %.3f\n", 
@@ -571,6 +622,9 @@ void D2Estimator::solveNonDistrib() {
         printf("[D2VINS] solve_count %d landmarks %d td %.1fms opti_time %.1fms\n", solve_count, 
             current_landmark_num, state.td*1000, report.total_time*1000);
     }
+    if (params->enable_adaptive_budget) {
+        updateBudget(tic.toc());
+    }
 
     // Reprogation
     for (auto drone_id : state.availableDrones()) {
@@ -591,6 +645,124 @@ void D2Estimator::solveNonDistrib() {
     }
 }
 
+void D2Estimator::reportOutliers(const SolverReport & report) {
+    //The measurements rejected after a solve were part of it: their share of the measurements
+    //approximates the share of the iterations spent on outliers
+    auto & outlier_report = state.lastOutlierReport();
+    static double sum_iteration = 0;
+    static double sum_outlier_iteration = 0;
+    static int sum_removed_observations = 0;
+    static int sum_removed_landmarks = 0;
+    double outlier_ratio = 0;
+    if (current_measurement_num > 0) {
+        outlier_ratio = std::min(1.0, (double) outlier_report.removed_observations / current_measurement_num);
+    }
+    sum_iteration += report.total_iterations;
+    sum_outlier_iteration += report.total_iterations * outlier_ratio;
+    sum_removed_observations += outlier_report.removed_observations;
+    sum_removed_landmarks += outlier_report.removed_landmarks;
+    if (params->enable_perf_output) {
+        printf("[D2VINS] outliers: removed %d observations %d landmarks (total %d/%d), %.1f%% of measurements, %.2f%% of all iterations spent on outliers\n",
+            outlier_report.removed_observations, outlier_report.removed_landmarks, sum_removed_observations, sum_removed_landmarks,
+            outlier_ratio*100, sum_iteration > 0 ? sum_outlier_iteration*100/sum_iteration : 0);
+    }
+}
+
+void D2Estimator::estimateCovariance() {
+    D2_TRACE_ZONE("D2Estimator::estimateCovariance");
+    D2Common::Utility::TicToc tic;
+    ceres::Problem & problem = solver->getProblem();
+    auto & residuals = solver->getResiduals();
+    std::set<state_type*> fixed;
+    for (auto info : residuals) {
+        for (auto pointer : info->paramsPointerList(&state)) {
+            if (problem.HasParameterBlock(pointer) && problem.IsParameterBlockConstant(pointer)) {
+                fixed.insert(pointer);
+            }
+        }
+    }
+    std::map<state_type*, ParamInfo> param_infos;
+    SparseMat H = evaluateHessian(&state, residuals, fixed, param_infos, covariance_report.residual_dim);
+    covariance_report.state_dim = H.rows();
+    covariance_report.time_hessian = tic.toc();
+
+    //Latest pose, its velocity and the extrinsics being estimated
+    auto & frame = state.lastFrame();
+    std::vector<std::pair<int, int>> wanted;
+    auto pose_it = param_infos.find(state.getPoseState(frame.frame_id));
+    auto spd_it = param_infos.find(state.getSpdBiasState(frame.frame_id));
+    if (pose_it == param_infos.end() || spd_it == param_infos.end()) {
+        covariance_report.succ = false;
+        return;
+    }
+    wanted.emplace_back(pose_it->second.index, POSE_EFF_SIZE);
+    wanted.emplace_back(spd_it->second.index, 3);
+    std::vector<CamIdType> cam_ids;
+    for (auto cam_id : state.getAvailableCameraIds()) {
+        auto it = param_infos.find(state.getExtrinsicState(cam_id));
+        if (state.getCameraBelonging(cam_id) == self_id && it != param_infos.end()) {
+            wanted.emplace_back(it->second.index, POSE_EFF_SIZE);
+            cam_ids.emplace_back(cam_id);
+        }
+    }
+    covariance_report.wanted_dim = POSE_EFF_SIZE + 3 + POSE_EFF_SIZE * cam_ids.size();
+    MatrixXd cov;
+    covariance_report.succ = marginalCovariance(H, wanted, cov);
+    covariance_report.time_recovery = tic.toc() - covariance_report.time_hessian;
+    if (!covariance_report.succ) {
+        printf("\033[0;31m[D2VINS::D2Estimator] covariance recovery failed: Hessian of dim %d is not positive definite\033[0m\n",
+            covariance_report.state_dim);
+        return;
+    }
+    //The frame is synced from the state after this, take the solved pose from the state directly
+    Swarm::Pose pose(state.getPoseState(frame.frame_id));
+    frame.pose_cov = poseCovarianceToWorld(cov.block<6, 6>(0, 0), pose);
+    frame.vel_cov = cov.block<3, 3>(POSE_EFF_SIZE, POSE_EFF_SIZE);
+    extrinsic_covs.clear();
+    for (int i = 0; i < cam_ids.size(); i ++) {
+        int index = POSE_EFF_SIZE + 3 + POSE_EFF_SIZE * i;
+        extrinsic_covs[cam_ids[i]] = cov.block<6, 6>(index, index);
+    }
+    if (params->enable_perf_output) {
+        printf("[D2VINS] covariance: state dim %d residuals %d hessian %.1fms recovery %.1fms pos std %.3f %.3f %.3fm\n",
+            covariance_report.state_dim, covariance_report.residual_dim, covariance_report.time_hessian,
+            covariance_report.time_recovery, sqrt(frame.pose_cov(0, 0)), sqrt(frame.pose_cov(1, 1)), sqrt(frame.pose_cov(2, 2)));
+    }
+}
+
+const CovarianceReport & D2Estimator::lastCovarianceReport() const {
+    return covariance_report;
+}
+
+const std::map<CamIdType, Matrix6d> & D2Estimator::getExtrinsicCovariance() const {
+    return extrinsic_covs;
+}
+
+void D2Estimator::updateBudget(double latency) {
+    if (!budget.update(latency, current_landmark_num)) {
+        return;
+    }
+    state.setMaxSldWinSize(budget.sldWinSize());
+    if (params->verbose || params->enable_perf_output) {
+        printf("[D2VINS] compute budget level %d: window %d landmarks %d keyframe thres x%.2f (latency %.1fms budget %.1fms)\n",
+            budget.getLevel(), budget.sldWinSize(), budget.maxLandmarks(), budget.keyframeThresScale(), latency, params->latency_budget);
+    }
+}
+
+int D2Estimator::maxSolveLandmarks() const {
+    if (params->enable_adaptive_budget) {
+        return budget.maxLandmarks();
+    }
+    return params->max_solve_cnt;
+}
+
+double D2Estimator::keyframeThresScale() const {
+    if (params->enable_adaptive_budget) {
+        return budget.keyframeThresScale();
+    }
+    return 1.0;
+}
+
 void D2Estimator::addIMUFactor(FrameIdType frame_ida, FrameIdType frame_idb, IntegrationBase* pre_integrations) {
     IMUFactor* imu_factor = new IMUFactor(pre_integrations);
     auto info = ImuResInfo::create(imu_factor, frame_ida, frame_idb);
@@ -640,7 +812,7 @@ void D2Estimator::setupImuFactors() {
 }
 
 bool D2Estimator::hasCommonLandmarkMeasurments() {
-    auto lms = state.availableLandmarkMeasurements(params->max_solve_cnt, params->max_solve_measurements);
+    auto lms = state.availableLandmarkMeasurements(maxSolveLandmarks(), params->max_solve_measurements);
     for (auto lm : lms) {
         if (lm.solver_id == -1 && lm.drone_id != self_id) {
             // This is a internal only remote landmark
@@ -660,7 +832,7 @@ bool D2Estimator::hasCommonLandmarkMeasurments() {
 
 void D2Estimator::setupLandmarkFactors() {
     used_landmarks.clear();
-    auto lms = state.availableLandmarkMeasurements(params->max_solve_cnt, params->max_solve_measurements);
+    auto lms = state.availableLandmarkMeasurements(maxSolveLandmarks(), params->max_solve_measurements);
     current_landmark_num = lms.size();
     current_measurement_num = 0;
     auto loss_function = new ceres::HuberLoss(1.0);    
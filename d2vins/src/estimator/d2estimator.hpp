@@ -7,6 +7,8 @@
 #include "../visualization/visualization.hpp"
 #include <d2common/solver/SolverWrapper.hpp>
 #include "solver/ConsensusSync.hpp"
+#include "covariance.hpp"
+#include "adaptive_budget.hpp"
 #include <mutex>
 
 using namespace Eigen;
@@ -50,6 +52,9 @@ protected:
     bool updated = false;
     std::set<LandmarkIdType> used_landmarks;
     std::recursive_mutex imu_prop_lock;
+    CovarianceReport covariance_report;
+    std::map<CamIdType, Matrix6d> extrinsic_covs; //On the tangent space of the extrinsic
+    AdaptiveBudget budget;
     
     //Internal functions
     bool tryinitFirstPose(VisualImageDescArray & frame);
@@ -58,6 +63,10 @@ protected:
     void solveNonDistrib();
     void setupImuFactors();
     void setupLandmarkFactors();
+    void reportOutliers(const SolverReport & report);
+    void estimateCovariance();
+    void updateBudget(double latency);
+    int maxSolveLandmarks() const;
     void addIMUFactor(FrameIdType frame_ida, FrameIdType frame_idb, IntegrationBase* _pre_integration);
     void setupPriorFactor();
     std::pair<bool, Swarm::Pose> initialFramePnP(const VisualImageDescArray & frame, 
@@ -85,6 +94,8 @@ public:
     Swarm::Odometry getOdometry() const;
     Swarm::Odometry getOdometry(int drone_id) const;
     void init(ros::NodeHandle & nh, D2VINSNet * net);
+    // Without ROS: nothing is published. Without net, single drone only.
+    void init(D2VINSNet * net);
     D2EstimatorState & getState();
     std::vector<LandmarkPerId> getMarginedLandmarks() const;
     void updateSldwin(int drone_id, const std::vector<FrameIdType> & sld_win);
@@ -99,6 +110,9 @@ public:
     void setPGOPoses(const std::map<int, Swarm::Pose> & poses);
     std::set<int> getNearbyDronesbyPGOData(const std::map<int, std::pair<int, Swarm::Pose>> & vins_poses);
     void setStateProperties();
+    const CovarianceReport & lastCovarianceReport() const;
+    const std::map<CamIdType, Matrix6d> & getExtrinsicCovariance() const;
+    double keyframeThresScale() const;
     virtual std::pair<Swarm::Odometry, std::pair<IMUBuffer, int>> getMotionPredict(double stamp) const;
 };
 }
\ No newline at end of file
@@ -11,7 +11,7 @@ using D2Common::generateCameraId;
 namespace D2VINS {
 
 D2EstimatorState::D2EstimatorState(int _self_id):
-    D2State(_self_id)
+    D2State(_self_id), max_sld_win_size(params->max_sld_win_size)
 {
     sld_wins[self_id] = std::vector<VINSFrame*>();
     if (params->estimation_mode != D2VINSConfig::SERVER_MODE) {
@@ -263,7 +263,7 @@ std::vector<LandmarkPerId> D2EstimatorState::clearUselessFrames() {
     auto & self_sld_win = sld_wins[self_id];
     if (self_sld_win.size() >= params->min_solve_frames) {
         int count_removed = 0;
-        int require_sld_win_size = params->max_sld_win_size;
+        int require_sld_win_size = max_sld_win_size;
         int sld_win_size = self_sld_win.size();
         //We remove the second last non keyframe
         if (sld_win_size > require_sld_win_size && !self_sld_win[sld_win_size - 3]->is_keyframe) {
@@ -499,7 +499,7 @@ void D2EstimatorState::syncFromState(const std::set<LandmarkIdType> & used_landm
         extrinsic.at(cam_id).from_vector(_camera_extrinsic_state.at(cam_id));
     }
     lmanager.syncState(this);
-    if (size() < params->max_sld_win_size ) {
+    if (size() < max_sld_win_size) {
         //We only repropagte when sld win is smaller than max, means not full initialized.
         printf("[D2VINS] not fully initialized, will repropagte IMU\n");
         repropagateIMU();
@@ -23,6 +23,7 @@ protected:
     std::map<FrameIdType, VectorXd> linear_point;
     std::map<FrameIdType, Swarm::Odometry> ego_motions;
     FrameIdType last_ego_frame_id;
+    int max_sld_win_size; //Of the self drone, params->max_sld_win_size unless adapted to the compute budget
 
     Marginalizer * marginalizer = nullptr;
     PriorFactor * prior_factor = nullptr;
@@ -95,12 +96,22 @@ public:
     //Debug
     void printSldWin(const std::map<FrameIdType, int> & keyframe_measurments) const;
 
+    int maxSldWinSize() const {
+        return max_sld_win_size;
+    }
+    void setMaxSldWinSize(int size) {
+        max_sld_win_size = size;
+    }
+
     void setMarginalizer(Marginalizer * _marginalizer) {
         marginalizer = _marginalizer;
     }
     const std::map<LandmarkIdType, LandmarkPerId> & getLandmarkDB() const {
         return lmanager.getLandmarkDB();
     }
+    const OutlierRejectionReport & lastOutlierReport() const {
+        return lmanager.lastOutlierReport();
+    }
 
     void updateEgoMotion();
     void printLandmarkReport(FrameIdType frame_id) const;
@@ -1,11 +1,12 @@
 #include "landmark_manager.hpp"
 #include "d2vinsstate.hpp"
 #include "../d2vins_params.hpp"
+#include <d2common/tracing.hpp>
+#include "triangulation.hpp"
+#include "../factors/projectionTwoFrameOneCamFactor.h"
 
 namespace D2VINS {
 
-double triangulatePoint3DPts(const std::vector<Swarm::Pose> poses, const std::vector<Vector3d> &points, Vector3d &point_3d);
-
 void D2LandmarkManager::addKeyframe(const VisualImageDescArray & images, double td) {
     const Guard lock(state_lock);
     for (auto & image : images.images) {
@@ -70,7 +71,7 @@ std::vector<LandmarkPerId> D2LandmarkManager::availableMeasurements(int max_pts,
             }
             auto & lm = landmark_db.at(lm_id);
             if (lm.track.size() >= params->landmark_estimate_tracks && 
-                lm.flag >= LandmarkFlag::INITIALIZED) {
+                lm.flag >= LandmarkFlag::INITIALIZED && lm.flag != LandmarkFlag::OUTLIER) {
                 if (lm.scoreForSolve(params->self_id) > score_best) {
                     score_best = lm.scoreForSolve(params->self_id);
                     lm_best = lm_id;
@@ -122,107 +123,81 @@ void D2LandmarkManager::moveByPose(const Swarm::Pose & delta_pose) {
     }
 }
 
-void D2LandmarkManager::initialLandmarkState(LandmarkPerId & lm, const D2EstimatorState * state) {
-    const Guard lock(state_lock);
-    LandmarkPerFrame lm_first;
-    lm_first = lm.track[0];
+static int cameraPoseIndex(CameraPoseCache & cache, const D2EstimatorState * state, FrameIdType frame_id, CamIdType camera_id) {
+    int index = cache.find(frame_id, camera_id);
+    if (index < 0) {
+        index = cache.add(frame_id, camera_id, state->getFramebyId(frame_id)->odom.pose()*state->getExtrinsic(camera_id));
+    }
+    return index;
+}
+
+void D2LandmarkManager::initialLandmarkByDepth(LandmarkPerId & lm, const Swarm::Pose & cam_pose) {
     auto lm_id = lm.landmark_id;
-    auto pt3d_n = lm_first.pt3d_norm;
-    auto firstFrame = *state->getFramebyId(lm_first.frame_id);
-    // printf("[D2VINS::D2LandmarkManager] Try initial landmark %ld dep %d tracks %ld\n", lm_id, 
-    //     lm.track[0].depth_mea && lm.track[0].depth > params->min_depth_to_fuse && lm.track[0].depth < params->max_depth_to_fuse,
-    //     lm.track.size());
-    if (lm_first.depth_mea && lm_first.depth > params->min_depth_to_fuse && lm_first.depth < params->max_depth_to_fuse) {
-        //Use depth to initial
-        auto ext = state->getExtrinsic(lm_first.camera_id);
-        //Note in depth mode, pt3d = (u, v, w), depth is distance since we use unitsphere
-        Vector3d pos = pt3d_n * lm_first.depth;
-        pos = firstFrame.odom.pose()*ext*pos;
-        lm.position = pos;
-        if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
-            *landmark_state[lm_id] = 1/lm_first.depth;
-            if (params->debug_print_states) {
-                printf("[D2VINS::D2LandmarkManager] Initialize landmark %ld by depth measurement position %.3f %.3f %.3f inv_dep %.3f\n",
-                    lm_id, pos.x(), pos.y(), pos.z(), 1/lm_first.depth);
-            }
-        } else {
-            memcpy(landmark_state[lm_id], lm.position.data(), sizeof(state_type)*POS_SIZE);
+    auto & lm_first = lm.track[0];
+    //Note in depth mode, pt3d = (u, v, w), depth is distance since we use unitsphere
+    Vector3d pos = lm_first.pt3d_norm * lm_first.depth;
+    pos = cam_pose*pos;
+    lm.position = pos;
+    if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
+        *landmark_state[lm_id] = 1/lm_first.depth;
+        if (params->debug_print_states) {
+            printf("[D2VINS::D2LandmarkManager] Initialize landmark %ld by depth measurement position %.3f %.3f %.3f inv_dep %.3f\n",
+                lm_id, pos.x(), pos.y(), pos.z(), 1/lm_first.depth);
         }
-        lm.flag = LandmarkFlag::INITIALIZED;
-    } else if (lm.track.size() >= params->landmark_estimate_tracks || lm.isMultiCamera()) {
-        //Initialize by motion.
-        std::vector<Swarm::Pose> poses;
-        std::vector<Vector3d> points;
-        auto ext_base = state->getExtrinsic(lm_first.camera_id);
-        Eigen::Vector3d _min = (firstFrame.odom.pose()*ext_base).pos();
-        Eigen::Vector3d _max = (firstFrame.odom.pose()*ext_base).pos();
-        for (auto & it: lm.track) {
-            auto frame = *state->getFramebyId(it.frame_id);
-            auto ext = state->getExtrinsic(it.camera_id);
-            auto cam_pose = frame.odom.pose()*ext;
-            poses.push_back(cam_pose);
-            points.push_back(it.pt3d_norm);
-            _min = _min.cwiseMin((frame.odom.pose()*ext).pos());
-            _max = _max.cwiseMax((frame.odom.pose()*ext).pos());
+    } else {
+        memcpy(landmark_state[lm_id], lm.position.data(), sizeof(state_type)*POS_SIZE);
+    }
+    lm.flag = LandmarkFlag::INITIALIZED;
+}
+
+void D2LandmarkManager::applyTriangulation(LandmarkPerId & lm, const TriangulationTask & task, const Swarm::Pose & first_cam_pose) {
+    auto lm_id = lm.landmark_id;
+    auto & point_3d = task.position;
+    if (task.baseline <= params->depth_estimate_baseline) {
+        if (params->debug_print_states) {
+            printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too short baseline: landmark %ld tracks %ld baseline %.2f\033[0m\n",
+                lm_id, lm.track.size(), task.baseline);
         }
-        if ((_max - _min).norm() > params->depth_estimate_baseline) {
-            //Initialize by triangulation
-            Vector3d point_3d(0., 0., 0.);
-            double tri_err = triangulatePoint3DPts(poses, points, point_3d);
-            // printf("Lm %ld tri err %.3f thres %.3f\n", lm_id, tri_err*params->focal_length, params->tri_max_err*params->focal_length);
-            if (tri_err < params->tri_max_err) {
-                lm.position = point_3d;
-                if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
-                    auto ptcam = (firstFrame.odom.pose()*ext_base).inverse()*point_3d;
-                    auto inv_dep = 1/ptcam.norm();
-                    if (inv_dep > params->min_inv_dep) {
-                        lm.flag = LandmarkFlag::INITIALIZED;
-                        *landmark_state[lm_id] = inv_dep;
-                        if (params->debug_print_states) {
-                            printf("[D2VINS::D2LandmarkManager] Landmark %ld tracks %ld baseline %.2f by tri. P %.3f %.3f %.3f inv_dep %.3f err %.3f\n",
-                                lm_id, lm.track.size(), (_max - _min).norm(), point_3d.x(), point_3d.y(), point_3d.z(), inv_dep, tri_err);
-                        }
-                    } else {
-                        lm.flag = LandmarkFlag::INITIALIZED;
-                        *landmark_state[lm_id] = params->min_inv_dep;
-                        if (params->debug_print_states) {
-                            printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too far away: landmark %ld tracks %ld baseline %.2f by triangulation position %.3f %.3f %.3f inv_dep %.3f \033[0m\n",
-                                lm_id, lm.track.size(), (_max - _min).norm(), point_3d.x(), point_3d.y(), point_3d.z(), inv_dep);
-                        }
-                    }
-                    // for (auto & it: lm.track) {
-                    //     auto frame = *state->getFramebyId(it.frame_id);
-                    //     auto ext = state->getExtrinsic(it.camera_id);
-                    //     auto cam_pose = frame.odom.pose()*ext;
-                    //     auto reproject_pos = cam_pose.inverse()*point_3d;
-                    //     reproject_pos.normalize();
-                    //     printf("Frame %ld camera_id %d index %d cam pose: %s pt3d norm %.3f %.3f %.3f reproject %.3f %.3f %.3f\n", 
-                    //             it.frame_id, it.camera_id, it.camera_index, cam_pose.toStr().c_str(), it.pt3d_norm.x(), it.pt3d_norm.y(), it.pt3d_norm.z(), 
-                    //             reproject_pos.x(), reproject_pos.y(), reproject_pos.z());
-                    // }
-                } else {
-                    lm.flag = LandmarkFlag::INITIALIZED;
-                    memcpy(landmark_state[lm_id], lm.position.data(), sizeof(state_type)*POS_SIZE);
-                }
-                // Some debug code
-            } else {
-                if (params->debug_print_states) {
-                    printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too large triangle error: landmark %ld tracks %ld baseline %.2f by triangulation position %.3f %.3f %.3f\033[0m\n",
-                        lm_id, lm.track.size(), (_max - _min).norm(), point_3d.x(), point_3d.y(), point_3d.z());
-                }
+        return;
+    }
+    if (!task.triangulated) {
+        if (params->debug_print_states) {
+            printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too large triangle error: landmark %ld tracks %ld inliers %d baseline %.2f by triangulation position %.3f %.3f %.3f\033[0m\n",
+                lm_id, lm.track.size(), task.inlier_num, task.baseline, point_3d.x(), point_3d.y(), point_3d.z());
+        }
+        return;
+    }
+    lm.position = point_3d;
+    lm.flag = LandmarkFlag::INITIALIZED;
+    if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
+        auto ptcam = first_cam_pose.inverse()*point_3d;
+        auto inv_dep = 1/ptcam.norm();
+        if (inv_dep > params->min_inv_dep) {
+            *landmark_state[lm_id] = inv_dep;
+            if (params->debug_print_states) {
+                printf("[D2VINS::D2LandmarkManager] Landmark %ld tracks %ld baseline %.2f by tri. P %.3f %.3f %.3f inv_dep %.3f err %.3f\n",
+                    lm_id, lm.track.size(), task.baseline, point_3d.x(), point_3d.y(), point_3d.z(), inv_dep, task.error);
             }
-        } else  { 
+        } else {
+            *landmark_state[lm_id] = params->min_inv_dep;
             if (params->debug_print_states) {
-                printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too short baseline: landmark %ld tracks %ld baseline %.2f\033[0m\n",
-                    lm_id, lm.track.size(), (_max - _min).norm());
+                printf("\033[0;31m [D2VINS::D2LandmarkManager] Initialize failed too far away: landmark %ld tracks %ld baseline %.2f by triangulation position %.3f %.3f %.3f inv_dep %.3f \033[0m\n",
+                    lm_id, lm.track.size(), task.baseline, point_3d.x(), point_3d.y(), point_3d.z(), inv_dep);
             }
         }
+    } else {
+        memcpy(landmark_state[lm_id], lm.position.data(), sizeof(state_type)*POS_SIZE);
     }
 }
 
 void D2LandmarkManager::initialLandmarks(const D2EstimatorState * state) {
     const Guard lock(state_lock);
+    D2_TRACE_ZONE("D2LandmarkManager::initialLandmarks");
+    D2Common::Utility::TicToc tic;
     int inited_count = 0;
+    //Camera poses are composed once per frame and camera, then the triangulations run in parallel
+    CameraPoseCache cache;
+    std::vector<TriangulationTask> tasks;
     for (auto & it: landmark_db) {
         auto & lm = it.second;
         auto lm_id = it.first;
@@ -233,81 +208,170 @@ void D2LandmarkManager::initialLandmarks(const D2EstimatorState * state) {
                 printf("\033[0;31m[D2VINS::D2LandmarkManager] Initialize landmark %ld failed, no track.\033[0m\n", lm_id);
                 continue;
             }
-            initialLandmarkState(lm, state);
             inited_count += 1;
+            auto & lm_first = lm.track[0];
+            if (lm_first.depth_mea && lm_first.depth > params->min_depth_to_fuse && lm_first.depth < params->max_depth_to_fuse) {
+                //Use depth to initial
+                int index = cameraPoseIndex(cache, state, lm_first.frame_id, lm_first.camera_id);
+                initialLandmarkByDepth(lm, cache.pose(index));
+            } else if (lm.track.size() >= params->landmark_estimate_tracks || lm.isMultiCamera()) {
+                //Initialize by motion.
+                TriangulationTask task;
+                task.landmark_id = lm_id;
+                task.pose_indices.reserve(lm.track.size());
+                task.bearings.reserve(lm.track.size());
+                for (auto & obs: lm.track) {
+                    task.pose_indices.emplace_back(cameraPoseIndex(cache, state, obs.frame_id, obs.camera_id));
+                    task.bearings.emplace_back(obs.pt3d_norm);
+                }
+                tasks.emplace_back(std::move(task));
+            }
         } else if(lm.flag == LandmarkFlag::ESTIMATED) {
             //Extracting depth from estimated pos
             inited_count += 1;
             if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
-                auto lm_per_frame = landmark_db.at(lm_id).track[0];
-                auto firstFrame = state->getFramebyId(lm_per_frame.frame_id);
-                auto ext = state->getExtrinsic(lm_per_frame.camera_id);
-                Vector3d pos_cam = (firstFrame->odom.pose()*ext).inverse()*lm.position;
+                auto & lm_per_frame = lm.track[0];
+                int index = cameraPoseIndex(cache, state, lm_per_frame.frame_id, lm_per_frame.camera_id);
+                Vector3d pos_cam = cache.pose(index).inverse()*lm.position;
                 *landmark_state[lm_id] = 1.0/pos_cam.norm();
             } else {
                 memcpy(landmark_state[lm_id], lm.position.data(), sizeof(state_type)*POS_SIZE);
             }
         }
     }
+    double prepare_time = tic.toc();
+    TriangulationConfig config;
+    config.min_baseline = params->depth_estimate_baseline;
+    config.max_err = params->tri_max_err;
+    config.ransac = params->tri_ransac;
+    config.ransac_iterations = params->tri_ransac_iterations;
+    config.ransac_threshold = params->landmark_outlier_threshold / params->focal_length;
+    triangulateBatch(cache, tasks, config);
+    for (auto & task : tasks) {
+        applyTriangulation(landmark_db.at(task.landmark_id), task, cache.pose(task.pose_indices[0]));
+    }
 
     if (params->debug_print_states) {
         printf("[D2VINS::D2LandmarkManager] Total %d initialized %d\n", 
             landmark_db.size(), inited_count);
     }
+    if (params->enable_perf_output) {
+        printf("[D2VINS::D2LandmarkManager] initialLandmarks triangulated %ld landmarks with %d camera poses, prepare %.2fms total %.2fms\n",
+            tasks.size(), cache.size(), prepare_time, tic.toc());
+    }
+}
+
+//Error on the unit sphere and chi-square of the projection factors, whose residual is sqrt_info * tangent_base * (pts_camera - pts)
+static inline void observationError(const Eigen::Matrix<double, 3, 4> & projection, const Vector3d & position, const Vector3d & pt3d_n,
+        const Matrix2d & sqrt_info, double & err, double & chi2) {
+    Vector3d pts = pt3d_n.normalized();
+    Vector3d pos_cam = (projection.leftCols<3>() * position + projection.col(3)).normalized();
+    Vector3d tmp(0, 0, 1);
+    if (pts == tmp) {
+        tmp << 1, 0, 0;
+    }
+    Vector3d b1 = (tmp - pts * (pts.transpose() * tmp)).normalized();
+    Vector3d b2 = pts.cross(b1);
+    Vector3d diff = pos_cam - pts;
+    Vector2d residual = sqrt_info * Vector2d(b1.dot(diff), b2.dot(diff));
+    err = (pt3d_n - pos_cam).norm();
+    chi2 = residual.squaredNorm();
+}
+
+void D2LandmarkManager::removeObservation(LandmarkPerId & lm, int index) {
+    auto frame_id = lm.track[index].frame_id;
+    lm.track.erase(lm.track.begin() + index);
+    auto it = related_landmarks.find(frame_id);
+    if (it != related_landmarks.end() && it->second.find(lm.landmark_id) != it->second.end()) {
+        if (-- it->second.at(lm.landmark_id) <= 0) {
+            it->second.erase(lm.landmark_id);
+        }
+    }
+    total_lm_per_frame_num --;
 }
 
 void D2LandmarkManager::outlierRejection(const D2EstimatorState * state, const std::set<LandmarkIdType> & used_landmarks) {
     const Guard lock(state_lock);
-    int remove_count = 0;
-    int total_count = 0;
+    outlier_report = OutlierRejectionReport();
     if (estimated_landmark_size < params->perform_outlier_rejection_num) {
         return;
     }
+    D2_TRACE_ZONE("D2LandmarkManager::outlierRejection");
+    D2Common::Utility::TicToc tic;
+    //Flatten the observations, camera poses are composed once per frame and camera
+    CameraPoseCache cache;
+    std::vector<LandmarkPerId*> landmarks;
+    std::vector<int> obs_begin{0};
+    std::vector<int> obs_landmark, obs_pose;
+    std::vector<Vector3d> obs_pt3d;
     for (auto & it: landmark_db) {
         auto & lm = it.second;
-        auto lm_id = it.first;
-        if(lm.flag == LandmarkFlag::ESTIMATED && used_landmarks.find(lm_id)!=used_landmarks.end()) {
-            double err_sum = 0;
-            double err_cnt = 0;
-            int count_err_track = 0;
-            total_count ++;
-            for (auto it = lm.track.begin() + 1; it != lm.track.end();) {
-                auto pose = state->getFramebyId(it->frame_id)->odom.pose();
-                auto ext = state->getExtrinsic(it->camera_id);
-                auto pt3d_n = it->pt3d_norm;
-                Vector3d pos_cam = (pose*ext).inverse()*lm.position;
-                pos_cam.normalize();
-                //Compute reprojection error
-                Vector3d reproj_error = pt3d_n - pos_cam;
-                if (reproj_error.norm() * params->focal_length > params->landmark_outlier_threshold) {
-                    count_err_track += 1;
-                    // printf("[outlierRejection] remove outlier track LM %d frame %ld inv_dep/dep %.2f/%.2f reproj_err %.2f/%.2f\n",
-                    //         lm_id, it->frame_id, *landmark_state[lm_id], 1./(*landmark_state[lm_id]), reproj_error.norm() * params->focal_length, 
-                    //         params->landmark_outlier_threshold);
-                    // //Remove the track
-                    // it = lm.track.erase(it);
-                    ++it;
-                } else {
-                    ++it;
-                }
-                err_sum += reproj_error.norm();
-                err_cnt += 1;
+        if (lm.flag != LandmarkFlag::ESTIMATED || used_landmarks.find(it.first) == used_landmarks.end()) {
+            continue;
+        }
+        //The first observation anchors the landmark
+        for (int i = 1; i < lm.track.size(); i ++) {
+            auto & obs = lm.track[i];
+            int index = cache.find(obs.frame_id, obs.camera_id);
+            if (index < 0) {
+                index = cache.add(obs.frame_id, obs.camera_id, state->getFramebyId(obs.frame_id)->odom.pose()*state->getExtrinsic(obs.camera_id));
             }
-            lm.num_outlier_tracks = count_err_track;
-            if (err_cnt > 0) {
-                double reproj_err = err_sum/err_cnt;
-                if (reproj_err*params->focal_length > params->landmark_outlier_threshold) {
-                    remove_count ++;
-                    lm.flag = LandmarkFlag::OUTLIER;
-                    if (params->verbose) {
-                        printf("[outlierRejection] remove LM %d inv_dep/dep %.2f/%.2f pos %.2f %.2f %.2f reproj_error %.2f\n",
-                            lm_id, *landmark_state[lm_id], 1./(*landmark_state[lm_id]), lm.position.x(), lm.position.y(), lm.position.z(), reproj_err*params->focal_length);
-                    }
-                }
+            obs_landmark.emplace_back(landmarks.size());
+            obs_pose.emplace_back(index);
+            obs_pt3d.emplace_back(obs.pt3d_norm);
+        }
+        landmarks.emplace_back(&lm);
+        obs_begin.emplace_back(obs_pose.size());
+    }
+    int obs_num = obs_pose.size();
+    std::vector<double> errs(obs_num), chi2s(obs_num);
+    Matrix2d sqrt_info = ProjectionTwoFrameOneCamFactor::sqrt_info;
+#pragma omp parallel for schedule(static, 256)
+    for (int i = 0; i < obs_num; i ++) {
+        observationError(cache.projection(obs_pose[i]), landmarks[obs_landmark[i]]->position, obs_pt3d[i], sqrt_info, errs[i], chi2s[i]);
+    }
+
+    outlier_report.landmark_num = landmarks.size();
+    outlier_report.observation_num = obs_num;
+    for (int k = 0; k < landmarks.size(); k ++) {
+        auto & lm = *landmarks[k];
+        int cnt = obs_begin[k + 1] - obs_begin[k];
+        if (cnt == 0) {
+            continue;
+        }
+        double err_sum = 0;
+        std::vector<int> outlier_tracks;
+        for (int i = obs_begin[k]; i < obs_begin[k + 1]; i ++) {
+            err_sum += errs[i];
+            if (chi2s[i] > params->landmark_outlier_chi2) {
+                outlier_tracks.emplace_back(i - obs_begin[k] + 1);
+            }
+        }
+        lm.num_outlier_tracks = outlier_tracks.size();
+        double reproj_err = err_sum/cnt;
+        if (reproj_err*params->focal_length > params->landmark_outlier_threshold) {
+            outlier_report.removed_landmarks ++;
+            lm.flag = LandmarkFlag::OUTLIER;
+            if (params->verbose) {
+                printf("[outlierRejection] remove LM %d inv_dep/dep %.2f/%.2f pos %.2f %.2f %.2f reproj_error %.2f\n",
+                    lm.landmark_id, *landmark_state[lm.landmark_id], 1./(*landmark_state[lm.landmark_id]), lm.position.x(), lm.position.y(), lm.position.z(), reproj_err*params->focal_length);
+            }
+        } else if (params->enable_observation_rejection && outlier_tracks.size() > 0) {
+            //Remove the bad observations only, from the last so the indices stay valid
+            for (auto it = outlier_tracks.rbegin(); it != outlier_tracks.rend(); it ++) {
+                removeObservation(lm, *it);
+            }
+            outlier_report.removed_observations += outlier_tracks.size();
+            lm.num_outlier_tracks = 0;
+            if (lm.track.size() < 2) {
+                outlier_report.removed_landmarks ++;
+                lm.flag = LandmarkFlag::OUTLIER;
             }
         }
     }
-    printf("[D2VINS::D2LandmarkManager] outlierRejection remove %d/%d landmarks\n", remove_count, total_count);
+    outlier_report.time = tic.toc();
+    printf("[D2VINS::D2LandmarkManager] outlierRejection remove %d/%d landmarks %d/%d observations in %.2fms\n",
+        outlier_report.removed_landmarks, outlier_report.landmark_num, outlier_report.removed_observations, obs_num, outlier_report.time);
 }
 
 void D2LandmarkManager::syncState(const D2EstimatorState * state) {
@@ -356,40 +420,4 @@ void D2LandmarkManager::removeLandmark(const LandmarkIdType & id) {
     landmark_db.erase(id);
     landmark_state.erase(id);
 }
-
-double triangulatePoint3DPts(const std::vector<Swarm::Pose> poses, const std::vector<Vector3d> &points, Vector3d &point_3d) {
-    MatrixXd design_matrix(poses.size()*2, 4);
-    assert(poses.size() > 0 && poses.size() == points.size() && "We at least have 2 poses and number of pts and poses must equal");
-    for (unsigned int i = 0; i < poses.size(); i ++) {
-        double p0x = points[i][0];
-        double p0y = points[i][1];
-        double p0z = points[i][2];
-        Eigen::Matrix<double, 3, 4> pose;
-        auto R0 = poses[i].R();
-        auto t0 = poses[i].pos();
-        pose.leftCols<3>() = R0.transpose();
-        pose.rightCols<1>() = -R0.transpose() * t0;
-        design_matrix.row(i*2) = p0x * pose.row(2) - p0z*pose.row(0);
-        design_matrix.row(i*2+1) = p0y * pose.row(2) - p0z*pose.row(1);
-    }
-    Vector4d triangulated_point;
-    triangulated_point =
-              design_matrix.jacobiSvd(Eigen::ComputeFullV).matrixV().rightCols<1>();
-    point_3d(0) = triangulated_point(0) / triangulated_point(3);
-    point_3d(1) = triangulated_point(1) / triangulated_point(3);
-    point_3d(2) = triangulated_point(2) / triangulated_point(3);
-
-    double sum_err = 0;
-    double err_pose_0 = 0.0;
-    for (unsigned int i = 0; i < poses.size(); i ++) {
-        auto reproject_pos = poses[i].inverse()*point_3d;
-        reproject_pos.normalize();
-        Vector3d err = points[i] - reproject_pos;
-        if (i == 0) {
-            err_pose_0 = err.norm();
-        }
-        sum_err += err.norm();
-    }
-    return sum_err/ points.size() + err_pose_0; 
-}
 }
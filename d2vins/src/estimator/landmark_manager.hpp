@@ -2,20 +2,36 @@
 
 #include <d2common/d2vinsframe.h>
 #include "d2frontend/d2landmark_manager.h"
+#include "triangulation.hpp"
 
 namespace D2VINS {
 class D2EstimatorState;
+struct OutlierRejectionReport {
+    int landmark_num = 0; //Checked landmarks
+    int observation_num = 0; //Checked observations
+    int removed_landmarks = 0;
+    int removed_observations = 0;
+    double time = 0; //ms
+};
+
 class D2LandmarkManager : public D2FrontEnd::LandmarkManager {
     std::map<LandmarkIdType, state_type*> landmark_state;
     int estimated_landmark_size = 0;
-    void initialLandmarkState(LandmarkPerId & lm, const D2EstimatorState * state);
+    void initialLandmarkByDepth(LandmarkPerId & lm, const Swarm::Pose & cam_pose);
+    void applyTriangulation(LandmarkPerId & lm, const TriangulationTask & task, const Swarm::Pose & first_cam_pose);
+    void removeObservation(LandmarkPerId & lm, int index);
+    OutlierRejectionReport outlier_report;
 public:
     virtual void addKeyframe(const VisualImageDescArray & images, double td);
     std::vector<LandmarkPerId> availableMeasurements(int max_pts, int max_solve_measurements, const std::set<FrameIdType> & current_frames) const;
     double * getLandmarkState(LandmarkIdType landmark_id) const;
     void initialLandmarks(const D2EstimatorState * state);
     void syncState(const D2EstimatorState * state);
+    //Removes the landmarks whose mean reprojection error is too large and the observations failing the chi-square test
     void outlierRejection(const D2EstimatorState * state, const std::set<LandmarkIdType> & used_landmarks);
+    const OutlierRejectionReport & lastOutlierReport() const {
+        return outlier_report;
+    }
     void moveByPose(const Swarm::Pose & delta_pose);
     virtual void removeLandmark(const LandmarkIdType & id) override;
 };
@@ -1,6 +1,7 @@
 #include "marginalization.hpp"
 #include "../d2vinsstate.hpp"
 #include <d2common/utils.hpp>
+#include <d2common/tracing.hpp>
 #include "../../factors/prior_factor.h"
 #include "../../factors/imu_factor.h"
 #include "../../factors/projectionTwoFrameOneCamFactor.h"
@@ -139,6 +140,7 @@ void Marginalizer::showDeltaXofschurComplement(std::vector<ParamInfo> keep_param
 }
 
 PriorFactor * Marginalizer::marginalize(std::set<FrameIdType> _remove_frame_ids) {
+    D2_TRACE_ZONE("Marginalizer::marginalize");
     Utility::TicToc tic;
     remove_frame_ids = _remove_frame_ids;
     //Clear previous states
@@ -183,6 +185,7 @@ PriorFactor * Marginalizer::marginalize(std::set<FrameIdType> _remove_frame_ids)
         prior = new PriorFactor(keep_params_list, Ab.first, Ab.second);
         // showDeltaXofschurComplement(keep_params_list, Ab.first, Ab.second);
     } else {
+        D2_TRACE_ZONE("Marginalizer::schurComplement");
         Utility::TicToc tt;
         auto Ab = Utility::schurComplement(H.toDense(), g, keep_state_dim);
         double t_schur = tt.toc();
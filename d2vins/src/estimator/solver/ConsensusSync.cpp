@@ -1,5 +1,6 @@
 #include "ConsensusSync.hpp"
 #include <swarm_msgs/swarm_lcm_converter.hpp>
+#include <cstring>
 
 namespace D2VINS {
 DistributedVinsData::DistributedVinsData(const DistributedVinsData_t & msg):
@@ -37,5 +38,156 @@ DistributedVinsData_t DistributedVinsData::toLCM() const {
     return msg;
 }
 
+namespace {
+const uint8_t COMPACT_MAGIC = 0xD2;
+const uint8_t COMPACT_VERSION = 1;
+const size_t COMPACT_HEADER_SIZE = 34;
+const size_t COMPACT_POSE_SIZE = 25; //Position, index of the largest quaternion component, the three others
+const size_t COMPACT_FRAME_SIZE = 8 + COMPACT_POSE_SIZE; //int64 frame id + pose
+const size_t COMPACT_CAM_SIZE = 4 + COMPACT_POSE_SIZE; //int32 camera id + pose
 
-}
\ No newline at end of file
+template <typename T>
+void put(std::vector<uint8_t> & buf, const T & value) {
+    auto ptr = reinterpret_cast<const uint8_t*>(&value);
+    buf.insert(buf.end(), ptr, ptr + sizeof(T));
+}
+
+template <typename T>
+bool get(const uint8_t * data, size_t len, size_t & offset, T & value) {
+    if (offset + sizeof(T) > len) {
+        return false;
+    }
+    memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+//Quaternion as its three smallest components, the largest (positive, >= 0.5) is recovered from the norm.
+void putPose(std::vector<uint8_t> & buf, const Swarm::Pose & pose) {
+    Vector4d q = pose.att().coeffs(); //x y z w
+    int largest;
+    q.cwiseAbs().maxCoeff(&largest);
+    if (q(largest) < 0) {
+        q = -q;
+    }
+    Vector3d pos = pose.pos();
+    for (int i = 0; i < 3; i ++) {
+        put(buf, (float) pos(i));
+    }
+    put(buf, (uint8_t) largest);
+    for (int i = 0; i < 4; i ++) {
+        if (i != largest) {
+            put(buf, (float) q(i));
+        }
+    }
+}
+
+bool getPose(const uint8_t * data, size_t len, size_t & offset, Swarm::Pose & pose) {
+    float pos[3], v[3];
+    uint8_t largest;
+    for (int i = 0; i < 3; i ++) {
+        if (!get(data, len, offset, pos[i])) {
+            return false;
+        }
+    }
+    if (!get(data, len, offset, largest) || largest > 3) {
+        return false;
+    }
+    for (int i = 0; i < 3; i ++) {
+        if (!get(data, len, offset, v[i])) {
+            return false;
+        }
+    }
+    Vector4d q;
+    double sum = 0;
+    for (int i = 0, k = 0; i < 4; i ++) {
+        if (i != largest) {
+            q(i) = v[k++];
+            sum += q(i) * q(i);
+        }
+    }
+    q(largest) = sqrt(std::max(0.0, 1.0 - sum));
+    pose = Swarm::Pose(Vector3d(pos[0], pos[1], pos[2]), Quaterniond(q(3), q(0), q(1), q(2)).normalized());
+    return true;
+}
+}
+
+std::vector<uint8_t> DistributedVinsData::encodeCompact() const {
+    std::vector<uint8_t> buf;
+    buf.reserve(COMPACT_HEADER_SIZE + frame_ids.size() * COMPACT_FRAME_SIZE + cam_ids.size() * COMPACT_CAM_SIZE);
+    put(buf, COMPACT_MAGIC);
+    put(buf, COMPACT_VERSION);
+    put(buf, stamp);
+    put(buf, (int32_t) drone_id);
+    put(buf, (int32_t) solver_token);
+    put(buf, (int32_t) iteration_count);
+    put(buf, (int32_t) reference_frame_id);
+    put(buf, (uint32_t) frame_ids.size());
+    put(buf, (uint32_t) cam_ids.size());
+    for (int i = 0; i < frame_ids.size(); i++) {
+        put(buf, (int64_t) frame_ids[i]);
+        putPose(buf, frame_poses[i]);
+    }
+    for (int i = 0; i < cam_ids.size(); i++) {
+        put(buf, (int32_t) cam_ids[i]);
+        putPose(buf, extrinsic[i]);
+    }
+    return buf;
+}
+
+bool DistributedVinsData::decodeCompact(const uint8_t * data, size_t len) {
+    size_t offset = 0;
+    uint8_t magic, version;
+    int32_t _drone_id, _solver_token, _iteration_count, _reference_frame_id;
+    uint32_t frame_num, cam_num;
+    if (!get(data, len, offset, magic) || !get(data, len, offset, version) ||
+            magic != COMPACT_MAGIC || version != COMPACT_VERSION) {
+        return false;
+    }
+    if (!get(data, len, offset, stamp) || !get(data, len, offset, _drone_id) || !get(data, len, offset, _solver_token) ||
+            !get(data, len, offset, _iteration_count) || !get(data, len, offset, _reference_frame_id) ||
+            !get(data, len, offset, frame_num) || !get(data, len, offset, cam_num)) {
+        return false;
+    }
+    //The counts come from the network: check they fit in the packet before allocating for them.
+    if ((uint64_t) frame_num * COMPACT_FRAME_SIZE + (uint64_t) cam_num * COMPACT_CAM_SIZE > len - offset) {
+        return false;
+    }
+    drone_id = _drone_id;
+    solver_token = _solver_token;
+    iteration_count = _iteration_count;
+    reference_frame_id = _reference_frame_id;
+    frame_ids.resize(frame_num);
+    frame_poses.resize(frame_num);
+    cam_ids.resize(cam_num);
+    extrinsic.resize(cam_num);
+    for (int i = 0; i < frame_num; i++) {
+        int64_t frame_id;
+        if (!get(data, len, offset, frame_id) || !getPose(data, len, offset, frame_poses[i])) {
+            return false;
+        }
+        frame_ids[i] = frame_id;
+    }
+    for (int i = 0; i < cam_num; i++) {
+        int32_t cam_id;
+        if (!get(data, len, offset, cam_id) || !getPose(data, len, offset, extrinsic[i])) {
+            return false;
+        }
+        cam_ids[i] = cam_id;
+    }
+    return offset == len;
+}
+
+DistributedVinsData DistributedVinsData::selectFrames(const std::set<FrameIdType> & selected) const {
+    DistributedVinsData data = *this;
+    data.frame_ids.clear();
+    data.frame_poses.clear();
+    for (int i = 0; i < frame_ids.size(); i++) {
+        if (selected.find(frame_ids[i]) != selected.end()) {
+            data.frame_ids.emplace_back(frame_ids[i]);
+            data.frame_poses.emplace_back(frame_poses[i]);
+        }
+    }
+    return data;
+}
+}
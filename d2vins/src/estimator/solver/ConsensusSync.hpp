@@ -23,6 +23,13 @@ struct DistributedVinsData {
     DistributedVinsData() {}
     DistributedVinsData(const DistributedVinsData_t & msg);
     DistributedVinsData_t toLCM() const;
+    // Compact binary encoding for the DISTRIB_VINS_DATA_COMPACT channel: float32 positions and the three
+    // smallest quaternion components, about half of the size of DistributedVinsData_t. Host byte order.
+    std::vector<uint8_t> encodeCompact() const;
+    // Returns false if the buffer is not a compact DistributedVinsData
+    bool decodeCompact(const uint8_t * data, size_t len);
+    // Keeps the frames of frame_ids, extrinsics are always kept
+    DistributedVinsData selectFrames(const std::set<FrameIdType> & frame_ids) const;
 };
 
 typedef BaseSyncDataReceiver<DistributedVinsData> SyncDataReceiver;
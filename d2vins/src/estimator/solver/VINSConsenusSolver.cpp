@@ -1,6 +1,7 @@
 #include "VINSConsenusSolver.hpp"
 #include "../d2estimator.hpp"
 #include "../../d2vins_params.hpp"
+#include <d2common/tracing.hpp>
 
 namespace D2VINS {
 void D2VINSConsensusSolver::setStateProperties() {
@@ -82,21 +83,15 @@ void D2VINSConsensusSolver::updateWithDistributedVinsData(const DistributedVinsD
 
 
 void D2VINSConsensusSolver::waitForSync() {
-    //Wait for all remote drone to publish result.
+    //Wait for the remote drones to publish result, within the staleness bound.
+    D2_TRACE_ZONE("D2VINSConsensusSolver::waitForSync");
     Utility::TicToc tic;
     if (params->verbose) {
-        printf("[ConsensusSolver::waitForSync@%d] token %d iteration %d\n", self_id, solver_token, iteration_count - 1);
-    }
-    std::vector<DistributedVinsData> sync_datas;
-    while (tic.toc() < config.timout_wait_sync) {
-        //Wait for remote data
-        auto ret = receiver->retrive(solver_token, iteration_count);
-        sync_datas.insert(sync_datas.end(), ret.begin(), ret.end());
-        usleep(100);
-        if (sync_datas.size() == state->availableDrones().size() - 1) {
-            break;
-        }
+        printf("[ConsensusSolver::waitForSync@%d] token %d iteration %d\n", self_id, solver_token, iteration_count);
     }
+    std::set<int> peers = state->availableDrones();
+    peers.erase(self_id);
+    auto sync_datas = sync.wait(*receiver, solver_token, iteration_count, peers, config.max_staleness, config.timout_wait_sync);
     for (auto data: sync_datas) {
         updateWithDistributedVinsData(data);
     }
@@ -12,6 +12,7 @@ class D2VINSConsensusSolver : public ConsensusSolver {
 protected:
     D2Estimator * estimator;
     SyncDataReceiver * receiver;
+    BoundedStalenessSync<DistributedVinsData> sync;
     void updateWithDistributedVinsData(const DistributedVinsData & dist_data);
     virtual void broadcastData() override;
     virtual void receiveAll() override;
@@ -23,5 +24,8 @@ public:
             estimator(_estimator), 
             ConsensusSolver((D2State*)_state, _config, _solver_token), receiver(_receiver) {
     }
+    const std::map<int, PeerSyncStats> & peerStats() const {
+        return sync.peerStats();
+    }
 };
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "triangulation.hpp"
+#include <Eigen/Eigenvalues>
+
+namespace D2VINS {
+
+int CameraPoseCache::add(FrameIdType frame_id, CamIdType camera_id, const Swarm::Pose & pose) {
+    Eigen::Matrix<double, 3, 4> projection;
+    Matrix3d R = pose.R();
+    projection.leftCols<3>() = R.transpose();
+    projection.rightCols<1>() = -R.transpose() * pose.pos();
+    poses.emplace_back(pose);
+    projections.emplace_back(projection);
+    int index = poses.size() - 1;
+    indices[std::make_pair(frame_id, camera_id)] = index;
+    return index;
+}
+
+double triangulatePoint3DPts(const CameraPoseCache & cache, const int * pose_indices, const Vector3d * bearings,
+        int num, Vector3d & point_3d) {
+    //Normal equations of the DLT design matrix: its smallest eigen vector is the smallest right singular vector
+    Matrix4d A = Matrix4d::Zero();
+    for (int i = 0; i < num; i ++) {
+        const auto & pose = cache.projection(pose_indices[i]);
+        const auto & pt = bearings[i];
+        Eigen::Matrix<double, 2, 4> rows;
+        rows.row(0) = pt.x() * pose.row(2) - pt.z() * pose.row(0);
+        rows.row(1) = pt.y() * pose.row(2) - pt.z() * pose.row(1);
+        A.noalias() += rows.transpose() * rows;
+    }
+    Eigen::SelfAdjointEigenSolver<Matrix4d> eig(A);
+    Vector4d triangulated_point = eig.eigenvectors().col(0);
+    point_3d = triangulated_point.head<3>() / triangulated_point(3);
+
+    double sum_err = 0;
+    double err_pose_0 = 0.0;
+    for (int i = 0; i < num; i ++) {
+        const auto & pose = cache.projection(pose_indices[i]);
+        Vector3d reproject_pos = pose.leftCols<3>() * point_3d + pose.col(3);
+        reproject_pos.normalize();
+        double err = (bearings[i] - reproject_pos).norm();
+        if (i == 0) {
+            err_pose_0 = err;
+        }
+        sum_err += err;
+    }
+    return sum_err / num + err_pose_0;
+}
+
+static int countInliers(const CameraPoseCache & cache, const TriangulationTask & task, const Vector3d & point_3d,
+        double threshold, std::vector<int> * inliers) {
+    int count = 0;
+    for (int i = 0; i < task.pose_indices.size(); i ++) {
+        const auto & pose = cache.projection(task.pose_indices[i]);
+        Vector3d reproject_pos = pose.leftCols<3>() * point_3d + pose.col(3);
+        if (reproject_pos.dot(task.bearings[i]) <= 0) {
+            continue;
+        }
+        if ((task.bearings[i] - reproject_pos.normalized()).norm() < threshold) {
+            count ++;
+            if (inliers != nullptr) {
+                inliers->emplace_back(i);
+            }
+        }
+    }
+    return count;
+}
+
+static void triangulateTask(const CameraPoseCache & cache, TriangulationTask & task, const TriangulationConfig & config,
+        std::vector<int> & inlier_indices, std::vector<Vector3d> & inlier_bearings) {
+    int num = task.pose_indices.size();
+    task.triangulated = false;
+    task.inlier_num = 0;
+    if (num < 2) {
+        return;
+    }
+    Vector3d _min = cache.pose(task.pose_indices[0]).pos();
+    Vector3d _max = _min;
+    for (auto index : task.pose_indices) {
+        _min = _min.cwiseMin(cache.pose(index).pos());
+        _max = _max.cwiseMax(cache.pose(index).pos());
+    }
+    task.baseline = (_max - _min).norm();
+    if (task.baseline <= config.min_baseline) {
+        return;
+    }
+    const int * pose_indices = task.pose_indices.data();
+    const Vector3d * bearings = task.bearings.data();
+    if (config.ransac && num >= 3) {
+        //Deterministic per landmark, so the result does not depend on the scheduling
+        uint64_t seed = task.landmark_id * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::vector<int> best_inliers;
+        int best_count = 0;
+        for (int iter = 0; iter < config.ransac_iterations && best_count < num; iter ++) {
+            int a = 0, b = num - 1; //Widest span of the track first
+            if (iter > 0) {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                a = (seed >> 33) % num;
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                b = (seed >> 33) % (num - 1);
+                if (b >= a) {
+                    b ++;
+                }
+            }
+            int pair_indices[2] = {pose_indices[a], pose_indices[b]};
+            Vector3d pair_bearings[2] = {bearings[a], bearings[b]};
+            Vector3d point_3d;
+            triangulatePoint3DPts(cache, pair_indices, pair_bearings, 2, point_3d);
+            int count = countInliers(cache, task, point_3d, config.ransac_threshold, nullptr);
+            if (count > best_count) {
+                best_count = count;
+                best_inliers.clear();
+                countInliers(cache, task, point_3d, config.ransac_threshold, &best_inliers);
+            }
+        }
+        if (best_count < 2) {
+            return;
+        }
+        inlier_indices.clear();
+        inlier_bearings.clear();
+        //Keeps the order, the first observation stays first if it is an inlier
+        for (auto i : best_inliers) {
+            inlier_indices.emplace_back(pose_indices[i]);
+            inlier_bearings.emplace_back(bearings[i]);
+        }
+        pose_indices = inlier_indices.data();
+        bearings = inlier_bearings.data();
+        num = best_count;
+    }
+    task.inlier_num = num;
+    task.error = triangulatePoint3DPts(cache, pose_indices, bearings, num, task.position);
+    task.triangulated = task.error < config.max_err;
+}
+
+void triangulateBatch(const CameraPoseCache & cache, std::vector<TriangulationTask> & tasks, const TriangulationConfig & config) {
+#pragma omp parallel
+    {
+        std::vector<int> inlier_indices;
+        std::vector<Vector3d> inlier_bearings;
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < tasks.size(); i ++) {
+            triangulateTask(cache, tasks[i], config, inlier_indices, inlier_bearings);
+        }
+    }
+}
+
+double triangulatePoint3DPts(const std::vector<Swarm::Pose> & poses, const std::vector<Vector3d> &points, Vector3d &point_3d) {
+    MatrixXd design_matrix(poses.size()*2, 4);
+    assert(poses.size() > 0 && poses.size() == points.size() && "We at least have 2 poses and number of pts and poses must equal");
+    for (unsigned int i = 0; i < poses.size(); i ++) {
+        double p0x = points[i][0];
+        double p0y = points[i][1];
+        double p0z = points[i][2];
+        Eigen::Matrix<double, 3, 4> pose;
+        auto R0 = poses[i].R();
+        auto t0 = poses[i].pos();
+        pose.leftCols<3>() = R0.transpose();
+        pose.rightCols<1>() = -R0.transpose() * t0;
+        design_matrix.row(i*2) = p0x * pose.row(2) - p0z*pose.row(0);
+        design_matrix.row(i*2+1) = p0y * pose.row(2) - p0z*pose.row(1);
+    }
+    Vector4d triangulated_point;
+    triangulated_point =
+              design_matrix.jacobiSvd(Eigen::ComputeFullV).matrixV().rightCols<1>();
+    point_3d(0) = triangulated_point(0) / triangulated_point(3);
+    point_3d(1) = triangulated_point(1) / triangulated_point(3);
+    point_3d(2) = triangulated_point(2) / triangulated_point(3);
+
+    double sum_err = 0;
+    double err_pose_0 = 0.0;
+    for (unsigned int i = 0; i < poses.size(); i ++) {
+        auto reproject_pos = poses[i].inverse()*point_3d;
+        reproject_pos.normalize();
+        Vector3d err = points[i] - reproject_pos;
+        if (i == 0) {
+            err_pose_0 = err.norm();
+        }
+        sum_err += err.norm();
+    }
+    return sum_err/ points.size() + err_pose_0;
+}
+}
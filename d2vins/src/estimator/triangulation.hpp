@@ -0,0 +1,67 @@
+#pragma once
+#include <swarm_msgs/Pose.h>
+#include <d2common/d2basetypes.h>
+
+namespace D2VINS {
+using D2Common::FrameIdType;
+using D2Common::LandmarkIdType;
+using D2Common::CamIdType;
+
+//Multi-view DLT triangulation, returns the mean bearing error plus the bearing error of the first view
+double triangulatePoint3DPts(const std::vector<Swarm::Pose> & poses, const std::vector<Vector3d> &points, Vector3d &point_3d);
+
+// Camera poses (frame pose * extrinsic) of a triangulation batch, computed once per frame and camera.
+// The world to camera projection is stored alongside for the fixed size kernels.
+class CameraPoseCache {
+    std::vector<Swarm::Pose> poses;
+    std::vector<Eigen::Matrix<double, 3, 4>> projections;
+    std::map<std::pair<FrameIdType, CamIdType>, int> indices;
+public:
+    int find(FrameIdType frame_id, CamIdType camera_id) const {
+        auto it = indices.find(std::make_pair(frame_id, camera_id));
+        return it == indices.end() ? -1 : it->second;
+    }
+    int add(FrameIdType frame_id, CamIdType camera_id, const Swarm::Pose & pose);
+    const Swarm::Pose & pose(int index) const {
+        return poses[index];
+    }
+    const Eigen::Matrix<double, 3, 4> & projection(int index) const {
+        return projections[index];
+    }
+    int size() const {
+        return poses.size();
+    }
+    void clear() {
+        poses.clear();
+        projections.clear();
+        indices.clear();
+    }
+};
+
+struct TriangulationTask {
+    LandmarkIdType landmark_id = -1;
+    std::vector<int> pose_indices; //Indices in CameraPoseCache of the observations
+    std::vector<Vector3d> bearings;
+    //Results
+    bool triangulated = false;
+    Vector3d position = Vector3d::Zero();
+    double error = 0;
+    double baseline = 0;
+    int inlier_num = 0;
+};
+
+struct TriangulationConfig {
+    double min_baseline = 0.05; //Between the camera centers of the observations
+    double max_err = 0.1; //Of triangulatePoint3DPts
+    bool ransac = false; //Two-view RANSAC on tracks with three observations or more
+    int ransac_iterations = 8;
+    double ransac_threshold = 0.02; //Bearing error of inliers
+};
+
+//Fixed size DLT triangulation of the observations [0, num), same error as the dynamic version
+double triangulatePoint3DPts(const CameraPoseCache & cache, const int * pose_indices, const Vector3d * bearings,
+    int num, Vector3d & point_3d);
+
+//Triangulate the tasks in parallel. The cache is read only during the batch.
+void triangulateBatch(const CameraPoseCache & cache, std::vector<TriangulationTask> & tasks, const TriangulationConfig & config);
+}
@@ -6,21 +6,28 @@ namespace D2VINS {
 D2VINSNet::D2VINSNet(D2Estimator * _estimator, std::string _lcm_uri): 
         lcm(_lcm_uri), estimator(_estimator), state(_estimator->getState()) {
     lcm.subscribe("DISTRIB_VINS_DATA", &D2VINSNet::onDistributedVinsData, this);
+    lcm.subscribe("DISTRIB_VINS_DATA_COMPACT", &D2VINSNet::onDistributedVinsDataCompact, this);
     lcm.subscribe("SYNC_SIGNAL", &D2VINSNet::receiveSyncSignal, this);
+    lcm.subscribe("SYNC_SLDWIN", &D2VINSNet::onSldWinReceived, this);
 }
 
+//Advertises all the frames held in the state, of every drone: the peers send the poses of these frames only.
 void D2VINSNet::pubSlidingWindow() {
     if (state.size() == 0) {
         return;
     }
     SlidingWindow_t sld_win;
-    sld_win.timestamp = toLCMTime(ros::Time(state.lastFrame().stamp));
-    sld_win.sld_win_len = state.size();
+    double stamp = 0;
     sld_win.drone_id = params->self_id;
-    for (int i = 0; i < state.size(); i ++) {
-        auto & frame = state.getFrame(i);
-        sld_win.frame_ids.push_back(frame.frame_id);
+    for (auto drone_id : state.availableDrones()) {
+        for (int i = 0; i < state.size(drone_id); i ++) {
+            auto & frame = state.getFrame(drone_id, i);
+            sld_win.frame_ids.push_back(frame.frame_id);
+            stamp = std::max(stamp, frame.stamp);
+        }
     }
+    sld_win.timestamp = toLCMTime(ros::Time(stamp));
+    sld_win.sld_win_len = sld_win.frame_ids.size();
     lcm.publish("SYNC_SLDWIN", &sld_win);
 }
 
@@ -48,7 +55,10 @@ void D2VINSNet::onSldWinReceived(const lcm::ReceiveBuffer* rbuf,
     if (msg->drone_id == params->self_id) {
         return;
     }
-    state.updateSldwin(msg->drone_id, msg->frame_ids);
+    const Guard lock(interest_lock);
+    auto & interest = peer_interests[msg->drone_id];
+    interest.stamp = toROSTime(msg->timestamp).toSec();
+    interest.frame_ids = std::set<FrameIdType>(msg->frame_ids.begin(), msg->frame_ids.end());
 }
 
 void D2VINSNet::onDistributedVinsData(const lcm::ReceiveBuffer* rbuf,
@@ -60,12 +70,59 @@ void D2VINSNet::onDistributedVinsData(const lcm::ReceiveBuffer* rbuf,
     DistributedVinsData_callback(DistributedVinsData(*msg));
 }
 
+void D2VINSNet::onDistributedVinsDataCompact(const lcm::ReceiveBuffer* rbuf,
+                const std::string& chan) {
+    DistributedVinsData data;
+    if (!data.decodeCompact(static_cast<const uint8_t*>(rbuf->data), rbuf->data_size)) {
+        printf("\033[0;31m[D2VINSNet] Invalid compact VINS data of size %d\033[0m\n", rbuf->data_size);
+        return;
+    }
+    if (data.drone_id == params->self_id) {
+        return;
+    }
+    DistributedVinsData_callback(data);
+}
+
+//Union over the peers of the frames they share with us. A frame newer than the advertisement of a peer may have
+//reached it since, a peer without advertisement gets everything.
+std::set<FrameIdType> D2VINSNet::framesOfInterest(const DistributedVinsData & data) {
+    const Guard lock(interest_lock);
+    std::set<FrameIdType> selected;
+    for (auto drone_id : state.availableDrones()) {
+        if (drone_id == params->self_id) {
+            continue;
+        }
+        auto it = peer_interests.find(drone_id);
+        if (it == peer_interests.end()) {
+            return std::set<FrameIdType>(data.frame_ids.begin(), data.frame_ids.end());
+        }
+        for (auto frame_id : data.frame_ids) {
+            if (it->second.frame_ids.find(frame_id) != it->second.frame_ids.end() ||
+                    state.getFramebyId(frame_id)->stamp > it->second.stamp) {
+                selected.insert(frame_id);
+            }
+        }
+    }
+    return selected;
+}
+
 void D2VINSNet::sendDistributedVinsData(const DistributedVinsData & data) {
-    DistributedVinsData_t msg = data.toLCM();
+    if (!params->consensus_partial_exchange) {
+        DistributedVinsData_t msg = data.toLCM();
+        if (params->print_network_status) {
+            printf("[D2VINS] Broadcast VINS Data size %ld with %ld poses %ld extrinsic.\n", 
+                msg.getEncodedSize(), data.frame_poses.size(), data.extrinsic.size());
+        }
+        lcm.publish("DISTRIB_VINS_DATA", &msg);
+        return;
+    }
+    //LCM multicasts, so a single message carries the frames of interest of all the peers.
+    auto selected = data.selectFrames(framesOfInterest(data));
+    auto buf = selected.encodeCompact();
     if (params->print_network_status) {
-        printf("[D2VINS] Broadcast VINS Data size %ld with %ld poses %ld extrinsic.\n", 
-            msg.getEncodedSize(), data.frame_poses.size(), data.extrinsic.size());
+        printf("[D2VINS] Broadcast compact VINS Data size %ld with %ld/%ld poses %ld extrinsic.\n", 
+            buf.size(), selected.frame_poses.size(), data.frame_poses.size(), selected.extrinsic.size());
     }
-    lcm.publish("DISTRIB_VINS_DATA", &msg);
+    lcm.publish("DISTRIB_VINS_DATA_COMPACT", buf.data(), buf.size());
 }
 }
\ No newline at end of file
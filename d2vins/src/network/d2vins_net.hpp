@@ -2,6 +2,7 @@
 #include <lcm/lcm-cpp.hpp>
 #include "../estimator/d2vinsstate.hpp"
 #include <functional>
+#include <mutex>
 #include <swarm_msgs/lcm_gen/SlidingWindow_t.hpp>
 #include <swarm_msgs/lcm_gen/DistributedSync_t.hpp>
 #include <swarm_msgs/lcm_gen/DistributedVinsData_t.hpp>
@@ -10,10 +11,18 @@ namespace D2VINS {
 class D2Estimator;
 struct DistributedVinsData;
 class D2VINSNet {
+    // Frames held by a peer, as advertised on SYNC_SLDWIN
+    struct PeerInterest {
+        double stamp = 0; //Of the latest frame held
+        std::set<FrameIdType> frame_ids;
+    };
     std::function<void(int, double, std::vector<FrameIdType>)> remote_sld_win_callback;
     D2EstimatorState & state;
     D2Estimator * estimator;
     lcm::LCM lcm;
+    std::recursive_mutex interest_lock;
+    std::map<int, PeerInterest> peer_interests;
+    std::set<FrameIdType> framesOfInterest(const DistributedVinsData & data);
 public:
     std::function<void(DistributedVinsData)> DistributedVinsData_callback;
     std::function<void(int, int, int64_t)> DistributedSync_callback;
@@ -30,6 +39,8 @@ public:
     void onDistributedVinsData(const lcm::ReceiveBuffer* rbuf,
                 const std::string& chan, 
                 const DistributedVinsData_t * msg);
+    void onDistributedVinsDataCompact(const lcm::ReceiveBuffer* rbuf,
+                const std::string& chan);
     int lcmHandle() {
         return lcm.handle();
     }
@@ -0,0 +1,197 @@
+#include "output_writer.hpp"
+#include <opencv2/core/eigen.hpp>
+#include <yaml-cpp/yaml.h>
+#include <iomanip>
+#include <limits>
+
+namespace D2VINS {
+// Large enough for a few seconds of trajectory between flushes
+const int LOG_BUFFER_SIZE = 1 << 20;
+
+D2OutputWriter::D2OutputWriter(): queue(4096) {
+}
+
+D2OutputWriter::~D2OutputWriter() {
+    stop();
+}
+
+void D2OutputWriter::init(ros::NodeHandle & nh, const OutputWriterConfig & _config) {
+    config = _config;
+    _nh = &nh;
+    self_path_pub = nh.advertise<nav_msgs::Path>("path", 1000);
+    running = true;
+    thread = std::thread(&D2OutputWriter::run, this);
+}
+
+void D2OutputWriter::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    thread.join();
+}
+
+void D2OutputWriter::pushOdometry(int drone_id, double stamp, const Swarm::Pose & pose) {
+    Record record;
+    record.type = Record::Odometry;
+    record.drone_id = drone_id;
+    record.stamp = stamp;
+    record.pose = pose;
+    if (!queue.push(std::move(record))) {
+        dropped_num++;
+    }
+}
+
+void D2OutputWriter::pushExtrinsics(int drone_id, const std::vector<Swarm::Pose> & extrinsics, double td) {
+    bool changed = extrinsics.size() != last_extrinsics.size() || td != last_td;
+    for (size_t i = 0; i < extrinsics.size() && !changed; i++) {
+        changed = extrinsics[i].pos() != last_extrinsics[i].pos() ||
+            extrinsics[i].att().coeffs() != last_extrinsics[i].att().coeffs();
+    }
+    if (!changed) {
+        return;
+    }
+    Record record;
+    record.type = Record::Extrinsic;
+    record.drone_id = drone_id;
+    record.extrinsics = extrinsics;
+    record.td = td;
+    if (queue.push(std::move(record))) {
+        last_extrinsics = extrinsics;
+        last_td = td;
+    } else {
+        dropped_num++;
+    }
+}
+
+void D2OutputWriter::run() {
+    double last_pub = 0, last_flush = 0;
+    Record record;
+    while (true) {
+        // Read the flag before draining, so the records pushed before stop() are written.
+        bool stopping = !running;
+        int num = 0;
+        while (queue.pop(record)) {
+            process(record);
+            num++;
+        }
+        double now = ros::WallTime::now().toSec();
+        if (stopping || config.path_pub_rate <= 0 || now - last_pub >= 1.0 / config.path_pub_rate) {
+            publishPaths();
+            last_pub = now;
+        }
+        if (stopping || now - last_flush >= config.flush_interval) {
+            flush();
+            last_flush = now;
+        }
+        if (stopping) {
+            break;
+        }
+        if (num == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    if (dropped_num > 0) {
+        printf("[D2OutputWriter] %d records dropped, the writer fell behind\n", dropped_num.load());
+    }
+}
+
+void D2OutputWriter::process(const Record & record) {
+    if (record.type == Record::Odometry) {
+        writeTrajectory(record);
+    } else {
+        writeExtrinsics(record);
+    }
+}
+
+std::ofstream * D2OutputWriter::openLog(const std::string & path, bool binary) {
+    auto ofs = new std::ofstream;
+    // The buffer has to be set before opening
+    file_buffers.emplace_back(new char[LOG_BUFFER_SIZE]);
+    ofs->rdbuf()->pubsetbuf(file_buffers.back().get(), LOG_BUFFER_SIZE);
+    ofs->open(path, binary ? std::ios::out | std::ios::binary : std::ios::out);
+    return ofs;
+}
+
+void D2OutputWriter::writeTrajectory(const Record & record) {
+    int drone_id = record.drone_id;
+    if (csv_files.find(drone_id) == csv_files.end()) {
+        auto prefix = config.output_folder + "/d2vins_" + std::to_string(drone_id);
+        csv_files[drone_id].reset(openLog(prefix + ".csv", false));
+        *csv_files[drone_id] << std::setprecision(std::numeric_limits<long double>::digits10 + 1);
+        if (config.write_binary_traj) {
+            bin_files[drone_id].reset(openLog(prefix + ".bin", true));
+        }
+        path_pubs[drone_id] = _nh->advertise<nav_msgs::Path>("path_" + std::to_string(drone_id), 1000);
+    }
+    *csv_files[drone_id] << record.stamp << " " << record.pose.toStr(true) << "\n";
+    if (config.write_binary_traj) {
+        auto pos = record.pose.pos();
+        auto att = record.pose.att();
+        double data[8] = {record.stamp, pos.x(), pos.y(), pos.z(), att.x(), att.y(), att.z(), att.w()};
+        bin_files[drone_id]->write(reinterpret_cast<const char*>(data), sizeof(data));
+    }
+
+    geometry_msgs::PoseStamped pose_stamped;
+    pose_stamped.header.stamp = ros::Time(record.stamp);
+    pose_stamped.header.frame_id = "world";
+    pose_stamped.pose = record.pose.toROS();
+    auto & path = paths[drone_id];
+    path.push_back(pose_stamped);
+    if (config.max_path_length > 0 && path.size() > config.max_path_length) {
+        path.pop_front();
+    }
+    path_updated[drone_id] = true;
+}
+
+void D2OutputWriter::writeExtrinsics(const Record & record) {
+    YAML::Node output_params;
+    for (int i = 0; i < record.extrinsics.size(); i ++) {
+        Eigen::Matrix4d eigen_T = record.extrinsics[i].toMatrix();
+        cv::Mat cv_T;
+        cv::eigen2cv(eigen_T, cv_T);
+        std::ofstream ofs(config.output_folder + "/extrinsic" + std::to_string(i) + ".csv", std::ios::out);
+        ofs << "body_T_cam" <<  std::to_string(i) << std::endl << cv_T ;
+        ofs.close();
+        std::vector<std::vector<double>> output_data;
+        for (auto k  = 0; k < 4; k++) {
+            std::vector<double> row;
+            for (auto j = 0; j < 4; j++) {
+                row.push_back(cv_T.at<double>(k, j));
+            }
+            output_data.push_back(row);
+        }
+        output_params["body_T_cam" + std::to_string(i)] = output_data;
+    }
+    output_params["drone_id"] = record.drone_id;
+    output_params["td"] = record.td;
+    std::ofstream ofs(config.output_folder + "/extrinsic.yaml", std::ios::out);
+    ofs << output_params << std::endl;
+}
+
+void D2OutputWriter::publishPaths() {
+    for (auto & it : path_updated) {
+        if (!it.second) {
+            continue;
+        }
+        it.second = false;
+        auto & poses = paths[it.first];
+        nav_msgs::Path path;
+        path.header = poses.back().header;
+        path.poses.assign(poses.begin(), poses.end());
+        path_pubs[it.first].publish(path);
+        if (it.first == config.self_id) {
+            self_path_pub.publish(path);
+        }
+    }
+}
+
+void D2OutputWriter::flush() {
+    for (auto & it : csv_files) {
+        it.second->flush();
+    }
+    for (auto & it : bin_files) {
+        it.second->flush();
+    }
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <ros/ros.h>
+#include <nav_msgs/Path.h>
+#include <swarm_msgs/Pose.h>
+#include <d2common/lockfree_queue.hpp>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <thread>
+
+namespace D2VINS {
+struct OutputWriterConfig {
+    std::string output_folder;
+    int self_id = 0;
+    double path_pub_rate = 10.0; // Rate (Hz) of publishing the paths
+    int max_path_length = 10000; // Latest poses in the published paths, 0 for unlimited
+    bool write_binary_traj = false; // Also write d2vins_<id>.bin: stamp, x, y, z, qx, qy, qz, qw as doubles
+    double flush_interval = 1.0; // Seconds between flushes of the trajectory logs
+};
+
+// Trajectory logs, extrinsic files and paths, written and published by a background thread.
+// The estimator thread only pushes records into a lock-free queue, so the output cost no longer
+// grows with the mission length nor adds to the solve latency.
+class D2OutputWriter {
+public:
+    struct Record {
+        enum Type {
+            Odometry,
+            Extrinsic
+        } type = Odometry;
+        int drone_id = 0;
+        double stamp = 0;
+        Swarm::Pose pose;
+        std::vector<Swarm::Pose> extrinsics;
+        double td = 0;
+    };
+    D2OutputWriter();
+    ~D2OutputWriter();
+    void init(ros::NodeHandle & nh, const OutputWriterConfig & config);
+    // Never blocks: the record is dropped if the writer falls behind.
+    void pushOdometry(int drone_id, double stamp, const Swarm::Pose & pose);
+    // Written only if the extrinsics or td changed since the last call.
+    void pushExtrinsics(int drone_id, const std::vector<Swarm::Pose> & extrinsics, double td);
+    void stop();
+protected:
+    OutputWriterConfig config;
+    ros::NodeHandle * _nh = nullptr;
+    D2Common::LockFreeQueue<Record> queue;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<int> dropped_num{0};
+    // Producer side
+    std::vector<Swarm::Pose> last_extrinsics;
+    double last_td = 0;
+    // Writer thread
+    ros::Publisher self_path_pub;
+    std::map<int, ros::Publisher> path_pubs;
+    std::map<int, std::deque<geometry_msgs::PoseStamped>> paths;
+    std::map<int, bool> path_updated;
+    // Declared before the files so they are destroyed after them
+    std::vector<std::unique_ptr<char[]>> file_buffers;
+    std::map<int, std::unique_ptr<std::ofstream>> csv_files, bin_files;
+    void run();
+    void process(const Record & record);
+    void writeTrajectory(const Record & record);
+    void writeExtrinsics(const Record & record);
+    void publishPaths();
+    void flush();
+    std::ofstream * openLog(const std::string & path, bool binary);
+};
+}
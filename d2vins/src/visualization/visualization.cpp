@@ -2,9 +2,8 @@
 #include <nav_msgs/Odometry.h>
 #include <sensor_msgs/PointCloud.h>
 #include "../estimator/d2estimator.hpp"
+#include <d2common/tracing.hpp>
 #include "CameraPoseVisualization.h"
-#include <opencv2/core/eigen.hpp>
-#include <yaml-cpp/yaml.h>
 
 namespace D2VINS {
 sensor_msgs::PointCloud toPointCloud(const std::vector<D2Common::LandmarkPerId> landmarks, bool use_raw_color = false);
@@ -36,7 +35,6 @@ void D2Visualization::init(ros::NodeHandle & nh, D2Estimator * estimator) {
     margined_pcl = nh.advertise<sensor_msgs::PointCloud>("margined_cloud", 1000);
     odom_pub = nh.advertise<nav_msgs::Odometry>("odometry", 1000);
     imu_prop_pub = nh.advertise<nav_msgs::Odometry>("imu_propagation", 1000);
-    path_pub = nh.advertise<nav_msgs::Path>("path", 1000);
     sld_win_pub = nh.advertise<visualization_msgs::MarkerArray>("slding_window", 1000);
     cam_pub = nh.advertise<visualization_msgs::MarkerArray>("camera_visual", 1000);
     frame_pub_local = nh.advertise<swarm_msgs::VIOFrame>("frame_local", 1000);
@@ -48,79 +46,61 @@ void D2Visualization::init(ros::NodeHandle & nh, D2Estimator * estimator) {
     }
     _estimator = estimator;
     _nh = &nh;
+    br = new tf::TransformBroadcaster;
+    OutputWriterConfig writer_config;
+    writer_config.output_folder = params->output_folder;
+    writer_config.self_id = params->self_id;
+    writer_config.path_pub_rate = params->path_pub_rate;
+    writer_config.max_path_length = params->max_path_length;
+    writer_config.write_binary_traj = params->write_binary_traj;
+    writer.init(nh, writer_config);
 }
 
 void D2Visualization::pubIMUProp(const Swarm::Odometry & odom) {
+    if (_nh == nullptr) {
+        return;
+    }
     imu_prop_pub.publish(odom.toRos());
 }
 
-void D2Visualization::pubOdometry(int drone_id, const Swarm::Odometry & odom) {
-    auto odom_ros = odom.toRos();
-    if (paths.find(drone_id) != paths.end() && (odom_ros.header.stamp - paths[drone_id].header.stamp).toSec() < 1e-3) {
+void D2Visualization::pubOdometry(int drone_id, const Swarm::Odometry & odom, const D2Common::D2BaseFrame & frame) {
+    if (_nh == nullptr) {
+        return;
+    }
+    if (last_odom_stamps.find(drone_id) != last_odom_stamps.end() && odom.stamp - last_odom_stamps[drone_id] < 1e-3) {
         return;
     }
-    auto & path = paths[drone_id];
+    last_odom_stamps[drone_id] = odom.stamp;
+    auto odom_ros = odom.toRos();
+    frame.setCovariance(odom_ros);
     if (odom_pubs.find(drone_id) == odom_pubs.end()) {
         odom_pubs[drone_id] = _nh->advertise<nav_msgs::Odometry>("odometry_" + std::to_string(drone_id), 1000);
-        path_pubs[drone_id] = _nh->advertise<nav_msgs::Path>("path_" + std::to_string(drone_id), 1000);
-        csv_output_files[drone_id] = std::ofstream(params->output_folder + "/d2vins_" + std::to_string(drone_id) + ".csv", std::ios::out);
     }
-    geometry_msgs::PoseStamped pose_stamped;
-    pose_stamped.header = odom_ros.header;
-    pose_stamped.header.frame_id = "world";
-    pose_stamped.pose = odom_ros.pose.pose;
-    path.header = odom_ros.header;
-    path.header.frame_id = "world";
-    path.poses.push_back(pose_stamped);
-    
     if (drone_id == params->self_id) {
         CameraPoseVisualization camera_visual;
-        YAML::Node output_params;
-        path_pub.publish(path);
         odom_pub.publish(odom_ros);
         tf::Transform transform = odom.toTF();
-        br.sendTransform(tf::StampedTransform(transform, odom_ros.header.stamp, "world", "imu"));
+        br->sendTransform(tf::StampedTransform(transform, odom_ros.header.stamp, "world", "imu"));
         auto & state = _estimator->getState();
         auto exts = state.localCameraExtrinsics();
         for (int i = 0; i < exts.size(); i ++) {
-            auto camera_pose = exts[i];
-            auto pose = odom.pose()*camera_pose;
+            auto pose = odom.pose()*exts[i];
             geometry_msgs::PoseStamped camera_pose_ros;
             camera_pose_ros.header = odom_ros.header;
             camera_pose_ros.header.frame_id = "world";
             camera_pose_ros.pose = pose.toROS();
             camera_pose_pubs[i].publish(camera_pose_ros);
             camera_visual.addPose(pose.pos(), pose.att(), Vector3d(0.1, 0.1, 0.5), display_alpha);
-            Eigen::Matrix4d eigen_T = camera_pose.toMatrix();
-            cv::Mat cv_T;
-            cv::eigen2cv(eigen_T, cv_T);
-            std::ofstream ofs(params->output_folder + "/extrinsic" + std::to_string(i) + ".csv", std::ios::out);
-            ofs << "body_T_cam" <<  std::to_string(i) << std::endl << cv_T ;
-            ofs.close();
-            std::vector<std::vector<double>> output_data;
-            for (auto k  = 0; k < 4; k++) {
-                std::vector<double> row;
-                for (auto j = 0; j < 4; j++) {
-                    row.push_back(cv_T.at<double>(k, j));
-                }
-                output_data.push_back(row);
-            }
-            output_params["body_T_cam" + std::to_string(i)] = output_data;
         }
-        output_params["drone_id"] = drone_id;
-        output_params["td"] = state.getTd(drone_id);
-        std::ofstream ofs(params->output_folder + "/extrinsic.yaml", std::ios::out);
-        ofs << output_params << std::endl;
+        writer.pushExtrinsics(drone_id, exts, state.getTd(drone_id));
         camera_visual.publishBy(cam_pub, odom_ros.header);
     }
-    //Write output_params to yaml
-    csv_output_files[drone_id] << std::setprecision(std::numeric_limits<long double>::digits10 + 1) << odom.stamp << " " << odom.pose().toStr(true) << std::endl;
+    writer.pushOdometry(drone_id, odom.stamp, odom.pose());
     odom_pubs[drone_id].publish(odom_ros);
-    path_pubs[drone_id].publish(path);
 }
 
 void D2Visualization::pubFrame(D2Common::VINSFrame* frame) {
-    if (frame == nullptr) {
+    if (frame == nullptr || _nh == nullptr) {
         return;
     }
     //Publish the VINSFrame
@@ -132,10 +112,14 @@ void D2Visualization::pubFrame(D2Common::VINSFrame* frame) {
         swarm_msgs::VIOFrame msg = frame->toROS();
         frame_pub_remote.publish(msg);
     }
-    pubOdometry(frame->drone_id, frame->odom);
+    pubOdometry(frame->drone_id, frame->odom, *frame);
 }
 
 void D2Visualization::postSolve() {
+    if (_nh == nullptr) {
+        return;
+    }
+    D2_TRACE_ZONE("D2Visualization::postSolve");
     D2Common::Utility::TicToc tic;
     auto & state = _estimator->getState();
     state.lock_state();
@@ -148,7 +132,7 @@ void D2Visualization::postSolve() {
             continue;
         }
         auto odom = _estimator->getOdometry(drone_id);
-        pubOdometry(drone_id, odom);
+        pubOdometry(drone_id, odom, state.lastFrame(drone_id));
     }
 
     CameraPoseVisualization sld_win_visual;
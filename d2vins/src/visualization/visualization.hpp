@@ -3,30 +3,31 @@
 #include <nav_msgs/Path.h>
 #include <Eigen/Eigen>
 #include <d2common/d2vinsframe.h>
+#include "output_writer.hpp"
 
 namespace D2VINS {
 class D2EstimatorState;
 class D2Estimator;
 class D2Visualization {
     D2Estimator * _estimator = nullptr;
-    ros::Publisher odom_pub, imu_prop_pub, pcl_pub, margined_pcl, path_pub;
+    ros::Publisher odom_pub, imu_prop_pub, pcl_pub, margined_pcl;
     ros::Publisher frame_pub_local, frame_pub_remote;
     std::vector<ros::Publisher> camera_pose_pubs;
-    std::map<int, ros::Publisher> path_pubs, odom_pubs;
+    std::map<int, ros::Publisher> odom_pubs;
     ros::Publisher sld_win_pub;
     ros::Publisher cam_pub;
-    std::map<int, nav_msgs::Path> paths;
+    std::map<int, double> last_odom_stamps;
     double display_alpha = 0.5;
-    ros::NodeHandle * _nh = nullptr;
-    std::map<int, std::ofstream> csv_output_files;
-    tf::TransformBroadcaster br;
+    ros::NodeHandle * _nh = nullptr; //Nothing is published before init, e.g. in offline replays without ROS
+    D2OutputWriter writer;
+    tf::TransformBroadcaster * br = nullptr; //Its NodeHandle requires ros::init
 public:
     D2Visualization();
     void init(ros::NodeHandle & nh, D2Estimator * estimator);
     void postSolve();
     void pubFrame(D2Common::VINSFrame* frame);
     void pubIMUProp(const Swarm::Odometry & odom);
-    void pubOdometry(int drone_id, const Swarm::Odometry & odom);
+    void pubOdometry(int drone_id, const Swarm::Odometry & odom, const D2Common::D2BaseFrame & frame);
     static std::vector<Eigen::Vector3d> drone_colors;
 };
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "../src/estimator/adaptive_budget.hpp"
+#include "../src/estimator/covariance.hpp"
+#include <d2common/utils.hpp>
+#include <d2common/bench_options.hpp>
+#include <random>
+
+// Replay of a synthetic flight (hover, cruise, aggressive texture-rich motion, hover) through the sliding window
+// solve, with the configured window and landmarks ("fixed") and with AdaptiveBudget ("adaptive").
+// The solve of each frame is timed for real: --gn_iterations sparse LDLT factorizations of the window Hessian
+// (poses and speed biases chained by IMU factors, inverse depth landmarks tracked over --track keyframes),
+// plus one for the marginalization on keyframes. A frame is a keyframe when its parallax since the last
+// keyframe exceeds the keyframe threshold scaled by the policy.
+// Accuracy is the position standard deviation of the latest frame, from its marginal covariance.
+// Reported: latency percentiles, frames over budget, keyframes and accuracy, per phase for the adaptive run.
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+struct BenchParams {
+    double budget_ms = 10;
+    int window = 11;
+    int min_window = 6;
+    int max_landmarks = 600;
+    int gn_iterations = 3;
+    int track = 4;
+    int max_level = 4;
+    double parallex_thres = 10.0/460.0;
+};
+
+struct Phase {
+    std::string name;
+    int frames;
+    double parallax; //Per frame
+    int landmarks; //Trackable in the window
+};
+
+void addFactor(std::mt19937 & rng, std::vector<Eigen::Triplet<double>> & triplets,
+        const std::vector<std::pair<int, int>> & blocks, int residual_size, double scale) {
+    std::normal_distribution<double> normal(0.0, scale);
+    int cols = 0;
+    for (auto & block : blocks) {
+        cols += block.second;
+    }
+    MatrixXd J(residual_size, cols);
+    for (int i = 0; i < J.size(); i ++) {
+        J.data()[i] = normal(rng);
+    }
+    MatrixXd H = J.transpose() * J;
+    int u = 0;
+    for (auto & block_u : blocks) {
+        int v = 0;
+        for (auto & block_v : blocks) {
+            for (int i = 0; i < block_u.second; i ++) {
+                for (int j = 0; j < block_v.second; j ++) {
+                    triplets.emplace_back(block_u.first + i, block_v.first + j, H(u + i, v + j));
+                }
+            }
+            v += block_v.second;
+        }
+        u += block_u.second;
+    }
+}
+
+// Window Hessian of window frames and landmark_num landmarks, the latest frame is the last pose
+SparseMat windowHessian(std::mt19937 & rng, int window, int landmark_num, int track) {
+    int spd_bias_start = window * POSE_EFF_SIZE;
+    int landmark_start = spd_bias_start + window * FRAME_SPDBIAS_SIZE;
+    int state_dim = landmark_start + landmark_num;
+    std::vector<Eigen::Triplet<double>> triplets;
+    addFactor(rng, triplets, {{0, POSE_EFF_SIZE}, {spd_bias_start, FRAME_SPDBIAS_SIZE}}, 15, 10.0);
+    for (int i = 0; i + 1 < window; i ++) {
+        addFactor(rng, triplets, {{i * POSE_EFF_SIZE, POSE_EFF_SIZE}, {spd_bias_start + i * FRAME_SPDBIAS_SIZE, FRAME_SPDBIAS_SIZE},
+            {(i + 1) * POSE_EFF_SIZE, POSE_EFF_SIZE}, {spd_bias_start + (i + 1) * FRAME_SPDBIAS_SIZE, FRAME_SPDBIAS_SIZE}}, 15, 0.3);
+    }
+    for (int j = 0; j < landmark_num; j ++) {
+        int base = rng() % window;
+        for (int k = 1; k < track && base + k < window; k ++) {
+            addFactor(rng, triplets, {{base * POSE_EFF_SIZE, POSE_EFF_SIZE}, {(base + k) * POSE_EFF_SIZE, POSE_EFF_SIZE},
+                {landmark_start + j, INV_DEP_SIZE}}, 2, 1.0);
+        }
+        addFactor(rng, triplets, {{landmark_start + j, INV_DEP_SIZE}}, 1, 1.0);
+    }
+    SparseMat H(state_dim, state_dim);
+    H.setFromTriplets(triplets.begin(), triplets.end());
+    return H;
+}
+
+struct FrameResult {
+    double latency; //ms
+    double pos_std;
+    bool keyframe;
+    int level;
+};
+
+std::vector<FrameResult> replay(const BenchParams & bench, const std::vector<Phase> & phases, bool adaptive) {
+    AdaptiveBudgetConfig config;
+    config.latency_budget = bench.budget_ms;
+    config.max_level = adaptive ? bench.max_level : 0;
+    config.max_sld_win_size = bench.window;
+    config.min_sld_win_size = bench.min_window;
+    config.max_landmarks = bench.max_landmarks;
+    AdaptiveBudget budget(config);
+    std::mt19937 rng(0);
+    std::vector<FrameResult> results;
+    double parallax = 0;
+    for (auto & phase : phases) {
+        for (int f = 0; f < phase.frames; f ++) {
+            parallax += phase.parallax;
+            bool keyframe = parallax > bench.parallex_thres * budget.keyframeThresScale();
+            if (keyframe) {
+                parallax = 0;
+            }
+            int landmark_num = std::min(phase.landmarks, budget.maxLandmarks());
+            SparseMat H = windowHessian(rng, budget.sldWinSize(), landmark_num, bench.track);
+            TicToc tic;
+            Eigen::SimplicialLDLT<SparseMat> solver;
+            for (int k = 0; k < bench.gn_iterations + (keyframe ? 1 : 0); k ++) {
+                solver.compute(H);
+            }
+            double latency = tic.toc();
+            MatrixXd cov;
+            std::vector<std::pair<int, int>> wanted{{(budget.sldWinSize() - 1) * POSE_EFF_SIZE, 3}};
+            double pos_std = marginalCovariance(H, wanted, cov) ? sqrt(cov.trace()) : NAN;
+            results.push_back({latency, pos_std, keyframe, budget.getLevel()});
+            budget.update(latency, landmark_num);
+        }
+    }
+    return results;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    int index = std::min((int) values.size() - 1, (int) (p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void report(const char * name, const BenchParams & bench, std::vector<FrameResult>::const_iterator begin,
+        std::vector<FrameResult>::const_iterator end) {
+    std::vector<double> latencies;
+    int over = 0, keyframes = 0;
+    double sum_std = 0, sum_level = 0;
+    for (auto it = begin; it != end; it ++) {
+        latencies.emplace_back(it->latency);
+        over += it->latency > bench.budget_ms;
+        keyframes += it->keyframe;
+        sum_std += it->pos_std;
+        sum_level += it->level;
+    }
+    int n = latencies.size();
+    printf("[AdaptiveBudgetBench] %-22s latency p50 %5.1f p90 %5.1f p99 %5.1f max %5.1fms over budget %5.1f%% keyframes %3d pos std %.4f level %.1f\n",
+        name, percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+        *std::max_element(latencies.begin(), latencies.end()), over * 100.0 / n, keyframes, sum_std / n, sum_level / n);
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.add("budget_ms", bench.budget_ms, "latency budget per frame")
+        .add("window", bench.window, "configured sliding window size")
+        .add("min_window", bench.min_window, "minimum sliding window size")
+        .add("max_landmarks", bench.max_landmarks, "configured landmarks per solve")
+        .add("gn_iterations", bench.gn_iterations, "factorizations per solve")
+        .add("track", bench.track, "keyframes tracking each landmark")
+        .add("max_level", bench.max_level, "levels of the policy");
+    options.parse(argc, argv);
+    std::vector<Phase> phases{{"hover", 200, 0.002, 150}, {"cruise", 200, 0.01, 300},
+        {"aggressive", 200, 0.03, 1000}, {"hover", 200, 0.002, 150}};
+    printf("[AdaptiveBudgetBench] budget %.1fms window %d (min %d) max landmarks %d gn iterations %d\n", bench.budget_ms,
+        bench.window, bench.min_window, bench.max_landmarks, bench.gn_iterations);
+    auto fixed = replay(bench, phases, false);
+    auto adaptive = replay(bench, phases, true);
+    report("fixed", bench, fixed.begin(), fixed.end());
+    report("adaptive", bench, adaptive.begin(), adaptive.end());
+    int start = 0;
+    for (auto & phase : phases) {
+        report(("  fixed " + phase.name).c_str(), bench, fixed.begin() + start, fixed.begin() + start + phase.frames);
+        report(("  adaptive " + phase.name).c_str(), bench, adaptive.begin() + start, adaptive.begin() + start + phase.frames);
+        start += phase.frames;
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "../src/estimator/solver/ConsensusSync.hpp"
+#include <d2common/bench_options.hpp>
+#include <random>
+
+// Bytes per consensus iteration of the DISTRIB_VINS_DATA exchange against the swarm size, in a single process.
+// Each agent holds its sliding window and the frames of the --neighbors agents on each side of a ring that it
+// shares landmarks with (a random --shared fraction of their windows), then broadcasts the poses it estimates
+// as D2VINSConsensusSolver::broadcastData does. Reported per iteration, summed over the agents:
+// "full" is DistributedVinsData_t with every frame (the previous exchange), "compact" the compact encoding of
+// every frame, "interest" the compact encoding of the frames held by at least one peer (one multicast message
+// per agent, as D2VINSNet sends) and "per peer" one message per peer with the frames it holds, for unicast links.
+// The decoded compact poses are checked against the originals.
+
+using namespace D2VINS;
+
+struct BenchParams {
+    std::vector<int> agents = {2, 4, 8, 16};
+    int window = 10;
+    int neighbors = 1;
+    double shared = 0.5;
+    int cameras = 4;
+};
+
+FrameIdType frameId(int drone_id, int index) {
+    return drone_id * 1000000 + index;
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.addList("agents", bench.agents, "swarm sizes to compare")
+        .add("window", bench.window, "keyframes in the sliding window of each agent")
+        .add("neighbors", bench.neighbors, "agents on each side of the ring sharing landmarks")
+        .add("shared", bench.shared, "fraction of the window of a neighbor held by an agent")
+        .add("cameras", bench.cameras, "cameras per drone");
+    options.parse(argc, argv);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    printf("[ConsensusExchangeBench] window %d neighbors %d shared %.0f%% cameras %d\n", bench.window, bench.neighbors,
+        bench.shared * 100, bench.cameras);
+    for (auto agents : bench.agents) {
+        //Frames held by each agent
+        std::vector<std::set<FrameIdType>> held(agents);
+        for (int i = 0; i < agents; i ++) {
+            for (int k = 0; k < bench.window; k ++) {
+                held[i].insert(frameId(i, k));
+            }
+            for (int d = -bench.neighbors; d <= bench.neighbors; d ++) {
+                int j = ((i + d) % agents + agents) % agents;
+                if (j == i) {
+                    continue;
+                }
+                for (int k = 0; k < bench.window; k ++) {
+                    if ((uniform(rng) + 1) / 2 < bench.shared) {
+                        held[i].insert(frameId(j, k));
+                    }
+                }
+            }
+        }
+        size_t bytes_full = 0, bytes_compact = 0, bytes_interest = 0, bytes_per_peer = 0;
+        size_t frames_full = 0, frames_interest = 0;
+        double max_pos_err = 0, max_ang_err = 0;
+        bool decode_succ = true;
+        for (int i = 0; i < agents; i ++) {
+            DistributedVinsData data;
+            data.stamp = 1000.0;
+            data.drone_id = i;
+            data.solver_token = 1;
+            data.iteration_count = 0;
+            data.reference_frame_id = frameId(0, 0);
+            for (auto frame_id : held[i]) {
+                data.frame_ids.emplace_back(frame_id);
+                Quaterniond q(uniform(rng), uniform(rng), uniform(rng), uniform(rng));
+                data.frame_poses.emplace_back(Vector3d(uniform(rng), uniform(rng), uniform(rng)) * 100, q.normalized());
+            }
+            for (int c = 0; c < bench.cameras; c ++) {
+                data.cam_ids.emplace_back(i * 1000 + c);
+                Quaterniond q(uniform(rng), uniform(rng), uniform(rng), uniform(rng));
+                data.extrinsic.emplace_back(Vector3d(uniform(rng), uniform(rng), uniform(rng)) * 0.1, q.normalized());
+            }
+            bytes_full += data.toLCM().getEncodedSize();
+            frames_full += data.frame_ids.size();
+            auto buf = data.encodeCompact();
+            bytes_compact += buf.size();
+
+            DistributedVinsData decoded;
+            decode_succ = decoded.decodeCompact(buf.data(), buf.size()) && decoded.frame_ids == data.frame_ids && decode_succ;
+            for (int k = 0; k < decoded.frame_poses.size() && k < data.frame_poses.size(); k ++) {
+                auto delta = Swarm::Pose::DeltaPose(data.frame_poses[k], decoded.frame_poses[k]);
+                max_pos_err = std::max(max_pos_err, delta.pos().norm());
+                max_ang_err = std::max(max_ang_err, delta.att().angularDistance(Quaterniond::Identity()));
+            }
+
+            std::set<FrameIdType> interest;
+            for (int j = 0; j < agents; j ++) {
+                if (j == i) {
+                    continue;
+                }
+                std::set<FrameIdType> shared;
+                for (auto frame_id : held[i]) {
+                    if (held[j].find(frame_id) != held[j].end()) {
+                        shared.insert(frame_id);
+                    }
+                }
+                if (!shared.empty()) {
+                    bytes_per_peer += data.selectFrames(shared).encodeCompact().size();
+                }
+                interest.insert(shared.begin(), shared.end());
+            }
+            auto selected = data.selectFrames(interest);
+            bytes_interest += selected.encodeCompact().size();
+            frames_interest += selected.frame_ids.size();
+        }
+        printf("[ConsensusExchangeBench] %d agents: full %ld compact %ld interest %ld (%.1fx) per peer %ld bytes/iteration, "
+            "frames %ld -> %ld\n", agents, bytes_full, bytes_compact, bytes_interest, (double) bytes_full / bytes_interest,
+            bytes_per_peer, frames_full, frames_interest);
+        printf("[ConsensusExchangeBench]     decode %s max error pos %.1e m rot %.1e rad\n", decode_succ ? "ok" : "FAILED",
+            max_pos_err, max_ang_err);
+    }
+    return 0;
+}
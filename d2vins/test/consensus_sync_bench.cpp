@@ -0,0 +1,224 @@
+#include <d2common/solver/BaseConsensusSync.hpp>
+#include <d2common/bench_options.hpp>
+#include <Eigen/Dense>
+#include <thread>
+#include <atomic>
+#include <queue>
+#include <random>
+#include <ctime>
+
+// Single process simulation of the synchronization of D2VINSConsensusSolver. Each agent runs a consensus ADMM
+// on a shared state (local step, broadcast, sync, averaging, dual update) in its own thread; a simulated network
+// delivers the broadcasts with random delay and loss, one agent is slower than the others.
+// "barrier" is the previous waitForSync: poll the data of the iteration with usleep(100) until every peer
+// arrived or timeout; "ssp" is BoundedStalenessSync waking on arrivals, with the staleness bounds 0 to --staleness.
+// Reported: iterations per second, CPU use of the process and the final error to the consensus optimum.
+
+using namespace D2Common;
+using namespace Eigen;
+
+struct BenchParams {
+    int agents = 4;
+    int iterations = 100;
+    double delay_ms = 5;
+    double jitter_ms = 5;
+    double loss = 0.05;
+    double slow_delay_ms = 20; //Extra delay of the messages of agent 0
+    double compute_ms = 5; //Simulated local step
+    double timeout_ms = 100;
+    int staleness = 2;
+    int dim = 6;
+    double rho = 1.0;
+};
+
+struct SimData {
+    int drone_id;
+    int64_t solver_token = 0;
+    int iteration_count;
+    VectorXd x;
+};
+
+// Delivers the broadcasts to the receivers of the other agents after a random delay, or drops them.
+class SimNetwork {
+    struct Packet {
+        std::chrono::steady_clock::time_point deliver_time;
+        int to;
+        SimData data;
+        bool operator<(const Packet & other) const {
+            return deliver_time > other.deliver_time;
+        }
+    };
+    const BenchParams & bench;
+    std::vector<BaseSyncDataReceiver<SimData>> & receivers;
+    std::priority_queue<Packet> packets;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::mt19937 rng{0};
+    bool running = true;
+    std::thread thread;
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (running) {
+            if (packets.empty()) {
+                cond.wait(guard);
+                continue;
+            }
+            auto deliver_time = packets.top().deliver_time;
+            if (std::chrono::steady_clock::now() < deliver_time) {
+                cond.wait_until(guard, deliver_time);
+                continue;
+            }
+            auto packet = packets.top();
+            packets.pop();
+            receivers[packet.to].add(packet.data);
+        }
+    }
+public:
+    std::atomic<int> sent{0}, lost{0};
+    SimNetwork(const BenchParams & _bench, std::vector<BaseSyncDataReceiver<SimData>> & _receivers):
+        bench(_bench), receivers(_receivers), thread(&SimNetwork::run, this) {}
+    ~SimNetwork() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running = false;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+    void broadcast(const SimData & data) {
+        std::lock_guard<std::mutex> guard(lock);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (int to = 0; to < bench.agents; to ++) {
+            if (to == data.drone_id) {
+                continue;
+            }
+            sent ++;
+            if (uniform(rng) < bench.loss) {
+                lost ++;
+                continue;
+            }
+            double delay = bench.delay_ms + bench.jitter_ms * uniform(rng) + (data.drone_id == 0 ? bench.slow_delay_ms : 0);
+            packets.push({std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(delay * 1000)), to, data});
+        }
+        cond.notify_all();
+    }
+};
+
+struct RunResult {
+    double wall_time = 0; //ms
+    double cpu_time = 0; //ms
+    double error = 0;
+    std::map<int, PeerSyncStats> stats; //Of agent 1, agent 0 is the slow one
+};
+
+RunResult run(const BenchParams & bench, bool barrier) {
+    //Local objectives 1/2 |W_i (x - a_i)|^2, the optimum is the weighted mean
+    std::mt19937 rng(1);
+    std::normal_distribution<double> normal(0, 1);
+    std::vector<VectorXd> a(bench.agents), w(bench.agents);
+    VectorXd num = VectorXd::Zero(bench.dim), den = VectorXd::Zero(bench.dim);
+    for (int i = 0; i < bench.agents; i ++) {
+        a[i] = VectorXd(bench.dim);
+        w[i] = VectorXd(bench.dim);
+        for (int k = 0; k < bench.dim; k ++) {
+            a[i](k) = normal(rng);
+            w[i](k) = 0.5 + std::abs(normal(rng));
+        }
+        num += w[i].cwiseProduct(a[i]);
+        den += w[i];
+    }
+    VectorXd optimum = num.cwiseQuotient(den);
+
+    std::vector<BaseSyncDataReceiver<SimData>> receivers(bench.agents);
+    std::vector<VectorXd> z(bench.agents);
+    RunResult result;
+    std::clock_t cpu_start = std::clock();
+    Utility::TicToc tic;
+    {
+        SimNetwork network(bench, receivers);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < bench.agents; i ++) {
+            threads.emplace_back([&, i]() {
+                BoundedStalenessSync<SimData> sync;
+                std::set<int> peers;
+                for (int j = 0; j < bench.agents; j ++) {
+                    if (j != i) {
+                        peers.insert(j);
+                    }
+                }
+                VectorXd x = a[i], u = VectorXd::Zero(bench.dim), z_i = a[i];
+                for (int iter = 0; iter < bench.iterations; iter ++) {
+                    //Local step: argmin 1/2 |W_i (x - a_i)|^2 + rho/2 |x - z + u|^2
+                    x = (w[i].cwiseProduct(a[i]) + bench.rho * (z_i - u)).cwiseQuotient(w[i] + VectorXd::Constant(bench.dim, bench.rho));
+                    usleep(bench.compute_ms * 1000);
+                    network.broadcast({i, 0, iter, x});
+                    std::vector<SimData> datas;
+                    if (barrier) {
+                        Utility::TicToc tic_wait;
+                        while (tic_wait.toc() < bench.timeout_ms) {
+                            auto ret = receivers[i].retrive(0, iter);
+                            datas.insert(datas.end(), ret.begin(), ret.end());
+                            usleep(100);
+                            if (datas.size() == bench.agents - 1) {
+                                break;
+                            }
+                        }
+                    } else {
+                        datas = sync.wait(receivers[i], 0, iter, peers, bench.staleness, bench.timeout_ms);
+                    }
+                    //Averaging with the data received, then the dual update
+                    VectorXd sum = x;
+                    for (auto & data : datas) {
+                        sum += data.x;
+                    }
+                    z_i = sum / (datas.size() + 1);
+                    u += x - z_i;
+                }
+                z[i] = z_i;
+                if (i == 1) {
+                    result.stats = sync.peerStats();
+                }
+            });
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+    result.wall_time = tic.toc();
+    result.cpu_time = (std::clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+    for (int i = 0; i < bench.agents; i ++) {
+        result.error = std::max(result.error, (z[i] - optimum).norm());
+    }
+    return result;
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.add("agents", bench.agents, "agents")
+        .add("iterations", bench.iterations, "consensus iterations")
+        .add("delay_ms", bench.delay_ms, "mean network delay")
+        .add("jitter_ms", bench.jitter_ms, "network delay jitter")
+        .add("loss", bench.loss, "message loss rate")
+        .add("slow_delay_ms", bench.slow_delay_ms, "extra delay of the messages of agent 0")
+        .add("compute_ms", bench.compute_ms, "simulated local step")
+        .add("timeout_ms", bench.timeout_ms, "sync timeout")
+        .add("staleness", bench.staleness, "largest staleness bound compared");
+    options.parse(argc, argv);
+    printf("[ConsensusSyncBench] %d agents %d iterations delay %.1f+%.1fms (slow agent +%.1fms) loss %.0f%% compute %.1fms\n",
+        bench.agents, bench.iterations, bench.delay_ms, bench.jitter_ms, bench.slow_delay_ms, bench.loss * 100, bench.compute_ms);
+    auto barrier = run(bench, true);
+    printf("[ConsensusSyncBench] barrier: %.1f iterations/s CPU %.0f%% error %.2e\n", bench.iterations * 1000 / barrier.wall_time,
+        barrier.cpu_time * 100 / barrier.wall_time, barrier.error);
+    int max_staleness = bench.staleness;
+    for (bench.staleness = 0; bench.staleness <= max_staleness; bench.staleness ++) {
+        auto ssp = run(bench, false);
+        printf("[ConsensusSyncBench] ssp (staleness %d): %.1f iterations/s CPU %.0f%% error %.2e\n", bench.staleness,
+            bench.iterations * 1000 / ssp.wall_time, ssp.cpu_time * 100 / ssp.wall_time, ssp.error);
+        for (auto & it : ssp.stats) {
+            printf("[ConsensusSyncBench]     agent 1 <- peer %d: fresh %d stale %d missed %d wait mean %.1fms max %.1fms\n", it.first,
+                it.second.fresh, it.second.stale, it.second.missed, it.second.meanWait(), it.second.max_wait);
+        }
+    }
+    return 0;
+}
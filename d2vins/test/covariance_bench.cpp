@@ -0,0 +1,115 @@
+#include "../src/estimator/covariance.hpp"
+#include <d2common/utils.hpp>
+#include <d2common/bench_options.hpp>
+#include <random>
+
+// Microbenchmark of the marginal covariance recovery of D2Estimator::estimateCovariance on synthetic sliding
+// window Hessians: frame poses and speed biases chained by IMU factors, quad camera extrinsics, td and inverse
+// depth landmarks observed from several frames, with a prior on the first frame.
+// "before" inverts the whole Hessian (Utility::inverse, as Marginalizer::covarianceEstimation does);
+// "after" recovers the latest pose, velocity and extrinsics with marginalCovariance.
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+struct BenchParams {
+    std::vector<int> windows = {5, 10, 15, 20, 30};
+    int cameras = 4;
+    int landmarks_per_frame = 100;
+    int track = 4;
+    int repeat = 3;
+};
+
+// Adds J_blocks^T J_blocks of a random residual of residual_size rows on the (index, size) blocks
+void addFactor(std::mt19937 & rng, std::vector<Eigen::Triplet<double>> & triplets,
+        const std::vector<std::pair<int, int>> & blocks, int residual_size, double scale) {
+    std::normal_distribution<double> normal(0.0, scale);
+    int cols = 0;
+    for (auto & block : blocks) {
+        cols += block.second;
+    }
+    MatrixXd J(residual_size, cols);
+    for (int i = 0; i < J.size(); i ++) {
+        J.data()[i] = normal(rng);
+    }
+    MatrixXd H = J.transpose() * J;
+    int u = 0;
+    for (auto & block_u : blocks) {
+        int v = 0;
+        for (auto & block_v : blocks) {
+            for (int i = 0; i < block_u.second; i ++) {
+                for (int j = 0; j < block_v.second; j ++) {
+                    triplets.emplace_back(block_u.first + i, block_v.first + j, H(u + i, v + j));
+                }
+            }
+            v += block_v.second;
+        }
+        u += block_u.second;
+    }
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.addList("windows", bench.windows, "window sizes to compare")
+        .add("cameras", bench.cameras, "cameras per drone")
+        .add("landmarks_per_frame", bench.landmarks_per_frame, "new landmarks per frame")
+        .add("track", bench.track, "frames observing each landmark")
+        .add("repeat", bench.repeat, "runs averaged per window size");
+    options.parse(argc, argv);
+    std::mt19937 rng(0);
+    printf("[CovarianceBench] %d cameras %d landmarks per frame track %d\n", bench.cameras, bench.landmarks_per_frame, bench.track);
+    for (auto window : bench.windows) {
+        //Layout: [poses, speed biases, extrinsics, td, landmarks]
+        int spd_bias_start = window * POSE_EFF_SIZE;
+        int extrinsic_start = spd_bias_start + window * FRAME_SPDBIAS_SIZE;
+        int td_index = extrinsic_start + bench.cameras * POSE_EFF_SIZE;
+        int landmark_start = td_index + TD_SIZE;
+        int landmark_num = window * bench.landmarks_per_frame;
+        int state_dim = landmark_start + landmark_num;
+        std::vector<Eigen::Triplet<double>> triplets;
+        addFactor(rng, triplets, {{0, POSE_EFF_SIZE}, {spd_bias_start, FRAME_SPDBIAS_SIZE}}, 15, 10.0);
+        for (int i = 0; i + 1 < window; i ++) {
+            addFactor(rng, triplets, {{i * POSE_EFF_SIZE, POSE_EFF_SIZE}, {spd_bias_start + i * FRAME_SPDBIAS_SIZE, FRAME_SPDBIAS_SIZE},
+                {(i + 1) * POSE_EFF_SIZE, POSE_EFF_SIZE}, {spd_bias_start + (i + 1) * FRAME_SPDBIAS_SIZE, FRAME_SPDBIAS_SIZE}}, 15, 1.0);
+        }
+        for (int j = 0; j < landmark_num; j ++) {
+            int base = rng() % window;
+            int camera = rng() % bench.cameras;
+            for (int k = 1; k < bench.track && base + k < window; k ++) {
+                addFactor(rng, triplets, {{base * POSE_EFF_SIZE, POSE_EFF_SIZE}, {(base + k) * POSE_EFF_SIZE, POSE_EFF_SIZE},
+                    {extrinsic_start + camera * POSE_EFF_SIZE, POSE_EFF_SIZE}, {landmark_start + j, INV_DEP_SIZE}, {td_index, TD_SIZE}}, 2, 1.0);
+            }
+            //Keeps landmarks seen once observable, as the depth prior of the stereo landmarks does
+            addFactor(rng, triplets, {{landmark_start + j, INV_DEP_SIZE}}, 1, 1.0);
+        }
+        SparseMat H(state_dim, state_dim);
+        H.setFromTriplets(triplets.begin(), triplets.end());
+
+        std::vector<std::pair<int, int>> wanted{{(window - 1) * POSE_EFF_SIZE, POSE_EFF_SIZE},
+            {spd_bias_start + (window - 1) * FRAME_SPDBIAS_SIZE, 3}};
+        for (int c = 0; c < bench.cameras; c ++) {
+            wanted.emplace_back(extrinsic_start + c * POSE_EFF_SIZE, POSE_EFF_SIZE);
+        }
+
+        MatrixXd cov_before(POSE_EFF_SIZE, POSE_EFF_SIZE);
+        TicToc tic_before;
+        for (int k = 0; k < bench.repeat; k ++) {
+            SparseMat H_inv = D2Common::Utility::inverse(H);
+            cov_before = MatrixXd(H_inv.block(wanted[0].first, wanted[0].first, POSE_EFF_SIZE, POSE_EFF_SIZE));
+        }
+        double time_before = tic_before.toc() / bench.repeat;
+
+        MatrixXd cov_after;
+        bool succ = true;
+        TicToc tic_after;
+        for (int k = 0; k < bench.repeat; k ++) {
+            succ = marginalCovariance(H, wanted, cov_after) && succ;
+        }
+        double time_after = tic_after.toc() / bench.repeat;
+        double err = succ ? (cov_after.block(0, 0, POSE_EFF_SIZE, POSE_EFF_SIZE) - cov_before).norm() / cov_before.norm() : -1;
+        printf("[CovarianceBench] window %d state dim %d nnz %ld: full inverse %.2fms subset %.2fms (%d wanted) speedup %.1fx rel. err %.1e\n",
+            window, state_dim, H.nonZeros(), time_before, time_after, cov_after.rows(), time_before / time_after, err);
+    }
+    return 0;
+}
@@ -0,0 +1,449 @@
+#include <d2frontend/d2frontend.h>
+#include <d2frontend/d2frontend_params.h>
+#include <d2frontend/loop_cam.h>
+#include <d2frontend/d2featuretracker.h>
+#include <d2common/param_handle.hpp>
+#include <d2common/bench_options.hpp>
+#include <d2common/tracing.hpp>
+#include "../src/estimator/d2estimator.hpp"
+#include <opencv2/opencv.hpp>
+#include <Eigen/Geometry>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// Offline replay of a EuRoC / TUM-VI dataset (ASL folder layout: mav0/cam0, mav0/cam1, mav0/imu0, as also written
+// by the bag extraction tools) through the frontend and the sliding window estimator of a single drone, without
+// ROS master, network or GPU: frames are processed one after the other as fast as possible, each once the IMU covers it.
+// Model paths and other node parameters are given as in the launch files, with _key:=value
+// (_superpoint_model_path, _netvlad_model_path, _pca_comp_path, _pca_mean_path...).
+// Without a CUDA device (or with enable_cuda: 0 in the config), the undistortion, LK optical flow and CNNs run on the CPU.
+// Loop detection is disabled.
+// Written: the trajectory in TUM format (stamp x y z qx qy qz qw), the pose of each frame when it is estimated.
+// Reported: per frame timing of each stage (image loading, feature extraction, tracking, estimator, tracker update),
+// the ATE RMSE after SE(3) Umeyama alignment and the RPE over --rpe_delta seconds against the ground truth
+// (mav0/state_groundtruth_estimate0 for EuRoC, mav0/mocap0 for TUM-VI, or --groundtruth in ASL or TUM format).
+// With enable_tracing: 1 in the config, the tracing summary is printed and the trace written (tracing_output) at the end.
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+struct BenchParams {
+    std::string dataset;
+    std::string config;
+    std::string output = "d2vins_replay.txt";
+    std::string groundtruth;
+    double start = 0; //Seconds skipped from the first frame
+    int max_frames = -1;
+    double rpe_delta = 1.0;
+    double imu_lead = 0.02; //IMU given beyond the frame stamp, as it would have arrived before the frame
+};
+
+struct Trajectory {
+    std::vector<double> stamps;
+    std::vector<Vector3d> positions;
+    std::vector<Quaterniond> attitudes;
+    void add(double stamp, const Vector3d & pos, const Quaterniond & att) {
+        stamps.emplace_back(stamp);
+        positions.emplace_back(pos);
+        attitudes.emplace_back(att);
+    }
+    // Pose at stamp, interpolated between the samples around it if they are at most max_gap apart
+    bool interpolate(double stamp, Vector3d & pos, Quaterniond & att, double max_gap = 0.1) const {
+        auto it = std::lower_bound(stamps.begin(), stamps.end(), stamp);
+        if (it == stamps.end() || (it == stamps.begin() && *it > stamp)) {
+            return false;
+        }
+        int j = it - stamps.begin();
+        if (*it == stamp) {
+            pos = positions[j];
+            att = attitudes[j];
+            return true;
+        }
+        int i = j - 1;
+        if (stamps[j] - stamps[i] > max_gap) {
+            return false;
+        }
+        double s = (stamp - stamps[i]) / (stamps[j] - stamps[i]);
+        pos = (1 - s) * positions[i] + s * positions[j];
+        att = attitudes[i].slerp(s, attitudes[j]);
+        return true;
+    }
+};
+
+struct FrameTiming {
+    double load = 0;
+    double extract = 0;
+    double track = 0;
+    double estimator = 0;
+    double update = 0;
+    double total = 0;
+};
+
+// Rows of a csv of the ASL layout, without the comments
+std::vector<std::vector<std::string>> readCSV(const std::string & path) {
+    std::vector<std::vector<std::string>> rows;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line.back() == '\r') {
+            line.pop_back();
+        }
+        std::vector<std::string> row;
+        std::stringstream ss(line);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            row.emplace_back(item);
+        }
+        rows.emplace_back(row);
+    }
+    return rows;
+}
+
+// Stamp (ns) -> image path, from <folder>/data.csv
+std::map<int64_t, std::string> readImageList(const std::string & folder) {
+    std::map<int64_t, std::string> images;
+    for (auto & row : readCSV(folder + "/data.csv")) {
+        if (row.size() >= 2) {
+            images[std::stoll(row[0])] = folder + "/data/" + row[1];
+        }
+    }
+    return images;
+}
+
+std::vector<IMUData> readIMU(const std::string & path) {
+    std::vector<IMUData> imus;
+    for (auto & row : readCSV(path)) {
+        if (row.size() < 7) {
+            continue;
+        }
+        IMUData data;
+        data.t = std::stoll(row[0]) * 1e-9;
+        data.gyro = Vector3d(std::stod(row[1]), std::stod(row[2]), std::stod(row[3]));
+        data.acc = Vector3d(std::stod(row[4]), std::stod(row[5]), std::stod(row[6]));
+        data.dt = imus.empty() ? 0 : data.t - imus.back().t;
+        imus.emplace_back(data);
+    }
+    return imus;
+}
+
+// ASL csv (stamp in ns, p xyz, q wxyz) or TUM format (stamp in s, p xyz, q xyzw)
+Trajectory readGroundtruth(const std::string & path) {
+    Trajectory gt;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        bool asl = line.find(',') != std::string::npos;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream ss(line);
+        double t, v[7];
+        ss >> t;
+        for (int i = 0; i < 7; i++) {
+            ss >> v[i];
+        }
+        if (ss.fail()) {
+            continue;
+        }
+        if (asl) {
+            gt.add(t * 1e-9, Vector3d(v[0], v[1], v[2]), Quaterniond(v[3], v[4], v[5], v[6]).normalized());
+        } else {
+            gt.add(t, Vector3d(v[0], v[1], v[2]), Quaterniond(v[6], v[3], v[4], v[5]).normalized());
+        }
+    }
+    return gt;
+}
+
+bool exists(const std::string & path) {
+    return std::ifstream(path).good();
+}
+
+cv::Mat loadImage(const std::string & path) {
+    cv::Mat img = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (img.depth() == CV_16U) {
+        //TUM-VI 16 bit images
+        img.convertTo(img, CV_8U, 1.0 / 256.0);
+    }
+    if (img.channels() == 3) {
+        cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
+    }
+    return img;
+}
+
+// D2VINS on a single drone, driven synchronously from the replay loop
+class D2VINSReplay : public D2FrontEnd::D2Frontend {
+    D2Estimator * estimator = nullptr;
+protected:
+    Swarm::Pose getMotionPredict(double stamp) const override {
+        return estimator->getMotionPredict(stamp).first.pose();
+    }
+public:
+    Trajectory trajectory;
+
+    void init() {
+        initLocalModules();
+        estimator = new D2Estimator(params->self_id);
+        estimator->init(nullptr);
+    }
+
+    void inputImu(const IMUData & data) {
+        estimator->inputImu(data);
+    }
+
+    double td() {
+        return estimator->getState().getTd(params->self_id);
+    }
+
+    // The steps of D2Frontend::processStereoframe and D2VINSNode::processVIOKFThread, timed separately
+    void inputStereo(const StereoFrame & stereoframe, FrameTiming & timing) {
+        TicToc tic;
+        auto vframearry = loop_cam->processStereoframe(stereoframe);
+        timing.extract = tic.toc();
+        tic.tic();
+        vframearry.motion_prediction = getMotionPredict(vframearry.stamp);
+        bool is_keyframe = feature_tracker->trackLocalFrames(vframearry);
+        vframearry.prevent_adding_db = !is_keyframe;
+        vframearry.is_keyframe = is_keyframe;
+        vframearry.releaseRawImages();
+        timing.track = tic.toc();
+        if (!vframearry.send_to_backend) {
+            return;
+        }
+        tic.tic();
+        bool ret = estimator->inputImage(vframearry);
+        timing.estimator = tic.toc();
+        tic.tic();
+        {
+            const std::lock_guard<std::recursive_mutex> lock(estimator->frame_mutex);
+            feature_tracker->updatebySldWin(estimator->getSelfSldWin());
+            feature_tracker->updatebyLandmarkDB(estimator->getLandmarkDB());
+            feature_tracker->setKeyframeThresScale(estimator->keyframeThresScale());
+        }
+        timing.update = tic.toc();
+        if (ret) {
+            auto pose = estimator->getOdometry().pose();
+            trajectory.add(vframearry.stamp, pose.pos(), pose.att());
+        }
+    }
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    int index = std::min((int) values.size() - 1, (int) (p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void reportTiming(const char * name, const std::vector<FrameTiming> & timings, double FrameTiming::* field) {
+    std::vector<double> values;
+    double sum = 0;
+    for (auto & timing : timings) {
+        values.emplace_back(timing.*field);
+        sum += timing.*field;
+    }
+    if (values.empty()) {
+        return;
+    }
+    printf("[DatasetReplay] %-10s mean %7.2fms p50 %7.2fms p90 %7.2fms p99 %7.2fms max %7.2fms\n", name,
+        sum / values.size(), percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+        *std::max_element(values.begin(), values.end()));
+}
+
+// ATE RMSE (m) of est after SE(3) alignment on the ground truth
+double alignedATE(const Trajectory & est, const Trajectory & gt, int & matched) {
+    std::vector<Vector3d> src, dst;
+    for (int i = 0; i < est.stamps.size(); i++) {
+        Vector3d pos;
+        Quaterniond att;
+        if (gt.interpolate(est.stamps[i], pos, att)) {
+            src.emplace_back(est.positions[i]);
+            dst.emplace_back(pos);
+        }
+    }
+    matched = src.size();
+    if (src.size() < 3) {
+        return -1;
+    }
+    Eigen::Matrix3Xd A(3, src.size()), B(3, dst.size());
+    for (int i = 0; i < src.size(); i++) {
+        A.col(i) = src[i];
+        B.col(i) = dst[i];
+    }
+    Eigen::Matrix4d T = Eigen::umeyama(A, B, false);
+    double sum = 0;
+    for (int i = 0; i < src.size(); i++) {
+        Vector3d p = T.block<3, 3>(0, 0) * src[i] + T.block<3, 1>(0, 3);
+        sum += (p - dst[i]).squaredNorm();
+    }
+    return sqrt(sum / src.size());
+}
+
+// RPE over delta seconds: RMSE of the translation (m) and mean of the rotation (deg) of the relative pose errors
+bool relativePoseError(const Trajectory & est, const Trajectory & gt, double delta, double & rpe_trans, double & rpe_rot,
+        int & pairs) {
+    double sum_trans = 0, sum_rot = 0;
+    pairs = 0;
+    for (int i = 0; i < est.stamps.size(); i++) {
+        auto it = std::lower_bound(est.stamps.begin(), est.stamps.end(), est.stamps[i] + delta);
+        if (it == est.stamps.end()) {
+            break;
+        }
+        int j = it - est.stamps.begin();
+        Vector3d p_gt_i, p_gt_j;
+        Quaterniond q_gt_i, q_gt_j;
+        if (!gt.interpolate(est.stamps[i], p_gt_i, q_gt_i) || !gt.interpolate(est.stamps[j], p_gt_j, q_gt_j)) {
+            continue;
+        }
+        Quaterniond dq_gt = q_gt_i.inverse() * q_gt_j;
+        Vector3d dp_gt = q_gt_i.inverse() * (p_gt_j - p_gt_i);
+        Quaterniond dq_est = est.attitudes[i].inverse() * est.attitudes[j];
+        Vector3d dp_est = est.attitudes[i].inverse() * (est.positions[j] - est.positions[i]);
+        Vector3d err_trans = dq_gt.inverse() * (dp_est - dp_gt);
+        sum_trans += err_trans.squaredNorm();
+        sum_rot += (dq_gt.inverse() * dq_est).angularDistance(Quaterniond::Identity()) * 180 / M_PI;
+        pairs++;
+    }
+    if (pairs == 0) {
+        return false;
+    }
+    rpe_trans = sqrt(sum_trans / pairs);
+    rpe_rot = sum_rot / pairs;
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.addRequired("dataset", bench.dataset, "dataset folder in the ASL layout")
+        .addRequired("config", bench.config, "vins config")
+        .add("output", bench.output, "trajectory output in TUM format")
+        .add("groundtruth", bench.groundtruth, "ground truth in ASL or TUM format, from the dataset if empty")
+        .add("start", bench.start, "seconds skipped from the first frame")
+        .add("max_frames", bench.max_frames, "frames to replay, all if negative")
+        .add("rpe_delta", bench.rpe_delta, "interval of the RPE in seconds")
+        .allowNodeParams();
+    options.parse(argc, argv);
+    cv::setNumThreads(1);
+    auto values = D2Common::ParamHandle::fromArgs(argc, argv);
+    values["vins_config_path"] = bench.config;
+    values.emplace("self_id", "0");
+    values.emplace("enable_loop", "false");
+    values.emplace("enable_network", "false");
+    D2Common::ParamHandle nh(values);
+    D2FrontEnd::params = new D2FrontEnd::D2FrontendParams(nh);
+    D2Common::Tracing::init(D2FrontEnd::params->tracing);
+    initParams(nh);
+    params->estimation_mode = D2VINSConfig::SINGLE_DRONE_MODE;
+    auto camera_configuration = D2FrontEnd::params->camera_configuration;
+    if (camera_configuration != CameraConfig::STEREO_PINHOLE && camera_configuration != CameraConfig::STEREO_FISHEYE) {
+        printf("[DatasetReplay] Only stereo camera configurations are supported, got %d\n", camera_configuration);
+        return -1;
+    }
+
+    std::string root = exists(bench.dataset + "/mav0/imu0/data.csv") ? bench.dataset + "/mav0" : bench.dataset;
+    auto left_images = readImageList(root + "/cam0");
+    auto right_images = readImageList(root + "/cam1");
+    auto imus = readIMU(root + "/imu0/data.csv");
+    if (left_images.empty() || imus.empty()) {
+        printf("[DatasetReplay] No images or IMU in %s\n", root.c_str());
+        return -1;
+    }
+    if (bench.groundtruth.empty()) {
+        for (auto path : {root + "/state_groundtruth_estimate0/data.csv", root + "/mocap0/data.csv"}) {
+            if (exists(path)) {
+                bench.groundtruth = path;
+                break;
+            }
+        }
+    }
+    printf("[DatasetReplay] %s: %ld frames %ld IMU samples ground truth %s\n", root.c_str(), left_images.size(),
+        imus.size(), bench.groundtruth.empty() ? "none" : bench.groundtruth.c_str());
+
+    D2VINSReplay replay;
+    replay.init();
+    std::vector<FrameTiming> timings;
+    int imu_index = 0;
+    double t_first = left_images.begin()->first * 1e-9, t_last = t_first;
+    TicToc wall;
+    for (auto & it : left_images) {
+        double stamp = it.first * 1e-9;
+        auto right = right_images.find(it.first);
+        if (stamp < t_first + bench.start || right == right_images.end()) {
+            continue;
+        }
+        if (bench.max_frames >= 0 && timings.size() >= bench.max_frames) {
+            break;
+        }
+        double t_imu = stamp + replay.td();
+        while (imu_index < imus.size() && imus[imu_index].t <= t_imu + bench.imu_lead) {
+            replay.inputImu(imus[imu_index]);
+            imu_index++;
+        }
+        if (imus.back().t <= t_imu) {
+            printf("[DatasetReplay] IMU ends at %.3f before frame %.3f\n", imus.back().t, stamp);
+            break;
+        }
+        FrameTiming timing;
+        TicToc tic;
+        cv::Mat left = loadImage(it.second);
+        cv::Mat right_img = loadImage(right->second);
+        timing.load = tic.toc();
+        if (left.empty() || right_img.empty()) {
+            printf("[DatasetReplay] Failed to load %s\n", it.second.c_str());
+            continue;
+        }
+        StereoFrame sframe(ros::Time(stamp), left, right_img, D2FrontEnd::params->extrinsics[0],
+            D2FrontEnd::params->extrinsics[1], params->self_id);
+        replay.inputStereo(sframe, timing);
+        timing.total = tic.toc();
+        timings.emplace_back(timing);
+        t_last = stamp;
+    }
+    double wall_time = wall.toc();
+
+    auto & traj = replay.trajectory;
+    std::ofstream output(bench.output);
+    output << std::fixed;
+    for (int i = 0; i < traj.stamps.size(); i++) {
+        auto & p = traj.positions[i];
+        auto & q = traj.attitudes[i];
+        output << std::setprecision(9) << traj.stamps[i] << " " << std::setprecision(6) << p.x() << " " << p.y() << " "
+            << p.z() << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << "\n";
+    }
+    output.close();
+
+    printf("[DatasetReplay] %ld frames (%.1fs of data) in %.1fs, %.1fx real time, %ld poses written to %s\n",
+        timings.size(), t_last - t_first - bench.start, wall_time / 1000, (t_last - t_first - bench.start) * 1000 / wall_time,
+        traj.stamps.size(), bench.output.c_str());
+    reportTiming("load", timings, &FrameTiming::load);
+    reportTiming("extract", timings, &FrameTiming::extract);
+    reportTiming("track", timings, &FrameTiming::track);
+    reportTiming("estimator", timings, &FrameTiming::estimator);
+    reportTiming("update", timings, &FrameTiming::update);
+    reportTiming("total", timings, &FrameTiming::total);
+    D2Common::Tracing::shutdown();
+    if (bench.groundtruth.empty()) {
+        return 0;
+    }
+    auto gt = readGroundtruth(bench.groundtruth);
+    int matched = 0, pairs = 0;
+    double ate = alignedATE(traj, gt, matched);
+    double rpe_trans = 0, rpe_rot = 0;
+    if (ate < 0) {
+        printf("[DatasetReplay] Too few poses (%d) covered by the ground truth\n", matched);
+        return 0;
+    }
+    printf("[DatasetReplay] ATE RMSE %.3fm over %d poses\n", ate, matched);
+    if (relativePoseError(traj, gt, bench.rpe_delta, rpe_trans, rpe_rot, pairs)) {
+        printf("[DatasetReplay] RPE over %.1fs: translation RMSE %.3fm rotation mean %.2fdeg over %d pairs\n",
+            bench.rpe_delta, rpe_trans, rpe_rot, pairs);
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include "../src/estimator/d2estimator.hpp"
+#include "../src/network/d2vins_net.hpp"
+#include "../src/MSCKF/MSCKF.hpp"
+#include <d2frontend/d2frontend_params.h>
+#include <d2common/bench_options.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Imu.h>
+#include <nav_msgs/Odometry.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <swarm_msgs/ImageArrayDescriptor.h>
+#include <Eigen/Geometry>
+#include <fstream>
+#include <iomanip>
+
+// Offline comparison of the MSCKF backend with the sliding window optimizer (D2Estimator) on a
+// single drone. The bag must contain the IMU and the frames of the frontend (image_array_desc,
+// recorded with pub_visual_frame enabled); both backends get the same frames once the IMU covers them.
+// Reported: per-frame latency of each backend and ATE RMSE after Umeyama alignment on the ground truth,
+// or the RMSE between the two trajectories without ground truth.
+// The VINS config is given as the node parameter _vins_config_path:=config.yaml.
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+struct BenchParams {
+    std::string bag;
+    std::string frame_topic = "/d2vins/image_array_desc";
+    std::string imu_topic;
+    std::string gt_topic;
+    std::string csv;
+    bool no_optimizer = false;
+};
+
+struct Trajectory {
+    std::vector<double> stamps;
+    std::vector<Vector3d> positions;
+    std::vector<double> latencies;
+    void add(double stamp, const Vector3d & pos, double latency) {
+        stamps.emplace_back(stamp);
+        positions.emplace_back(pos);
+        latencies.emplace_back(latency);
+    }
+};
+
+// Position of the reference trajectory closest to stamp, within 20ms
+bool lookup(const Trajectory & ref, double stamp, Vector3d & pos) {
+    auto it = std::lower_bound(ref.stamps.begin(), ref.stamps.end(), stamp);
+    int best = -1;
+    double best_dt = 0.02;
+    for (auto cand : {it, it == ref.stamps.begin() ? it : it - 1}) {
+        if (cand != ref.stamps.end() && fabs(*cand - stamp) < best_dt) {
+            best_dt = fabs(*cand - stamp);
+            best = cand - ref.stamps.begin();
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+    pos = ref.positions[best];
+    return true;
+}
+
+double alignedRMSE(const Trajectory & est, const Trajectory & ref) {
+    std::vector<Vector3d> src, dst;
+    for (int i = 0; i < est.stamps.size(); i++) {
+        Vector3d pos;
+        if (lookup(ref, est.stamps[i], pos)) {
+            src.emplace_back(est.positions[i]);
+            dst.emplace_back(pos);
+        }
+    }
+    if (src.size() < 3) {
+        return -1;
+    }
+    Eigen::Matrix3Xd A(3, src.size()), B(3, dst.size());
+    for (int i = 0; i < src.size(); i++) {
+        A.col(i) = src[i];
+        B.col(i) = dst[i];
+    }
+    Eigen::Matrix4d T = Eigen::umeyama(A, B, false);
+    double sum = 0;
+    for (int i = 0; i < src.size(); i++) {
+        Vector3d p = T.block<3, 3>(0, 0) * src[i] + T.block<3, 1>(0, 3);
+        sum += (p - dst[i]).squaredNorm();
+    }
+    return sqrt(sum / src.size());
+}
+
+void report(const std::string & name, const Trajectory & traj, const Trajectory & ref) {
+    if (traj.latencies.empty()) {
+        return;
+    }
+    double sum = 0, max = 0;
+    for (auto t : traj.latencies) {
+        sum += t;
+        max = std::max(max, t);
+    }
+    printf("[MSCKFBench] %s: frames %ld latency mean %.2fms max %.2fms ATE RMSE %.3fm\n", name.c_str(),
+        traj.latencies.size(), sum / traj.latencies.size(), max, alignedRMSE(traj, ref));
+}
+
+int main(int argc, char ** argv) {
+    ros::init(argc, argv, "d2vins_msckf_bench", ros::init_options::AnonymousName);
+    ros::NodeHandle nh("~");
+    // ros::init has removed the node parameters from argv.
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.addRequired("bag", bench.bag, "bag with the IMU and the frontend frames")
+        .add("frame_topic", bench.frame_topic, "topic of the frontend frames")
+        .add("imu_topic", bench.imu_topic, "IMU topic, the one of the config if empty")
+        .add("gt_topic", bench.gt_topic, "ground truth pose or odometry topic")
+        .add("csv", bench.csv, "output csv of the trajectories")
+        .add("no_optimizer", bench.no_optimizer, "run the MSCKF only");
+    options.parse(argc, argv);
+    D2FrontEnd::params = new D2FrontEnd::D2FrontendParams(nh);
+    initParams(nh);
+    params->estimation_mode = D2VINSConfig::SINGLE_DRONE_MODE;
+    if (bench.imu_topic.empty()) {
+        bench.imu_topic = params->imu_topic;
+    }
+    D2Estimator * estimator = nullptr;
+    if (!bench.no_optimizer) {
+        estimator = new D2Estimator(params->self_id);
+        estimator->init(nh, new D2VINSNet(estimator, params->lcm_uri));
+    }
+    MSCKF msckf;
+
+    rosbag::Bag bag;
+    bag.open(bench.bag, rosbag::bagmode::Read);
+    std::vector<std::string> topics{bench.frame_topic, bench.imu_topic};
+    if (!bench.gt_topic.empty()) {
+        topics.emplace_back(bench.gt_topic);
+    }
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+    Trajectory gt, traj_msckf, traj_opti;
+    std::deque<D2Common::VisualImageDescArray> frames;
+    double last_imu_t = -1;
+    auto processFrames = [&](double t_imu) {
+        //The backends wait for the IMU covering the frame
+        while (!frames.empty() && frames.front().stamp + params->td_initial < t_imu) {
+            auto frame = frames.front();
+            frames.pop_front();
+            auto frame_opti = frame;
+            TicToc tic;
+            if (msckf.inputImage(frame)) {
+                traj_msckf.add(frame.stamp, frame.pose_drone.pos(), tic.toc());
+            }
+            if (estimator != nullptr) {
+                TicToc tic_opti;
+                if (estimator->inputImage(frame_opti)) {
+                    traj_opti.add(frame_opti.stamp, estimator->getOdometry().pos(), tic_opti.toc());
+                }
+            }
+        }
+    };
+    for (const rosbag::MessageInstance & m : view) {
+        if (m.getTopic() == bench.imu_topic) {
+            auto imu = m.instantiate<sensor_msgs::Imu>();
+            if (imu == nullptr) {
+                continue;
+            }
+            IMUData data(*imu);
+            data.dt = last_imu_t < 0 ? 0 : data.t - last_imu_t;
+            last_imu_t = data.t;
+            msckf.inputImu(data);
+            if (estimator != nullptr) {
+                estimator->inputImu(data);
+            }
+            processFrames(data.t);
+        } else if (m.getTopic() == bench.frame_topic) {
+            auto desc = m.instantiate<swarm_msgs::ImageArrayDescriptor>();
+            if (desc != nullptr && desc->drone_id == params->self_id) {
+                frames.emplace_back(*desc);
+            }
+        } else if (m.getTopic() == bench.gt_topic) {
+            if (auto odom = m.instantiate<nav_msgs::Odometry>()) {
+                auto & p = odom->pose.pose.position;
+                gt.add(odom->header.stamp.toSec(), Vector3d(p.x, p.y, p.z), 0);
+            } else if (auto pose = m.instantiate<geometry_msgs::PoseStamped>()) {
+                auto & p = pose->pose.position;
+                gt.add(pose->header.stamp.toSec(), Vector3d(p.x, p.y, p.z), 0);
+            }
+        }
+        if (!ros::ok()) {
+            break;
+        }
+    }
+    bag.close();
+
+    if (gt.stamps.empty()) {
+        printf("[MSCKFBench] No ground truth, ATE of MSCKF is against the optimizer.\n");
+        report("MSCKF", traj_msckf, traj_opti);
+    } else {
+        report("MSCKF", traj_msckf, gt);
+        report("Optimizer", traj_opti, gt);
+    }
+    if (!bench.csv.empty()) {
+        std::ofstream csv(bench.csv);
+        csv << "backend,stamp,x,y,z,latency_ms\n";
+        for (int i = 0; i < traj_msckf.stamps.size(); i++) {
+            auto & p = traj_msckf.positions[i];
+            csv << "msckf," << std::setprecision(16) << traj_msckf.stamps[i] << "," << p.x() << "," << p.y() << "," << p.z() << "," << traj_msckf.latencies[i] << "\n";
+        }
+        for (int i = 0; i < traj_opti.stamps.size(); i++) {
+            auto & p = traj_opti.positions[i];
+            csv << "optimizer," << std::setprecision(16) << traj_opti.stamps[i] << "," << p.x() << "," << p.y() << "," << p.z() << "," << traj_opti.latencies[i] << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <d2common/tracing.hpp>
+#include <d2common/utils.hpp>
+#include <d2common/bench_options.hpp>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cost of the tracing instrumentation. First the cost of an empty zone, with the tracing disabled and enabled.
+// Then --threads threads (named as the viokf, loop detection and solver threads) run --frames frames each, a frame
+// being a zone around --work_us of computation with two nested zones, a queue depth counter and a solve time value,
+// with the tracing disabled and enabled: the overhead is the increase of the wall time per frame.
+// The trace of the enabled run is written to --output, to be opened in chrome://tracing or Perfetto.
+
+using D2Common::Utility::TicToc;
+using namespace D2Common;
+
+struct BenchParams {
+    int threads = 3;
+    int frames = 2000;
+    double work_us = 200;
+    std::string output = "d2vins_trace.json";
+};
+
+// Busy computation for about us microseconds
+double work(double us) {
+    volatile double sum = 0;
+    int64_t end = Tracing::now() + (int64_t) (us * 1000);
+    while (Tracing::now() < end) {
+        for (int i = 0; i < 100; i++) {
+            sum = sum + std::sqrt((double) i);
+        }
+    }
+    return sum;
+}
+
+double emptyZoneCost(int num) {
+    int64_t start = Tracing::now();
+    for (int i = 0; i < num; i++) {
+        D2_TRACE_ZONE("empty");
+    }
+    return (double) (Tracing::now() - start) / num;
+}
+
+// Mean wall time per frame of each thread in us
+double runFrames(const BenchParams & bench) {
+    static const char * names[] = {"viokf", "loop_detection", "solver"};
+    std::vector<std::thread> threads;
+    std::vector<double> times(bench.threads);
+    for (int k = 0; k < bench.threads; k++) {
+        threads.emplace_back([&, k] {
+            D2_TRACE_THREAD(names[k % 3]);
+            TicToc tic;
+            for (int i = 0; i < bench.frames; i++) {
+                D2_TRACE_ZONE("frame");
+                D2_TRACE_COUNTER("queue", i % 5);
+                {
+                    D2_TRACE_ZONE("input");
+                    work(bench.work_us / 2);
+                }
+                {
+                    D2_TRACE_ZONE("solve");
+                    work(bench.work_us / 2);
+                }
+                D2_TRACE_VALUE("solve_time", bench.work_us / 2000);
+            }
+            times[k] = tic.toc() * 1000 / bench.frames;
+        });
+    }
+    double sum = 0;
+    for (int k = 0; k < bench.threads; k++) {
+        threads[k].join();
+        sum += times[k];
+    }
+    return sum / bench.threads;
+}
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    BenchOptions options;
+    options.add("threads", bench.threads, "traced threads")
+        .add("frames", bench.frames, "frames per thread")
+        .add("work_us", bench.work_us, "computation per frame")
+        .add("output", bench.output, "Chrome trace JSON of the enabled run");
+    options.parse(argc, argv);
+    printf("[TracingBench] %d threads %d frames of %.0fus\n", bench.threads, bench.frames, bench.work_us);
+    double disabled_zone = emptyZoneCost(10000000);
+    double disabled_frame = runFrames(bench);
+    Tracing::TracingConfig config;
+    config.enable = true;
+    config.summary_interval = 0;
+    config.output = bench.output;
+    Tracing::init(config);
+    double enabled_zone = emptyZoneCost(1000000);
+    double enabled_frame = runFrames(bench);
+    Tracing::shutdown();
+    printf("[TracingBench] empty zone: disabled %.1fns enabled %.1fns\n", disabled_zone, enabled_zone);
+    printf("[TracingBench] frame: disabled %.1fus enabled %.1fus overhead %.2f%%\n", disabled_frame, enabled_frame,
+        (enabled_frame - disabled_frame) * 100 / disabled_frame);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "../src/estimator/triangulation.hpp"
+#include <d2common/utils.hpp>
+#include <d2common/bench_options.hpp>
+#include <random>
+
+// Microbenchmark of the landmark triangulation of D2LandmarkManager::initialLandmarks on a synthetic
+// quad camera sliding window. "before" composes frame pose * extrinsic per observation and calls the
+// dynamic size triangulatePoint3DPts landmark by landmark, as the serial implementation did;
+// "after" uses CameraPoseCache and the parallel fixed size triangulateBatch.
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+struct BenchParams {
+    int frames = 10;
+    int cameras = 4;
+    int landmarks = 2000;
+    int track = 5;
+    double noise_px = 0.5;
+    double outlier_ratio = 0;
+    bool ransac = false;
+    int repeat = 20;
+    double focal_length = 300;
+};
+
+struct Observation {
+    int frame;
+    int camera;
+    Vector3d bearing;
+};
+
+int main(int argc, char ** argv) {
+    BenchParams bench;
+    D2Common::BenchOptions options;
+    options.add("frames", bench.frames, "frames in the window")
+        .add("cameras", bench.cameras, "cameras per drone")
+        .add("landmarks", bench.landmarks, "landmarks to triangulate")
+        .add("track", bench.track, "frames observing each landmark")
+        .add("noise_px", bench.noise_px, "pixel noise of the observations")
+        .add("outlier_ratio", bench.outlier_ratio, "fraction of outlier observations")
+        .add("ransac", bench.ransac, "triangulate with RANSAC")
+        .add("repeat", bench.repeat, "runs averaged");
+    options.parse(argc, argv);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::normal_distribution<double> normal(0.0, bench.noise_px / bench.focal_length);
+
+    //Frames move forward, cameras look around the body like the quad fisheye setup
+    std::vector<Swarm::Pose> frame_poses, extrinsics;
+    for (int i = 0; i < bench.frames; i ++) {
+        frame_poses.emplace_back(Vector3d(0.1 * i, 0.02 * i, 0), Quaterniond(AngleAxisd(0.01 * i, Vector3d::UnitZ())));
+    }
+    for (int c = 0; c < bench.cameras; c ++) {
+        Quaterniond q = Quaterniond(AngleAxisd(2 * M_PI * c / bench.cameras, Vector3d::UnitZ())) *
+            Quaterniond(AngleAxisd(-M_PI / 2, Vector3d::UnitY())) * Quaterniond(AngleAxisd(M_PI / 2, Vector3d::UnitZ()));
+        extrinsics.emplace_back(Vector3d(0.05 * cos(2 * M_PI * c / bench.cameras), 0.05 * sin(2 * M_PI * c / bench.cameras), 0), q);
+    }
+    std::vector<Vector3d> points;
+    std::vector<std::vector<Observation>> tracks;
+    int outliers = 0;
+    while (points.size() < bench.landmarks) {
+        Vector3d dir(uniform(rng), uniform(rng), 0.3 * uniform(rng));
+        Vector3d point = dir.normalized() * (3 + 7 * (uniform(rng) + 1) / 2);
+        int camera = -1;
+        double best = 0.3;
+        for (int c = 0; c < bench.cameras; c ++) {
+            double cos_angle = (frame_poses[0] * extrinsics[c]).att().toRotationMatrix().col(2).dot(point.normalized());
+            if (cos_angle > best) {
+                best = cos_angle;
+                camera = c;
+            }
+        }
+        if (camera < 0) {
+            continue;
+        }
+        std::vector<Observation> track;
+        int start = rng() % std::max(1, bench.frames - bench.track + 1);
+        for (int i = start; i < std::min(bench.frames, start + bench.track); i ++) {
+            Vector3d bearing = ((frame_poses[i] * extrinsics[camera]).inverse() * point).normalized();
+            if (track.size() > 0 && (uniform(rng) + 1) / 2 < bench.outlier_ratio) {
+                bearing = (bearing + Vector3d(uniform(rng), uniform(rng), uniform(rng)) * 0.2).normalized();
+                outliers ++;
+            } else {
+                bearing = (bearing + Vector3d(normal(rng), normal(rng), normal(rng))).normalized();
+            }
+            track.push_back({i, camera, bearing});
+        }
+        points.emplace_back(point);
+        tracks.emplace_back(track);
+    }
+
+    TriangulationConfig config;
+    config.min_baseline = 0.05;
+    config.max_err = 0.1;
+    config.ransac = bench.ransac;
+    config.ransac_threshold = 10.0 / bench.focal_length;
+
+    std::vector<Vector3d> result_before(points.size()), result_after(points.size());
+    std::vector<bool> succ_before(points.size()), succ_after(points.size());
+    TicToc tic_before;
+    for (int k = 0; k < bench.repeat; k ++) {
+        for (int j = 0; j < tracks.size(); j ++) {
+            std::vector<Swarm::Pose> poses;
+            std::vector<Vector3d> bearings;
+            Vector3d _min = (frame_poses[tracks[j][0].frame] * extrinsics[tracks[j][0].camera]).pos();
+            Vector3d _max = _min;
+            for (auto & obs : tracks[j]) {
+                poses.push_back(frame_poses[obs.frame] * extrinsics[obs.camera]);
+                bearings.push_back(obs.bearing);
+                _min = _min.cwiseMin((frame_poses[obs.frame] * extrinsics[obs.camera]).pos());
+                _max = _max.cwiseMax((frame_poses[obs.frame] * extrinsics[obs.camera]).pos());
+            }
+            succ_before[j] = false;
+            if ((_max - _min).norm() > config.min_baseline) {
+                double err = triangulatePoint3DPts(poses, bearings, result_before[j]);
+                succ_before[j] = err < config.max_err;
+            }
+        }
+    }
+    double time_before = tic_before.toc() / bench.repeat;
+
+    TicToc tic_after;
+    for (int k = 0; k < bench.repeat; k ++) {
+        CameraPoseCache cache;
+        std::vector<TriangulationTask> tasks(tracks.size());
+        for (int j = 0; j < tracks.size(); j ++) {
+            auto & task = tasks[j];
+            task.landmark_id = j;
+            for (auto & obs : tracks[j]) {
+                int index = cache.find(obs.frame, obs.camera);
+                if (index < 0) {
+                    index = cache.add(obs.frame, obs.camera, frame_poses[obs.frame] * extrinsics[obs.camera]);
+                }
+                task.pose_indices.emplace_back(index);
+                task.bearings.emplace_back(obs.bearing);
+            }
+        }
+        triangulateBatch(cache, tasks, config);
+        for (int j = 0; j < tasks.size(); j ++) {
+            result_after[j] = tasks[j].position;
+            succ_after[j] = tasks[j].triangulated;
+        }
+    }
+    double time_after = tic_after.toc() / bench.repeat;
+
+    int num_before = 0, num_after = 0;
+    double err_before = 0, err_after = 0;
+    for (int j = 0; j < points.size(); j ++) {
+        if (succ_before[j]) {
+            num_before ++;
+            err_before += (result_before[j] - points[j]).norm();
+        }
+        if (succ_after[j]) {
+            num_after ++;
+            err_after += (result_after[j] - points[j]).norm();
+        }
+    }
+    printf("[TriangulationBench] %ld landmarks %d outlier observations, %d frames %d cameras\n", points.size(), outliers,
+        bench.frames, bench.cameras);
+    printf("[TriangulationBench] before: %.2fms %.1f landmarks/ms triangulated %d mean error %.3fm\n", time_before,
+        points.size() / time_before, num_before, err_before / std::max(num_before, 1));
+    printf("[TriangulationBench] after:  %.2fms %.1f landmarks/ms triangulated %d mean error %.3fm ransac %d\n", time_after,
+        points.size() / time_after, num_after, err_after / std::max(num_after, 1), bench.ransac);
+    return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <d2frontend/CNN/onnx_generic.h>
 #include <d2common/utils.hpp>
+#include <mutex>
 
 using D2Common::Utility::TicToc;
 
@@ -54,6 +55,7 @@ protected:
     std::vector<Ort::Value> inputs;
     bool combined = false;
     Ort::MemoryInfo memory_info;
+    std::mutex infer_mutex;
     void setInputs(Ort::MemoryInfo & memory_info, int width, int height) {
         inputs.clear();
         const std::array<int,3> dims = {3, height, width};                         
@@ -111,6 +113,8 @@ public:
         } 
     }
 
+    // Thread-safe: the session buffers are shared, so concurrent stereo pairs are serialized here
+    // and the returned disparity is a copy.
     cv::Mat inference(const cv::Mat & input_left, const cv::Mat & input_right) {
         cv::Mat _input_left, _input_right;
         if (input_left.channels() != 3) {
@@ -127,13 +131,14 @@ public:
         cv::Mat input_half_left, input_half_right;
         cv::resize(_input_left, input_half_left, cv::Size(width/2, height/2));
         cv::resize(_input_right, input_half_right, cv::Size(width/2, height/2));
+        const std::lock_guard<std::mutex> lock(infer_mutex);
         hwc_to_chw(_input_left, input_l);
         hwc_to_chw(_input_right, input_r);
         hwc_to_chw(input_half_left, input_l_half);
         hwc_to_chw(input_half_right, input_r_half);
         doInference();
         cv::Mat res(height, width, CV_32F, results_);
-        return res;
+        return res.clone();
     }
 };
 }
@@ -0,0 +1,103 @@
+#include "depth_fusion.hpp"
+
+namespace D2QuadCamDepthEst {
+DepthFusion::DepthFusion(const DepthFusionConfig & _config, cv::Vec3d _intrinsics, const Swarm::Pose & _extrinsic,
+        double _min_z, double _max_z):
+    config(_config), intrinsics(_intrinsics), extrinsic(_extrinsic), min_z(_min_z), max_z(_max_z) {
+}
+
+double DepthFusion::predict(const Swarm::Pose & pose_body_cur) {
+    if (!initialized) {
+        return 1.0;
+    }
+    Swarm::Pose prev_to_cur = (pose_body_cur * extrinsic).inverse() * (pose_body * extrinsic);
+    Matrix3f R = prev_to_cur.R().cast<float>();
+    Vector3f t = prev_to_cur.pos().cast<float>();
+    float f = intrinsics[0], cx = intrinsics[1], cy = intrinsics[2];
+    warp_buf.create(fused.size(), CV_32FC3);
+    warp_buf.setTo(cv::Scalar(0, 0, 0));
+    warp_weight_buf.create(fused.size(), CV_8U);
+    warp_weight_buf.setTo(0);
+    int warped_num = 0;
+    for (int v = 0; v < fused.rows; v++) {
+        for (int u = 0; u < fused.cols; u++) {
+            const cv::Vec3f & pt = fused.at<cv::Vec3f>(v, u);
+            if (!isValid(pt)) {
+                continue;
+            }
+            Vector3f pt_cur = R * Vector3f(pt[0], pt[1], pt[2]) + t;
+            if (pt_cur.z() <= min_z || pt_cur.z() >= max_z) {
+                continue;
+            }
+            int u_cur = std::round(f * pt_cur.x() / pt_cur.z() + cx);
+            int v_cur = std::round(f * pt_cur.y() / pt_cur.z() + cy);
+            if (u_cur < 0 || u_cur >= fused.cols || v_cur < 0 || v_cur >= fused.rows) {
+                continue;
+            }
+            // Z-buffer: the nearest surface wins.
+            auto & target = warp_buf.at<cv::Vec3f>(v_cur, u_cur);
+            if (target[2] == 0) {
+                warped_num++;
+            } else if (target[2] < pt_cur.z()) {
+                continue;
+            }
+            target = cv::Vec3f(pt_cur.x(), pt_cur.y(), pt_cur.z());
+            warp_weight_buf.at<uint8_t>(v_cur, u_cur) = weight.at<uint8_t>(v, u);
+        }
+    }
+    double hole_ratio = valid_num > 0 ? 1.0 - (double) warped_num / valid_num : 1.0;
+    std::swap(fused, warp_buf);
+    std::swap(weight, warp_weight_buf);
+    valid_num = warped_num;
+    pose_body = pose_body_cur;
+    return hole_ratio;
+}
+
+void DepthFusion::update(const cv::Mat & pts3d, const Swarm::Pose & pose_body_cur) {
+    if (!initialized || fused.size() != pts3d.size()) {
+        fused = pts3d.clone();
+        weight = cv::Mat::zeros(pts3d.size(), CV_8U);
+        valid_num = 0;
+        for (int v = 0; v < fused.rows; v++) {
+            for (int u = 0; u < fused.cols; u++) {
+                if (isValid(fused.at<cv::Vec3f>(v, u))) {
+                    weight.at<uint8_t>(v, u) = 1;
+                    valid_num++;
+                }
+            }
+        }
+        pose_body = pose_body_cur;
+        initialized = true;
+        return;
+    }
+    valid_num = 0;
+    for (int v = 0; v < fused.rows; v++) {
+        for (int u = 0; u < fused.cols; u++) {
+            const cv::Vec3f & meas = pts3d.at<cv::Vec3f>(v, u);
+            cv::Vec3f & pred = fused.at<cv::Vec3f>(v, u);
+            uint8_t & w = weight.at<uint8_t>(v, u);
+            bool pred_valid = w > 0 && isValid(pred);
+            if (isValid(meas)) {
+                if (pred_valid && fabs(meas[2] - pred[2]) < config.max_rel_diff * meas[2]) {
+                    pred = (pred * w + meas) / (w + 1.0f);
+                    w = std::min<int>(w + 1, config.max_weight);
+                } else {
+                    pred = meas;
+                    w = 1;
+                }
+            } else if (pred_valid) {
+                // No measurement, e.g. occluded in the right image: keep the prediction for a few frames.
+                w--;
+            } else {
+                w = 0;
+            }
+            if (w == 0) {
+                pred = cv::Vec3f(0, 0, 0);
+            } else {
+                valid_num++;
+            }
+        }
+    }
+    pose_body = pose_body_cur;
+}
+}
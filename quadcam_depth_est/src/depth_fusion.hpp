@@ -0,0 +1,47 @@
+#pragma once
+#include <swarm_msgs/Pose.h>
+#include <opencv2/core.hpp>
+#include <d2common/d2basetypes.h>
+
+namespace D2QuadCamDepthEst {
+struct DepthFusionConfig {
+    bool enable = false;
+    int full_pairs_per_frame = 1; // Stereo pairs with full disparity estimation per frame, rotating over the pairs
+    double max_hole_ratio = 0.2; // Warp error: fraction of the fused depth lost by the warp. Above it the pair is estimated
+    double max_rel_diff = 0.1; // Relative depth difference to fuse a measurement into the prediction
+    int max_weight = 5; // Frames a measurement counts for. A prediction without measurement decays one per frame
+    double odom_tolerance = 0.02; // Max time difference (s) between image and odometry
+};
+
+// Temporal fusion of the depth of one virtual stereo pair.
+// The fused points (in the rectified left camera frame, same layout as estimatePointsViaRaw)
+// are warped into the current view with the VIO pose, so the disparity does not need to be
+// estimated every frame. A new measurement is averaged into the prediction where they agree.
+class DepthFusion {
+    DepthFusionConfig config;
+    cv::Vec3d intrinsics; // f, cx, cy
+    Swarm::Pose extrinsic; // Camera pose in the body frame
+    double min_z, max_z;
+    cv::Mat fused, weight; // CV_32FC3, CV_8U
+    cv::Mat warp_buf, warp_weight_buf;
+    Swarm::Pose pose_body; // Body pose of fused
+    int valid_num = 0;
+    bool initialized = false;
+    bool isValid(const cv::Vec3f & pt) const {
+        return pt[2] > min_z && pt[2] < max_z;
+    }
+public:
+    DepthFusion(const DepthFusionConfig & _config, cv::Vec3d _intrinsics, const Swarm::Pose & _extrinsic,
+        double _min_z, double _max_z);
+    bool isInitialized() const {
+        return initialized;
+    }
+    // Warp the fused depth to the view at pose_body_cur. Returns the fraction of the fused points lost.
+    double predict(const Swarm::Pose & pose_body_cur);
+    // Fuse a measurement (CV_32FC3 from estimatePointsViaRaw) taken at pose_body_cur, after predict.
+    void update(const cv::Mat & pts3d, const Swarm::Pose & pose_body_cur);
+    const cv::Mat & points() const {
+        return fused;
+    }
+};
+}
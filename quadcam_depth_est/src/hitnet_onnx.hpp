@@ -1,6 +1,7 @@
 #pragma once
 #include <d2frontend/CNN/onnx_generic.h>
 #include <d2common/utils.hpp>
+#include <mutex>
 
 using D2Common::Utility::TicToc;
 
@@ -11,6 +12,7 @@ protected:
     std::array<int64_t, 4> output_shape_;
     std::array<int64_t, 4> input_shape_;
     cv::Mat input_image_mat;
+    std::mutex infer_mutex;
 public:
     HitnetONNX(std::string engine_path, int _width, int _height, bool use_tensorrt = true, bool use_fp16 = true, bool use_int8 = false): 
             ONNXInferenceGeneric(engine_path, "input", "reference_output_disparity", _width, _height, use_tensorrt, use_fp16, use_int8),
@@ -33,6 +35,8 @@ public:
         session_->Run(Ort::RunOptions{nullptr}, input_names, &input_tensor_, 1, output_names, &output_tensor_, 1);
     }
 
+    // Thread-safe: the session buffers are shared, so concurrent stereo pairs are serialized here
+    // and the returned disparity is a copy.
     cv::Mat inference(const cv::Mat & input_left, const cv::Mat & input_right) {
         TicToc tic;
         cv::Mat _input_left, _input_right;
@@ -49,10 +53,11 @@ public:
         } 
         cv::Mat input;
         cv::vconcat(_input_left, _input_right, input);
+        const std::lock_guard<std::mutex> lock(infer_mutex);
         input.convertTo(input_image_mat, CV_32F, 1.0/255.0);
         doInference();
         // printf("HitnetONNX::inference() took %f ms\n", tic.toc());
-        return cv::Mat(height, width, CV_32F, results_);
+        return cv::Mat(height, width, CV_32F, results_).clone();
     }
 };
 }
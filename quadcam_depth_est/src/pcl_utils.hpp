@@ -2,88 +2,172 @@
 #include <sensor_msgs/PointCloud.h>
 #include <pcl_ros/point_cloud.h>
 #include <opencv2/opencv.hpp>
+#include <unordered_map>
 
 namespace D2QuadCamDepthEst {
 typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 typedef pcl::PointCloud<pcl::PointXYZRGB> PointCloudRGB;
 
 
-inline void addtoPCL(PointCloud & pcl, Vector3f point) {
-    pcl::PointXYZ p(point(0), point(1), point(2));
-    pcl.points.push_back(p);
+inline void setPCLPoint(pcl::PointXYZ & p, Vector3f point) {
+    p.x = point(0);
+    p.y = point(1);
+    p.z = point(2);
 }
 
-inline void addtoPCL(PointCloudRGB & pcl, Vector3f point) {
-    pcl::PointXYZRGB p;
+inline void setPCLPoint(pcl::PointXYZRGB & p, Vector3f point) {
+    p = pcl::PointXYZRGB();
     p.x = point(0);
     p.y = point(1);
     p.z = point(2);
-    pcl.points.push_back(p);
 }
 
-inline void addtoPCL(PointCloud & pcl, Vector3f point, cv::Vec3b color) {
-    pcl::PointXYZ p(point(0), point(1), point(2));
-    pcl.points.push_back(p);
+inline void setPCLPoint(pcl::PointXYZ & p, Vector3f point, cv::Vec3b color) {
+    setPCLPoint(p, point);
 }
 
-inline void addtoPCL(PointCloudRGB & pcl, Vector3f point, cv::Vec3b color) {
-    pcl::PointXYZRGB p;
-    p.x = point(0);
-    p.y = point(1);
-    p.z = point(2);
-    p.r = color[2], 255;
-    p.g = color[1], 255;
-    p.b = color[0], 255;
-    pcl.points.push_back(p);
+inline void setPCLPoint(pcl::PointXYZRGB & p, Vector3f point, cv::Vec3b color) {
+    setPCLPoint(p, point);
+    p.r = color[2];
+    p.g = color[1];
+    p.b = color[0];
 }
 
-inline void addtoPCL(PointCloudRGB &pcl, Vector3f point, uchar grayscale) {
-    pcl::PointXYZRGB p;
-    p.x = point(0);
-    p.y = point(1);
-    p.z = point(2);
+inline void setPCLPoint(pcl::PointXYZ & p, Vector3f point, uchar grayscale) {
+    setPCLPoint(p, point);
+}
+
+inline void setPCLPoint(pcl::PointXYZRGB & p, Vector3f point, uchar grayscale) {
+    setPCLPoint(p, point);
     p.r = grayscale;
     p.g = grayscale;
     p.b = grayscale;
-    pcl.points.push_back(p);
 }
 
+// Voxel hash to downsample the points while they are written, without an intermediate full resolution cloud.
+// Each voxel keeps one point: the centroid of the points fallen into it.
+class VoxelHash {
+    float inv_leaf = 0;
+    std::unordered_map<int64_t, std::pair<int, int>> voxels; // voxel key -> (index of its point, point count)
+    int64_t key(const Vector3f & p) const {
+        // 21 bits per axis
+        int64_t x = (int64_t) std::floor(p.x()*inv_leaf) & 0x1FFFFF;
+        int64_t y = (int64_t) std::floor(p.y()*inv_leaf) & 0x1FFFFF;
+        int64_t z = (int64_t) std::floor(p.z()*inv_leaf) & 0x1FFFFF;
+        return (x << 42) | (y << 21) | z;
+    }
+public:
+    VoxelHash() {}
+    VoxelHash(float leaf_size): inv_leaf(leaf_size > 0 ? 1.0f/leaf_size : 0) {}
+    bool enabled() const {
+        return inv_leaf > 0;
+    }
+    // Keeps the buckets, so the hash is reused across frames without reallocation.
+    void clear() {
+        voxels.clear();
+    }
+    // Index of the point of the voxel containing p and the number of points in it including p.
+    // A new voxel takes new_index.
+    std::pair<int, int> insert(const Vector3f & p, int new_index) {
+        auto & voxel = voxels.emplace(key(p), std::make_pair(new_index, 0)).first->second;
+        voxel.second++;
+        return voxel;
+    }
+};
+
+// Upper bound of the points written by writePointsToPCL for an image of this size.
+inline int maxPointsNum(cv::Size size, int step) {
+    return ((size.height + step - 1) / step) * ((size.width + step - 1) / step);
+}
+
+// Write the valid points into out (at least maxPointsNum(pts3d.size(), step) entries) and return the count.
+// Writing into a preallocated slice lets several stereo pairs fill one cloud concurrently.
+// With a voxel hash only one point per voxel is written.
 template<typename PointType>
-void addPointsToPCL(const cv::Mat & pts3d, const cv::Mat & color, Swarm::Pose pose, 
-        pcl::PointCloud<PointType> & pcl, int step, double min_z, double max_z) {
+int writePointsToPCL(const cv::Mat & pts3d, const cv::Mat & color, Swarm::Pose pose,
+        PointType * out, int step, double min_z, double max_z, VoxelHash * voxel = nullptr) {
     bool rgb_color = color.channels() == 3;
     Matrix3f R = pose.R().template cast<float>();
     Vector3f t = pose.pos().template cast<float>();
+    int count = 0;
     for(int v = 0; v < pts3d.rows; v += step) {
         for(int u = 0; u < pts3d.cols; u += step) {
             cv::Vec3f vec = pts3d.at<cv::Vec3f>(v, u);
             Vector3f pts_i(vec[0], vec[1], vec[2]);
             if (pts_i.z() < max_z && pts_i.z() > min_z) {
                 Vector3f w_pts_i = R * pts_i + t;
-                // Vector3d w_pts_i = pts_i;
+                if (voxel != nullptr) {
+                    auto ret = voxel->insert(w_pts_i, count);
+                    if (ret.first != count) {
+                        // Running mean of the voxel, the color of the first point is kept.
+                        PointType & p = out[ret.first];
+                        float w = 1.0f/ret.second;
+                        p.x += (w_pts_i.x() - p.x)*w;
+                        p.y += (w_pts_i.y() - p.y)*w;
+                        p.z += (w_pts_i.z() - p.z)*w;
+                        continue;
+                    }
+                }
+                PointType & p = out[count++];
                 if (color.empty()) {
-                    addtoPCL(pcl, w_pts_i);
-                } else {
-                    int32_t rgb_packed;
-                    if(rgb_color) {
-                        if (color.type() == CV_8UC3) {
-                            const cv::Vec3b& bgr = color.at<cv::Vec3b>(v, u);
-                            addtoPCL(pcl, w_pts_i, bgr);
-                        } else if(color.type() == CV_32FC3) {
-                            const cv::Vec3f& bgr = color.at<cv::Vec3f>(v, u);
-                            cv::Vec3b bgr_8u;
-                            bgr_8u[0] = std::min((int)bgr[0], 255);
-                            bgr_8u[1] = std::min((int)bgr[1], 255);
-                            bgr_8u[2] = std::min((int)bgr[2], 255);
-                            addtoPCL(pcl, w_pts_i, bgr);
-                        }
+                    setPCLPoint(p, w_pts_i);
+                } else if(rgb_color) {
+                    if (color.type() == CV_8UC3) {
+                        const cv::Vec3b& bgr = color.at<cv::Vec3b>(v, u);
+                        setPCLPoint(p, w_pts_i, bgr);
                     } else {
-                        const uchar& bgr = color.at<uchar>(v, u);
-                        addtoPCL(pcl, w_pts_i, bgr);
+                        const cv::Vec3f& bgr = color.at<cv::Vec3f>(v, u);
+                        cv::Vec3b bgr_8u;
+                        bgr_8u[0] = std::min((int)bgr[0], 255);
+                        bgr_8u[1] = std::min((int)bgr[1], 255);
+                        bgr_8u[2] = std::min((int)bgr[2], 255);
+                        setPCLPoint(p, w_pts_i, bgr_8u);
                     }
+                } else {
+                    const uchar& gray = color.at<uchar>(v, u);
+                    setPCLPoint(p, w_pts_i, gray);
                 }
             }
         }
     }
+    return count;
+}
+
+// Uniformly decimate the cloud to at most max_points (<= 0 for unlimited).
+// The cloud is usually voxelized already, so a uniform stride keeps its spatial coverage.
+template<typename PointType>
+void limitPCLSize(pcl::PointCloud<PointType> & pcl, int max_points) {
+    int size = pcl.points.size();
+    if (max_points <= 0 || size <= max_points) {
+        return;
+    }
+    for (int i = 0; i < max_points; i++) {
+        pcl.points[i] = pcl.points[(int64_t) i*size/max_points];
+    }
+    pcl.points.resize(max_points);
+    pcl.width = max_points;
+    pcl.height = 1;
+}
+
+// Depth (z of the points) as a 32FC1 image, NaN outside (min_z, max_z), subsampled by step.
+inline cv::Mat depthImageFromPoints(const cv::Mat & pts3d, int step, double min_z, double max_z) {
+    cv::Mat depth;
+    cv::extractChannel(pts3d, depth, 2);
+    if (step > 1) {
+        cv::resize(depth, depth, cv::Size((depth.cols + step - 1)/step, (depth.rows + step - 1)/step), 0, 0, cv::INTER_NEAREST);
+    }
+    depth.setTo(std::numeric_limits<float>::quiet_NaN(), (depth <= min_z) | (depth >= max_z));
+    return depth;
+}
+
+template<typename PointType>
+void addPointsToPCL(const cv::Mat & pts3d, const cv::Mat & color, Swarm::Pose pose,
+        pcl::PointCloud<PointType> & pcl, int step, double min_z, double max_z) {
+    int offset = pcl.points.size();
+    pcl.points.resize(offset + maxPointsNum(pts3d.size(), step));
+    int count = writePointsToPCL(pts3d, color, pose, pcl.points.data() + offset, step, min_z, max_z);
+    pcl.points.resize(offset + count);
+    pcl.width = pcl.points.size();
+    pcl.height = 1;
+}
 }
-}
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <numeric>
 
 
 namespace D2FrontEnd {
@@ -29,8 +31,33 @@ QuadCamDepthEst::QuadCamDepthEst(ros::NodeHandle & _nh): nh(_nh) {
     image_step = config["image_step"].as<int>();
     min_z = config["min_z"].as<double>();
     max_z = config["max_z"].as<double>();
+    if (config["enable_cuda"]) {
+        enable_cuda = config["enable_cuda"].as<bool>();
+    }
+    if (config["voxel_size"]) {
+        voxel_size = config["voxel_size"].as<double>();
+    }
+    if (config["max_points"]) {
+        max_points = config["max_points"].as<int>();
+    }
+    if (config["publish_depth_image"]) {
+        publish_depth_image = config["publish_depth_image"].as<bool>();
+    }
     loadCNN(config);
+    loadSGBMConfig(config);
+    loadDepthFusionConfig(config);
     loadCameraConfig(config, configPath);
+    voxel_hashes = std::vector<VoxelHash>(virtual_stereos.size(), VoxelHash(voxel_size));
+    merge_voxel_hash = VoxelHash(voxel_size);
+    fusion_scheduled.resize(virtual_stereos.size(), 1);
+    fusion_estimated.resize(virtual_stereos.size(), 0);
+    for (auto stereo : virtual_stereos) {
+        depth_fusions.emplace_back(fusion_config, stereo->rectifiedIntrinsics(), stereo->extrinsic, min_z, max_z);
+    }
+    if (publish_depth_image) {
+        initDepthImagePublishers();
+    }
+    printf("[QuadCamDepthEst] voxel_size %.3f max_points %d publish_depth_image %d\n", voxel_size, max_points, publish_depth_image);
     std::string format = "compressed"; //TODO: make it configurable
     image_transport::TransportHints hints(format, ros::TransportHints().tcpNoDelay(true));
     it_ = new image_transport::ImageTransport(nh);
@@ -79,39 +106,271 @@ void QuadCamDepthEst::loadCNN(YAML::Node & config) {
     }
 }
 
-void QuadCamDepthEst::stereoImagesCallback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right) {
-     if (image_count % image_step != 0) {
-        image_count++;
+template<typename PointType>
+double QuadCamDepthEst::generatePointCloud(const std::vector<cv::Mat> & imgs_input, const std::vector<cv::Mat> & imgs_color,
+        pcl::PointCloud<PointType> & cloud) {
+    int num = virtual_stereos.size();
+    std::vector<int> offsets(num + 1, 0), counts(num, 0);
+    std::vector<double> pcl_times(num, 0.0);
+    for (int i = 0; i < num; i++) {
+        offsets[i + 1] = offsets[i] + maxPointsNum(virtual_stereos[i]->rectifiedSize(), pixel_step);
+    }
+    cloud.points.resize(offsets[num]);
+    // Each pair writes its own slice of the cloud. CNN inference is serialized inside the network,
+    // so it overlaps with the rectification and projection of the other pairs.
+    // imshow is not thread-safe, so the pairs run serially when show is on.
+#pragma omp parallel for num_threads(num) if(!show)
+    for (int i = 0; i < num; i++) {
+        auto stereo = virtual_stereos[i];
+        auto ret = estimatePoints(i, imgs_input, imgs_color);
+        TicToc t_pcl;
+        VoxelHash * voxel = nullptr;
+        if (voxel_hashes[i].enabled()) {
+            voxel = &voxel_hashes[i];
+            voxel->clear();
+        }
+        counts[i] = writePointsToPCL(ret.first, ret.second, stereo->extrinsic, cloud.points.data() + offsets[i], 
+            pixel_step, min_z, max_z, voxel);
+        pcl_times[i] = t_pcl.toc();
+    }
+    // Compact the slices. The slices are voxelized already, so between pairs the first point of a voxel is kept.
+    TicToc t_merge;
+    int size = 0;
+    double pcl_time = 0;
+    merge_voxel_hash.clear();
+    for (int i = 0; i < num; i++) {
+        for (int j = offsets[i]; j < offsets[i] + counts[i]; j++) {
+            if (merge_voxel_hash.enabled() && 
+                    merge_voxel_hash.insert(cloud.points[j].getVector3fMap(), size).first != size) {
+                continue;
+            }
+            cloud.points[size++] = cloud.points[j];
+        }
+        pcl_time += pcl_times[i];
+    }
+    cloud.points.resize(size);
+    cloud.width = size;
+    cloud.height = 1;
+    limitPCLSize(cloud, max_points);
+    return pcl_time + t_merge.toc();
+}
+
+void QuadCamDepthEst::loadSGBMConfig(YAML::Node & config) {
+    stereo_config.use_cnn = enable_cnn;
+    if (!config["sgbm"]) {
         return;
     }
-    TicToc t;
-    cv_bridge::CvImagePtr cv_ptr_l = cv_bridge::toCvCopy(left, sensor_msgs::image_encodings::MONO8);
-    cv_bridge::CvImagePtr cv_ptr_r = cv_bridge::toCvCopy(right, sensor_msgs::image_encodings::MONO8);
-    if (enable_texture) {
-        pcl_conversions::toPCL(left->header.stamp, pcl_color->header.stamp);
+    auto node = config["sgbm"];
+    if (node["mode"]) {
+        int mode = sgbmModeFromString(node["mode"].as<std::string>());
+        if (mode < 0) {
+            printf("[QuadCamDepthEst] Unknown SGBM mode %s, use SGBM\n", node["mode"].as<std::string>().c_str());
+        } else {
+            stereo_config.mode = mode;
+        }
+    }
+    if (node["num_disparities"]) {
+        stereo_config.numDisparities = node["num_disparities"].as<int>();
+    }
+    if (node["block_size"]) {
+        stereo_config.blockSize = node["block_size"].as<int>();
+        stereo_config.P1 = 8*stereo_config.blockSize*stereo_config.blockSize;
+        stereo_config.P2 = 32*stereo_config.blockSize*stereo_config.blockSize;
+    }
+    if (node["downscale"]) {
+        stereo_config.downscale = node["downscale"].as<double>();
+    }
+    printf("[QuadCamDepthEst] SGBM mode %d num_disparities %d block_size %d downscale %.2f\n", stereo_config.mode,
+        stereo_config.numDisparities, stereo_config.blockSize, stereo_config.downscale);
+}
+
+void QuadCamDepthEst::initDepthImagePublishers() {
+    for (int i = 0; i < virtual_stereos.size(); i++) {
+        auto stereo = virtual_stereos[i];
+        char topic[64];
+        sprintf(topic, "/depth_estimation/camera_%d", i);
+        pub_depth_images.emplace_back(nh.advertise<sensor_msgs::Image>(std::string(topic) + "/depth", 1));
+        pub_camera_infos.emplace_back(nh.advertise<sensor_msgs::CameraInfo>(std::string(topic) + "/camera_info", 1));
+        // Pose of the depth camera in the imu frame, latched as it is constant.
+        pub_depth_extrinsics.emplace_back(nh.advertise<geometry_msgs::PoseStamped>(std::string(topic) + "/extrinsic", 1, true));
+        geometry_msgs::PoseStamped extrinsic;
+        extrinsic.header.frame_id = "imu";
+        extrinsic.pose = stereo->extrinsic.toROS();
+        pub_depth_extrinsics.back().publish(extrinsic);
+        // The depth image is subsampled by pixel_step.
+        auto intrinsics = stereo->rectifiedIntrinsics() / pixel_step;
+        sensor_msgs::CameraInfo info;
+        info.distortion_model = "plumb_bob";
+        info.D = {0, 0, 0, 0, 0};
+        info.K = {intrinsics[0], 0, intrinsics[1], 0, intrinsics[0], intrinsics[2], 0, 0, 1};
+        info.R = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+        info.P = {intrinsics[0], 0, intrinsics[1], 0, 0, intrinsics[0], intrinsics[2], 0, 0, 0, 1, 0};
+        camera_infos.emplace_back(info);
+    }
+}
+
+double QuadCamDepthEst::publishDepthImages(const ros::Time & stamp, const std::vector<cv::Mat> & imgs_input) {
+    int num = virtual_stereos.size();
+    std::vector<cv::Mat> depths(num);
+    std::vector<double> depth_times(num, 0.0);
+#pragma omp parallel for num_threads(num) if(!show)
+    for (int i = 0; i < num; i++) {
+        auto ret = estimatePoints(i, imgs_input, std::vector<cv::Mat>());
+        TicToc t_depth;
+        depths[i] = depthImageFromPoints(ret.first, pixel_step, min_z, max_z);
+        depth_times[i] = t_depth.toc();
+    }
+    double depth_time = 0;
+    for (int i = 0; i < num; i++) {
+        char frame_id[64];
+        sprintf(frame_id, "quadcam_depth_%d", i);
+        std_msgs::Header header;
+        header.stamp = stamp;
+        header.frame_id = frame_id;
+        pub_depth_images[i].publish(cv_bridge::CvImage(header, sensor_msgs::image_encodings::TYPE_32FC1, depths[i]).toImageMsg());
+        auto & info = camera_infos[i];
+        info.header = header;
+        info.width = depths[i].cols;
+        info.height = depths[i].rows;
+        pub_camera_infos[i].publish(info);
+        depth_time += depth_times[i];
+    }
+    return depth_time;
+}
+
+double QuadCamDepthEst::processStereos(const ros::Time & stamp, const std::vector<cv::Mat> & imgs_input, 
+        const std::vector<cv::Mat> & imgs_color) {
+    double pcl_time = 0;
+    scheduleFusion(stamp);
+    if (publish_depth_image) {
+        pcl_time = publishDepthImages(stamp, imgs_input);
+    } else if (enable_texture) {
+        pcl_conversions::toPCL(stamp, pcl_color->header.stamp);
         pcl_color->header.frame_id = "imu";
-        pcl_color->points.clear();
+        pcl_time = generatePointCloud(imgs_input, imgs_color, *pcl_color);
+        pub_pcl.publish(*pcl_color);
     } else {
-        pcl_conversions::toPCL(left->header.stamp, pcl->header.stamp);
+        pcl_conversions::toPCL(stamp, pcl->header.stamp);
         pcl->header.frame_id = "imu";
-        pcl->points.clear();
-    }
-    std::pair<cv::Mat, cv::Mat> ret = virtual_stereos[0]->estimatePointsViaRaw(cv_ptr_l->image, cv_ptr_r->image, cv_ptr_l->image, show);
-    if (enable_texture) {
-        addPointsToPCL(ret.first, ret.second, virtual_stereos[0]->extrinsic, *pcl_color, pixel_step, min_z, max_z);
-    } else {
-        addPointsToPCL(ret.first, ret.second, virtual_stereos[0]->extrinsic, *pcl, pixel_step, min_z, max_z);
+        pcl_time = generatePointCloud(imgs_input, imgs_color, *pcl);
+        pub_pcl.publish(*pcl);
     }
     if (show) {
         cv::waitKey(1);
     }
-    if (enable_texture) {
-        pub_pcl.publish(*pcl_color);
-    } else {
-        pub_pcl.publish(*pcl);
+    return pcl_time;
+}
+
+void QuadCamDepthEst::loadDepthFusionConfig(YAML::Node & config) {
+    if (!config["depth_fusion"]) {
+        return;
+    }
+    auto node = config["depth_fusion"];
+    fusion_config.enable = node["enable"].as<bool>();
+    if (node["full_pairs_per_frame"]) {
+        fusion_config.full_pairs_per_frame = node["full_pairs_per_frame"].as<int>();
+    }
+    if (node["max_hole_ratio"]) {
+        fusion_config.max_hole_ratio = node["max_hole_ratio"].as<double>();
+    }
+    if (node["max_rel_diff"]) {
+        fusion_config.max_rel_diff = node["max_rel_diff"].as<double>();
+    }
+    if (node["max_weight"]) {
+        fusion_config.max_weight = node["max_weight"].as<int>();
     }
+    if (node["odom_tolerance"]) {
+        fusion_config.odom_tolerance = node["odom_tolerance"].as<double>();
+    }
+    std::string odometry_topic = "/d2vins/imu_propagation";
+    if (node["odometry_topic"]) {
+        odometry_topic = node["odometry_topic"].as<std::string>();
+    }
+    if (fusion_config.enable) {
+        odom_sub = nh.subscribe(odometry_topic, 1000, &QuadCamDepthEst::odometryCallback, this, ros::TransportHints().tcpNoDelay());
+        printf("[QuadCamDepthEst] Depth fusion enabled, odometry %s full pairs per frame %d max_hole_ratio %.2f\n",
+            odometry_topic.c_str(), fusion_config.full_pairs_per_frame, fusion_config.max_hole_ratio);
+    }
+}
+
+void QuadCamDepthEst::odometryCallback(const nav_msgs::Odometry & odom) {
+    const std::lock_guard<std::mutex> lock(odom_lock);
+    odom_buffer[odom.header.stamp.toSec()] = Swarm::Pose(odom.pose.pose);
+}
+
+bool QuadCamDepthEst::getOdometry(const ros::Time & stamp, Swarm::Pose & pose) {
+    const std::lock_guard<std::mutex> lock(odom_lock);
+    double t = stamp.toSec();
+    auto it = odom_buffer.lower_bound(t);
+    if (it == odom_buffer.end() || (it != odom_buffer.begin() && t - std::prev(it)->first < it->first - t)) {
+        if (it == odom_buffer.begin()) {
+            return false;
+        }
+        it--;
+    }
+    if (fabs(it->first - t) > fusion_config.odom_tolerance) {
+        return false;
+    }
+    pose = it->second;
+    // Images arrive in order, older odometry is not needed.
+    odom_buffer.erase(odom_buffer.begin(), odom_buffer.lower_bound(t - 1.0));
+    return true;
+}
+
+void QuadCamDepthEst::scheduleFusion(const ros::Time & stamp) {
+    if (!fusion_config.enable) {
+        return;
+    }
+    int num = virtual_stereos.size();
+    frame_has_pose = getOdometry(stamp, frame_pose);
+    for (int i = 0; i < num; i++) {
+        // Rotate the pairs with full estimation.
+        fusion_scheduled[i] = !frame_has_pose || (i - fusion_round % num + num) % num < fusion_config.full_pairs_per_frame;
+        fusion_estimated[i] = 0;
+    }
+    fusion_round += fusion_config.full_pairs_per_frame;
+}
+
+std::pair<cv::Mat, cv::Mat> QuadCamDepthEst::estimatePoints(int i, const std::vector<cv::Mat> & imgs_input, 
+        const std::vector<cv::Mat> & imgs_color) {
+    auto stereo = virtual_stereos[i];
+    const cv::Mat & left = imgs_input[stereo->cam_idx_a];
+    const cv::Mat & right = imgs_input[stereo->cam_idx_b];
+    cv::Mat color;
+    if (!imgs_color.empty()) {
+        color = imgs_color[stereo->cam_idx_a];
+    }
+    if (!fusion_config.enable || !frame_has_pose) {
+        return stereo->estimatePointsViaRaw(left, right, color, show);
+    }
+    // Warp the fused depth to this frame, estimate the disparity only if scheduled or the warp lost too much.
+    auto & fusion = depth_fusions[i];
+    double hole_ratio = fusion.predict(frame_pose);
+    if (fusion_scheduled[i] || hole_ratio > fusion_config.max_hole_ratio) {
+        auto ret = stereo->estimatePointsViaRaw(left, right, color, show);
+        fusion.update(ret.first, frame_pose);
+        fusion_estimated[i] = 1;
+        return std::make_pair(fusion.points(), ret.second);
+    }
+    TicToc tic;
+    stereo->timing = VirtualStereoTiming();
+    auto texture = stereo->rectifyTexture(left, color);
+    stereo->timing.rectify = tic.toc();
+    return std::make_pair(fusion.points(), texture);
+}
+
+void QuadCamDepthEst::stereoImagesCallback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right) {
+     if (image_count % image_step != 0) {
+        image_count++;
+        return;
+    }
+    TicToc t;
+    cv_bridge::CvImagePtr cv_ptr_l = cv_bridge::toCvCopy(left, sensor_msgs::image_encodings::MONO8);
+    cv_bridge::CvImagePtr cv_ptr_r = cv_bridge::toCvCopy(right, sensor_msgs::image_encodings::MONO8);
+    std::vector<cv::Mat> imgs{cv_ptr_l->image, cv_ptr_r->image};
+    double pcl_time = processStereos(left->header.stamp, imgs, imgs);
     image_count++;
-    printf("[QuadCamDepthEst] count %d process time %.1fms\n", image_count, t.toc());
+    printTiming(left->header.stamp, t.toc(), pcl_time);
 }
 
 void QuadCamDepthEst::imageCallback(const sensor_msgs::ImageConstPtr & left) {
@@ -133,39 +392,41 @@ void QuadCamDepthEst::imageCallback(const sensor_msgs::ImageConstPtr & left) {
             imgs_gray.emplace_back(img_gray);
         }
     }
-    if (enable_texture) {
-        pcl_conversions::toPCL(left->header.stamp, pcl_color->header.stamp);
-        pcl_color->header.frame_id = "imu";
-        pcl_color->points.clear();
-    } else {
-        pcl_conversions::toPCL(left->header.stamp, pcl->header.stamp);
-        pcl->header.frame_id = "imu";
-        pcl->points.clear();
+    // CNN with RGB input takes the color images directly; otherwise gray images with color texture.
+    const std::vector<cv::Mat> & imgs_input = cnn_rgb ? imgs : imgs_gray;
+    std::vector<cv::Mat> imgs_color;
+    if (!cnn_rgb) {
+        imgs_color = imgs;
     }
-    int size = 0;
-    for (auto stereo: virtual_stereos) {
-        std::pair<cv::Mat, cv::Mat> ret;
-        if (cnn_rgb) {
-            ret = stereo->estimatePointsViaRaw(imgs[stereo->cam_idx_a], imgs[stereo->cam_idx_b], cv::Mat(), show);
-        } else {
-            ret = stereo->estimatePointsViaRaw(imgs_gray[stereo->cam_idx_a], imgs_gray[stereo->cam_idx_b], imgs[stereo->cam_idx_a], show);
-        }
-        if (enable_texture) {
-            addPointsToPCL(ret.first, ret.second, stereo->extrinsic, *pcl_color, pixel_step, min_z, max_z);
-        } else {
-            addPointsToPCL(ret.first, ret.second, stereo->extrinsic, *pcl, pixel_step, min_z, max_z);
-        }
+    double pcl_time = processStereos(left->header.stamp, imgs_input, imgs_color);
+    image_count++;
+    printTiming(left->header.stamp, t.toc(), pcl_time);
+}
+
+void QuadCamDepthEst::printTiming(const ros::Time & stamp, double process_time, double pcl_time) {
+    // Throughput over a window of completed frames, so it includes the idle time between frames.
+    double throughput = 1000.0/process_time;
+    if (throughput_frames > 0) {
+        throughput = throughput_frames*1000.0/throughput_tic.toc();
     }
-    if (show) {
-        cv::waitKey(1);
+    if (throughput_frames == 0 || throughput_frames >= 100) {
+        throughput_tic.tic();
+        throughput_frames = 0;
     }
-    if (enable_texture) {
-        pub_pcl.publish(*pcl_color);
-    } else {
-        pub_pcl.publish(*pcl);
+    throughput_frames++;
+    double latency = (ros::Time::now() - stamp).toSec()*1000.0;
+    VirtualStereoTiming sum;
+    for (auto stereo: virtual_stereos) {
+        sum.rectify += stereo->timing.rectify;
+        sum.disparity += stereo->timing.disparity;
+        sum.reproject += stereo->timing.reproject;
+    }
+    printf("[QuadCamDepthEst] count %d latency %.1fms process %.1fms throughput %.1ffps | rectify %.1fms disparity %.1fms reproject %.1fms pcl %.1fms (summed over %ld pairs)\n",
+        image_count, latency, process_time, throughput, sum.rectify, sum.disparity, sum.reproject, pcl_time, virtual_stereos.size());
+    if (fusion_config.enable) {
+        int estimated = std::accumulate(fusion_estimated.begin(), fusion_estimated.end(), 0);
+        printf("[QuadCamDepthEst] depth fusion: pose %d, disparity estimated on %d/%ld pairs\n", frame_has_pose, estimated, virtual_stereos.size());
     }
-    image_count++;
-    printf("[QuadCamDepthEst] count %d process time %.1fms\n", image_count, t.toc());
 }
 
 cv::Mat readVingette(const std::string & mask_file, double avg_brightness) {
@@ -196,6 +457,9 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
     printf("[QuadCamDepthEst] Load camera config from %s\n", calib_file_path.c_str());
     calib_file_path = configPath + "/" + calib_file_path;
     YAML::Node config_cams = YAML::LoadFile(calib_file_path); 
+    if (config["undist_map_cache_dir"]) {
+        D2Common::FisheyeUndist::mapCacheDir() = config["undist_map_cache_dir"].as<std::string>();
+    }
 
     for (const auto& kv : config_cams) {
         std::string camera_name = kv.first.as<std::string>();
@@ -205,7 +469,7 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
         raw_cameras.emplace_back(ret.first);
         if (camera_config == CameraConfig::FOURCORNER_FISHEYE) {
             double fov = config["fov"].as<double>();
-            undistortors.push_back(new D2Common::FisheyeUndist(ret.first, 0, fov, true,
+            undistortors.push_back(new D2Common::FisheyeUndist(ret.first, 0, fov, enable_cuda,
                 D2Common::FisheyeUndist::UndistortPinhole2, width, height, photometric_inv));
         }
         raw_cam_extrinsics.emplace_back(ret.second);
@@ -220,9 +484,10 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
             }
         }
         auto baseline = Swarm::Pose(T.block<3, 3>(0, 0), T.block<3, 1>(0, 3));
-        auto stereo = new VirtualStereo(baseline, raw_cameras[0], raw_cameras[1], hitnet, crestereo);
+        auto stereo = new VirtualStereo(baseline, raw_cameras[0], raw_cameras[1], hitnet, crestereo, enable_cuda);
         stereo->extrinsic = raw_cam_extrinsics[0];
         stereo->enable_texture = enable_texture;
+        stereo->setConfig(stereo_config);
         stereo->initVingette(photometric_inv, photometric_inv_1);
         virtual_stereos.emplace_back(stereo);
     } else if (camera_config == CameraConfig::FOURCORNER_FISHEYE) {
@@ -249,10 +514,11 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
             printf("[QuadCamDepthEst] Load stereo %s, stereo %d(%d):%d(%d) baseline: %s\n", 
                 stereo_name.c_str(), cam_idx_l, idx_l, cam_idx_r, idx_r, baseline.toStr().c_str());
             auto stereo = new VirtualStereo(cam_idx_l, cam_idx_r, baseline, 
-                undistortors[cam_idx_l], undistortors[cam_idx_r], idx_l, idx_r, hitnet, crestereo);
+                undistortors[cam_idx_l], undistortors[cam_idx_r], idx_l, idx_r, hitnet, crestereo, enable_cuda);
             auto att = undistortors[cam_idx_l]->t[idx_l];
             stereo->extrinsic = raw_cam_extrinsics[cam_idx_l] * Swarm::Pose(att, Vector3d(0, 0, 0));
             stereo->enable_texture = enable_texture;
+            stereo->setConfig(stereo_config);
             stereo->initRecitfy(baseline, KD0.first, KD0.second, KD1.first, KD1.second);
             virtual_stereos.emplace_back(stereo);
         }
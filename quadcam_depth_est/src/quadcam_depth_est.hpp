@@ -4,11 +4,17 @@
 #include "virtual_stereo.hpp"
 #include <ros/ros.h>
 #include <yaml-cpp/yaml.h>
+#include <mutex>
+#include <map>
 #include <image_transport/image_transport.h>
 #include "pcl_utils.hpp"
 #include <d2common/d2basetypes.h>
+#include <d2common/utils.hpp>
 #include <image_transport/subscriber_filter.h>
 #include <message_filters/time_synchronizer.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <nav_msgs/Odometry.h>
+#include "depth_fusion.hpp"
 
 typedef image_transport::SubscriberFilter ImageSubscriber;
 
@@ -27,12 +33,30 @@ class QuadCamDepthEst {
     int pixel_step = 1;
     int image_step = 1;
     bool enable_texture = false;
+    bool enable_cuda = true;
     bool show;
     int image_count = 0;
+    D2Common::Utility::TicToc throughput_tic;
+    int throughput_frames = 0;
     double min_z = 0.1;
     double max_z = 10;
     bool cnn_rgb = false;
     bool enable_cnn;
+    VirtualStereoConfig stereo_config;
+    double voxel_size = 0; // 0 to disable voxel downsampling
+    int max_points = 0; // Point budget of the published cloud, 0 for unlimited
+    bool publish_depth_image = false; // Publish depth images + camera info per stereo instead of the cloud
+    std::vector<VoxelHash> voxel_hashes;
+    VoxelHash merge_voxel_hash;
+    DepthFusionConfig fusion_config;
+    std::vector<DepthFusion> depth_fusions;
+    int fusion_round = 0;
+    // State of the frame in process, read by the stereo workers.
+    bool frame_has_pose = false;
+    Swarm::Pose frame_pose;
+    std::vector<int> fusion_scheduled, fusion_estimated;
+    std::mutex odom_lock;
+    std::map<double, Swarm::Pose> odom_buffer;
 
     ros::NodeHandle nh;
     image_transport::ImageTransport * it_;
@@ -40,11 +64,27 @@ class QuadCamDepthEst {
     ImageSubscriber * left_sub, *right_sub;
     message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image> * sync;
     ros::Publisher pub_pcl;
+    ros::Subscriber odom_sub;
+    std::vector<ros::Publisher> pub_depth_images, pub_camera_infos, pub_depth_extrinsics;
+    std::vector<sensor_msgs::CameraInfo> camera_infos;
     PointCloud * pcl = nullptr;
     PointCloudRGB * pcl_color = nullptr;
     CameraConfig camera_config = D2Common::STEREO_PINHOLE;
     
     void loadCNN(YAML::Node & config);
+    void loadSGBMConfig(YAML::Node & config);
+    void printTiming(const ros::Time & stamp, double process_time, double pcl_time);
+    void initDepthImagePublishers();
+    void loadDepthFusionConfig(YAML::Node & config);
+    void odometryCallback(const nav_msgs::Odometry & odom);
+    bool getOdometry(const ros::Time & stamp, Swarm::Pose & pose);
+    void scheduleFusion(const ros::Time & stamp);
+    std::pair<cv::Mat, cv::Mat> estimatePoints(int i, const std::vector<cv::Mat> & imgs_input, const std::vector<cv::Mat> & imgs_color);
+    double processStereos(const ros::Time & stamp, const std::vector<cv::Mat> & imgs_input, const std::vector<cv::Mat> & imgs_color);
+    double publishDepthImages(const ros::Time & stamp, const std::vector<cv::Mat> & imgs_input);
+    template<typename PointType>
+    double generatePointCloud(const std::vector<cv::Mat> & imgs_input, const std::vector<cv::Mat> & imgs_color,
+        pcl::PointCloud<PointType> & cloud);
     void loadCameraConfig(YAML::Node & config, std::string configPath);
     void imageCallback(const sensor_msgs::ImageConstPtr & left);
     void stereoImagesCallback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right);
@@ -17,9 +17,9 @@ VirtualStereo::VirtualStereo(int _cam_idx_a, int _cam_idx_b,
         D2Common::FisheyeUndist* _undist_right,
         int _undist_id_l, 
         int _undist_id_r,
-        HitnetONNX* _hitnet, CREStereoONNX* _crestereo):
-    cam_idx_a(_cam_idx_a), cam_idx_b(_cam_idx_b), undist_left(_undist_left), undist_right(_undist_right),
-    undist_id_l(_undist_id_l), undist_id_r(_undist_id_r), hitnet(_hitnet), crestereo(_crestereo) { 
+        HitnetONNX* _hitnet, CREStereoONNX* _crestereo, bool _enable_cuda):
+    undist_left(_undist_left), undist_right(_undist_right), undist_id_l(_undist_id_l), undist_id_r(_undist_id_r),
+    hitnet(_hitnet), crestereo(_crestereo), enable_cuda(_enable_cuda), cam_idx_a(_cam_idx_a), cam_idx_b(_cam_idx_b) { 
     auto cam_param = static_cast<const camodocal::PinholeCamera*>(undist_left->cam_side.get())->getParameters();
     img_size = cv::Size(cam_param.imageWidth(), cam_param.imageHeight());
     cv::Mat K = (cv::Mat_<double>(3,3) << cam_param.fx(), 0, cam_param.cx(), 0, cam_param.fy(), cam_param.cy(), 0, 0, 1);
@@ -27,14 +27,15 @@ VirtualStereo::VirtualStereo(int _cam_idx_a, int _cam_idx_b,
 }
 
 void VirtualStereo::initVingette(const cv::Mat & _inv_vingette_l, const cv::Mat & _inv_vingette_r) {
-    inv_vingette_l.upload(_inv_vingette_l);
-    inv_vingette_r.upload(_inv_vingette_r);
+    inv_vingette_l = _inv_vingette_l;
+    inv_vingette_r = _inv_vingette_r;
+    initFusedMaps();
 }
 
 VirtualStereo::VirtualStereo(const Swarm::Pose & baseline, 
             camodocal::CameraPtr cam_left,
-            camodocal::CameraPtr cam_right, HitnetONNX* _hitnet, CREStereoONNX * _crestereo): 
-            hitnet(_hitnet), crestereo(_crestereo) {
+            camodocal::CameraPtr cam_right, HitnetONNX* _hitnet, CREStereoONNX * _crestereo, bool _enable_cuda): 
+            hitnet(_hitnet), crestereo(_crestereo), enable_cuda(_enable_cuda) {
     cv::eigen2cv(baseline.R(), R);
     cv::eigen2cv(baseline.pos(), T);
     // int flag = cv::omnidir::RECTIFY_LONGLATI;
@@ -69,12 +70,8 @@ VirtualStereo::VirtualStereo(const Swarm::Pose & baseline,
     }
     cv::omnidir::initUndistortRectifyMap(K0, D0, xi0, R1, P1, img_size, CV_32FC1, lmap_1, lmap_2, flag);
     cv::omnidir::initUndistortRectifyMap(K1, D1, xi1, R2, P2, img_size, CV_32FC1, rmap_1, rmap_2, flag);
-
-    cuda_lmap_1.upload(lmap_1);
-    cuda_lmap_2.upload(lmap_2);
-    cuda_rmap_1.upload(rmap_1);
-    cuda_rmap_2.upload(rmap_2);
     input_is_stereo = true;
+    initFusedMaps();
 
     // std::cout << "img_size" << img_size << std::endl;
     // std::cout << "K0: " << K0 << std::endl;
@@ -98,16 +95,68 @@ void VirtualStereo::initRecitfy(const Swarm::Pose & baseline, cv::Mat K0, cv::Ma
     cv::stereoRectify(K0, D0, K1, D1, img_size, R, T, R1, R2, T1, T2, Q, 1024, -1, cv::Size(), &roi_l, &roi_r);
     initUndistortRectifyMap(K0, D0, R1, T1, img_size, CV_32FC1, lmap_1, lmap_2);
     initUndistortRectifyMap(K1, D1, R2, T2, img_size, CV_32FC1, rmap_1, rmap_2);
-    cuda_lmap_1.upload(lmap_1);
-    cuda_lmap_2.upload(lmap_2);
-    cuda_rmap_1.upload(rmap_1);
-    cuda_rmap_2.upload(rmap_2);
+    initFusedMaps();
+}
+
+void VirtualStereo::initFusedMaps() {
+    if (input_is_stereo) {
+        // Pinhole input: the rectification map already starts from the raw image.
+        cv::Mat gain_l, gain_r;
+        if (!inv_vingette_l.empty()) {
+            cv::remap(inv_vingette_l, gain_l, lmap_1, lmap_2, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(1));
+        }
+        if (!inv_vingette_r.empty()) {
+            cv::remap(inv_vingette_r, gain_r, rmap_1, rmap_2, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(1));
+        }
+        initFusedRemap(fused_l, lmap_1, lmap_2, gain_l);
+        initFusedRemap(fused_r, rmap_1, rmap_2, gain_r);
+    } else {
+        cv::Mat maps_l[2], maps_r[2];
+        cv::split(undist_left->composeMap(undist_id_l, lmap_1, lmap_2), maps_l);
+        cv::split(undist_right->composeMap(undist_id_r, rmap_1, rmap_2), maps_r);
+        initFusedRemap(fused_l, maps_l[0], maps_l[1], undist_left->composePhotometric(undist_id_l, lmap_1, lmap_2));
+        initFusedRemap(fused_r, maps_r[0], maps_r[1], undist_right->composePhotometric(undist_id_r, rmap_1, rmap_2));
+    }
+}
+
+void VirtualStereo::initFusedRemap(FusedRemap & fused, const cv::Mat & map_x, const cv::Mat & map_y, const cv::Mat & gain) {
+    cv::convertMaps(map_x, map_y, fused.map_1, fused.map_2, CV_16SC2);
+    fused.gain = gain;
+    fused.gain_bgr = cv::Mat();
+    if (!gain.empty()) {
+        cv::cvtColor(gain, fused.gain_bgr, cv::COLOR_GRAY2BGR);
+    }
+    if (enable_cuda) {
+        fused.cuda_map_x.upload(map_x);
+        fused.cuda_map_y.upload(map_y);
+        if (gain.empty()) {
+            fused.cuda_gain.release();
+            fused.cuda_gain_bgr.release();
+        } else {
+            fused.cuda_gain.upload(fused.gain);
+            fused.cuda_gain_bgr.upload(fused.gain_bgr);
+        }
+    }
+}
+
+cv::Vec3d VirtualStereo::rectifiedIntrinsics() const {
+    //Q = [1 0 0 -cx; 0 1 0 -cy; 0 0 0 f; 0 0 -1/Tx (cx - cx')/Tx]
+    double f = Q.at<double>(2, 3);
+    double cx = -Q.at<double>(0, 3);
+    double cy = -Q.at<double>(1, 3);
+    if (!roi_l.empty()) {
+        cx -= roi_l.x;
+        cy -= roi_l.y;
+    }
+    return cv::Vec3d(f, cx, cy);
 }
 
 std::pair<cv::Mat, cv::Mat> VirtualStereo::estimatePointsViaRaw(const cv::Mat & left, const cv::Mat & right, const cv::Mat & left_color, bool show) {
     auto ret = estimateDisparityViaRaw(left, right, left_color, show);
+    TicToc tic;
     cv::Mat points;
     cv::reprojectImageTo3D(ret.first, points, Q, 3);
+    timing.reproject = tic.toc();
     if (roi_l.empty()) {
         return std::make_pair(points, ret.second);
     }
@@ -115,10 +164,30 @@ std::pair<cv::Mat, cv::Mat> VirtualStereo::estimatePointsViaRaw(const cv::Mat &
 }
 
 
+cv::Mat VirtualStereo::rectifyTexture(const cv::Mat & left, const cv::Mat & left_color) {
+    cv::Mat texture;
+    if (enable_texture && !input_is_stereo && left.channels() == 1) {
+        texture = remapFused(fused_l, left_color, false);
+    } else {
+        texture = remapFused(fused_l, left, true);
+        if (enable_texture && input_is_stereo && texture.channels() == 1) {
+            cv::cvtColor(texture, texture, cv::COLOR_GRAY2BGR);
+        }
+    }
+    if (roi_l.empty()) {
+        return texture;
+    }
+    return texture(roi_l);
+}
+
 std::pair<cv::Mat, cv::Mat>VirtualStereo::estimateDisparityViaRaw(const cv::Mat & left, const cv::Mat & right, const cv::Mat & left_color, bool show) {
+    TicToc tic;
     auto ret = rectifyImage(left, right);
-    cv::Mat limg_rect(ret[0]), rimg_rect(ret[1]);
+    cv::Mat limg_rect = ret[0], rimg_rect = ret[1];
+    timing.rectify = tic.toc();
+    tic.tic();
     auto disp = estimateDisparity(limg_rect, rimg_rect);
+    timing.disparity = tic.toc();
     if (show) {
         cv::Mat show;
         cv::Mat disp_show; //64 is max
@@ -153,10 +222,8 @@ std::pair<cv::Mat, cv::Mat>VirtualStereo::estimateDisparityViaRaw(const cv::Mat
             return std::make_pair(disp, limg_rect);
         }
         if (left.channels() == 1) {
-            cv::cuda::GpuMat lcolor_gpu;
-            lcolor_gpu = undist_left->undist_id_cuda(left_color, undist_id_l, false);
-            lcolor_gpu.convertTo(lcolor_gpu, CV_8UC3);
-            cv::Mat lcolor_rect(lcolor_gpu);
+            // Same fused map as the gray image, so the texture is aligned with the disparity.
+            cv::Mat lcolor_rect = remapFused(fused_l, left_color, false);
             return std::make_pair(disp, lcolor_rect);
         } else {
             return std::make_pair(disp, limg_rect);
@@ -166,40 +233,91 @@ std::pair<cv::Mat, cv::Mat>VirtualStereo::estimateDisparityViaRaw(const cv::Mat
     }
 }
 
-std::vector<cv::cuda::GpuMat> VirtualStereo::rectifyImage(const cv::Mat & left, const cv::Mat & right) {
-    cv::cuda::GpuMat leftRectify, rightRectify, img_cuda_l, img_cuda_r;
-    if (input_is_stereo) {
-        img_cuda_l.upload(left);
-        img_cuda_r.upload(right);
-        if (!inv_vingette_l.empty()) {
-            img_cuda_l.convertTo(img_cuda_l, CV_32FC1);
-            img_cuda_r.convertTo(img_cuda_r, CV_32FC1);
-            cv::cuda::multiply(img_cuda_l, inv_vingette_l, img_cuda_l);
-            cv::cuda::multiply(img_cuda_r, inv_vingette_r, img_cuda_r);
+std::vector<cv::Mat> VirtualStereo::rectifyImage(const cv::Mat & left, const cv::Mat & right) {
+    return {remapFused(fused_l, left, true), remapFused(fused_r, right, true)};
+}
+
+cv::Mat VirtualStereo::remapFused(const FusedRemap & fused, const cv::Mat & img, bool calib_photometric) {
+    bool is_bgr = img.channels() == 3;
+    bool apply_gain = calib_photometric && !fused.gain.empty();
+    cv::Mat rect;
+    if (enable_cuda) {
+        cv::cuda::GpuMat img_cuda(img), rect_cuda;
+        cv::cuda::remap(img_cuda, rect_cuda, fused.cuda_map_x, fused.cuda_map_y, cv::INTER_LINEAR);
+        if (apply_gain) {
+            rect_cuda.convertTo(rect_cuda, CV_32FC(img.channels()));
+            cv::cuda::multiply(rect_cuda, is_bgr ? fused.cuda_gain_bgr : fused.cuda_gain, rect_cuda);
+            if (!input_is_stereo) {
+                rect_cuda.convertTo(rect_cuda, img.type());
+            }
         }
+        rect_cuda.download(rect);
     } else {
-        auto img_cuda_l = undist_left->undist_id_cuda(left, undist_id_l, true);
-        auto img_cuda_r = undist_right->undist_id_cuda(right, undist_id_r, true);
+        cv::remap(img, rect, fused.map_1, fused.map_2, cv::INTER_LINEAR);
+        if (apply_gain) {
+            cv::multiply(rect, is_bgr ? fused.gain_bgr : fused.gain, rect, 1.0, CV_32F);
+            if (!input_is_stereo) {
+                rect.convertTo(rect, img.type());
+            }
+        }
     }
-    cv::cuda::remap(img_cuda_l, leftRectify, cuda_lmap_1, cuda_lmap_2, cv::INTER_LINEAR);
-    cv::cuda::remap(img_cuda_r, rightRectify, cuda_rmap_1, cuda_rmap_2, cv::INTER_LINEAR);
-    return {leftRectify, rightRectify};
+    return rect;
 }
 
-cv::Mat VirtualStereo::estimateDisparityOCV(const cv::Mat & left, const cv::Mat & right) {
-    auto sgbm = cv::StereoSGBM::create(config.minDisparity, config.numDisparities, config.blockSize,
+int sgbmModeFromString(const std::string & mode) {
+    if (mode == "SGBM") {
+        return cv::StereoSGBM::MODE_SGBM;
+    } else if (mode == "HH") {
+        return cv::StereoSGBM::MODE_HH;
+    } else if (mode == "SGBM_3WAY") {
+        return cv::StereoSGBM::MODE_SGBM_3WAY;
+    } else if (mode == "HH4") {
+        return cv::StereoSGBM::MODE_HH4;
+    }
+    return -1;
+}
+
+void VirtualStereo::setConfig(const VirtualStereoConfig & _config) {
+    config = _config;
+    initSGBM();
+}
+
+void VirtualStereo::initSGBM() {
+    // Disparity range shrinks with the image on the downscaled pair, numDisparities must stay a multiple of 16.
+    double scale = std::min(config.downscale, 1.0);
+    int num_disparities = std::max(16, (int) std::ceil(config.numDisparities*scale/16.0)*16);
+    sgbm = cv::StereoSGBM::create((int)(config.minDisparity*scale), num_disparities, config.blockSize,
         config.P1, config.P2, config.disp12MaxDiff, config.preFilterCap, config.uniquenessRatio, 
         config.speckleWindowSize, config.speckleRange, config.mode);
+}
+
+cv::Mat VirtualStereo::estimateDisparityOCV(const cv::Mat & left, const cv::Mat & right) {
+    if (sgbm.empty()) {
+        initSGBM();
+    }
+    cv::Mat input_l = left, input_r = right;
+    if (left.depth() != CV_8U) {
+        left.convertTo(sgbm_left, CV_8U);
+        right.convertTo(sgbm_right, CV_8U);
+        input_l = sgbm_left;
+        input_r = sgbm_right;
+    }
+    double scale = std::min(config.downscale, 1.0);
+    if (scale < 1.0) {
+        cv::resize(input_l, sgbm_left_small, cv::Size(), scale, scale, cv::INTER_AREA);
+        cv::resize(input_r, sgbm_right_small, cv::Size(), scale, scale, cv::INTER_AREA);
+        input_l = sgbm_left_small;
+        input_r = sgbm_right_small;
+    }
+    sgbm->compute(input_l, input_r, sgbm_disp);
+    // SGBM outputs fixed-point disparity with 4 fractional bits.
     cv::Mat disparity;
-    if (left.type() == CV_32FC1) {
-        cv::Mat left_show, right_show;
-        left.convertTo(left_show, CV_8U);
-        right.convertTo(right_show, CV_8U);
-        sgbm->compute(left_show, right_show, disparity);
-    } else {
-        sgbm->compute(left, right, disparity);
+    sgbm_disp.convertTo(disparity, CV_32F, 1.0/(16.0*scale));
+    if (scale < 1.0) {
+        // Nearest upsampling keeps depth edges sharp, the median removes the blocks it leaves.
+        cv::resize(disparity, disparity, left.size(), 0, 0, cv::INTER_NEAREST);
+        cv::medianBlur(disparity, disparity, 5);
     }
-    disparity = disparity / 16.0;
     return disparity;
 }
 
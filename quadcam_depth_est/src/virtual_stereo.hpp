@@ -1,5 +1,6 @@
 #include <swarm_msgs/Pose.h>
 #include <opencv2/cudaimgproc.hpp>
+#include <opencv2/calib3d.hpp>
 namespace camodocal {
 class Camera;
 typedef boost::shared_ptr< Camera > CameraPtr;
@@ -25,9 +26,28 @@ struct VirtualStereoConfig {
     int uniquenessRatio = 10;
     int speckleWindowSize = 100;
     int speckleRange = 32;
-    int mode = 0;
+    int mode = cv::StereoSGBM::MODE_SGBM; // MODE_SGBM, MODE_HH, MODE_SGBM_3WAY or MODE_HH4
+    double downscale = 1.0; // < 1.0: match on the downscaled pair, then upsample and refine the disparity.
 };
 
+// "SGBM", "HH", "SGBM_3WAY" or "HH4" to cv::StereoSGBM mode, -1 if unknown.
+int sgbmModeFromString(const std::string & mode);
+
+struct VirtualStereoTiming {
+    double rectify = 0.0;
+    double disparity = 0.0;
+    double reproject = 0.0;
+};
+
+// Raw image -> rectified image of one side in a single remap.
+// For fisheye input the undistortion map is composed with the rectification map at startup,
+// and the photometric gain is resampled to the rectified view.
+struct FusedRemap {
+    cv::Mat map_1, map_2; // Fixed-point maps (CV_16SC2 + CV_16UC1) for cv::remap
+    cv::cuda::GpuMat cuda_map_x, cuda_map_y;
+    cv::Mat gain, gain_bgr;
+    cv::cuda::GpuMat cuda_gain, cuda_gain_bgr;
+};
 
 class VirtualStereo {
 protected:
@@ -35,7 +55,7 @@ protected:
     Swarm::Pose rect_pose_left, rect_pose_right;
     double baseline = 0.0;
     cv::Mat lmap_1, lmap_2, rmap_1, rmap_2;
-    cv::cuda::GpuMat cuda_lmap_1, cuda_lmap_2, cuda_rmap_1, cuda_rmap_2;
+    FusedRemap fused_l, fused_r;
     D2Common::FisheyeUndist* undist_left = nullptr, *undist_right = nullptr;
     int undist_id_l = 0;
     int undist_id_r = 1;
@@ -47,28 +67,47 @@ protected:
     cv::Rect roi_l;
     cv::Rect roi_r;
     //Rectify the images from pinhole images.
-    bool input_is_stereo;
-    cv::cuda::GpuMat inv_vingette_l, inv_vingette_r;
+    bool input_is_stereo = false;
+    cv::Mat inv_vingette_l, inv_vingette_r;
+    // Persistent matcher and input buffers of the OpenCV backend.
+    cv::Ptr<cv::StereoSGBM> sgbm;
+    cv::Mat sgbm_left, sgbm_right, sgbm_left_small, sgbm_right_small, sgbm_disp;
+    // Rectification runs on the GPU; fixed at construction, the GPU copies of the maps exist only if set.
+    bool enable_cuda = true;
+    void initSGBM();
+    // Rebuilds the raw to rectified maps, called whenever the rectification or vingette changes.
+    void initFusedMaps();
+    void initFusedRemap(FusedRemap & fused, const cv::Mat & map_x, const cv::Mat & map_y, const cv::Mat & gain);
+    cv::Mat remapFused(const FusedRemap & fused, const cv::Mat & img, bool calib_photometric);
 public:
     bool enable_texture = true;
+    VirtualStereoTiming timing;
+    void setConfig(const VirtualStereoConfig & _config);
+    cv::Size rectifiedSize() const {
+        return img_size;
+    }
+    // Focal length and principal point of the points from estimatePointsViaRaw (rectified left view cropped to the ROI).
+    cv::Vec3d rectifiedIntrinsics() const;
     int cam_idx_a = 0;
     int cam_idx_b = 1;
     Swarm::Pose extrinsic;
-    std::vector<cv::cuda::GpuMat> rectifyImage(const cv::Mat & left, const cv::Mat & right);
+    std::vector<cv::Mat> rectifyImage(const cv::Mat & left, const cv::Mat & right);
     cv::Mat estimateDisparityOCV(const cv::Mat & left, const cv::Mat & right);
     cv::Mat estimateDisparity(const cv::Mat & left, const cv::Mat & right);
     std::pair<cv::Mat, cv::Mat> estimateDisparityViaRaw(const cv::Mat & left, const cv::Mat & right, const cv::Mat & left_color, bool show = false);
     std::pair<cv::Mat, cv::Mat> estimatePointsViaRaw(const cv::Mat & left, const cv::Mat & right, const cv::Mat & left_color, bool show = false);
+    // Texture of the points from estimatePointsViaRaw, without estimating the disparity.
+    cv::Mat rectifyTexture(const cv::Mat & left, const cv::Mat & left_color);
     VirtualStereo(int _idx_a, int _idx_b, 
             const Swarm::Pose & baseline, 
             D2Common::FisheyeUndist* _undist_left,
             D2Common::FisheyeUndist* _undist_right,
             int _undist_id_l, 
-            int _undist_id_r, HitnetONNX* _hitnet, CREStereoONNX * _crestereo);
+            int _undist_id_r, HitnetONNX* _hitnet, CREStereoONNX * _crestereo, bool _enable_cuda);
     VirtualStereo(const Swarm::Pose & baseline, 
             camodocal::CameraPtr cam_left,
             camodocal::CameraPtr cam_right, 
-            HitnetONNX* _hitnet, CREStereoONNX * _crestereo);
+            HitnetONNX* _hitnet, CREStereoONNX * _crestereo, bool _enable_cuda);
     void initVingette(const cv::Mat & _inv_vingette_l, const cv::Mat & _inv_vingette_r);
     void initRecitfy(const Swarm::Pose & baseline, cv::Mat K0, cv::Mat D0, cv::Mat K1, cv::Mat D1);
 };
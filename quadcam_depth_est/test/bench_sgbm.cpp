@@ -0,0 +1,134 @@
+#include "d2common/fisheye_undistort.h"
+#include <yaml-cpp/yaml.h>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include "../src/virtual_stereo.hpp"
+
+namespace D2FrontEnd {
+std::pair<camodocal::CameraPtr, Swarm::Pose> readCameraConfig(const std::string & camera_name, const YAML::Node & config);
+}
+
+namespace D2QuadCamDepthEst {
+std::pair<cv::Mat, cv::Mat> intrinsicsFromNode(const YAML::Node & node);
+}
+
+using namespace D2QuadCamDepthEst;
+using D2Common::FisheyeUndist;
+using D2Common::Utility::TicToc;
+
+// Disparity throughput and density of the OpenCV SGBM backend across modes and downscale factors,
+// on recorded quad-camera frames (the four fisheye images side by side, as published on /arducam/image).
+int main(int argc, char** argv) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("config,c", po::value<std::string>()->default_value(""), "path of quadcam depth config")
+        ("images,i", po::value<std::string>()->default_value(""), "folder of recorded quad-camera frames")
+        ("frames,n", po::value<int>()->default_value(50), "max frames to use")
+        ("threads,t", po::value<int>()->default_value(0), "OpenCV threads, 0 for default")
+        ("modes,m", po::value<std::string>()->default_value("SGBM,HH,SGBM_3WAY,HH4"), "SGBM modes to compare")
+        ("downscales,d", po::value<std::string>()->default_value("1.0,0.5"), "downscale factors to compare")
+        ("cuda", po::value<bool>()->default_value(false), "rectify with CUDA");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    auto config_file = vm["config"].as<std::string>();
+    bool enable_cuda = vm["cuda"].as<bool>();
+    int max_frames = vm["frames"].as<int>();
+    if (vm["threads"].as<int>() > 0) {
+        cv::setNumThreads(vm["threads"].as<int>());
+    }
+    std::vector<std::string> modes, downscales;
+    boost::split(modes, vm["modes"].as<std::string>(), boost::is_any_of(","));
+    boost::split(downscales, vm["downscales"].as<std::string>(), boost::is_any_of(","));
+
+    //Load the virtual stereos in the same way as QuadCamDepthEst
+    int pn = config_file.find_last_of('/');
+    std::string config_path = config_file.substr(0, pn);
+    YAML::Node config = YAML::LoadFile(config_file);
+    int width = config["width"].as<int>();
+    int height = config["height"].as<int>();
+    double fov = config["fov"].as<double>();
+    YAML::Node config_cams = YAML::LoadFile(config_path + "/" + config["calib_file_path"].as<std::string>());
+    std::vector<FisheyeUndist*> undistortors;
+    for (const auto& kv : config_cams) {
+        auto ret = D2FrontEnd::readCameraConfig(kv.first.as<std::string>(), kv.second);
+        undistortors.push_back(new FisheyeUndist(ret.first, 0, fov, enable_cuda,
+            FisheyeUndist::UndistortPinhole2, width, height));
+    }
+    std::vector<VirtualStereo*> stereos;
+    for (const auto & kv: config["stereos"]) {
+        auto node = kv.second;
+        int cam_idx_l = node["cam_idx_l"].as<int>();
+        int cam_idx_r = node["cam_idx_r"].as<int>();
+        YAML::Node stereo_calib = YAML::LoadFile(config_path + "/" + node["stereo_config"].as<std::string>());
+        Matrix4d T;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                T(i, j) = stereo_calib["cam1"]["T_cn_cnm1"][i][j].as<double>();
+            }
+        }
+        Swarm::Pose baseline(T.block<3, 3>(0, 0), T.block<3, 1>(0, 3));
+        auto KD0 = intrinsicsFromNode(stereo_calib["cam0"]);
+        auto KD1 = intrinsicsFromNode(stereo_calib["cam1"]);
+        auto stereo = new VirtualStereo(cam_idx_l, cam_idx_r, baseline, undistortors[cam_idx_l], undistortors[cam_idx_r],
+            node["idx_l"].as<int>(), node["idx_r"].as<int>(), nullptr, nullptr, enable_cuda);
+        stereo->initRecitfy(baseline, KD0.first, KD0.second, KD1.first, KD1.second);
+        stereos.emplace_back(stereo);
+    }
+
+    //Rectify all frames first so only the disparity is timed.
+    std::vector<cv::String> files;
+    cv::glob(vm["images"].as<std::string>(), files);
+    std::vector<std::pair<VirtualStereo*, std::vector<cv::Mat>>> pairs;
+    int frame_num = 0;
+    for (auto & file : files) {
+        cv::Mat img = cv::imread(file, cv::IMREAD_GRAYSCALE);
+        if (img.empty()) {
+            continue;
+        }
+        for (auto stereo : stereos) {
+            cv::Mat left = img(cv::Rect(stereo->cam_idx_a*img.cols/4, 0, img.cols/4, img.rows));
+            cv::Mat right = img(cv::Rect(stereo->cam_idx_b*img.cols/4, 0, img.cols/4, img.rows));
+            pairs.emplace_back(stereo, stereo->rectifyImage(left, right));
+        }
+        if (++frame_num >= max_frames) {
+            break;
+        }
+    }
+    printf("[bench_sgbm] %d frames %ld stereo pairs %dx%d OpenCV threads %d\n", frame_num, pairs.size(),
+        width, height, cv::getNumThreads());
+    printf("%-10s %9s %12s %10s %9s\n", "mode", "downscale", "ms/pair", "pairs/s", "density");
+    for (auto & mode_str : modes) {
+        int mode = sgbmModeFromString(mode_str);
+        if (mode < 0) {
+            printf("[bench_sgbm] Unknown mode %s\n", mode_str.c_str());
+            continue;
+        }
+        for (auto & downscale_str : downscales) {
+            VirtualStereoConfig stereo_config;
+            stereo_config.use_cnn = false;
+            stereo_config.mode = mode;
+            stereo_config.downscale = std::stod(downscale_str);
+            for (auto stereo : stereos) {
+                stereo->setConfig(stereo_config);
+            }
+            double valid = 0, total = 0;
+            TicToc tic;
+            for (auto & pair : pairs) {
+                auto disp = pair.first->estimateDisparityOCV(pair.second[0], pair.second[1]);
+                valid += cv::countNonZero(disp > stereo_config.minDisparity - 0.5);
+                total += disp.total();
+            }
+            double time = tic.toc();
+            printf("%-10s %9.2f %12.2f %10.1f %8.1f%%\n", mode_str.c_str(), stereo_config.downscale,
+                time/pairs.size(), pairs.size()*1000.0/time, valid/total*100);
+        }
+    }
+    return 0;
+}